@@ -1,18 +1,63 @@
 #version 330 core
 
+/*
+ * Built with SIVOX_PACKED_VERTICES defined for meshes using VertexFormat::Packed.
+ */
+#ifdef SIVOX_PACKED_VERTICES
+layout(location = 0) in uvec2 vert_packed;
+
+/*
+ * Indexed by BlockFace.
+ */
+const vec3 face_normals[6] = vec3[6](
+    vec3(0.0, 1.0, 0.0),
+    vec3(0.0, -1.0, 0.0),
+    vec3(-1.0, 0.0, 0.0),
+    vec3(1.0, 0.0, 0.0),
+    vec3(0.0, 0.0, -1.0),
+    vec3(0.0, 0.0, 1.0)
+);
+#else
 layout(location = 0) in vec3 vert_position;
 layout(location = 1) in vec3 vert_normal;
+layout(location = 3) in float vert_ao;
+#endif
+
+/*
+ * Chunk offsets are looked up by slot. (See TerrainRenderer)
+ */
+layout(location = 2) in uint vert_chunk_slot;
 
 out vec3 vert_color;
 
 uniform mat4 u_matrix_mvp;
+uniform samplerBuffer u_chunk_offsets;
 uniform vec3 u_light_dir;
 uniform float u_light_intensity;
 uniform float u_ambient_light;
  
 void main() {
-    gl_Position = u_matrix_mvp * vec4(vert_position, 1.0);
+#ifdef SIVOX_PACKED_VERTICES
+    /*
+     * See ChunkMesh::PackedVertex for the layout.
+     */
+    vec3 vert_position = vec3(
+        float(vert_packed.x & 63u),
+        float((vert_packed.x >> 6u) & 63u),
+        float((vert_packed.x >> 12u) & 63u) - 1.0
+    );
+    vec3 vert_normal = face_normals[(vert_packed.x >> 18u) & 7u];
+    float vert_ao = float((vert_packed.x >> 21u) & 3u);
+#endif
+
+    vec3 chunk_offset = texelFetch(u_chunk_offsets, int(vert_chunk_slot)).xyz;
+    gl_Position = u_matrix_mvp * vec4(vert_position + chunk_offset, 1.0);
     float dir_light = clamp(dot(vert_normal, -u_light_dir), 0.0, 1.0) * clamp(u_light_intensity, 0.0, 1.0);
     float amb_light = clamp(u_ambient_light, 0.0, 1.0);
-    vert_color = vec3(1.0f) * clamp(dir_light + amb_light, 0.0, 1.0);
+
+    /*
+     * Ambient occlusion is baked into the mesh, from 0 (open) to 3 (boxed in).
+     */
+    float occlusion = 1.0 - 0.2 * vert_ao;
+    vert_color = vec3(1.0f) * clamp(dir_light + amb_light, 0.0, 1.0) * occlusion;
 }
@@ -3,48 +3,75 @@
 
 namespace {
     void set_up_buffers(sivox::ChunkBuffers const& buffers) {
-        const GLenum buffer_usage = GL_STATIC_DRAW; // TODO: See how using GL_DYNAMIC_DRAW affects performance!
-        const GLuint vertex_position_loc = 0; // TODO: Look this up in the shader in the future?
-        const GLuint vertex_normal_loc = 1; // TODO: Look this up in the shader in the future?
-
         glBindVertexArray(buffers.vertex_array());
 
         glBindBuffer(GL_ARRAY_BUFFER, buffers.vertex_buffer());
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.element_buffer());
 
-        glBufferData(
-            GL_ARRAY_BUFFER, 
-            sivox::ChunkMesh::max_vertex_count * sizeof(sivox::ChunkMesh::Vertex), 
-            nullptr, 
-            buffer_usage
-        );
-
-        glBufferData(
-            GL_ELEMENT_ARRAY_BUFFER, 
-            sivox::ChunkMesh::max_triangle_index_count * sizeof(sivox::ChunkMesh::TriangleIndex), 
-            nullptr, 
-            buffer_usage
-        );
-
-        glEnableVertexAttribArray(vertex_position_loc);
-        glEnableVertexAttribArray(vertex_normal_loc);
+        /*
+         * No storage is allocated up front. It's sized to fit whatever mesh gets uploaded. (See ChunkBuffers::set_mesh)
+         */
 
-        glVertexAttribPointer(vertex_position_loc, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 6, 0);
-        glVertexAttribPointer(vertex_normal_loc, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 6, (GLvoid*)(sizeof(GLfloat) * 3));
+        sivox::set_up_vertex_attributes(buffers.vertex_format());
 
         glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     }
+
+    /*
+     * Uploads [size] bytes of [data] to the buffer bound to [target], reallocating its storage if it doesn't fit or
+     * if it's wastefully large. Returns the new capacity in bytes.
+     */
+    sivox::s64 upload(GLenum target, sivox::s64 capacity, void const* data, sivox::s64 size) {
+        const GLenum buffer_usage = GL_STATIC_DRAW; // TODO: See how using GL_DYNAMIC_DRAW affects performance!
+
+        sivox::s64 new_capacity = sivox::ChunkBuffers::fitted_capacity(capacity, size);
+        if (new_capacity != capacity) {
+            glBufferData(target, new_capacity, nullptr, buffer_usage);
+        }
+        if (size > 0) {
+            glBufferSubData(target, 0, size, data);
+        }
+        return new_capacity;
+    }
 }
 
 namespace sivox {
-    ChunkBuffers::ChunkBuffers() : m_element_count(0) {
+    void set_up_vertex_attributes(VertexFormat format) {
+        const GLuint vertex_position_loc = 0; // TODO: Look this up in the shader in the future?
+        const GLuint vertex_normal_loc = 1; // TODO: Look this up in the shader in the future?
+        const GLuint vertex_ao_loc = 3; // TODO: Look this up in the shader in the future?
+        const GLuint vertex_packed_loc = 0; // TODO: Look this up in the shader in the future?
+
+        if (format == VertexFormat::Packed) {
+            /*
+             * The packed vertex is two integers which the shader unpacks itself. Note the I in glVertexAttribIPointer:
+             * the plain version would convert them to floats.
+             */
+            glEnableVertexAttribArray(vertex_packed_loc);
+            glVertexAttribIPointer(vertex_packed_loc, 2, GL_UNSIGNED_INT, sizeof(ChunkMesh::PackedVertex), 0);
+        }
+        else {
+            glEnableVertexAttribArray(vertex_position_loc);
+            glEnableVertexAttribArray(vertex_normal_loc);
+            glEnableVertexAttribArray(vertex_ao_loc);
+
+            glVertexAttribPointer(vertex_position_loc, 3, GL_FLOAT, GL_FALSE, sizeof(ChunkMesh::Vertex), 0);
+            glVertexAttribPointer(vertex_normal_loc, 3, GL_FLOAT, GL_FALSE, sizeof(ChunkMesh::Vertex), (GLvoid*)(sizeof(GLfloat) * 3));
+            glVertexAttribPointer(vertex_ao_loc, 1, GL_FLOAT, GL_FALSE, sizeof(ChunkMesh::Vertex), (GLvoid*)(sizeof(GLfloat) * 6));
+        }
+    }
+
+    ChunkBuffers::ChunkBuffers(VertexFormat format) :
+        m_element_count(0), m_format(format), m_vertex_capacity(0), m_element_capacity(0) {
         glGenBuffers(m_buffers.size(), m_buffers.data());
         glGenVertexArrays(1, &m_vao);
         set_up_buffers(*this);
     }
 
-    ChunkBuffers::ChunkBuffers(ChunkMesh const& mesh) : m_element_count(0) {
+    ChunkBuffers::ChunkBuffers(ChunkMesh const& mesh) :
+        m_element_count(0), m_format(mesh.format), m_vertex_capacity(0), m_element_capacity(0) {
         glGenBuffers(m_buffers.size(), m_buffers.data());
         glGenVertexArrays(1, &m_vao);
         set_up_buffers(*this);
@@ -56,25 +83,62 @@ namespace sivox {
         glDeleteBuffers(m_buffers.size(), m_buffers.data());
     }
 
+    s64 ChunkBuffers::fitted_capacity(s64 capacity, s64 required) {
+        if (required > capacity) {
+            /*
+             * Grow geometrically so a chunk that keeps getting a little bigger doesn't reallocate on every edit.
+             */
+            s64 grown = capacity < min_capacity ? min_capacity : capacity;
+            while (grown < required) { grown *= 2; }
+            return grown;
+        }
+        else if (capacity > min_capacity && required < capacity / 4) {
+            /*
+             * Give memory back when the mesh shrinks a lot, e.g. when a chunk is cleared.
+             */
+            s64 shrunk = capacity;
+            while (shrunk > min_capacity && required < shrunk / 4) { shrunk /= 2; }
+            return shrunk;
+        }
+        return capacity;
+    }
+
     void ChunkBuffers::set_mesh(ChunkMesh const& mesh) {
-        assert(mesh.vertices.size() <= ChunkMesh::max_vertex_count);
-        assert(mesh.triangles.size() <= ChunkMesh::max_triangle_index_count);
+        assert(mesh.format == vertex_format());
+
+        void const* vertices = vertex_format() == VertexFormat::Packed
+            ? static_cast<void const*>(mesh.packed_vertices.data())
+            : static_cast<void const*>(mesh.vertices.data());
 
-        m_element_count = mesh.triangles.size() > ChunkMesh::max_triangle_index_count ? ChunkMesh::max_triangle_index_count : mesh.triangles.size();
+        set_mesh_data(vertices, mesh.vertex_count(), mesh.triangles.data(), static_cast<s32>(mesh.triangles.size()));
+    }
+
+    void ChunkBuffers::set_mesh_data(void const* vertices, s32 vertex_count, ChunkMesh::TriangleIndex const* triangles, s32 triangle_index_count) {
+        assert(vertex_count <= ChunkMesh::max_vertex_count);
+        assert(triangle_index_count <= ChunkMesh::max_triangle_index_count);
+
+        m_element_count = triangle_index_count;
 
         /*
-         * TODO: We're making a full copy of the mesh data here. Perhaps, ChunkMesh should be generated with the
-         * appropriate number of verts and tri indices? We could then switch to using std::array over std::vector in
-         * ChunkMesh.
+         * GL_ARRAY_BUFFER isn't part of the VAO state so it has to be bound separately.
          */
-        ChunkMesh mesh_copy = mesh;
+        glBindVertexArray(vertex_array());
+        glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer());
 
-        mesh_copy.vertices.resize(ChunkMesh::max_vertex_count, { glm::vec3(0.0f, 0.0f, 0.0f) });
-        mesh_copy.triangles.resize(ChunkMesh::max_triangle_index_count, 0);
+        m_vertex_capacity = upload(
+            GL_ARRAY_BUFFER,
+            m_vertex_capacity,
+            vertices,
+            static_cast<s64>(vertex_count) * ChunkMesh::vertex_size(vertex_format())
+        );
+        m_element_capacity = upload(
+            GL_ELEMENT_ARRAY_BUFFER,
+            m_element_capacity,
+            triangles,
+            static_cast<s64>(triangle_index_count) * sizeof(ChunkMesh::TriangleIndex)
+        );
 
-        glBindVertexArray(vertex_array());
-        glBufferSubData(GL_ARRAY_BUFFER, 0, ChunkMesh::max_vertex_count * sizeof(ChunkMesh::Vertex), mesh_copy.vertices.data());
-        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, ChunkMesh::max_triangle_index_count * sizeof(ChunkMesh::TriangleIndex), mesh_copy.triangles.data());
         glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
     }
 }
@@ -8,9 +8,15 @@
 #include "meshgenerator.hpp"
 
 namespace sivox {
+    /*
+     * Sets up the vertex attributes for chunk meshes in [format] on the bound vertex array, reading from the bound
+     * GL_ARRAY_BUFFER.
+     */
+    void set_up_vertex_attributes(VertexFormat format);
+
     class ChunkBuffers {
     public:
-        ChunkBuffers();
+        explicit ChunkBuffers(VertexFormat format = VertexFormat::Float);
         explicit ChunkBuffers(ChunkMesh const& mesh);
 
         ~ChunkBuffers();
@@ -22,6 +28,10 @@ namespace sivox {
             m_vao = other.m_vao;
             m_buffers[0] = other.m_buffers[0];
             m_buffers[1] = other.m_buffers[1];
+            m_element_count = other.m_element_count;
+            m_format = other.m_format;
+            m_vertex_capacity = other.m_vertex_capacity;
+            m_element_capacity = other.m_element_capacity;
 
             other.m_vao = 0;
             other.m_buffers[0] = 0;
@@ -32,6 +42,10 @@ namespace sivox {
             m_vao = other.m_vao;
             m_buffers[0] = other.m_buffers[0];
             m_buffers[1] = other.m_buffers[1];
+            m_element_count = other.m_element_count;
+            m_format = other.m_format;
+            m_vertex_capacity = other.m_vertex_capacity;
+            m_element_capacity = other.m_element_capacity;
 
             other.m_vao = 0;
             other.m_buffers[0] = 0;
@@ -40,17 +54,49 @@ namespace sivox {
             return *this;
         }
 
+        /*
+         * Uploads the [mesh] straight from its vectors. It must use the same vertex format as the buffers.
+         *
+         * Storage is sized to the mesh rather than to the largest possible chunk mesh. It grows geometrically and is
+         * only reallocated when the mesh no longer fits (or has shrunk to a fraction of it).
+         */
         void set_mesh(ChunkMesh const& mesh);
 
+        /*
+         * Same as set_mesh but takes raw pointers, so meshes living elsewhere (e.g. in scratch memory) can be uploaded
+         * without building a ChunkMesh. [vertices] must be in the buffers' vertex format.
+         */
+        void set_mesh_data(void const* vertices, s32 vertex_count, ChunkMesh::TriangleIndex const* triangles, s32 triangle_index_count);
+
         GLuint vertex_array() const { return m_vao; }
         GLuint vertex_buffer() const { return m_buffers[0]; }
         GLuint element_buffer() const { return m_buffers[1]; } 
         s32 element_count() const { return m_element_count; }
+        VertexFormat vertex_format() const { return m_format; }
+
+        /*
+         * Bytes of GPU storage currently allocated for vertices and triangle indices.
+         */
+        s64 vertex_capacity() const { return m_vertex_capacity; }
+        s64 element_capacity() const { return m_element_capacity; }
+
+        /*
+         * Smallest allocation in bytes. Keeps tiny meshes from reallocating on every edit.
+         */
+        static constexpr s64 min_capacity = 4096;
+
+        /*
+         * Returns the buffer capacity to use for [required] bytes given the [capacity] we have now.
+         */
+        static s64 fitted_capacity(s64 capacity, s64 required);
 
     private:
         GLuint m_vao;
         std::array<GLuint, 2> m_buffers;
         s32 m_element_count;
+        VertexFormat m_format;
+        s64 m_vertex_capacity;
+        s64 m_element_capacity;
     };
 }
 #endif // SIVOX_GAME_CHUNKBUFFERS_HPP
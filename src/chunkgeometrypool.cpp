@@ -0,0 +1,301 @@
+#include "chunkgeometrypool.hpp"
+#include "chunkbuffers.hpp"
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+
+namespace {
+    const GLenum buffer_usage = GL_DYNAMIC_DRAW;
+    const GLuint chunk_slot_loc = 2; // TODO: Look this up in the shader in the future?
+    const sivox::s64 initial_slot_capacity = 1024;
+
+    /*
+     * Returns [capacity] doubled until there's room for [required] more units on top of [used].
+     */
+    sivox::s64 grown_capacity(sivox::s64 capacity, sivox::s64 used, sivox::s64 required) {
+        sivox::s64 grown = capacity > 0 ? capacity : 1024;
+        while (grown - used < required) { grown *= 2; }
+        return grown;
+    }
+}
+
+namespace sivox {
+    ChunkGeometryPool::ChunkGeometryPool(VertexFormat format, ChunkSlotSource slot_source, s64 vertex_capacity, s64 triangle_index_capacity) :
+        m_format(format), m_slot_source(slot_source), m_vao(0), m_vertex_buffer(0), m_element_buffer(0),
+        m_slot_buffer(0), m_offset_buffer(0), m_offset_texture(0),
+        m_vertex_allocator(vertex_capacity), m_triangle_allocator(triangle_index_capacity), m_slots_used(0) {
+        glGenVertexArrays(1, &m_vao);
+        create_buffers(vertex_capacity, triangle_index_capacity, m_vertex_buffer, m_element_buffer, m_slot_buffer);
+
+        glGenBuffers(1, &m_offset_buffer);
+        glGenTextures(1, &m_offset_texture);
+        if (m_slot_source == ChunkSlotSource::BaseInstance) {
+            glGenBuffers(1, &m_slot_buffer);
+        }
+        resize_slot_storage(initial_slot_capacity);
+
+        glBindTexture(GL_TEXTURE_BUFFER, m_offset_texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_offset_buffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+        attach_buffers();
+    }
+
+    ChunkGeometryPool::~ChunkGeometryPool() {
+        glDeleteVertexArrays(1, &m_vao);
+        glDeleteBuffers(1, &m_vertex_buffer);
+        glDeleteBuffers(1, &m_element_buffer);
+        glDeleteBuffers(1, &m_slot_buffer);
+        glDeleteTextures(1, &m_offset_texture);
+        glDeleteBuffers(1, &m_offset_buffer);
+    }
+
+    void ChunkGeometryPool::create_buffers(s64 vertex_capacity, s64 triangle_index_capacity, GLuint &vertex_buffer, GLuint &element_buffer, GLuint &slot_buffer) const {
+        glGenBuffers(1, &vertex_buffer);
+        glGenBuffers(1, &element_buffer);
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, vertex_buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, vertex_capacity * ChunkMesh::vertex_size(m_format), nullptr, buffer_usage);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, element_buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, triangle_index_capacity * sizeof(ChunkMesh::TriangleIndex), nullptr, buffer_usage);
+
+        /*
+         * Per vertex slots live alongside the vertices, so they're reallocated with them.
+         */
+        if (m_slot_source == ChunkSlotSource::PerVertex) {
+            glGenBuffers(1, &slot_buffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, slot_buffer);
+            glBufferData(GL_COPY_WRITE_BUFFER, vertex_capacity * sizeof(u32), nullptr, buffer_usage);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    void ChunkGeometryPool::attach_buffers() {
+        glBindVertexArray(m_vao);
+        glBindBuffer(GL_ARRAY_BUFFER, m_vertex_buffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_element_buffer);
+        set_up_vertex_attributes(m_format);
+
+        glBindBuffer(GL_ARRAY_BUFFER, m_slot_buffer);
+        glEnableVertexAttribArray(chunk_slot_loc);
+        glVertexAttribIPointer(chunk_slot_loc, 1, GL_UNSIGNED_INT, sizeof(u32), 0);
+        glVertexAttribDivisor(chunk_slot_loc, m_slot_source == ChunkSlotSource::BaseInstance ? 1 : 0);
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+
+    void ChunkGeometryPool::rebuild_buffers(s64 vertex_capacity, s64 triangle_index_capacity, bool compact) {
+        const s64 vertex_size = ChunkMesh::vertex_size(m_format);
+        const s64 index_size = sizeof(ChunkMesh::TriangleIndex);
+        const bool per_vertex_slots = m_slot_source == ChunkSlotSource::PerVertex;
+
+        GLuint vertex_buffer = 0, element_buffer = 0, slot_buffer = m_slot_buffer;
+        create_buffers(vertex_capacity, triangle_index_capacity, vertex_buffer, element_buffer, slot_buffer);
+
+        /*
+         * Copying into fresh buffers rather than in place means we don't have to worry about overlapping moves, and
+         * growing and compacting can share the same code.
+         */
+        auto copy = [](GLuint from_buffer, GLuint to_buffer, s64 from, s64 to, s64 size) {
+            glBindBuffer(GL_COPY_READ_BUFFER, from_buffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, to_buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, from, to, size);
+        };
+
+        /*
+         * The entries aren't touched in between, so both loops visit the sections in the same order.
+         */
+        std::vector<std::pair<s64, s64>> old_offsets;
+        for (auto const& pair : m_entries) {
+            for (Section const& section : pair.second.sections) {
+                if (section.empty()) { continue; }
+                old_offsets.push_back({ base_vertex(section), first_triangle_index(section) });
+            }
+        }
+
+        if (compact) {
+            m_vertex_allocator.defragment();
+            m_triangle_allocator.defragment();
+        }
+
+        auto old = old_offsets.begin();
+        for (auto const& pair : m_entries) {
+            for (Section const& section : pair.second.sections) {
+                if (section.empty()) { continue; }
+                s64 vertex_count = m_vertex_allocator.range(section.vertices).size;
+                s64 triangle_index_count = m_triangle_allocator.range(section.triangles).size;
+                copy(m_vertex_buffer, vertex_buffer, old->first * vertex_size, base_vertex(section) * vertex_size, vertex_count * vertex_size);
+                copy(m_element_buffer, element_buffer, old->second * index_size, first_triangle_index(section) * index_size, triangle_index_count * index_size);
+                if (per_vertex_slots) {
+                    copy(m_slot_buffer, slot_buffer, old->first * sizeof(u32), base_vertex(section) * sizeof(u32), vertex_count * sizeof(u32));
+                }
+                ++old;
+            }
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        glDeleteBuffers(1, &m_vertex_buffer);
+        glDeleteBuffers(1, &m_element_buffer);
+        m_vertex_buffer = vertex_buffer;
+        m_element_buffer = element_buffer;
+        if (per_vertex_slots) {
+            glDeleteBuffers(1, &m_slot_buffer);
+            m_slot_buffer = slot_buffer;
+        }
+
+        m_vertex_allocator.grow(vertex_capacity);
+        m_triangle_allocator.grow(triangle_index_capacity);
+        attach_buffers();
+    }
+
+    void ChunkGeometryPool::resize_slot_storage(s64 slot_capacity) {
+        m_slot_offsets.resize(slot_capacity, glm::vec4(0.0f));
+
+        glBindBuffer(GL_TEXTURE_BUFFER, m_offset_buffer);
+        glBufferData(GL_TEXTURE_BUFFER, slot_capacity * sizeof(glm::vec4), m_slot_offsets.data(), buffer_usage);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        /*
+         * With base instance drawing, the instanced slot attribute reads element [base instance] of this buffer, so
+         * element i just needs to hold i.
+         */
+        if (m_slot_source == ChunkSlotSource::BaseInstance) {
+            std::vector<u32> slots(slot_capacity);
+            std::iota(slots.begin(), slots.end(), 0u);
+            glBindBuffer(GL_ARRAY_BUFFER, m_slot_buffer);
+            glBufferData(GL_ARRAY_BUFFER, slot_capacity * sizeof(u32), slots.data(), buffer_usage);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+    }
+
+    s32 ChunkGeometryPool::allocate_slot(Position chunk_position) {
+        s32 slot;
+        if (!m_free_slots.empty()) {
+            slot = m_free_slots.back();
+            m_free_slots.pop_back();
+        }
+        else {
+            slot = m_slots_used++;
+            if (slot >= static_cast<s32>(m_slot_offsets.size())) {
+                resize_slot_storage(static_cast<s64>(m_slot_offsets.size()) * 2);
+            }
+        }
+
+        m_slot_offsets[slot] = glm::vec4(
+            static_cast<f32>(chunk_position.x * Chunk::width),
+            static_cast<f32>(chunk_position.y * Chunk::height),
+            static_cast<f32>(chunk_position.z * Chunk::length),
+            0.0f
+        );
+        glBindBuffer(GL_TEXTURE_BUFFER, m_offset_buffer);
+        glBufferSubData(GL_TEXTURE_BUFFER, slot * sizeof(glm::vec4), sizeof(glm::vec4), &m_slot_offsets[slot]);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        return slot;
+    }
+
+    void ChunkGeometryPool::set_mesh(Position chunk_position, ChunkMesh const& mesh) {
+        remove(chunk_position);
+        set_section_mesh(chunk_position, 0, mesh);
+    }
+
+    void ChunkGeometryPool::set_section_mesh(Position chunk_position, s32 section_index, ChunkMesh const& mesh) {
+        assert(mesh.format == m_format);
+        assert(section_index >= 0 && section_index < Chunk::section_count);
+
+        auto it = m_entries.find(chunk_position);
+        if (it != m_entries.end()) {
+            free_section(it->second.sections[section_index]);
+        }
+
+        s64 vertex_count = mesh.vertex_count();
+        s64 triangle_index_count = static_cast<s64>(mesh.triangles.size());
+        if (vertex_count == 0 || triangle_index_count == 0) {
+            if (it != m_entries.end()) {
+                auto const& sections = it->second.sections;
+                if (std::all_of(sections.begin(), sections.end(), [](Section const& section) { return section.empty(); })) {
+                    remove(chunk_position);
+                }
+            }
+            return;
+        }
+
+        auto vertex_stats = m_vertex_allocator.stats();
+        auto triangle_stats = m_triangle_allocator.stats();
+        if (vertex_stats.largest_free < vertex_count || triangle_stats.largest_free < triangle_index_count) {
+            /*
+             * Growing copies everything anyway, so compact while we're at it if that's enough to make room.
+             */
+            bool compacting_fits = vertex_stats.free() >= vertex_count && triangle_stats.free() >= triangle_index_count;
+            rebuild_buffers(
+                compacting_fits ? vertex_stats.capacity : grown_capacity(vertex_stats.capacity, vertex_stats.used, vertex_count),
+                compacting_fits ? triangle_stats.capacity : grown_capacity(triangle_stats.capacity, triangle_stats.used, triangle_index_count),
+                true
+            );
+        }
+
+        if (it == m_entries.end()) {
+            Entry entry;
+            entry.chunk_position = chunk_position;
+            entry.slot = allocate_slot(chunk_position);
+            it = m_entries.emplace(chunk_position, entry).first;
+        }
+        Entry const& entry = it->second;
+        Section &section = it->second.sections[section_index];
+        section.vertices = m_vertex_allocator.allocate(vertex_count);
+        section.triangles = m_triangle_allocator.allocate(triangle_index_count);
+        section.vertex_count = static_cast<s32>(vertex_count);
+        section.triangle_index_count = static_cast<s32>(triangle_index_count);
+        assert(section.vertices != RangeAllocator::invalid_handle);
+        assert(section.triangles != RangeAllocator::invalid_handle);
+
+        const s64 vertex_size = ChunkMesh::vertex_size(m_format);
+        void const* vertex_data = m_format == VertexFormat::Packed
+            ? static_cast<void const*>(mesh.packed_vertices.data())
+            : static_cast<void const*>(mesh.vertices.data());
+
+        glBindBuffer(GL_ARRAY_BUFFER, m_vertex_buffer);
+        glBufferSubData(GL_ARRAY_BUFFER, base_vertex(section) * vertex_size, vertex_count * vertex_size, vertex_data);
+        if (m_slot_source == ChunkSlotSource::PerVertex) {
+            m_vertex_slots.assign(vertex_count, static_cast<u32>(entry.slot));
+            glBindBuffer(GL_ARRAY_BUFFER, m_slot_buffer);
+            glBufferSubData(GL_ARRAY_BUFFER, base_vertex(section) * sizeof(u32), vertex_count * sizeof(u32), m_vertex_slots.data());
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        /*
+         * The element buffer binding is part of the VAO state, so go through the VAO rather than binding it bare.
+         */
+        glBindVertexArray(m_vao);
+        glBufferSubData(
+            GL_ELEMENT_ARRAY_BUFFER,
+            first_triangle_index(section) * sizeof(ChunkMesh::TriangleIndex),
+            triangle_index_count * sizeof(ChunkMesh::TriangleIndex),
+            mesh.triangles.data()
+        );
+        glBindVertexArray(0);
+    }
+
+    void ChunkGeometryPool::free_section(Section &section) {
+        m_vertex_allocator.free(section.vertices);
+        m_triangle_allocator.free(section.triangles);
+        section = Section();
+    }
+
+    void ChunkGeometryPool::remove(Position chunk_position) {
+        auto it = m_entries.find(chunk_position);
+        if (it != m_entries.end()) {
+            for (Section &section : it->second.sections) {
+                free_section(section);
+            }
+            m_free_slots.push_back(it->second.slot);
+            m_entries.erase(it);
+        }
+    }
+
+    void ChunkGeometryPool::defragment() {
+        rebuild_buffers(m_vertex_allocator.capacity(), m_triangle_allocator.capacity(), true);
+    }
+}
@@ -0,0 +1,150 @@
+#pragma once
+#ifndef SIVOX_GAME_CHUNKGEOMETRYPOOL_HPP
+#define SIVOX_GAME_CHUNKGEOMETRYPOOL_HPP
+
+#include "common.hpp"
+#include <array>
+#include <unordered_map>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "meshgenerator.hpp"
+#include "rangeallocator.hpp"
+#include "voxelterrain.hpp"
+
+namespace sivox {
+    /*
+     * Where the vertex shader's chunk slot attribute gets its value from. (See ChunkGeometryPool)
+     *
+     * PerVertex:    Every vertex stores the slot of the chunk it belongs to in a buffer parallel to the vertex buffer.
+     *               Costs 4 bytes per vertex but works with glMultiDrawElementsBaseVertex on plain OpenGL 3.3.
+     * BaseInstance: The slot attribute is instanced and the draw command's base instance selects the slot. Needs
+     *               base instance support (GL 4.2 or ARB_base_instance) but costs nothing per vertex.
+     */
+    enum class ChunkSlotSource {
+        PerVertex,
+        BaseInstance
+    };
+
+    /*
+     * Stores the meshes of many chunks in one shared vertex buffer and one shared element buffer, with one VAO.
+     *
+     * Each chunk's vertices and triangle indices are sub-allocated from the shared buffers using RangeAllocators.
+     * Triangle indices stay relative to the chunk's own vertices and are drawn with a base vertex, so meshes can be
+     * uploaded as they come out of the mesh generator. When a mesh doesn't fit, the buffers grow (doubling) and the
+     * existing meshes are copied over on the GPU.
+     *
+     * Every chunk also gets a slot. The chunk's offset in blocks is stored at its slot in a texture buffer, and the
+     * VAO feeds the slot to the vertex shader at attribute location 2, so many chunks can be drawn in a single call
+     * without setting a uniform for each one. (See TerrainRenderer)
+     *
+     * A chunk's geometry is either one mesh for the whole chunk or a mesh per section (see Chunk::section_height),
+     * each with ranges of its own, so that remeshing a section only re-uploads that section. Whole chunk meshes are
+     * kept as section 0.
+     */
+    class ChunkGeometryPool {
+    public:
+        struct Section {
+            RangeAllocator::Handle vertices = RangeAllocator::invalid_handle;
+            RangeAllocator::Handle triangles = RangeAllocator::invalid_handle;
+            s32 vertex_count = 0;
+            s32 triangle_index_count = 0;
+
+            bool empty() const { return triangle_index_count == 0; }
+        };
+
+        struct Entry {
+            Position chunk_position;
+            s32 slot;
+            std::array<Section, Chunk::section_count> sections;
+        };
+
+        /*
+         * Capacities are in vertices and triangle indices.
+         */
+        explicit ChunkGeometryPool(
+            VertexFormat format,
+            ChunkSlotSource slot_source = ChunkSlotSource::PerVertex,
+            s64 vertex_capacity = 1 << 20,
+            s64 triangle_index_capacity = 3 << 19
+        );
+        ~ChunkGeometryPool();
+
+        ChunkGeometryPool(ChunkGeometryPool const& other) = delete;
+        ChunkGeometryPool &operator=(ChunkGeometryPool const& other) = delete;
+
+        /*
+         * Uploads the [mesh] of the chunk at [chunk_position], replacing its previous mesh, sections and all. An empty
+         * mesh removes the chunk. The [mesh] must use the pool's vertex format.
+         */
+        void set_mesh(Position chunk_position, ChunkMesh const& mesh);
+
+        /*
+         * Uploads the [mesh] of a single [section] of the chunk at [chunk_position], replacing only that section's
+         * previous mesh. The chunk is removed once all of its sections are empty.
+         */
+        void set_section_mesh(Position chunk_position, s32 section, ChunkMesh const& mesh);
+        void remove(Position chunk_position);
+
+        /*
+         * Packs every mesh to the start of the buffers, leaving all the free space in one piece at the end.
+         */
+        void defragment();
+
+        /*
+         * First vertex and first triangle index of a non-empty [section] of an entry in the shared buffers.
+         */
+        s64 base_vertex(Section const& section) const { return m_vertex_allocator.range(section.vertices).offset; }
+        s64 first_triangle_index(Section const& section) const { return m_triangle_allocator.range(section.triangles).offset; }
+
+        std::unordered_map<Position, Entry, PositionHash> const& entries() const { return m_entries; }
+
+        RangeAllocator::Stats vertex_stats() const { return m_vertex_allocator.stats(); }
+        RangeAllocator::Stats triangle_stats() const { return m_triangle_allocator.stats(); }
+
+        VertexFormat vertex_format() const { return m_format; }
+        ChunkSlotSource slot_source() const { return m_slot_source; }
+        GLuint vertex_array() const { return m_vao; }
+        GLuint vertex_buffer() const { return m_vertex_buffer; }
+        GLuint element_buffer() const { return m_element_buffer; }
+
+        /*
+         * GL_TEXTURE_BUFFER of RGBA32F texels. Texel [slot] holds the offset in blocks of the chunk using [slot].
+         */
+        GLuint chunk_offset_texture() const { return m_offset_texture; }
+
+    private:
+        VertexFormat m_format;
+        ChunkSlotSource m_slot_source;
+        GLuint m_vao;
+        GLuint m_vertex_buffer;
+        GLuint m_element_buffer;
+
+        /*
+         * One slot per vertex for ChunkSlotSource::PerVertex, or just the slot numbers in order for
+         * ChunkSlotSource::BaseInstance.
+         */
+        GLuint m_slot_buffer;
+        GLuint m_offset_buffer;
+        GLuint m_offset_texture;
+
+        RangeAllocator m_vertex_allocator;
+        RangeAllocator m_triangle_allocator;
+        std::unordered_map<Position, Entry, PositionHash> m_entries;
+
+        std::vector<glm::vec4> m_slot_offsets;
+        std::vector<s32> m_free_slots;
+        s32 m_slots_used;
+        std::vector<u32> m_vertex_slots; // Scratch space for uploading per vertex slots.
+
+        void create_buffers(s64 vertex_capacity, s64 triangle_index_capacity, GLuint &vertex_buffer, GLuint &element_buffer, GLuint &slot_buffer) const;
+        void attach_buffers();
+        void rebuild_buffers(s64 vertex_capacity, s64 triangle_index_capacity, bool compact);
+
+        s32 allocate_slot(Position chunk_position);
+        void free_section(Section &section);
+        void resize_slot_storage(s64 slot_capacity);
+    };
+}
+
+#endif // SIVOX_GAME_CHUNKGEOMETRYPOOL_HPP
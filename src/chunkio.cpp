@@ -0,0 +1,110 @@
+#include "chunkio.hpp"
+#include <algorithm>
+
+namespace sivox {
+    ChunkIO::ChunkIO(RegionStorage &storage, s32 thread_count) : m_storage(storage) {
+        thread_count = std::max(1, thread_count);
+        m_threads.reserve(thread_count);
+        for (s32 i = 0; i < thread_count; ++i) {
+            m_threads.emplace_back([this]() { run_worker(); });
+        }
+    }
+
+    ChunkIO::~ChunkIO() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+            m_loads.clear();
+        }
+        m_wake.notify_all();
+
+        for (std::thread &thread : m_threads) {
+            thread.join();
+        }
+    }
+
+    void ChunkIO::load(std::vector<LoadRequest> const& requests) {
+        if (requests.empty()) { return; }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_loads.insert(m_loads.end(), requests.begin(), requests.end());
+        }
+        m_wake.notify_one();
+    }
+
+    void ChunkIO::save(Position chunk_position, std::shared_ptr<Chunk const> chunk) {
+        m_storage.stage(chunk_position, std::move(chunk));
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_saves.push_back(chunk_position);
+        }
+        m_wake.notify_one();
+    }
+
+    std::vector<ChunkIO::LoadResult> ChunkIO::poll() {
+        std::vector<LoadResult> results;
+        std::lock_guard<std::mutex> lock(m_results_mutex);
+        results.swap(m_results);
+        return results;
+    }
+
+    void ChunkIO::wait_idle() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idle.wait(lock, [this]() { return m_loads.empty() && m_saves.empty() && m_running == 0; });
+    }
+
+    s32 ChunkIO::pending_count() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return static_cast<s32>(m_loads.size() + m_saves.size()) + m_running;
+    }
+
+    void ChunkIO::run_worker() {
+        std::vector<LoadRequest> loads;
+        std::vector<Position> saves;
+        std::vector<Position> positions;
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait(lock, [this]() { return m_stopping || !m_loads.empty() || !m_saves.empty(); });
+                if (m_stopping && m_saves.empty()) { break; }
+
+                loads.swap(m_loads);
+                saves.swap(m_saves);
+                m_running += static_cast<s32>(loads.size() + saves.size());
+            }
+
+            /*
+             * Saves go first. They're already visible to loads through the staging area, so the order doesn't matter
+             * for correctness, but writing them out keeps the staging area small. Saves that fail to write stay
+             * staged, so they still load, and are tried again with the chunk's next save.
+             */
+            if (!saves.empty()) {
+                m_storage.flush(saves);
+            }
+
+            if (!loads.empty()) {
+                positions.clear();
+                for (LoadRequest const& request : loads) {
+                    positions.push_back(request.chunk_position);
+                }
+                std::vector<std::unique_ptr<Chunk>> chunks = m_storage.load(positions);
+
+                std::lock_guard<std::mutex> lock(m_results_mutex);
+                for (std::size_t i = 0; i < loads.size(); ++i) {
+                    m_results.push_back({ loads[i].chunk_position, loads[i].tag, std::move(chunks[i]) });
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_running -= static_cast<s32>(loads.size() + saves.size());
+                if (m_loads.empty() && m_saves.empty() && m_running == 0) {
+                    m_idle.notify_all();
+                }
+            }
+            loads.clear();
+            saves.clear();
+        }
+    }
+}
@@ -0,0 +1,108 @@
+#pragma once
+#ifndef SIVOX_GAME_CHUNKIO_HPP
+#define SIVOX_GAME_CHUNKIO_HPP
+
+#include "common.hpp"
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "regionfile.hpp"
+#include "voxelterrain.hpp"
+
+namespace sivox {
+    /*
+     * Loads and saves chunks in the background, on threads of its own.
+     *
+     * Disk access has its own threads rather than going through the JobPool because a job waiting on the disk holds
+     * up a worker that could be meshing. Here a stalled read only stalls other reads.
+     *
+     * Requests are batched: a worker takes every request queued up since it last looked, groups them by region file
+     * and hands each group to RegionStorage in one go. A region file is then mapped and locked once per batch and the
+     * slots of neighbouring chunks are read in file order, prefetched as a few large ranges rather than faulted in a
+     * page at a time. Requests for a moving player's new chunks tend to arrive together and sit in the same regions,
+     * so batches are usually well coalesced.
+     *
+     * Finished loads are picked up with poll(), typically by the ChunkProcessor on the render thread. Saves don't
+     * complete anywhere: the chunk is staged in the storage straight away, so loading it again before it's written
+     * already gets the saved version. Saves of the same chunk may be written by different workers at once, which
+     * RegionStorage::flush() keeps in order, so the newest one always ends up on disk.
+     *
+     * Thread safe.
+     */
+    class ChunkIO {
+    public:
+        struct LoadRequest {
+            Position chunk_position;
+            u64 tag; // Handed back with the result, for the caller to match it up with whatever asked for it
+        };
+
+        struct LoadResult {
+            Position chunk_position;
+            u64 tag;
+            std::unique_ptr<Chunk> chunk; // Null if the chunk was never saved
+        };
+
+        /*
+         * [storage] must outlive this.
+         */
+        explicit ChunkIO(RegionStorage &storage, s32 thread_count = 1);
+
+        /*
+         * Writes out every save still queued up. Loads still queued up are dropped.
+         */
+        ~ChunkIO();
+
+        ChunkIO(ChunkIO const& other) = delete;
+        ChunkIO &operator=(ChunkIO const& other) = delete;
+
+        /*
+         * Queues up a batch of loads. The results come back from poll(), in no particular order.
+         */
+        void load(std::vector<LoadRequest> const& requests);
+
+        /*
+         * Queues up [chunk] to be written at [chunk_position]. Replaces any save still queued for the same chunk.
+         */
+        void save(Position chunk_position, std::shared_ptr<Chunk const> chunk);
+
+        /*
+         * Takes the results of every load that finished since the last call. Never blocks.
+         */
+        std::vector<LoadResult> poll();
+
+        /*
+         * Blocks until every queued request has been carried out. There may still be results left to poll()
+         * afterwards.
+         */
+        void wait_idle();
+
+        /*
+         * Number of requests queued up or being carried out.
+         */
+        s32 pending_count() const;
+
+        RegionStorage &storage() { return m_storage; }
+
+    private:
+        RegionStorage &m_storage;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::condition_variable m_idle;
+        std::vector<LoadRequest> m_loads;
+        std::vector<Position> m_saves;
+        s32 m_running = 0; // Requests taken by a worker and not finished yet
+        bool m_stopping = false;
+
+        std::mutex m_results_mutex;
+        std::vector<LoadResult> m_results;
+
+        std::vector<std::thread> m_threads;
+
+        void run_worker();
+    };
+}
+
+#endif // SIVOX_GAME_CHUNKIO_HPP
@@ -0,0 +1,269 @@
+#include "chunkprocessor.hpp"
+#include <algorithm>
+
+namespace {
+    /*
+     * The 26 chunks around [p], which all have some of it in their ChunkNeighbourhood.
+     */
+    std::array<sivox::Position, 26> neighbours(sivox::Position p) {
+        std::array<sivox::Position, 26> positions;
+        std::size_t i = 0;
+        for (sivox::s32 dz = -1; dz <= 1; ++dz) {
+            for (sivox::s32 dx = -1; dx <= 1; ++dx) {
+                for (sivox::s32 dy = -1; dy <= 1; ++dy) {
+                    if (dx != 0 || dy != 0 || dz != 0) {
+                        positions[i++] = {p.x + dx, p.y + dy, p.z + dz};
+                    }
+                }
+            }
+        }
+        return positions;
+    }
+}
+
+namespace sivox {
+    ChunkProcessor::ChunkProcessor(Terrain &terrain, Generator generator, s32 thread_count) :
+        m_terrain(terrain), m_generator(std::move(generator)), m_pool(thread_count) {}
+
+    ChunkProcessor::~ChunkProcessor() {
+        for (auto &pair : m_tasks) {
+            pair.second.cancelled->store(true);
+        }
+        m_tasks.clear();
+    }
+
+    ChunkProcessor::Task &ChunkProcessor::start_task(Position chunk_position, s32 priority) {
+        cancel(chunk_position);
+        Task &task = m_tasks[chunk_position];
+        task.id = m_next_task_id++;
+        task.priority = priority;
+        task.cancelled = std::make_shared<std::atomic<bool>>(false);
+        task.sections = 0;
+        return task;
+    }
+
+    void ChunkProcessor::generate(Position chunk_position, Task const& task) {
+        m_pool.submit([this, chunk_position, id = task.id, cancelled = task.cancelled]() {
+            if (cancelled->load()) { return; }
+            auto generated = std::make_unique<Chunk>();
+            m_generator(*generated, chunk_position);
+            generated->compact();
+            finish({ chunk_position, id, std::move(generated), {}, 0, 0, {}, {}, {} });
+        }, task.priority);
+    }
+
+    void ChunkProcessor::send_loads() {
+        if (m_loads.empty()) { return; }
+        m_chunk_io->load(m_loads);
+        m_loads.clear();
+    }
+
+    void ChunkProcessor::wait_idle() {
+        /*
+         * A load that comes back empty is only turned into a generation job by collect(), so there's nothing more to
+         * wait for after the ChunkIO.
+         */
+        if (m_chunk_io) {
+            send_loads();
+            m_chunk_io->wait_idle();
+        }
+        m_pool.wait_idle();
+    }
+
+    void ChunkProcessor::submit(Position chunk_position, s32 priority) {
+        Chunk *chunk = m_terrain.chunk(chunk_position);
+        if (!chunk) { return; }
+
+        switch (chunk->state()) {
+            case ChunkState::Created: {
+                Task &task = start_task(chunk_position, priority);
+                if (m_chunk_io) {
+                    m_loads.push_back({ chunk_position, task.id });
+                }
+                else {
+                    generate(chunk_position, task);
+                }
+                break;
+            }
+            case ChunkState::Updated: {
+                /*
+                 * Meshing works on a copy so the chunk can keep being edited while the job is in flight. The copy
+                 * includes a border from the neighbouring chunks so faces between two solid chunks get culled.
+                 */
+                auto in_flight = m_tasks.find(chunk_position);
+                u32 sections = chunk->dirty_sections() | (in_flight != m_tasks.end() ? in_flight->second.sections : 0);
+                chunk->clear_dirty_sections();
+
+                Task &task = start_task(chunk_position, priority);
+                task.sections = Chunk::all_sections;
+                s32 lod_level = m_lod_selector ? std::clamp(m_lod_selector(chunk_position), 0, ChunkLod::max_level) : 0;
+                if (lod_level > 0) {
+                    /*
+                     * Coarse meshes don't look at the neighbours, and downsampling is left to the worker.
+                     */
+                    auto snapshot = std::make_shared<Chunk const>(*chunk);
+                    m_pool.submit([this, chunk_position, id = task.id, cancelled = task.cancelled, snapshot, lod_level, rule = m_lod_rule, format = m_vertex_format]() {
+                        if (cancelled->load()) { return; }
+                        ChunkMesh mesh = generate_mesh(ChunkLod(*snapshot, lod_level, rule), format);
+                        finish({ chunk_position, id, nullptr, std::move(mesh), lod_level, 0, {}, FaceConnectivity::compute(*snapshot), ChunkOccluder::compute(*snapshot) });
+                    }, priority);
+                    break;
+                }
+                if (m_partial_remeshing) {
+                    if (sections == 0 || m_whole_meshes.count(chunk_position)) { sections = Chunk::all_sections; }
+                    task.sections = sections;
+
+                    /*
+                     * Only the dirty sections are copied, which is most of the saving for small edits. Connectivity
+                     * and occluders still need the whole chunk, which is a cheaper copy than a whole neighbourhood.
+                     */
+                    auto snapshot = std::make_shared<ChunkNeighbourhood>(m_terrain, chunk_position, sections);
+                    auto chunk_snapshot = std::make_shared<Chunk const>(*chunk);
+                    m_pool.submit([this, chunk_position, id = task.id, cancelled = task.cancelled, snapshot, chunk_snapshot, sections, mode = m_meshing_mode, format = m_vertex_format]() {
+                        if (cancelled->load()) { return; }
+                        std::vector<ChunkMesh> meshes;
+                        for (s32 section = 0; section < Chunk::section_count; ++section) {
+                            if (sections & (1u << section)) {
+                                meshes.push_back(generate_section_mesh(*snapshot, section, mode, format));
+                            }
+                        }
+                        finish({ chunk_position, id, nullptr, {}, 0, sections, std::move(meshes), FaceConnectivity::compute(*chunk_snapshot), ChunkOccluder::compute(*chunk_snapshot) });
+                    }, priority);
+                    break;
+                }
+                auto snapshot = std::make_shared<ChunkNeighbourhood>(m_terrain, chunk_position);
+                m_pool.submit([this, chunk_position, id = task.id, cancelled = task.cancelled, snapshot, mode = m_meshing_mode, format = m_vertex_format]() {
+                    if (cancelled->load()) { return; }
+                    ChunkMesh mesh = generate_mesh(*snapshot, mode, format);
+                    finish({ chunk_position, id, nullptr, std::move(mesh), 0, 0, {}, FaceConnectivity::compute(*snapshot), ChunkOccluder::compute(*snapshot) });
+                }, priority);
+                break;
+            }
+            case ChunkState::Loaded:
+                break;
+            case ChunkState::Unloaded:
+                cancel(chunk_position);
+                m_whole_meshes.erase(chunk_position);
+                if (m_chunk_io) {
+                    m_chunk_io->save(chunk_position, std::make_shared<Chunk const>(*chunk));
+                }
+                chunk->set_state(ChunkState::Unused);
+                break;
+            case ChunkState::Unused:
+                break;
+        }
+    }
+
+    void ChunkProcessor::block_changed(Position chunk_position, Position block_position, s32 priority) {
+        mark_updated(chunk_position, priority);
+        for (Position neighbour : chunks_touching_block(chunk_position, block_position)) {
+            /*
+             * The height of the block as seen from the neighbour, which is off the end for the chunks above and below,
+             * diagonal ones included.
+             */
+            if (Chunk *chunk = m_terrain.chunk(neighbour)) {
+                s32 y = block_position.y - (neighbour.y - chunk_position.y) * Chunk::height;
+                chunk->mark_sections_dirty(Chunk::sections_around(y, y + 1));
+            }
+            mark_updated(neighbour, priority);
+        }
+    }
+
+    void ChunkProcessor::mark_updated(Position chunk_position, s32 priority) {
+        Chunk *chunk = m_terrain.chunk(chunk_position);
+        if (!chunk) { return; }
+
+        ChunkState state = chunk->state();
+        if (state == ChunkState::Loaded || state == ChunkState::Updated) {
+            chunk->set_state(ChunkState::Updated);
+            submit(chunk_position, priority);
+        }
+    }
+
+    void ChunkProcessor::cancel(Position chunk_position) {
+        auto it = m_tasks.find(chunk_position);
+        if (it != m_tasks.end()) {
+            it->second.cancelled->store(true);
+            m_tasks.erase(it);
+        }
+    }
+
+    void ChunkProcessor::finish(Finished finished) {
+        std::lock_guard<std::mutex> lock(m_finished_mutex);
+        m_finished.push_back(std::move(finished));
+    }
+
+    std::vector<ChunkProcessor::Result> ChunkProcessor::collect() {
+        std::vector<Finished> finished;
+        {
+            std::lock_guard<std::mutex> lock(m_finished_mutex);
+            finished.swap(m_finished);
+        }
+
+        if (m_chunk_io) {
+            send_loads();
+
+            /*
+             * Loaded chunks are applied like generated ones. Chunks that were never saved get generated now, under
+             * the same task so a cancel in the meantime still drops them.
+             */
+            for (ChunkIO::LoadResult &loaded : m_chunk_io->poll()) {
+                if (loaded.chunk) {
+                    finished.push_back({ loaded.chunk_position, loaded.tag, std::move(loaded.chunk), {}, 0, 0, {}, {}, {} });
+                    continue;
+                }
+                auto it = m_tasks.find(loaded.chunk_position);
+                if (it != m_tasks.end() && it->second.id == loaded.tag) {
+                    generate(loaded.chunk_position, it->second);
+                }
+            }
+        }
+
+        std::vector<Result> results;
+        for (Finished &f : finished) {
+            /*
+             * Results of cancelled or superseded tasks are stale.
+             */
+            auto it = m_tasks.find(f.chunk_position);
+            if (it == m_tasks.end() || it->second.id != f.task_id) { continue; }
+            s32 priority = it->second.priority;
+            m_tasks.erase(it);
+
+            Chunk *chunk = m_terrain.chunk(f.chunk_position);
+            if (!chunk) { continue; }
+
+            if (f.generated) {
+                *chunk = std::move(*f.generated);
+                chunk->set_state(ChunkState::Updated);
+                submit(f.chunk_position, priority);
+
+                /*
+                 * Neighbours were meshed against air where this chunk is. Now they may have faces to cull and
+                 * corners to darken.
+                 */
+                for (Position neighbour : neighbours(f.chunk_position)) {
+                    if (Chunk *neighbour_chunk = m_terrain.chunk(neighbour)) {
+                        neighbour_chunk->mark_sections_dirty(Chunk::all_sections);
+                    }
+                    mark_updated(neighbour, priority);
+                }
+            }
+            else if (f.sections != 0) {
+                chunk->set_state(ChunkState::Loaded);
+                m_whole_meshes.erase(f.chunk_position);
+                auto mesh = f.section_meshes.begin();
+                for (s32 section = 0; section < Chunk::section_count; ++section) {
+                    if (f.sections & (1u << section)) {
+                        results.push_back({ f.chunk_position, std::move(*mesh++), 0, section, f.connectivity, f.occluder });
+                    }
+                }
+            }
+            else {
+                chunk->set_state(ChunkState::Loaded);
+                m_whole_meshes.insert(f.chunk_position);
+                results.push_back({ f.chunk_position, std::move(f.mesh), f.lod_level, whole_chunk, f.connectivity, f.occluder });
+            }
+        }
+        return results;
+    }
+}
@@ -0,0 +1,236 @@
+#pragma once
+#ifndef SIVOX_GAME_CHUNKPROCESSOR_HPP
+#define SIVOX_GAME_CHUNKPROCESSOR_HPP
+
+#include "common.hpp"
+#include <array>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "voxelterrain.hpp"
+#include "meshgenerator.hpp"
+#include "jobpool.hpp"
+#include "chunkio.hpp"
+#include "visibility.hpp"
+#include "occlusion.hpp"
+
+namespace sivox {
+    /*
+     * Processes chunks as they are created, loaded, generated, updated, unloaded and
+     * destroyed. (See ChunkState for what each state means.)
+     *
+     *  Chunks are submitted by position along with a priority. The actual work happens
+     *  on a JobPool and the results are picked up by calling collect() from the thread
+     *  that owns the Terrain (the render thread). Worker threads never touch the
+     *  Terrain: generation happens in a scratch chunk that is copied in on collect() and
+     *  meshing happens on a snapshot of the chunk taken at submit time. This means the
+     *  render thread is free to keep editing chunks while work is in flight.
+     *
+     *  The state transitions are as follows:
+     *   - Created --> Updated
+     *     The chunk is loaded from disk or generated. Its mesh must be generated for
+     *     display and other data may be computed too. Once the generated data is
+     *     collected, the chunk is resubmitted for meshing automatically. Chunks are
+     *     only loaded from disk if a ChunkIO has been set. Loads are batched up and
+     *     sent to it on the next collect(), and a chunk it doesn't have is generated
+     *     once that comes back.
+     *
+     *   - Updated --> Loaded
+     *     The chunk's mesh is regenerated. collect() hands the finished mesh back to the
+     *     caller.
+     *
+     *   - Loaded --> Loaded
+     *     Currently chunks in the loaded state should not be submitted at all. So a
+     *     Loaded chunk is simply skipped.
+     *
+     *     IDEA: In the future, we may implement this transition to simulate fluids or do
+     *     other dynamic things. (Though a 'Loaded --> Updated' transition probably makes
+     *     more sense...)
+     *
+     *   - Unloaded --> Unused
+     *     If a ChunkIO has been set, a snapshot of the chunk is handed to it for saving.
+     *     Either way the state changes immediately, since the snapshot is all the save
+     *     needs. The save can't be cancelled and loading the chunk again before it's
+     *     written gets the snapshot.
+     *
+     *  Any other state transitions are up to the user and must happen elsewhere. Reusing
+     *  an Unused chunk will require the state to be manually set to Created. Same for
+     *  freeing it. Changing the state from Loaded to Updated when a block is changed is
+     *  also up to the user, meant to be done wherever the block placement logic is
+     *  handled.
+     *
+     *  Meshing takes the neighbouring chunks into account. When a chunk finishes
+     *  generating, its Loaded neighbours are remeshed so the faces between them get culled.
+     *
+     *  Submitting a chunk that already has work in flight cancels the old work. Jobs
+     *  that haven't started yet are skipped and results of jobs that were already running
+     *  are thrown away in collect().
+     */
+    class ChunkProcessor {
+    public:
+        /*
+         * Fills [chunk] with the terrain at [chunk_position].
+         * Runs on worker threads, possibly several at once, so it must be thread safe.
+         */
+        using Generator = std::function<void(Chunk &chunk, Position chunk_position)>;
+
+        /*
+         * Picks the ChunkLod level to mesh the chunk at [chunk_position] with, or 0 for full detail. Called from
+         * submit(), on the thread that owns the Terrain.
+         */
+        using LodSelector = std::function<s32(Position chunk_position)>;
+
+        /*
+         * A finished mesh for the chunk at [chunk_position], at [lod_level]. With partial remeshing, [mesh] is only the
+         * mesh of one [section] of the chunk, and the other sections keep their meshes. Otherwise [section] is
+         * whole_chunk and [mesh] replaces the whole chunk's mesh.
+         *
+         * [connectivity] and [occluder] are always those of the whole chunk, recomputed along with every mesh, for a
+         * VisibilityGraph and an OcclusionCuller.
+         */
+        static constexpr s32 whole_chunk = -1;
+        struct Result {
+            Position chunk_position;
+            ChunkMesh mesh;
+            s32 lod_level = 0;
+            s32 section = whole_chunk;
+            FaceConnectivity connectivity;
+            ChunkOccluder occluder;
+        };
+
+        ChunkProcessor(Terrain &terrain, Generator generator, s32 thread_count = JobPool::default_thread_count());
+        ~ChunkProcessor();
+
+        ChunkProcessor(ChunkProcessor const& other) = delete;
+        ChunkProcessor &operator=(ChunkProcessor const& other) = delete;
+
+        /*
+         * Queues up the chunk at [chunk_position] for its next state transition. Lower [priority] values are
+         * processed first.
+         */
+        void submit(Position chunk_position, s32 priority = 0);
+
+        /*
+         * Call after changing the block at [block_position] in the chunk at [chunk_position]. Marks the chunk as
+         * Updated and queues it up for meshing, along with any neighbouring chunk sharing a face with the block. The
+         * neighbours get the sections next to the block marked dirty.
+         */
+        void block_changed(Position chunk_position, Position block_position, s32 priority = 0);
+
+        /*
+         * Drops any work queued up for the chunk at [chunk_position].
+         */
+        void cancel(Position chunk_position);
+
+        /*
+         * Applies the state transitions of every job that finished since the last call and returns the finished
+         * meshes. Must be called from the thread that owns the Terrain.
+         */
+        std::vector<Result> collect();
+
+        /*
+         * Blocks until the workers and the ChunkIO run out of work. There may still be results left to collect()
+         * afterwards.
+         */
+        void wait_idle();
+
+        /*
+         * Number of chunks with work in flight (or waiting to be collected).
+         */
+        s32 pending_count() const { return static_cast<s32>(m_tasks.size()); }
+
+        Terrain &terrain() { return m_terrain; }
+        Terrain const& terrain() const { return m_terrain; }
+
+        /*
+         * The meshing mode used for jobs submitted from now on.
+         */
+        MeshingMode meshing_mode() const { return m_meshing_mode; }
+        void set_meshing_mode(MeshingMode mode) { m_meshing_mode = mode; }
+
+        /*
+         * The vertex format of meshes from jobs submitted from now on.
+         */
+        VertexFormat vertex_format() const { return m_vertex_format; }
+        void set_vertex_format(VertexFormat format) { m_vertex_format = format; }
+
+        /*
+         * Whether Updated chunks are remeshed a section at a time, from jobs submitted from now on. If so, only the
+         * chunk's dirty sections are meshed (see Chunk::dirty_sections) and each comes back as a Result of its own,
+         * so a single block edit costs a fraction of meshing the whole chunk. Chunks with nothing dirty, and chunks
+         * whose last mesh was a whole one, have every section meshed. Off by default.
+         */
+        bool partial_remeshing() const { return m_partial_remeshing; }
+        void set_partial_remeshing(bool partial) { m_partial_remeshing = partial; }
+
+        /*
+         * Picks the level of detail of meshes from jobs submitted from now on. Null (the default) meshes every chunk
+         * at full detail. Chunks meshed at a coarser level are meshed on their own, without the neighbourhood. (See
+         * ChunkLod for how the seams are covered.) Changing the level of a Loaded chunk is up to the user, by marking
+         * it Updated and submitting it again.
+         */
+        void set_lod_selector(LodSelector selector) { m_lod_selector = std::move(selector); }
+        LodRule lod_rule() const { return m_lod_rule; }
+        void set_lod_rule(LodRule rule) { m_lod_rule = rule; }
+
+        /*
+         * Where chunks are loaded from and saved to. Null (the default) means chunks are always generated and never
+         * saved. The ChunkIO must outlive the processor.
+         */
+        ChunkIO *chunk_io() const { return m_chunk_io; }
+        void set_chunk_io(ChunkIO *chunk_io) { m_chunk_io = chunk_io; }
+
+    private:
+        struct Task {
+            u64 id;
+            s32 priority;
+            std::shared_ptr<std::atomic<bool>> cancelled;
+            u32 sections; // Sections being meshed, so they can be meshed again if the task is superseded
+        };
+
+        struct Finished {
+            Position chunk_position;
+            u64 task_id;
+            std::unique_ptr<Chunk> generated; // Set for generation jobs
+            ChunkMesh mesh;                   // Set for meshing jobs
+            s32 lod_level;
+            u32 sections;                     // Set for section meshing jobs, along with a mesh per section
+            std::vector<ChunkMesh> section_meshes;
+            FaceConnectivity connectivity;    // Set for meshing jobs
+            ChunkOccluder occluder;           // Set for meshing jobs
+        };
+
+        Terrain &m_terrain;
+        Generator m_generator;
+        MeshingMode m_meshing_mode = MeshingMode::PerFace;
+        VertexFormat m_vertex_format = VertexFormat::Float;
+        LodSelector m_lod_selector;
+        LodRule m_lod_rule = LodRule::Majority;
+        bool m_partial_remeshing = false;
+        std::unordered_set<Position, PositionHash> m_whole_meshes; // Chunks whose last mesh covered the whole chunk
+        ChunkIO *m_chunk_io = nullptr;
+        std::vector<ChunkIO::LoadRequest> m_loads; // Sent to m_chunk_io as one batch on the next collect()
+
+        std::unordered_map<Position, Task, PositionHash> m_tasks;
+        u64 m_next_task_id = 1;
+
+        std::mutex m_finished_mutex;
+        std::vector<Finished> m_finished;
+
+        /*
+         * Declared last so it's destroyed first: the workers must be joined before the members they write to go away.
+         */
+        JobPool m_pool;
+
+        Task &start_task(Position chunk_position, s32 priority);
+        void generate(Position chunk_position, Task const& task);
+        void send_loads();
+        void mark_updated(Position chunk_position, s32 priority);
+        void finish(Finished finished);
+    };
+}
+
+#endif // SIVOX_GAME_CHUNKPROCESSOR_HPP
@@ -0,0 +1,152 @@
+#include "frustum.hpp"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define SIVOX_FRUSTUM_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace {
+    /*
+     * A box is outside a plane when even its corner furthest along the plane normal is behind the plane. That
+     * corner is center + extent * sign(normal), so rather than finding it, the box's "radius" along the normal is
+     * added onto the plane's w.
+     */
+    sivox::f32 plane_offset(glm::vec4 const& plane, glm::vec3 extent) {
+        return plane.w + (glm::abs(plane.x) * extent.x + glm::abs(plane.y) * extent.y + glm::abs(plane.z) * extent.z);
+    }
+
+    /*
+     * Written out step by step so the SSE version can do exactly the same operations in the same order.
+     */
+    bool outside_plane(glm::vec4 const& plane, sivox::f32 offset, sivox::f32 x, sivox::f32 y, sivox::f32 z) {
+        sivox::f32 distance = plane.x * x;
+        distance += plane.y * y;
+        distance += plane.z * z;
+        distance += offset;
+        return distance < 0.0f;
+    }
+}
+
+namespace sivox {
+    Frustum Frustum::from_matrix(glm::mat4 const& view_projection) {
+        /*
+         * glm matrices are indexed by column, so pull the rows out first.
+         */
+        glm::vec4 rows[4];
+        for (s32 i = 0; i < 4; ++i) {
+            rows[i] = glm::vec4(view_projection[0][i], view_projection[1][i], view_projection[2][i], view_projection[3][i]);
+        }
+
+        Frustum frustum;
+        frustum.planes[0] = rows[3] + rows[0]; // Left
+        frustum.planes[1] = rows[3] - rows[0]; // Right
+        frustum.planes[2] = rows[3] + rows[1]; // Bottom
+        frustum.planes[3] = rows[3] - rows[1]; // Top
+        frustum.planes[4] = rows[3] + rows[2]; // Near
+        frustum.planes[5] = rows[3] - rows[2]; // Far
+
+        for (glm::vec4 &plane : frustum.planes) {
+            plane /= glm::length(glm::vec3(plane));
+        }
+        return frustum;
+    }
+
+    bool Frustum::intersects(glm::vec3 center, glm::vec3 extent) const {
+        for (glm::vec4 const& plane : planes) {
+            if (outside_plane(plane, plane_offset(plane, extent), center.x, center.y, center.z)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void ChunkCuller::clear() {
+        m_chunks.clear();
+        m_center_x.clear();
+        m_center_y.clear();
+        m_center_z.clear();
+    }
+
+    void ChunkCuller::reserve(s32 chunk_count) {
+        m_chunks.reserve(chunk_count);
+        m_center_x.reserve(chunk_count);
+        m_center_y.reserve(chunk_count);
+        m_center_z.reserve(chunk_count);
+    }
+
+    void ChunkCuller::add(Position chunk_position) {
+        glm::vec3 center = chunk_center(chunk_position);
+        m_chunks.push_back(chunk_position);
+        m_center_x.push_back(center.x);
+        m_center_y.push_back(center.y);
+        m_center_z.push_back(center.z);
+    }
+
+    void ChunkCuller::cull_scalar(Frustum const& frustum, std::vector<Position> &visible) const {
+        visible.clear();
+        const glm::vec3 extent = chunk_extent();
+        for (s32 i = 0; i < chunk_count(); ++i) {
+            if (frustum.intersects(glm::vec3(m_center_x[i], m_center_y[i], m_center_z[i]), extent)) {
+                visible.push_back(m_chunks[i]);
+            }
+        }
+    }
+
+    void ChunkCuller::cull(Frustum const& frustum, std::vector<Position> &visible) const {
+        visible.clear();
+        const glm::vec3 extent = chunk_extent();
+
+        std::array<f32, 6> offsets;
+        for (s32 p = 0; p < 6; ++p) {
+            offsets[p] = plane_offset(frustum.planes[p], extent);
+        }
+
+        s32 i = 0;
+#ifdef SIVOX_FRUSTUM_SSE
+        __m128 normal_x[6], normal_y[6], normal_z[6], offset[6];
+        for (s32 p = 0; p < 6; ++p) {
+            normal_x[p] = _mm_set1_ps(frustum.planes[p].x);
+            normal_y[p] = _mm_set1_ps(frustum.planes[p].y);
+            normal_z[p] = _mm_set1_ps(frustum.planes[p].z);
+            offset[p] = _mm_set1_ps(offsets[p]);
+        }
+
+        const __m128 zero = _mm_setzero_ps();
+        for (; i + 4 <= chunk_count(); i += 4) {
+            __m128 x = _mm_loadu_ps(&m_center_x[i]);
+            __m128 y = _mm_loadu_ps(&m_center_y[i]);
+            __m128 z = _mm_loadu_ps(&m_center_z[i]);
+
+            __m128 outside = zero;
+            for (s32 p = 0; p < 6; ++p) {
+                __m128 distance = _mm_mul_ps(normal_x[p], x);
+                distance = _mm_add_ps(distance, _mm_mul_ps(normal_y[p], y));
+                distance = _mm_add_ps(distance, _mm_mul_ps(normal_z[p], z));
+                distance = _mm_add_ps(distance, offset[p]);
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, zero));
+            }
+
+            /*
+             * One bit per chunk, set if it's outside any plane.
+             */
+            s32 visible_mask = ~_mm_movemask_ps(outside) & 0xF;
+            while (visible_mask != 0) {
+                s32 lane = 0;
+                while ((visible_mask & (1 << lane)) == 0) { ++lane; }
+                visible.push_back(m_chunks[i + lane]);
+                visible_mask &= visible_mask - 1;
+            }
+        }
+#endif
+
+        for (; i < chunk_count(); ++i) {
+            bool outside = false;
+            for (s32 p = 0; p < 6 && !outside; ++p) {
+                outside = outside_plane(frustum.planes[p], offsets[p], m_center_x[i], m_center_y[i], m_center_z[i]);
+            }
+            if (!outside) {
+                visible.push_back(m_chunks[i]);
+            }
+        }
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+#ifndef SIVOX_GAME_FRUSTUM_HPP
+#define SIVOX_GAME_FRUSTUM_HPP
+
+#include "common.hpp"
+#include <array>
+#include <vector>
+#include <glm/glm.hpp>
+#include "voxelterrain.hpp"
+
+namespace sivox {
+    /*
+     * The six planes of a view frustum, facing inwards. A point p is inside plane i if
+     * dot(planes[i].xyz, p) + planes[i].w >= 0.
+     */
+    struct Frustum {
+        std::array<glm::vec4, 6> planes;
+
+        /*
+         * Extracts the planes from a [view_projection] matrix (projection * view) using OpenGL clip space, where
+         * everything inside satisfies -w <= x, y, z <= w. The planes are normalized.
+         */
+        static Frustum from_matrix(glm::mat4 const& view_projection);
+
+        /*
+         * Whether the box at [center] with half size [extent] is at least partly inside. Conservative: boxes near
+         * the corners of the frustum can be reported visible when they're just outside.
+         */
+        bool intersects(glm::vec3 center, glm::vec3 extent) const;
+    };
+
+    /*
+     * Finds which of a set of chunks are in a view frustum.
+     *
+     * All chunk boxes are the same size, so the box's "radius" along each plane's normal is the same for every chunk
+     * and only the chunk centers need to be stored. They're kept as separate x, y and z arrays so four chunks can be
+     * tested per iteration with SSE.
+     */
+    class ChunkCuller {
+    public:
+        void clear();
+        void add(Position chunk_position);
+        void reserve(s32 chunk_count);
+
+        s32 chunk_count() const { return static_cast<s32>(m_chunks.size()); }
+        std::vector<Position> const& chunks() const { return m_chunks; }
+
+        /*
+         * Replaces the contents of [visible] with the positions of the chunks intersecting the [frustum], in the
+         * order they were added.
+         */
+        void cull(Frustum const& frustum, std::vector<Position> &visible) const;
+
+        /*
+         * Same as cull(), testing one chunk at a time with Frustum::intersects. Gives the same results.
+         */
+        void cull_scalar(Frustum const& frustum, std::vector<Position> &visible) const;
+
+    private:
+        std::vector<Position> m_chunks;
+        std::vector<f32> m_center_x;
+        std::vector<f32> m_center_y;
+        std::vector<f32> m_center_z;
+    };
+
+    /*
+     * Half the size of a chunk's bounding box.
+     */
+    inline glm::vec3 chunk_extent() {
+        return glm::vec3(Chunk::width, Chunk::height, Chunk::length) * 0.5f;
+    }
+
+    /*
+     * Center of the bounding box of the chunk at [chunk_position], in blocks. Meshes of the chunk reach one block
+     * below its z origin (see the face templates in meshgenerator.cpp), so the box is shifted to match.
+     */
+    inline glm::vec3 chunk_center(Position chunk_position) {
+        return glm::vec3(
+            chunk_position.x * Chunk::width,
+            chunk_position.y * Chunk::height,
+            chunk_position.z * Chunk::length - 1
+        ) + chunk_extent();
+    }
+}
+
+#endif // SIVOX_GAME_FRUSTUM_HPP
@@ -1,7 +1,19 @@
 #include "ioutils.hpp"
+#include <algorithm>
 #include <fstream>
 #include <filesystem>
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace fs = std::filesystem;
 
 namespace sivox {
@@ -27,4 +39,94 @@ namespace sivox {
         std::ofstream file(path);
         file << contents;
     }
+
+#ifdef _WIN32
+    bool MappedFile::open(fs::path const& path) {
+        close();
+
+        HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) { return false; }
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+            CloseHandle(file);
+            return false;
+        }
+
+        HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) {
+            CloseHandle(file);
+            return false;
+        }
+
+        void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!data) {
+            CloseHandle(mapping);
+            CloseHandle(file);
+            return false;
+        }
+
+        m_file = file;
+        m_mapping = mapping;
+        m_data = static_cast<u8 const*>(data);
+        m_size = size.QuadPart;
+        return true;
+    }
+
+    void MappedFile::close() {
+        if (m_data) { UnmapViewOfFile(m_data); }
+        if (m_mapping) { CloseHandle(m_mapping); }
+        if (m_file) { CloseHandle(m_file); }
+        m_data = nullptr;
+        m_mapping = nullptr;
+        m_file = nullptr;
+        m_size = 0;
+    }
+
+    void MappedFile::prefetch(s64, s64) const {}
+#else
+    bool MappedFile::open(fs::path const& path) {
+        close();
+
+        int file = ::open(path.c_str(), O_RDONLY);
+        if (file < 0) { return false; }
+
+        struct stat info;
+        if (fstat(file, &info) != 0 || info.st_size == 0) {
+            ::close(file);
+            return false;
+        }
+
+        /*
+         * The mapping keeps the file alive by itself.
+         */
+        void *data = mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_SHARED, file, 0);
+        ::close(file);
+        if (data == MAP_FAILED) { return false; }
+
+        m_data = static_cast<u8 const*>(data);
+        m_size = info.st_size;
+        return true;
+    }
+
+    void MappedFile::close() {
+        if (m_data) {
+            munmap(const_cast<u8*>(m_data), static_cast<std::size_t>(m_size));
+        }
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    void MappedFile::prefetch(s64 offset, s64 size) const {
+        if (!m_data || offset < 0 || size <= 0 || offset >= m_size) { return; }
+
+        /*
+         * madvise wants a page aligned address.
+         */
+        const s64 page_size = sysconf(_SC_PAGESIZE);
+        s64 begin = offset / page_size * page_size;
+        s64 end = std::min(offset + size, m_size);
+        madvise(const_cast<u8*>(m_data) + begin, static_cast<std::size_t>(end - begin), MADV_WILLNEED);
+    }
+#endif
 }
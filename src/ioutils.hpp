@@ -9,6 +9,46 @@
 namespace sivox {
     std::string read_text_file(std::filesystem::path const& path);
     void write_text_file(std::filesystem::path const& path, std::string const& contents);
+
+    /*
+     * A read-only memory mapping of a whole file. Reading from it costs page faults rather than copies, and pages
+     * nobody touches are never read from disk at all.
+     *
+     * The mapping shows the file as it was when it was opened. Files must not be truncated while they're mapped.
+     */
+    class MappedFile {
+    public:
+        MappedFile() = default;
+        ~MappedFile() { close(); }
+
+        MappedFile(MappedFile const& other) = delete;
+        MappedFile &operator=(MappedFile const& other) = delete;
+
+        /*
+         * Maps the file at [path], closing any previous mapping. Fails for missing and empty files.
+         */
+        bool open(std::filesystem::path const& path);
+        void close();
+
+        bool is_open() const { return m_data != nullptr; }
+        u8 const* data() const { return m_data; }
+        s64 size() const { return m_size; }
+
+        /*
+         * Hints that [size] bytes at [offset] are about to be read, so the OS can read them in one go rather than
+         * faulting them in a page at a time. Does nothing where there's no way to tell the OS.
+         */
+        void prefetch(s64 offset, s64 size) const;
+
+    private:
+        u8 const* m_data = nullptr;
+        s64 m_size = 0;
+
+#ifdef _WIN32
+        void *m_file = nullptr;
+        void *m_mapping = nullptr;
+#endif
+    };
 }
 
 #endif // SIVOX_GAME_IOUTILS_HPP
@@ -0,0 +1,139 @@
+#include "jobpool.hpp"
+#include <algorithm>
+
+namespace {
+    /*
+     * Lets submit() tell whether it's being called from one of our own workers, in which case the job goes into that
+     * worker's deque.
+     */
+    thread_local sivox::JobPool const* t_current_pool = nullptr;
+    thread_local sivox::s32 t_current_worker = -1;
+}
+
+namespace sivox {
+    s32 JobPool::default_thread_count() {
+        s32 cores = static_cast<s32>(std::thread::hardware_concurrency());
+        return std::max(1, cores - 1);
+    }
+
+    JobPool::JobPool(s32 thread_count) : m_queued(0), m_pending(0) {
+        thread_count = std::max(1, thread_count);
+
+        m_workers.reserve(thread_count);
+        for (s32 i = 0; i < thread_count; ++i) {
+            m_workers.push_back(std::make_unique<Worker>());
+        }
+
+        m_threads.reserve(thread_count);
+        for (s32 i = 0; i < thread_count; ++i) {
+            m_threads.emplace_back([this, i]() { run_worker(i); });
+        }
+    }
+
+    JobPool::~JobPool() {
+        {
+            std::lock_guard<std::mutex> lock(m_sleep_mutex);
+            m_stopping = true;
+        }
+        m_wake.notify_all();
+
+        for (std::thread &thread : m_threads) {
+            thread.join();
+        }
+    }
+
+    void JobPool::submit(Job job, s32 priority) {
+        m_pending++;
+
+        if (t_current_pool == this) {
+            Worker &worker = *m_workers[t_current_worker];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            worker.jobs.push_back(std::move(job));
+        }
+        else {
+            std::lock_guard<std::mutex> lock(m_shared_mutex);
+            m_shared_jobs.push({ std::move(job), priority, m_sequence++ });
+        }
+
+        {
+            /*
+             * Bumping the counter under the sleep mutex means a worker can't check it, miss the job and then go to
+             * sleep right after we notify.
+             */
+            std::lock_guard<std::mutex> lock(m_sleep_mutex);
+            m_queued++;
+        }
+        m_wake.notify_one();
+    }
+
+    void JobPool::wait_idle() {
+        std::unique_lock<std::mutex> lock(m_sleep_mutex);
+        m_idle.wait(lock, [this]() { return m_pending.load() == 0; });
+    }
+
+    bool JobPool::take_job(s32 index, Job &job) {
+        {
+            Worker &own = *m_workers[index];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.jobs.empty()) {
+                job = std::move(own.jobs.back());
+                own.jobs.pop_back();
+                return true;
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_shared_mutex);
+            if (!m_shared_jobs.empty()) {
+                /*
+                 * priority_queue::top is const, but we're popping the element right away so moving out is fine.
+                 */
+                job = std::move(const_cast<QueuedJob&>(m_shared_jobs.top()).job);
+                m_shared_jobs.pop();
+                return true;
+            }
+        }
+
+        s32 count = static_cast<s32>(m_workers.size());
+        for (s32 offset = 1; offset < count; ++offset) {
+            Worker &victim = *m_workers[(index + offset) % count];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.jobs.empty()) {
+                job = std::move(victim.jobs.front());
+                victim.jobs.pop_front();
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void JobPool::run_worker(s32 index) {
+        t_current_pool = this;
+        t_current_worker = index;
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(m_sleep_mutex);
+                m_wake.wait(lock, [this]() { return m_stopping || m_queued.load() > 0; });
+                if (m_stopping) { break; }
+            }
+
+            Job job;
+            if (!take_job(index, job)) {
+                /*
+                 * Somebody else got to it first.
+                 */
+                continue;
+            }
+            m_queued--;
+
+            job();
+
+            if (--m_pending == 0) {
+                std::lock_guard<std::mutex> lock(m_sleep_mutex);
+                m_idle.notify_all();
+            }
+        }
+    }
+}
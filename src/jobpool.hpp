@@ -0,0 +1,102 @@
+#pragma once
+#ifndef SIVOX_GAME_JOBPOOL_HPP
+#define SIVOX_GAME_JOBPOOL_HPP
+
+#include "common.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace sivox {
+    /*
+     * A small work-stealing thread pool.
+     *
+     * Jobs submitted from outside the pool go into a shared priority queue. Lower priority values are more urgent, so
+     * callers can pass something like a distance to the camera and have the closest work done first. Jobs submitted
+     * from a worker thread (e.g. a generation job queueing up a follow-up job) go into that worker's own deque instead.
+     *
+     * A worker looks for work in this order:
+     *   - the back of its own deque (most recently submitted, still warm in cache)
+     *   - the shared priority queue
+     *   - the front of another worker's deque (stealing the oldest job)
+     *
+     * The queues are guarded by small mutexes rather than being truly lockfree. Jobs are big (meshing, generation, disk
+     * IO) so contention on the queues is not what we're worried about.
+     */
+    class JobPool {
+    public:
+        using Job = std::function<void()>;
+
+        /*
+         * One worker per core, leaving one core for the render thread.
+         */
+        static s32 default_thread_count();
+
+        explicit JobPool(s32 thread_count = default_thread_count());
+        ~JobPool();
+
+        JobPool(JobPool const& other) = delete;
+        JobPool &operator=(JobPool const& other) = delete;
+
+        /*
+         * Queues up a [job]. Jobs with lower [priority] values are started first.
+         * Safe to call from any thread, including from inside a running job.
+         */
+        void submit(Job job, s32 priority = 0);
+
+        /*
+         * Blocks until every submitted job has finished running.
+         */
+        void wait_idle();
+
+        s32 thread_count() const { return static_cast<s32>(m_threads.size()); }
+        s32 pending_count() const { return m_pending.load(); }
+
+    private:
+        struct QueuedJob {
+            Job job;
+            s32 priority;
+            u64 sequence;
+
+            /*
+             * std::priority_queue puts the *largest* element on top, so this is backwards on purpose.
+             * Ties are broken by submission order.
+             */
+            friend bool operator<(QueuedJob const& a, QueuedJob const& b) {
+                if (a.priority != b.priority) { return a.priority > b.priority; }
+                return a.sequence > b.sequence;
+            }
+        };
+
+        struct Worker {
+            std::mutex mutex;
+            std::deque<Job> jobs;
+        };
+
+        std::vector<std::unique_ptr<Worker>> m_workers;
+        std::vector<std::thread> m_threads;
+
+        std::mutex m_shared_mutex;
+        std::priority_queue<QueuedJob> m_shared_jobs;
+        u64 m_sequence = 0;
+
+        std::mutex m_sleep_mutex;
+        std::condition_variable m_wake;
+        std::condition_variable m_idle;
+
+        std::atomic<s32> m_queued;  // Jobs sitting in a queue
+        std::atomic<s32> m_pending; // Jobs queued or running
+        bool m_stopping = false;
+
+        void run_worker(s32 index);
+        bool take_job(s32 index, Job &job);
+    };
+}
+
+#endif // SIVOX_GAME_JOBPOOL_HPP
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <chrono>
+#include <unordered_map>
 #include <SDL.h>
 #include <SDL_video.h>
 #include <SDL_timer.h>
@@ -8,10 +9,15 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include "common.hpp" 
-#include "chunkbuffers.hpp"
+#include "chunkprocessor.hpp"
+#include "frustum.hpp"
 #include "gamestate.hpp"
 #include "input.hpp" 
 #include "shader.hpp" 
+#include "terraingenerator.hpp"
+#include "terrainrenderer.hpp"
+#include "visibility.hpp"
+#include "occlusion.hpp"
 
 /*
  * For rand, srand and time
@@ -19,40 +25,8 @@
 #include <cstdlib>
 #include <ctime>
 
-/*
- * For std::function
- */
-#include <functional>
-
 using namespace sivox;
 
-namespace {
-    void foreach_block(Chunk &chunk, std::function<Block(Position pos, Block block)> f) {
-        for (s32 z = 0; z < Chunk::width; ++z) {
-            for (s32 x = 0; x < Chunk::width; ++x) {
-                for (s32 y = 0; y < Chunk::height; ++y) {
-                    chunk.set_block({x, y, z}, f({x, y, z}, chunk.block({x, y, z})));
-                }
-            }
-        }
-    }
-
-    void sine_mess(Chunk &chunk) {
-        f32 rand = static_cast<f32>(std::rand()) / static_cast<f32>(RAND_MAX);
-        f32 rand2 = static_cast<f32>(std::rand()) / static_cast<f32>(RAND_MAX);
-        f32 rand3 = static_cast<f32>(std::rand()) / static_cast<f32>(RAND_MAX);
-        f32 rand4 = static_cast<f32>(std::rand()) / static_cast<f32>(RAND_MAX);
-        foreach_block(chunk, [rand,rand2,rand3,rand4](Position p, Block b) { 
-            f32 zf = static_cast<f32>(p.z);
-            f32 xf = static_cast<f32>(p.x);
-            f32 sinZ = glm::sin(glm::radians(180 * rand + 180.0f * rand2 * (zf / 31.0f)));
-            f32 sinX = glm::sin(glm::radians(180 * rand3 + 180.0f * rand4 * (xf / 31.0f)));
-            f32 maxY = 10 + glm::clamp(20 * sinZ * sinX, 0.0f, 20.0f);
-            return p.y <= maxY ? 1 : 0;
-        });
-    }
-}
-
 s32 main(s32 argc, char *argv[]) {
     std::srand(std::time(nullptr)); // TODO: REMOVE!!!!!!!
     /*
@@ -82,7 +56,7 @@ s32 main(s32 argc, char *argv[]) {
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
 
     SDL_Window *window = SDL_CreateWindow(
-        "Simple Voxels (Esc - close, WASD - rotate camera, RF - zoom, I - invert vertical, Chunk[1 - random, 2 - less random, 3 - full, 4 - sine mess, 5 - clear])",
+        "Simple Voxels (Esc - close, WASD - rotate camera, RF - zoom, I - invert vertical, L - toggle LOD, Chunk[1 - random, 2 - less random, 3 - full, 4 - sine mess, 5 - clear, 6 - toggle a block])",
         SDL_WINDOWPOS_CENTERED,
         SDL_WINDOWPOS_CENTERED,
         1280,
@@ -125,8 +99,12 @@ s32 main(s32 argc, char *argv[]) {
         /*
          * Shaders
          */
+        const VertexFormat vertex_format = VertexFormat::Packed;
+
         Shader shader_none;
-        Shader shader_test = Shader::load("test");
+        Shader shader_test = vertex_format == VertexFormat::Packed
+            ? Shader::load("test", { "SIVOX_PACKED_VERTICES" })
+            : Shader::load("test");
 
         /*
          * Input handler
@@ -139,6 +117,10 @@ s32 main(s32 argc, char *argv[]) {
             ChunkRegenFull,
             ChunkClear,
             ChunkRegenSine,
+            ChunkToggleBlock,
+            ToggleLod,
+            ToggleCaveCulling,
+            ToggleOcclusionCulling,
         };
 
         enum class Axis {
@@ -156,6 +138,10 @@ s32 main(s32 argc, char *argv[]) {
         input.map_button(Button::ChunkRegenFull, ScanCode::Key3);
         input.map_button(Button::ChunkRegenSine, ScanCode::Key4);
         input.map_button(Button::ChunkClear, ScanCode::Key5);
+        input.map_button(Button::ChunkToggleBlock, ScanCode::Key6);
+        input.map_button(Button::ToggleLod, ScanCode::L);
+        input.map_button(Button::ToggleCaveCulling, ScanCode::C);
+        input.map_button(Button::ToggleOcclusionCulling, ScanCode::O);
 
         input.map_axis(Axis::CameraPitch, ScanCode::S, ScanCode::W);
         input.map_axis(Axis::CameraYaw, ScanCode::A, ScanCode::D);
@@ -164,9 +150,58 @@ s32 main(s32 argc, char *argv[]) {
         /*
          * Terrain test
          */
-        Chunk chunk;
-        sine_mess(chunk);
-        ChunkBuffers buffers(generate_mesh(chunk));
+        Terrain terrain(1, 1, 1);
+        const Position chunk_position = {0, 0, 0};
+        Chunk &chunk = *terrain.create_chunk(chunk_position);
+
+        /*
+         * Generation and meshing happen on worker threads. The results are picked up once per frame below.
+         */
+        const TerrainGenerator generator(static_cast<u64>(std::time(nullptr)));
+        ChunkProcessor processor(terrain, [&generator](Chunk &chunk, Position chunk_position) {
+            generator.generate(chunk, chunk_position);
+        });
+        processor.set_meshing_mode(MeshingMode::Greedy);
+        processor.set_vertex_format(vertex_format);
+        processor.set_partial_remeshing(true);
+
+        /*
+         * Level of detail by distance from the camera. Chunks are remeshed below whenever the level picked for them
+         * changes, which includes toggling LOD.
+         */
+        bool lod_enabled = false;
+        const LodDistances lod_distances;
+        glm::vec3 camera_position(0.0f);
+        auto lod_level = [&lod_enabled, &lod_distances, &camera_position](Position chunk_position) {
+            if (!lod_enabled) { return 0; }
+            glm::vec3 centre = (glm::vec3(chunk_position.x, chunk_position.y, chunk_position.z) + 0.5f)
+                * glm::vec3(Chunk::width, Chunk::height, Chunk::length);
+            return lod_distances.level(glm::length(centre - camera_position));
+        };
+        processor.set_lod_selector(lod_level);
+        std::unordered_map<Position, s32, PositionHash> chunk_lod_levels;
+
+        processor.submit(chunk_position);
+
+        TerrainRenderer renderer(vertex_format, SDL_GL_GetProcAddress);
+        ChunkCuller culler;
+        std::vector<Position> visible_chunks;
+
+        /*
+         * Chunks hidden behind solid rock are skipped by walking the visibility graph from the camera. Without cave
+         * culling, every chunk in the frustum is drawn.
+         */
+        bool cave_culling = true;
+        VisibilityGraph visibility;
+        const s32 view_distance = 16;
+
+        /*
+         * Chunks behind hills and mountains are culled against a small depth buffer of solid ground, drawn on a worker
+         * thread while the visibility graph is walked.
+         */
+        bool occlusion_culling = true;
+        OcclusionCuller occlusion;
+        std::vector<Position> drawn_chunks;
 
         const f32 camera_pitch_rate = 45.0f;
         const f32 camera_yaw_rate = 45.0f;
@@ -243,6 +278,15 @@ s32 main(s32 argc, char *argv[]) {
             if (input.button_pressed(Button::CameraInvert)) {
                 camera_inverted = !camera_inverted;
             }
+            if (input.button_pressed(Button::ToggleLod)) {
+                lod_enabled = !lod_enabled;
+            }
+            if (input.button_pressed(Button::ToggleCaveCulling)) {
+                cave_culling = !cave_culling;
+            }
+            if (input.button_pressed(Button::ToggleOcclusionCulling)) {
+                occlusion_culling = !occlusion_culling;
+            }
 
             camera_pitch += input.axis(Axis::CameraPitch) * camera_pitch_rate * static_cast<f32>(delta) * (camera_inverted ? 1.0f : -1.0f);
             camera_pitch = glm::clamp(camera_pitch, -90.0f, 90.0f);
@@ -253,23 +297,25 @@ s32 main(s32 argc, char *argv[]) {
             camera_fov = glm::clamp(camera_fov, 0.5f, 70.0f);
 
             if (input.button_pressed(Button::ChunkRegen)) {
-                foreach_block(chunk, [](Position p, Block b) { 
+                chunk.transform([](Position p, Block b) { 
                     return std::rand() % 10000 > 8000 ? 1 : 0;
                 });
-                buffers.set_mesh(generate_mesh(chunk));
+                chunk.set_state(ChunkState::Updated);
+                processor.submit(chunk_position);
             }
             if (input.button_pressed(Button::ChunkRegenRandomer)) {
-                foreach_block(chunk, [](Position p, Block b) { 
+                chunk.transform([](Position p, Block b) { 
                     return std::rand() % 10000 > 3000 ? 1 : 0;
                 });
-                buffers.set_mesh(generate_mesh(chunk));
+                chunk.set_state(ChunkState::Updated);
+                processor.submit(chunk_position);
             }
             if (input.button_pressed(Button::ChunkRegenSine)) {
                 f32 rand = static_cast<f32>(std::rand()) / static_cast<f32>(RAND_MAX);
                 f32 rand2 = static_cast<f32>(std::rand()) / static_cast<f32>(RAND_MAX);
                 f32 rand3 = static_cast<f32>(std::rand()) / static_cast<f32>(RAND_MAX);
                 f32 rand4 = static_cast<f32>(std::rand()) / static_cast<f32>(RAND_MAX);
-                foreach_block(chunk, [rand,rand2,rand3,rand4](Position p, Block b) { 
+                chunk.transform([rand,rand2,rand3,rand4](Position p, Block b) { 
                     f32 zf = static_cast<f32>(p.z);
                     f32 xf = static_cast<f32>(p.x);
                     f32 sinZ = glm::sin(glm::radians(180 * rand + 180.0f * rand2 * (zf / 31.0f)));
@@ -277,15 +323,52 @@ s32 main(s32 argc, char *argv[]) {
                     f32 maxY = 10 + glm::clamp(20 * sinZ * sinX, 0.0f, 20.0f);
                     return p.y <= maxY ? 1 : 0;
                 });
-                buffers.set_mesh(generate_mesh(chunk));
+                chunk.set_state(ChunkState::Updated);
+                processor.submit(chunk_position);
             }
             if (input.button_pressed(Button::ChunkRegenFull)) {
-                foreach_block(chunk, [](Position p, Block b) { return 1; });
-                buffers.set_mesh(generate_mesh(chunk));
+                chunk.fill(1);
+                chunk.set_state(ChunkState::Updated);
+                processor.submit(chunk_position);
             }
             if (input.button_pressed(Button::ChunkClear)) {
-                foreach_block(chunk, [](Position p, Block b) { return 0; });
-                buffers.set_mesh(generate_mesh(chunk));
+                chunk.fill(0);
+                chunk.set_state(ChunkState::Updated);
+                processor.submit(chunk_position);
+            }
+            if (input.button_pressed(Button::ChunkToggleBlock)) {
+                /*
+                 * A single block edit, which only remeshes the sections around the block.
+                 */
+                Position block_position = {std::rand() % Chunk::width, std::rand() % Chunk::height, std::rand() % Chunk::length};
+                chunk.set_block(block_position, chunk.block(block_position) == 0 ? 1 : 0);
+                processor.block_changed(chunk_position, block_position);
+            }
+
+            std::vector<ChunkProcessor::Result> results = processor.collect();
+            for (ChunkProcessor::Result const& result : results) {
+                if (result.section == ChunkProcessor::whole_chunk) {
+                    renderer.geometry().set_mesh(result.chunk_position, result.mesh);
+                }
+                else {
+                    renderer.geometry().set_section_mesh(result.chunk_position, result.section, result.mesh);
+                }
+                chunk_lod_levels[result.chunk_position] = result.lod_level;
+                visibility.set(result.chunk_position, result.connectivity);
+                occlusion.set(result.chunk_position, result.occluder);
+            }
+            for (auto const& pair : chunk_lod_levels) {
+                Chunk *lod_chunk = terrain.chunk(pair.first);
+                if (lod_chunk && lod_chunk->state() == ChunkState::Loaded && lod_level(pair.first) != pair.second) {
+                    lod_chunk->set_state(ChunkState::Updated);
+                    processor.submit(pair.first);
+                }
+            }
+            if (!results.empty()) {
+                culler.clear();
+                for (auto const& pair : renderer.geometry().entries()) {
+                    culler.add(pair.first);
+                }
             }
 
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -302,6 +385,7 @@ s32 main(s32 argc, char *argv[]) {
             view = glm::rotate(view, glm::radians(camera_pitch), glm::vec3(-1.0f, 0.0f, 0.0f));
             view = glm::rotate(view, glm::radians(camera_yaw), glm::vec3(0.0f, -1.0f, 0.0f));
             view = glm::translate(view, -glm::vec3(16.5f, 16.5f, 16.5f));
+            camera_position = glm::vec3(glm::inverse(view)[3]);
 
             glm::mat4 projection = glm::perspectiveFov(
                 glm::radians(camera_fov / 2.0f),
@@ -317,9 +401,22 @@ s32 main(s32 argc, char *argv[]) {
             glUniform1f(glGetUniformLocation(shader_test, "u_light_intensity"), 1.0f);
             glUniform1f(glGetUniformLocation(shader_test, "u_ambient_light"), 0.2f);
 
-            glBindVertexArray(buffers.vertex_array());
-            glDrawElements(GL_TRIANGLES, buffers.element_count(), GL_UNSIGNED_INT, 0);
-            glBindVertexArray(0);
+            const Frustum frustum = Frustum::from_matrix(projection * view * model);
+            if (occlusion_culling) {
+                occlusion.begin(projection * view * model, frustum);
+            }
+            if (cave_culling) {
+                visibility.traverse(camera_position, frustum, view_distance, visible_chunks);
+            }
+            else {
+                culler.cull(frustum, visible_chunks);
+            }
+            std::vector<Position> const* chunks_to_draw = &visible_chunks;
+            if (occlusion_culling) {
+                occlusion.cull(visible_chunks, drawn_chunks);
+                chunks_to_draw = &drawn_chunks;
+            }
+            renderer.draw(*chunks_to_draw, glGetUniformLocation(shader_test, "u_chunk_offsets"));
 
             glUseProgram(shader_none);
 
@@ -1,6 +1,18 @@
 #include "meshgenerator.hpp"
 #include <algorithm>
+#include <array>
+#include <cstdlib>
 #include <iterator>
+#include <utility>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define SIVOX_MESHING_SSE2
+#include <emmintrin.h>
+#endif
 
 namespace {
     const std::vector<sivox::ChunkMesh::Vertex> s_block_top {
@@ -63,10 +75,6 @@ namespace {
         { glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f) }
     };
 
-    const std::vector<sivox::ChunkMesh::TriangleIndex> s_triangles {
-        0, 1, 2, 2, 3, 0
-    };
-
     /*
      * Classic enum because enum class doesn't support bitwise ops. EWWW
      */
@@ -83,18 +91,518 @@ namespace {
         BLOCK_SIDES_ALL    = 0x03F
     };
 
-    void emit_block(sivox::ChunkMesh &mesh, sivox::Position position, BlockSides sides) {
+    /*
+     * Describes one of the six directions a face can point in.
+     * [normal_axis] is the axis the face is perpendicular to (0 = x, 1 = y, 2 = z), [u_axis] and [v_axis] are the two
+     * axes the face spans.
+     */
+    struct FaceDirection {
+        sivox::BlockFace face;
+        std::vector<sivox::ChunkMesh::Vertex> const& vertices;
+        sivox::s32 normal_axis;
+        sivox::s32 normal_sign;
+        sivox::s32 u_axis;
+        sivox::s32 v_axis;
+    };
+
+    /*
+     * Indexed by BlockFace.
+     */
+    const std::array<FaceDirection, 6> s_face_directions {{
+        { sivox::BlockFace::Top,    s_block_top,    1,  1, 0, 2 },
+        { sivox::BlockFace::Bottom, s_block_bottom, 1, -1, 0, 2 },
+        { sivox::BlockFace::Left,   s_block_left,   0, -1, 2, 1 },
+        { sivox::BlockFace::Right,  s_block_right,  0,  1, 2, 1 },
+        { sivox::BlockFace::Front,  s_block_front,  2, -1, 0, 1 },
+        { sivox::BlockFace::Back,   s_block_back,   2,  1, 0, 1 },
+    }};
+
+    /*
+     * Writes quads into a MeshTarget. With an [arena] behind it the target grows whenever it's full. Without one,
+     * quads that don't fit are counted but not written.
+     */
+    class MeshWriter {
+    public:
+        MeshWriter(sivox::MeshTarget const& target, sivox::MeshArena *arena) : m_target(target), m_arena(arena) {}
+
+        sivox::VertexFormat format() const { return m_target.format; }
+        sivox::MeshCounts counts() const { return m_counts; }
+
+        /*
+         * Makes room for [vertex_count] more vertices and [triangle_index_count] more indices. Returns false if there
+         * isn't any, in which case they're only counted.
+         */
+        bool begin(sivox::s32 vertex_count, sivox::s32 triangle_index_count) {
+            bool fits = m_counts.vertex_count + vertex_count <= m_target.vertex_capacity
+                && m_counts.triangle_index_count + triangle_index_count <= m_target.triangle_index_capacity;
+            if (!fits && m_arena) {
+                m_arena->reserve(m_target.format, m_counts.vertex_count + vertex_count,
+                    m_counts.triangle_index_count + triangle_index_count);
+                m_target = m_arena->target(m_target.format);
+                fits = true;
+            }
+            if (!fits) { end(vertex_count, triangle_index_count); }
+            return fits;
+        }
+
+        void end(sivox::s32 vertex_count, sivox::s32 triangle_index_count) {
+            m_counts.vertex_count += vertex_count;
+            m_counts.triangle_index_count += triangle_index_count;
+        }
+
+        template<class Vertex>
+        Vertex *vertices() { return static_cast<Vertex*>(m_target.vertices) + m_counts.vertex_count; }
+
+        sivox::ChunkMesh::TriangleIndex *triangles() { return m_target.triangles + m_counts.triangle_index_count; }
+
+    private:
+        sivox::MeshTarget m_target;
+        sivox::MeshArena *m_arena;
+        sivox::MeshCounts m_counts = {};
+    };
+
+    /*
+     * The two ways of splitting a quad into triangles, along the diagonal from corner 0 to 2 or from 1 to 3.
+     */
+    constexpr sivox::u8 s_quad_triangles[2][6] = {
+        { 0, 1, 2, 2, 3, 0 },
+        { 1, 2, 3, 3, 0, 1 },
+    };
+
+    /*
+     * Which diagonal to split a quad with corner occlusion [ao] along. (See face_ao.)
+     *
+     * Occlusion is interpolated linearly over each triangle rather than bilinearly over the quad, so the diagonal
+     * shows up as a crease whenever its two ends differ from the other two. Splitting along the more occluded diagonal
+     * keeps the shading symmetric around dark corners, which is the case that matters for terrain.
+     */
+    constexpr sivox::u32 quad_diagonal(sivox::u32 ao) {
+        const sivox::u32 diagonal_02 = (ao & 3u) + ((ao >> 4) & 3u);
+        const sivox::u32 diagonal_13 = ((ao >> 2) & 3u) + ((ao >> 6) & 3u);
+        return static_cast<sivox::u32>(diagonal_13 > diagonal_02);
     }
-}
 
-namespace sivox {
-    ChunkMesh generate_mesh(Chunk const& chunk) {
-        ChunkMesh mesh = {};
-        mesh.vertices.reserve(ChunkMesh::max_vertex_count);
-        mesh.triangles.reserve(ChunkMesh::max_triangle_index_count);
-        for (auto block : chunk) {
-            if (block.block != 0) {
-                Position p = block.position;
+    constexpr std::array<sivox::u8, 256> make_quad_diagonals_table() {
+        std::array<sivox::u8, 256> table = {};
+        for (sivox::u32 ao = 0; ao < 256; ++ao) {
+            table[ao] = static_cast<sivox::u8>(quad_diagonal(ao));
+        }
+        return table;
+    }
+
+    /*
+     * quad_diagonal of every corner occlusion, for emit_block.
+     */
+    constexpr std::array<sivox::u8, 256> s_quad_diagonals = make_quad_diagonals_table();
+
+    /*
+     * Emits a single quad covering the blocks from [min] to [min] + [size] (exclusive) facing in the direction of
+     * [face], in whichever vertex format [mesh] is written in. [ao] is the occlusion of each corner, as returned by
+     * face_ao.
+     *
+     * The face templates describe a unit block spanning 0..1 on x and y but -1..0 on z, so each template coordinate is
+     * stretched over [size] and the z coordinate is anchored at the far end of the range. For a size of 1 this is the
+     * same as offsetting the template by the block position.
+     */
+    void emit_quad(MeshWriter &mesh, sivox::BlockFace face, sivox::Position min, sivox::Position size, sivox::Block block,
+            sivox::u32 ao = 0) {
+        using namespace sivox;
+
+        if (!mesh.begin(4, 6)) { return; }
+        FaceDirection const& direction = s_face_directions[static_cast<s32>(face)];
+
+        const ChunkMesh::TriangleIndex start_index = static_cast<ChunkMesh::TriangleIndex>(mesh.counts().vertex_count);
+        ChunkMesh::PackedVertex *packed_vertices = mesh.vertices<ChunkMesh::PackedVertex>();
+        ChunkMesh::Vertex *vertices = mesh.vertices<ChunkMesh::Vertex>();
+        for (std::size_t i = 0; i < direction.vertices.size(); ++i) {
+            ChunkMesh::Vertex const& corner = direction.vertices[i];
+            Position position = {
+                min.x + static_cast<s32>(corner.position.x) * size.x,
+                min.y + static_cast<s32>(corner.position.y) * size.y,
+                min.z + size.z - 1 + static_cast<s32>(corner.position.z) * size.z
+            };
+
+            const u32 corner_ao = (ao >> (2 * i)) & 3u;
+            if (mesh.format() == VertexFormat::Packed) {
+                packed_vertices[i] = ChunkMesh::PackedVertex::pack(position, face, block, corner_ao);
+            }
+            else {
+                vertices[i] = { glm::vec3(position.x, position.y, position.z), corner.normal, static_cast<f32>(corner_ao) };
+            }
+        }
+
+        u8 const* quad = s_quad_triangles[quad_diagonal(ao)];
+        ChunkMesh::TriangleIndex *triangles = mesh.triangles();
+        for (std::size_t i = 0; i < 6; ++i) {
+            triangles[i] = start_index + quad[i];
+        }
+        mesh.end(4, 6);
+    }
+
+    /*
+     * The corners of each face of a unit block, as packed vertices of a block at the origin. Matches the face
+     * templates above. Indexed by BlockFace.
+     */
+    constexpr sivox::u32 pack_corner(sivox::u32 x, sivox::u32 y, sivox::s32 z, sivox::BlockFace face) {
+        using Packed = sivox::ChunkMesh::PackedVertex;
+        return x | (y << Packed::position_bits) | (static_cast<sivox::u32>(z + 1) << (2 * Packed::position_bits))
+            | (static_cast<sivox::u32>(face) << Packed::face_shift);
+    }
+
+    constexpr sivox::u32 s_face_corners[6][4] = {
+        {
+            pack_corner(0, 1, 0, sivox::BlockFace::Top), pack_corner(1, 1, 0, sivox::BlockFace::Top),
+            pack_corner(1, 1, -1, sivox::BlockFace::Top), pack_corner(0, 1, -1, sivox::BlockFace::Top)
+        },
+        {
+            pack_corner(0, 0, 0, sivox::BlockFace::Bottom), pack_corner(0, 0, -1, sivox::BlockFace::Bottom),
+            pack_corner(1, 0, -1, sivox::BlockFace::Bottom), pack_corner(1, 0, 0, sivox::BlockFace::Bottom)
+        },
+        {
+            pack_corner(0, 0, 0, sivox::BlockFace::Left), pack_corner(0, 1, 0, sivox::BlockFace::Left),
+            pack_corner(0, 1, -1, sivox::BlockFace::Left), pack_corner(0, 0, -1, sivox::BlockFace::Left)
+        },
+        {
+            pack_corner(1, 0, 0, sivox::BlockFace::Right), pack_corner(1, 0, -1, sivox::BlockFace::Right),
+            pack_corner(1, 1, -1, sivox::BlockFace::Right), pack_corner(1, 1, 0, sivox::BlockFace::Right)
+        },
+        {
+            pack_corner(0, 0, -1, sivox::BlockFace::Front), pack_corner(0, 1, -1, sivox::BlockFace::Front),
+            pack_corner(1, 1, -1, sivox::BlockFace::Front), pack_corner(1, 0, -1, sivox::BlockFace::Front)
+        },
+        {
+            pack_corner(0, 0, 0, sivox::BlockFace::Back), pack_corner(1, 0, 0, sivox::BlockFace::Back),
+            pack_corner(1, 1, 0, sivox::BlockFace::Back), pack_corner(0, 1, 0, sivox::BlockFace::Back)
+        },
+    };
+
+    /*
+     * Everything emit_block writes for one combination of exposed sides: the exposed faces and the packed corners of
+     * each of them, one after the other. Faces come in the same order the per block mesher emits them in.
+     */
+    struct BlockFaces {
+        sivox::s32 face_count;
+        sivox::s32 vertex_count;
+        sivox::s32 triangle_index_count;
+        sivox::u8 faces[6]; // BlockFace
+        sivox::u32 corners[24];
+    };
+
+    constexpr BlockFaces make_block_faces(sivox::u32 sides) {
+        using sivox::BlockFace;
+        constexpr sivox::u32 side_bits[6] = {
+            BLOCK_SIDES_TOP, BLOCK_SIDES_BOTTOM, BLOCK_SIDES_RIGHT, BLOCK_SIDES_LEFT, BLOCK_SIDES_FRONT, BLOCK_SIDES_BACK
+        };
+        constexpr BlockFace faces[6] = {
+            BlockFace::Top, BlockFace::Bottom, BlockFace::Right, BlockFace::Left, BlockFace::Front, BlockFace::Back
+        };
+
+        BlockFaces result = {};
+        for (sivox::s32 i = 0; i < 6; ++i) {
+            if ((sides & side_bits[i]) == 0) { continue; }
+            result.faces[result.face_count++] = static_cast<sivox::u8>(faces[i]);
+            result.triangle_index_count += 6;
+            for (sivox::s32 j = 0; j < 4; ++j) {
+                result.corners[result.vertex_count++] = s_face_corners[static_cast<sivox::s32>(faces[i])][j];
+            }
+        }
+        return result;
+    }
+
+    template<std::size_t... Sides>
+    constexpr std::array<BlockFaces, sizeof...(Sides)> make_block_faces_table(std::index_sequence<Sides...>) {
+        return {{ make_block_faces(static_cast<sivox::u32>(Sides))... }};
+    }
+
+    /*
+     * Indexed by a BlockSides bitmask.
+     */
+    constexpr std::array<BlockFaces, 64> s_block_faces = make_block_faces_table(std::make_index_sequence<64>());
+
+    /*
+     * The blocks that can occlude a corner of a face: the two beside it and the one diagonally across from it, all in
+     * the layer of blocks the face looks out onto. Offsets from the block the face belongs to.
+     */
+    struct CornerOccluders {
+        sivox::s32 side_a[3];
+        sivox::s32 side_b[3];
+        sivox::s32 diagonal[3];
+    };
+
+    constexpr CornerOccluders make_corner_occluders(sivox::s32 face, sivox::s32 corner) {
+        using Packed = sivox::ChunkMesh::PackedVertex;
+        constexpr sivox::s32 normals[6][3] = { {0, 1, 0}, {0, -1, 0}, {-1, 0, 0}, {1, 0, 0}, {0, 0, -1}, {0, 0, 1} };
+
+        /*
+         * Each corner is 0 or 1 along every axis (z included, since packed z is offset by one), so it lies towards -1
+         * or +1 along the two axes the face spans.
+         */
+        const sivox::u32 packed = s_face_corners[face][corner];
+        const sivox::s32 towards[3] = {
+            (packed & Packed::position_mask) ? 1 : -1,
+            ((packed >> Packed::position_bits) & Packed::position_mask) ? 1 : -1,
+            ((packed >> (2 * Packed::position_bits)) & Packed::position_mask) ? 1 : -1,
+        };
+        sivox::s32 normal_axis = 0;
+        while (normals[face][normal_axis] == 0) { ++normal_axis; }
+        const sivox::s32 a_axis = (normal_axis + 1) % 3;
+        const sivox::s32 b_axis = (normal_axis + 2) % 3;
+
+        CornerOccluders result = {};
+        for (sivox::s32 axis = 0; axis < 3; ++axis) {
+            result.side_a[axis] = normals[face][axis] + (axis == a_axis ? towards[axis] : 0);
+            result.side_b[axis] = normals[face][axis] + (axis == b_axis ? towards[axis] : 0);
+            result.diagonal[axis] = normals[face][axis] + (axis == normal_axis ? 0 : towards[axis]);
+        }
+        return result;
+    }
+
+    constexpr std::array<std::array<CornerOccluders, 4>, 6> make_corner_occluders_table() {
+        std::array<std::array<CornerOccluders, 4>, 6> table = {};
+        for (sivox::s32 face = 0; face < 6; ++face) {
+            for (sivox::s32 corner = 0; corner < 4; ++corner) {
+                table[face][corner] = make_corner_occluders(face, corner);
+            }
+        }
+        return table;
+    }
+
+    /*
+     * Indexed by BlockFace, then corner.
+     */
+    constexpr std::array<std::array<CornerOccluders, 4>, 6> s_corner_occluders = make_corner_occluders_table();
+
+    /*
+     * Ambient occlusion of each corner of the [face] of the block at [p], 2 bits per corner in template order: the
+     * number of blocks around the corner that are solid, except that a corner boxed in by both of the blocks beside it
+     * is fully occluded whatever the diagonal one is. 0 is no occlusion and 3 is the most. [is_solid] tells whether
+     * the block at a position is solid.
+     */
+    template<class IsSolid>
+    sivox::u32 face_ao(IsSolid const& is_solid, sivox::Position p, sivox::s32 face) {
+        using namespace sivox;
+
+        u32 ao = 0;
+        for (s32 corner = 0; corner < 4; ++corner) {
+            CornerOccluders const& o = s_corner_occluders[face][corner];
+            const u32 side_a = is_solid(p.x + o.side_a[0], p.y + o.side_a[1], p.z + o.side_a[2]);
+            const u32 side_b = is_solid(p.x + o.side_b[0], p.y + o.side_b[1], p.z + o.side_b[2]);
+            const u32 diagonal = is_solid(p.x + o.diagonal[0], p.y + o.diagonal[1], p.z + o.diagonal[2]);
+            ao |= (side_a + side_b + (diagonal | (side_a & side_b))) << (2 * corner);
+        }
+        return ao;
+    }
+
+    /*
+     * Normals of the float vertex format. Indexed by BlockFace.
+     */
+    const std::array<glm::vec3, 6> s_face_normals {{
+        glm::vec3(0.0f, 1.0f, 0.0f),
+        glm::vec3(0.0f, -1.0f, 0.0f),
+        glm::vec3(-1.0f, 0.0f, 0.0f),
+        glm::vec3(1.0f, 0.0f, 0.0f),
+        glm::vec3(0.0f, 0.0f, -1.0f),
+        glm::vec3(0.0f, 0.0f, 1.0f),
+    }};
+
+    /*
+     * Emits the faces [sides] of the block at [position], the same as calling emit_quad for each of them in turn. [ao]
+     * is the corner occlusion of each face as returned by face_ao, 8 bits per face in the order they're listed in
+     * s_block_faces, so it's 2 bits per vertex in the order they're emitted.
+     *
+     * Everything is looked up from s_block_faces, so the only loops are over the vertices and indices to copy, with
+     * the block's position and the corner's occlusion added to each corner on the way. The packed fields of a corner
+     * are at most 1 and those of a position at most 31, so adding the packed words never carries from one field into
+     * the next.
+     */
+    void emit_block(MeshWriter &mesh, sivox::Position position, sivox::u32 sides, sivox::Block block, sivox::u64 ao) {
+        using namespace sivox;
+        using Packed = ChunkMesh::PackedVertex;
+
+        BlockFaces const& faces = s_block_faces[sides & BLOCK_SIDES_ALL];
+        if (!mesh.begin(faces.vertex_count, faces.triangle_index_count)) { return; }
+
+        const ChunkMesh::TriangleIndex start_index = static_cast<ChunkMesh::TriangleIndex>(mesh.counts().vertex_count);
+        const u32 offset = static_cast<u32>(position.x)
+            | (static_cast<u32>(position.y) << Packed::position_bits)
+            | (static_cast<u32>(position.z) << (2 * Packed::position_bits));
+
+        if (mesh.format() == VertexFormat::Packed) {
+            Packed *vertices = mesh.vertices<Packed>();
+            const u32 material = static_cast<u32>(block.id);
+            for (s32 i = 0; i < faces.vertex_count; ++i) {
+                const u32 corner_ao = static_cast<u32>(ao >> (2 * i)) & Packed::ao_mask;
+                vertices[i] = { faces.corners[i] + offset + (corner_ao << Packed::ao_shift), material };
+            }
+        }
+        else {
+            ChunkMesh::Vertex *vertices = mesh.vertices<ChunkMesh::Vertex>();
+            for (s32 i = 0; i < faces.vertex_count; ++i) {
+                const u32 corner = faces.corners[i] + offset;
+                const u32 corner_ao = static_cast<u32>(ao >> (2 * i)) & Packed::ao_mask;
+                vertices[i] = {
+                    glm::vec3(
+                        static_cast<f32>(corner & Packed::position_mask),
+                        static_cast<f32>((corner >> Packed::position_bits) & Packed::position_mask),
+                        static_cast<f32>((corner >> (2 * Packed::position_bits)) & Packed::position_mask) - 1.0f
+                    ),
+                    s_face_normals[(corner >> Packed::face_shift) & Packed::face_mask],
+                    static_cast<f32>(corner_ao)
+                };
+            }
+        }
+
+        ChunkMesh::TriangleIndex *triangles = mesh.triangles();
+        for (s32 i = 0; i < faces.face_count; ++i) {
+            u8 const* quad = s_quad_triangles[s_quad_diagonals[(ao >> (8 * i)) & 0xFFu]];
+            const ChunkMesh::TriangleIndex face_start = start_index + static_cast<ChunkMesh::TriangleIndex>(4 * i);
+            for (s32 j = 0; j < 6; ++j) {
+                triangles[6 * i + j] = face_start + quad[j];
+            }
+        }
+        mesh.end(faces.vertex_count, faces.triangle_index_count);
+    }
+
+    /*
+     * Meshes the blocks of [chunk] from [begin] up to [end] (exclusive) on x, y and z, emitting every block [scale]
+     * blocks wide. The defaults mesh the whole of a Chunk or a ChunkNeighbourhood. A ChunkLod passes its cell counts
+     * and scale, and a chunk section the heights of the section. Faces are never merged across the edges of the box.
+     * Without [occlusion] every corner is left unoccluded.
+     */
+    template<class Volume>
+    void generate_mesh_greedy(Volume const& chunk, MeshWriter &mesh,
+            std::array<sivox::s32, 3> begin = { 0, 0, 0 },
+            std::array<sivox::s32, 3> end = { sivox::Chunk::width, sivox::Chunk::height, sivox::Chunk::length },
+            sivox::s32 scale = 1, bool occlusion = true) {
+        using namespace sivox;
+
+        constexpr s32 max_slice_area = std::max({
+            Chunk::width * Chunk::height,
+            Chunk::width * Chunk::length,
+            Chunk::height * Chunk::length
+        });
+
+        /*
+         * Block ids of the exposed faces in the current slice, with the face's corner occlusion from bit 16 up. 0 means
+         * there's no face there. Faces only merge with faces that have the same occlusion at every corner.
+         *
+         * That's enough for the merged quad to be shaded exactly like the faces it replaces. Neighbouring faces share
+         * the two corners between them, so when they have the same occlusion, it's the same at both ends along the
+         * axis they're neighbours on. Across the merged quad, occlusion then only changes along the other axis, and
+         * linear interpolation over its triangles gives the same values the faces had.
+         */
+        std::array<s32, max_slice_area> mask;
+        constexpr s32 ao_shift = 16;
+        static_assert(Block::max_id < (1 << ao_shift), "Block ids overlap the occlusion in the greedy mask");
+
+        auto to_position = [](std::array<s32, 3> const& coords) { return Position(coords[0], coords[1], coords[2]); };
+        auto is_solid = [&chunk](s32 x, s32 y, s32 z) { return static_cast<u32>(chunk.block({x, y, z}) != 0); };
+
+        for (FaceDirection const& direction : s_face_directions) {
+            const s32 u_begin = begin[direction.u_axis];
+            const s32 v_begin = begin[direction.v_axis];
+            const s32 u_size = end[direction.u_axis] - u_begin;
+            const s32 v_size = end[direction.v_axis] - v_begin;
+
+            for (s32 slice = begin[direction.normal_axis]; slice < end[direction.normal_axis]; ++slice) {
+                /*
+                 * Build the mask of exposed faces for this slice. Mask coordinates are relative to [begin].
+                 */
+                std::array<s32, 3> coords;
+                coords[direction.normal_axis] = slice;
+                for (s32 v = 0; v < v_size; ++v) {
+                    coords[direction.v_axis] = v_begin + v;
+                    for (s32 u = 0; u < u_size; ++u) {
+                        coords[direction.u_axis] = u_begin + u;
+
+                        Block block = chunk.block(to_position(coords));
+
+                        std::array<s32, 3> neighbour = coords;
+                        neighbour[direction.normal_axis] += direction.normal_sign;
+
+                        bool exposed = block != 0 && chunk.block(to_position(neighbour)) == 0;
+                        if (exposed) {
+                            u32 ao = occlusion ? face_ao(is_solid, to_position(coords), static_cast<s32>(direction.face)) : 0;
+                            mask[u + v * u_size] = block.id | static_cast<s32>(ao << ao_shift);
+                        }
+                        else {
+                            mask[u + v * u_size] = 0;
+                        }
+                    }
+                }
+
+                /*
+                 * Grab the largest rectangle starting at each remaining face, emit it and clear it from the mask.
+                 */
+                for (s32 v = 0; v < v_size; ++v) {
+                    for (s32 u = 0; u < u_size; ) {
+                        s32 id = mask[u + v * u_size];
+                        if (id == 0) {
+                            ++u;
+                            continue;
+                        }
+
+                        const u32 ao = static_cast<u32>(id) >> ao_shift;
+
+                        s32 width = 1;
+                        while (u + width < u_size && mask[u + width + v * u_size] == id) { ++width; }
+
+                        s32 height = 1;
+                        while (v + height < v_size) {
+                            bool row_matches = true;
+                            for (s32 i = 0; i < width; ++i) {
+                                if (mask[u + i + (v + height) * u_size] != id) {
+                                    row_matches = false;
+                                    break;
+                                }
+                            }
+                            if (!row_matches) { break; }
+                            ++height;
+                        }
+
+                        for (s32 j = 0; j < height; ++j) {
+                            for (s32 i = 0; i < width; ++i) {
+                                mask[u + i + (v + j) * u_size] = 0;
+                            }
+                        }
+
+                        std::array<s32, 3> min;
+                        min[direction.normal_axis] = slice;
+                        min[direction.u_axis] = u_begin + u;
+                        min[direction.v_axis] = v_begin + v;
+
+                        std::array<s32, 3> size;
+                        size[direction.normal_axis] = 1;
+                        size[direction.u_axis] = width;
+                        size[direction.v_axis] = height;
+
+                        for (s32 axis = 0; axis < 3; ++axis) {
+                            min[axis] *= scale;
+                            size[axis] *= scale;
+                        }
+                        emit_quad(mesh, direction.face, to_position(min), to_position(size), id & ((1 << ao_shift) - 1), ao);
+
+                        u += width;
+                    }
+                }
+            }
+        }
+    }
+
+    /*
+     * [Volume] is either a Chunk or a ChunkNeighbourhood. Both return air for positions they know nothing about.
+     */
+    template<class Volume>
+    void generate_mesh_per_block(Volume const& chunk, MeshWriter &mesh) {
+        using namespace sivox;
+
+        const Position unit = {1, 1, 1};
+        auto is_solid = [&chunk](s32 x, s32 y, s32 z) { return static_cast<u32>(chunk.block({x, y, z}) != 0); };
+        auto ao = [&](BlockFace face, Position p) { return face_ao(is_solid, p, static_cast<s32>(face)); };
+        for (s32 i = 0; i < Chunk::volume; ++i) {
+            Position p = Chunk::block_position(i);
+            Block block = chunk.block(p);
+            if (block != 0) {
                 s32 bitmask = BLOCK_SIDES_NONE;
                 if (chunk.block({p.x, p.y + 1, p.z}) == 0) { bitmask |= BLOCK_SIDES_TOP; }
                 if (chunk.block({p.x, p.y - 1, p.z}) == 0) { bitmask |= BLOCK_SIDES_BOTTOM; }
@@ -103,80 +611,514 @@ namespace sivox {
                 if (chunk.block({p.x, p.y, p.z + 1}) == 0) { bitmask |= BLOCK_SIDES_BACK; }
                 if (chunk.block({p.x, p.y, p.z - 1}) == 0) { bitmask |= BLOCK_SIDES_FRONT; }
 
-                s32 added_vertices = 0;
-
                 /*
-                 * TODO: 
-                 * Later we can jam all the separate arrays of vertices into a single huge lookup table with 2^6 = 64 entries.
-                 * Then we can just look up by passing the [bitmask] directly as the index.
+                 * One face at a time on purpose: this is the reference the table driven emit_block is tested against.
                  */
-                if (bitmask & BLOCK_SIDES_TOP) {
-                    s32 triangle_start_index = mesh.vertices.size(); 
-                    std::copy(s_block_top.begin(), s_block_top.end(), std::back_inserter(mesh.vertices));
-                    std::copy(s_triangles.begin(), s_triangles.end(), std::back_inserter(mesh.triangles));
-                    added_vertices += 4;
-
-                    for (auto it = mesh.triangles.end() - s_triangles.size(); it != mesh.triangles.end(); ++it) {
-                        *it += triangle_start_index;
-                    }
+                if (bitmask & BLOCK_SIDES_TOP) { emit_quad(mesh, BlockFace::Top, p, unit, block, ao(BlockFace::Top, p)); }
+                if (bitmask & BLOCK_SIDES_BOTTOM) { emit_quad(mesh, BlockFace::Bottom, p, unit, block, ao(BlockFace::Bottom, p)); }
+                if (bitmask & BLOCK_SIDES_RIGHT) { emit_quad(mesh, BlockFace::Right, p, unit, block, ao(BlockFace::Right, p)); }
+                if (bitmask & BLOCK_SIDES_LEFT) { emit_quad(mesh, BlockFace::Left, p, unit, block, ao(BlockFace::Left, p)); }
+                if (bitmask & BLOCK_SIDES_FRONT) { emit_quad(mesh, BlockFace::Front, p, unit, block, ao(BlockFace::Front, p)); }
+                if (bitmask & BLOCK_SIDES_BACK) { emit_quad(mesh, BlockFace::Back, p, unit, block, ao(BlockFace::Back, p)); }
+            }
+        }
+    }
+}
+
+namespace {
+    static_assert(sivox::Chunk::height == 32, "Column masks hold one bit per block of a column in a u32");
+
+    sivox::s32 count_trailing_zeros(sivox::u32 bits) {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, bits);
+        return static_cast<sivox::s32>(index);
+#else
+        return __builtin_ctz(bits);
+#endif
+    }
+
+    /*
+     * A column of blocks from y = -1 up to and including Chunk::height.
+     */
+    using Column = std::array<sivox::Block, sivox::Chunk::height + 2>;
+
+    /*
+     * Columns outside of a lone chunk are air, as are the blocks above and below it.
+     */
+    void load_column(sivox::Chunk const& chunk, sivox::s32 x, sivox::s32 z, Column &column) {
+        using namespace sivox;
+        column.fill(0);
+        if (x < 0 || x >= Chunk::width || z < 0 || z >= Chunk::length) { return; }
+
+        const s32 base = Chunk::block_index({x, 0, z});
+        for (s32 y = 0; y < Chunk::height; ++y) {
+            column[y + 1] = chunk.block_at(base + y);
+        }
+    }
+
+    void load_column(sivox::ChunkNeighbourhood const& neighbourhood, sivox::s32 x, sivox::s32 z, Column &column) {
+        sivox::Block const* blocks = neighbourhood.column(x, z);
+        std::copy(blocks, blocks + column.size(), column.begin());
+    }
+
+    /*
+     * Which blocks are solid, one bit per block, for every column of the chunk and its border, in three layers. Bit y
+     * of a column in the middle layer is set for a solid block at height y. The layers below and above are the same
+     * moved by a block, so bit y is set for a solid block at y - 1 and y + 1 respectively, taking in the blocks just
+     * below and above the chunk.
+     */
+    struct SolidColumns {
+        static constexpr sivox::s32 width = sivox::Chunk::width + 2;
+        static constexpr sivox::s32 length = sivox::Chunk::length + 2;
+        static constexpr sivox::s32 area = width * length;
+
+        std::array<sivox::u32, 3 * area> bits;
+
+        static sivox::s32 index(sivox::s32 x, sivox::s32 z) { return (x + 1) + (z + 1) * width; }
+
+        /*
+         * Offset from a column's index to the one [dx], [dz] away in the layer moved [dy] blocks. All of them are -1,
+         * 0 or 1.
+         */
+        static constexpr sivox::s32 offset(sivox::s32 dx, sivox::s32 dy, sivox::s32 dz) { return dx + dz * width + dy * area; }
+
+        sivox::u32 solid(sivox::s32 i) const { return bits[area + i]; }
+        sivox::u32 solid_below(sivox::s32 i) const { return bits[i]; }
+        sivox::u32 solid_above(sivox::s32 i) const { return bits[2 * area + i]; }
+        sivox::u32 at_offset(sivox::s32 i, sivox::s32 offset) const { return bits[area + i + offset]; }
+    };
+
+    /*
+     * face_ao for one face direction of every block in a column, bit sliced: bit y of planes[2 * corner] and
+     * planes[2 * corner + 1] are the low and high bits of that corner's occlusion for the block at height y.
+     */
+    struct alignas(16) ColumnOcclusion {
+        std::array<sivox::u32, 8> planes;
+
+        /*
+         * face_ao of the block at height [y], gathering bit y of every plane. With SSE2 that's moving bit y up to the
+         * sign bit of each plane and taking the sign bits.
+         */
+        sivox::u32 at(sivox::s32 y) const {
+#ifdef SIVOX_MESHING_SSE2
+            const __m128i shift = _mm_cvtsi32_si128(sivox::Chunk::height - 1 - y);
+            const __m128i low = _mm_sll_epi32(_mm_load_si128(reinterpret_cast<__m128i const*>(planes.data())), shift);
+            const __m128i high = _mm_sll_epi32(_mm_load_si128(reinterpret_cast<__m128i const*>(planes.data() + 4)), shift);
+            return static_cast<sivox::u32>(_mm_movemask_ps(_mm_castsi128_ps(low)) | (_mm_movemask_ps(_mm_castsi128_ps(high)) << 4));
+#else
+            sivox::u32 ao = 0;
+            for (sivox::s32 plane = 0; plane < 8; ++plane) {
+                ao |= ((planes[plane] >> y) & 1u) << plane;
+            }
+            return ao;
+#endif
+        }
+
+        /*
+         * Bit y is set if any corner of the face of the block at height y is occluded at all.
+         */
+        sivox::u32 occluded() const {
+            return planes[0] | planes[1] | planes[2] | planes[3] | planes[4] | planes[5] | planes[6] | planes[7];
+        }
+    };
+
+    constexpr std::array<std::array<std::array<sivox::s32, 3>, 4>, 6> make_column_occluders_table() {
+        std::array<std::array<std::array<sivox::s32, 3>, 4>, 6> table = {};
+        for (sivox::s32 face = 0; face < 6; ++face) {
+            for (sivox::s32 corner = 0; corner < 4; ++corner) {
+                CornerOccluders const& o = s_corner_occluders[face][corner];
+                table[face][corner][0] = SolidColumns::offset(o.side_a[0], o.side_a[1], o.side_a[2]);
+                table[face][corner][1] = SolidColumns::offset(o.side_b[0], o.side_b[1], o.side_b[2]);
+                table[face][corner][2] = SolidColumns::offset(o.diagonal[0], o.diagonal[1], o.diagonal[2]);
+            }
+        }
+        return table;
+    }
+
+    /*
+     * s_corner_occluders as SolidColumns offsets. Indexed by BlockFace, then corner, then side a, side b and diagonal.
+     */
+    constexpr std::array<std::array<std::array<sivox::s32, 3>, 4>, 6> s_column_occluders = make_column_occluders_table();
+
+    ColumnOcclusion column_occlusion(SolidColumns const& columns, sivox::s32 x, sivox::s32 z, sivox::s32 face) {
+        using namespace sivox;
+
+        const s32 i = SolidColumns::index(x, z);
+        ColumnOcclusion result;
+        for (s32 corner = 0; corner < 4; ++corner) {
+            std::array<s32, 3> const& offsets = s_column_occluders[face][corner];
+            const u32 side_a = columns.at_offset(i, offsets[0]);
+            const u32 side_b = columns.at_offset(i, offsets[1]);
+            const u32 diagonal = columns.at_offset(i, offsets[2]) | (side_a & side_b);
+
+            /*
+             * side_a + side_b + diagonal, 32 blocks at a time.
+             */
+            result.planes[2 * corner] = side_a ^ side_b ^ diagonal;
+            result.planes[2 * corner + 1] = (side_a & side_b) | (diagonal & (side_a ^ side_b));
+        }
+        return result;
+    }
+
+    template<class Volume>
+    void find_solid_columns(Volume const& chunk, SolidColumns &columns) {
+        using namespace sivox;
+
+        Column column;
+        for (s32 z = -1; z <= Chunk::length; ++z) {
+            for (s32 x = -1; x <= Chunk::width; ++x) {
+                load_column(chunk, x, z, column);
+                u32 solid = 0;
+                for (s32 y = 0; y < Chunk::height; ++y) {
+                    solid |= static_cast<u32>(column[y + 1] != 0) << y;
                 }
-                if (bitmask & BLOCK_SIDES_BOTTOM) {
-                    s32 triangle_start_index = mesh.vertices.size(); 
-                    std::copy(s_block_bottom.begin(), s_block_bottom.end(), std::back_inserter(mesh.vertices));
-                    std::copy(s_triangles.begin(), s_triangles.end(), std::back_inserter(mesh.triangles));
-                    added_vertices += 4;
-
-                    for (auto it = mesh.triangles.end() - s_triangles.size(); it != mesh.triangles.end(); ++it) {
-                        *it += triangle_start_index;
-                    }
+                s32 i = SolidColumns::index(x, z);
+                columns.bits[i] = (solid << 1) | static_cast<u32>(column[0] != 0);
+                columns.bits[SolidColumns::area + i] = solid;
+                columns.bits[2 * SolidColumns::area + i] = (solid >> 1) | (static_cast<u32>(column[Chunk::height + 1] != 0) << (Chunk::height - 1));
+            }
+        }
+    }
+
+    /*
+     * Same output as generate_mesh_per_block, finding the exposed faces of 32 blocks at a time. A face is exposed
+     * where its block is solid and the neighbouring block isn't, so each face direction is the column's solid bits
+     * with the neighbouring column's solid bits (or the column's own, shifted a block up or down) masked out.
+     * Faces are still emitted in block_index order and in the same order per block. Corner occlusion is looked up in
+     * the same solid bits, 32 blocks at a time, and only gathered per block for blocks with an occluded face.
+     *
+     * Occlusion makes meshing a chunk of random blocks, where nearly every face is occluded somewhere, about 1.5x as
+     * slow, and terrain about 1.25x. Besides the lookups, every vertex carries its own occlusion and every quad picks
+     * its own diagonal, so that part of the cost comes with the feature.
+     *
+     * Only blocks with their bit set in [rows] are meshed, which is how a single section of the chunk is meshed.
+     */
+    template<class Volume>
+    void generate_mesh_per_face(Volume const& chunk, MeshWriter &mesh, sivox::u32 rows = ~0u) {
+        using namespace sivox;
+
+        SolidColumns columns;
+        find_solid_columns(chunk, columns);
+
+        Column column;
+        for (s32 z = 0; z < Chunk::length; ++z) {
+            for (s32 x = 0; x < Chunk::width; ++x) {
+                s32 i = SolidColumns::index(x, z);
+                const u32 solid = columns.solid(i) & rows;
+                if (solid == 0) { continue; }
+
+                const u32 top = solid & ~columns.solid_above(i);
+                const u32 bottom = solid & ~columns.solid_below(i);
+                const u32 right = solid & ~columns.solid(SolidColumns::index(x + 1, z));
+                const u32 left = solid & ~columns.solid(SolidColumns::index(x - 1, z));
+                const u32 front = solid & ~columns.solid(SolidColumns::index(x, z - 1));
+                const u32 back = solid & ~columns.solid(SolidColumns::index(x, z + 1));
+
+                u32 exposed = top | bottom | right | left | front | back;
+                if (exposed == 0) { continue; }
+
+                /*
+                 * Indexed by BlockFace.
+                 */
+                const std::array<u32, 6> face_masks = { top, bottom, left, right, front, back };
+                std::array<ColumnOcclusion, 6> occlusion;
+                u32 occluded = 0;
+                for (s32 face = 0; face < 6; ++face) {
+                    if (face_masks[face] == 0) { continue; }
+                    occlusion[face] = column_occlusion(columns, x, z, face);
+                    occluded |= occlusion[face].occluded() & face_masks[face];
                 }
-                if (bitmask & BLOCK_SIDES_RIGHT) {
-                    s32 triangle_start_index = mesh.vertices.size(); 
-                    std::copy(s_block_right.begin(), s_block_right.end(), std::back_inserter(mesh.vertices));
-                    std::copy(s_triangles.begin(), s_triangles.end(), std::back_inserter(mesh.triangles));
-                    added_vertices += 4;
-
-                    for (auto it = mesh.triangles.end() - s_triangles.size(); it != mesh.triangles.end(); ++it) {
-                        *it += triangle_start_index;
+
+                load_column(chunk, x, z, column);
+                while (exposed != 0) {
+                    s32 y = count_trailing_zeros(exposed);
+                    exposed &= exposed - 1;
+
+                    const u32 sides = ((top >> y) & 1u) * BLOCK_SIDES_TOP
+                        | ((bottom >> y) & 1u) * BLOCK_SIDES_BOTTOM
+                        | ((left >> y) & 1u) * BLOCK_SIDES_LEFT
+                        | ((right >> y) & 1u) * BLOCK_SIDES_RIGHT
+                        | ((front >> y) & 1u) * BLOCK_SIDES_FRONT
+                        | ((back >> y) & 1u) * BLOCK_SIDES_BACK;
+
+                    BlockFaces const& faces = s_block_faces[sides];
+                    u64 ao = 0;
+                    if ((occluded >> y) & 1u) {
+                        for (s32 f = 0; f < faces.face_count; ++f) {
+                            ao |= static_cast<u64>(occlusion[faces.faces[f]].at(y)) << (8 * f);
+                        }
                     }
+                    emit_block(mesh, {x, y, z}, sides, column[y + 1], ao);
                 }
-                if (bitmask & BLOCK_SIDES_LEFT) {
-                    s32 triangle_start_index = mesh.vertices.size(); 
-                    std::copy(s_block_left.begin(), s_block_left.end(), std::back_inserter(mesh.vertices));
-                    std::copy(s_triangles.begin(), s_triangles.end(), std::back_inserter(mesh.triangles));
-                    added_vertices += 4;
-
-                    for (auto it = mesh.triangles.end() - s_triangles.size(); it != mesh.triangles.end(); ++it) {
-                        *it += triangle_start_index;
+            }
+        }
+    }
+
+    /*
+     * Meshes the blocks of [chunk] at heights [y_begin, y_end), by default all of them.
+     */
+    template<class Volume>
+    sivox::MeshCounts generate_mesh_into(Volume const& chunk, sivox::MeshingMode mode, MeshWriter writer,
+            sivox::s32 y_begin = 0, sivox::s32 y_end = sivox::Chunk::height) {
+        using namespace sivox;
+        switch (mode) {
+            case MeshingMode::Greedy:
+                generate_mesh_greedy(chunk, writer, { 0, y_begin, 0 }, { Chunk::width, y_end, Chunk::length });
+                break;
+            case MeshingMode::GreedyNoOcclusion:
+                generate_mesh_greedy(chunk, writer, { 0, y_begin, 0 }, { Chunk::width, y_end, Chunk::length }, 1, false);
+                break;
+            case MeshingMode::PerFace:
+            default: {
+                const u32 below_end = y_end >= 32 ? ~0u : (1u << y_end) - 1;
+                generate_mesh_per_face(chunk, writer, below_end & ~((1u << y_begin) - 1));
+                break;
+            }
+        }
+        return writer.counts();
+    }
+}
+
+namespace sivox {
+    MeshArena &MeshArena::for_this_thread() {
+        thread_local MeshArena arena;
+        return arena;
+    }
+
+    void MeshArena::reserve(VertexFormat format, s32 vertex_count, s32 triangle_index_count) {
+        /*
+         * Grows at least twofold, so an arena that starts out empty only reallocates a handful of times before it fits
+         * the biggest mesh it's asked for.
+         */
+        auto grow = [](auto &buffer, s32 count) {
+            std::size_t size = static_cast<std::size_t>(count);
+            if (size > buffer.size()) {
+                buffer.resize(std::max({ size, buffer.size() * 2, std::size_t(1024) }));
+            }
+        };
+        if (format == VertexFormat::Packed) { grow(m_packed_vertices, vertex_count); }
+        else { grow(m_vertices, vertex_count); }
+        grow(m_triangles, triangle_index_count);
+    }
+
+    MeshTarget MeshArena::target(VertexFormat format) {
+        MeshTarget target;
+        target.format = format;
+        if (format == VertexFormat::Packed) {
+            target.vertices = m_packed_vertices.data();
+            target.vertex_capacity = static_cast<s32>(m_packed_vertices.size());
+        }
+        else {
+            target.vertices = m_vertices.data();
+            target.vertex_capacity = static_cast<s32>(m_vertices.size());
+        }
+        target.triangles = m_triangles.data();
+        target.triangle_index_capacity = static_cast<s32>(m_triangles.size());
+        return target;
+    }
+
+    ChunkMesh MeshArena::to_mesh(VertexFormat format, MeshCounts counts) const {
+        ChunkMesh mesh = {};
+        mesh.format = format;
+        if (format == VertexFormat::Packed) {
+            mesh.packed_vertices.assign(m_packed_vertices.begin(), m_packed_vertices.begin() + counts.vertex_count);
+        }
+        else {
+            mesh.vertices.assign(m_vertices.begin(), m_vertices.begin() + counts.vertex_count);
+        }
+        mesh.triangles.assign(m_triangles.begin(), m_triangles.begin() + counts.triangle_index_count);
+        return mesh;
+    }
+
+    ChunkMesh generate_mesh_per_block(Chunk const& chunk, VertexFormat format) {
+        MeshArena &arena = MeshArena::for_this_thread();
+        MeshWriter writer(arena.target(format), &arena);
+        ::generate_mesh_per_block(chunk, writer);
+        return arena.to_mesh(format, writer.counts());
+    }
+
+    ChunkMesh generate_mesh_per_block(ChunkNeighbourhood const& neighbourhood, VertexFormat format) {
+        MeshArena &arena = MeshArena::for_this_thread();
+        MeshWriter writer(arena.target(format), &arena);
+        ::generate_mesh_per_block(neighbourhood, writer);
+        return arena.to_mesh(format, writer.counts());
+    }
+
+    ChunkMesh generate_mesh(Chunk const& chunk, MeshingMode mode, VertexFormat format) {
+        MeshArena &arena = MeshArena::for_this_thread();
+        return arena.to_mesh(format, generate_mesh(chunk, mode, format, arena));
+    }
+
+    ChunkMesh generate_mesh(ChunkNeighbourhood const& neighbourhood, MeshingMode mode, VertexFormat format) {
+        MeshArena &arena = MeshArena::for_this_thread();
+        return arena.to_mesh(format, generate_mesh(neighbourhood, mode, format, arena));
+    }
+
+    MeshCounts generate_mesh(Chunk const& chunk, MeshingMode mode, VertexFormat format, MeshArena &arena) {
+        return generate_mesh_into(chunk, mode, MeshWriter(arena.target(format), &arena));
+    }
+
+    MeshCounts generate_mesh(ChunkNeighbourhood const& neighbourhood, MeshingMode mode, VertexFormat format, MeshArena &arena) {
+        return generate_mesh_into(neighbourhood, mode, MeshWriter(arena.target(format), &arena));
+    }
+
+    MeshCounts generate_mesh(Chunk const& chunk, MeshingMode mode, MeshTarget const& target) {
+        return generate_mesh_into(chunk, mode, MeshWriter(target, nullptr));
+    }
+
+    MeshCounts generate_mesh(ChunkNeighbourhood const& neighbourhood, MeshingMode mode, MeshTarget const& target) {
+        return generate_mesh_into(neighbourhood, mode, MeshWriter(target, nullptr));
+    }
+
+    MeshCounts generate_section_mesh(ChunkNeighbourhood const& neighbourhood, s32 section, MeshingMode mode, VertexFormat format, MeshArena &arena) {
+        const s32 y_begin = section * Chunk::section_height;
+        return generate_mesh_into(neighbourhood, mode, MeshWriter(arena.target(format), &arena), y_begin, y_begin + Chunk::section_height);
+    }
+
+    ChunkMesh generate_section_mesh(ChunkNeighbourhood const& neighbourhood, s32 section, MeshingMode mode, VertexFormat format) {
+        MeshArena &arena = MeshArena::for_this_thread();
+        return arena.to_mesh(format, generate_section_mesh(neighbourhood, section, mode, format, arena));
+    }
+
+    ChunkLod::ChunkLod(Chunk const& chunk, s32 level, LodRule rule) : m_level(std::clamp(level, 1, max_level)) {
+        const s32 cell = scale();
+        const s32 cell_volume = cell * cell * cell;
+
+        /*
+         * Block counts of the cell being downsampled. A cell with more distinct blocks than this is rare enough that
+         * ignoring the extra ones doesn't matter, as long as the solid count is right.
+         */
+        constexpr s32 max_candidates = 8;
+        std::array<Block, max_candidates> candidates;
+        std::array<s32, max_candidates> counts;
+
+        for (s32 z = 0; z < length(); ++z) {
+            for (s32 x = 0; x < width(); ++x) {
+                for (s32 y = 0; y < height(); ++y) {
+                    s32 candidate_count = 0;
+                    s32 solid = 0;
+                    for (s32 bz = z * cell; bz < (z + 1) * cell; ++bz) {
+                        for (s32 bx = x * cell; bx < (x + 1) * cell; ++bx) {
+                            for (s32 by = y * cell; by < (y + 1) * cell; ++by) {
+                                Block block = chunk.block({bx, by, bz});
+                                if (block == 0) { continue; }
+                                ++solid;
+
+                                s32 i = 0;
+                                while (i < candidate_count && candidates[i] != block) { ++i; }
+                                if (i == candidate_count) {
+                                    if (candidate_count == max_candidates) { continue; }
+                                    candidates[candidate_count] = block;
+                                    counts[candidate_count++] = 0;
+                                }
+                                ++counts[i];
+                            }
+                        }
                     }
-                }
-                if (bitmask & BLOCK_SIDES_FRONT) {
-                    s32 triangle_start_index = mesh.vertices.size(); 
-                    std::copy(s_block_front.begin(), s_block_front.end(), std::back_inserter(mesh.vertices));
-                    std::copy(s_triangles.begin(), s_triangles.end(), std::back_inserter(mesh.triangles));
-                    added_vertices += 4;
-
-                    for (auto it = mesh.triangles.end() - s_triangles.size(); it != mesh.triangles.end(); ++it) {
-                        *it += triangle_start_index;
+
+                    const bool border = x == 0 || y == 0 || z == 0 || x == width() - 1 || y == height() - 1 || z == length() - 1;
+                    const bool is_solid = rule == LodRule::AnySolid || border ? solid > 0 : 2 * solid >= cell_volume;
+
+                    Block block = 0;
+                    if (is_solid) {
+                        block = candidates[std::max_element(counts.begin(), counts.begin() + candidate_count) - counts.begin()];
                     }
+                    m_data[y + x * height() + z * height() * width()] = block;
                 }
-                if (bitmask & BLOCK_SIDES_BACK) {
-                    s32 triangle_start_index = mesh.vertices.size(); 
-                    std::copy(s_block_back.begin(), s_block_back.end(), std::back_inserter(mesh.vertices));
-                    std::copy(s_triangles.begin(), s_triangles.end(), std::back_inserter(mesh.triangles));
-                    added_vertices += 4;
-
-                    for (auto it = mesh.triangles.end() - s_triangles.size(); it != mesh.triangles.end(); ++it) {
-                        *it += triangle_start_index;
-                    }
+            }
+        }
+    }
+
+    ChunkMesh generate_mesh(ChunkLod const& lod, VertexFormat format) {
+        MeshArena &arena = MeshArena::for_this_thread();
+        return arena.to_mesh(format, generate_mesh(lod, format, arena));
+    }
+
+    MeshCounts generate_mesh(ChunkLod const& lod, VertexFormat format, MeshArena &arena) {
+        MeshWriter writer(arena.target(format), &arena);
+        generate_mesh_greedy(lod, writer, { 0, 0, 0 }, { lod.width(), lod.height(), lod.length() }, lod.scale());
+        return writer.counts();
+    }
+
+    ChunkNeighbourhood::ChunkNeighbourhood(Chunk const& chunk) {
+        m_data.fill(0);
+        for (s32 i = 0; i < Chunk::volume; ++i) {
+            Position p = Chunk::block_position(i);
+            m_data[padded_index(p)] = chunk.block(p);
+        }
+    }
+
+    ChunkNeighbourhood::ChunkNeighbourhood(Terrain const& terrain, Position chunk_position) :
+        ChunkNeighbourhood(terrain, chunk_position, Chunk::all_sections) {}
+
+    ChunkNeighbourhood::ChunkNeighbourhood(Terrain const& terrain, Position chunk_position, u32 sections) {
+        /*
+         * Bit y + 1 is set for each height to copy, from y = -1 up to Chunk::height. The rest is air.
+         */
+        static_assert(height <= 64, "Copied heights are tracked one bit per height in a u64");
+        u64 rows = 0;
+        for (s32 section = 0; section < Chunk::section_count; ++section) {
+            if (sections & (1u << section)) {
+                rows |= ((u64(1) << (Chunk::section_height + 2)) - 1) << (section * Chunk::section_height);
+            }
+        }
+        if (sections != Chunk::all_sections) {
+            m_data.fill(0);
+        }
+
+        /*
+         * Grab the chunk and its 26 neighbours up front, indexed by offset + 1 on each axis.
+         */
+        std::array<Chunk const*, 27> chunks;
+        for (s32 dz = -1; dz <= 1; ++dz) {
+            for (s32 dx = -1; dx <= 1; ++dx) {
+                for (s32 dy = -1; dy <= 1; ++dy) {
+                    Position neighbour = {chunk_position.x + dx, chunk_position.y + dy, chunk_position.z + dz};
+                    chunks[(dy + 1) + (dx + 1) * 3 + (dz + 1) * 9] = terrain.chunk(neighbour);
                 }
+            }
+        }
+
+        auto offset = [](s32 coord, s32 size) { return coord < 0 ? 0 : (coord >= size ? 2 : 1); };
 
-                for (auto it = mesh.vertices.end() - added_vertices; it != mesh.vertices.end(); ++it) {
-                    it->position += glm::vec3(p.x, p.y, p.z);
+        for (s32 z = -1; z <= Chunk::length; ++z) {
+            for (s32 x = -1; x <= Chunk::width; ++x) {
+                for (s32 y = -1; y <= Chunk::height; ++y) {
+                    if (!((rows >> (y + 1)) & 1u)) { continue; }
+                    Chunk const* source = chunks[
+                        offset(y, Chunk::height) + offset(x, Chunk::width) * 3 + offset(z, Chunk::length) * 9
+                    ];
+                    Position p = {x, y, z};
+                    m_data[padded_index(p)] = source ? source->block({
+                        x & Chunk::width_mask,
+                        y & Chunk::height_mask,
+                        z & Chunk::length_mask
+                    }) : Block(0);
                 }
+            }
+        }
+    }
 
+    std::vector<Position> chunks_touching_block(Position chunk_position, Position block_position) {
+        /*
+         * The chunk offset the block touches along each axis, if any. Every combination of those offsets but the
+         * chunk itself is a neighbour.
+         */
+        auto side = [](s32 coord, s32 size) { return coord == 0 ? -1 : (coord == size - 1 ? 1 : 0); };
+        const s32 side_x = side(block_position.x, Chunk::width);
+        const s32 side_y = side(block_position.y, Chunk::height);
+        const s32 side_z = side(block_position.z, Chunk::length);
+
+        std::vector<Position> neighbours;
+        for (s32 z = 0; z <= std::abs(side_z); ++z) {
+            for (s32 x = 0; x <= std::abs(side_x); ++x) {
+                for (s32 y = 0; y <= std::abs(side_y); ++y) {
+                    if (x == 0 && y == 0 && z == 0) { continue; }
+                    neighbours.push_back({chunk_position.x + x * side_x, chunk_position.y + y * side_y, chunk_position.z + z * side_z});
+                }
             }
         }
-        return mesh;
-    } 
+        return neighbours;
+    }
 }
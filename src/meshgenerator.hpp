@@ -4,13 +4,41 @@
 
 #include "common.hpp"
 #include <glm/glm.hpp>
+#include <array>
 #include <vector>
 #include "voxelterrain.hpp"
 
 namespace sivox {
+    /*
+     * The direction a block face is pointing in.
+     * Packed vertices store this instead of a normal, so the order must match the normal table in test.vert.
+     */
+    enum class BlockFace : u32 {
+        Top,    // +y
+        Bottom, // -y
+        Left,   // -x
+        Right,  // +x
+        Front,  // -z
+        Back,   // +z
+    };
+
+    /*
+     * The vertex layouts a ChunkMesh can be generated with.
+     *   - Float
+     *     ChunkMesh::Vertex. A float position, a float normal and float ambient occlusion, 28 bytes.
+     *
+     *   - Packed
+     *     ChunkMesh::PackedVertex. Integer position, face, block id and ambient occlusion packed into 8 bytes.
+     */
+    enum class VertexFormat {
+        Float,
+        Packed,
+    };
+
     /*
      * Represents a single chunk's mesh.
-     * Contains a vector of vertices and a vector of triangle indices.
+     * Contains a vector of vertices and a vector of triangle indices. Depending on [format], the vertices are either in
+     * [vertices] or [packed_vertices]. The other vector is left empty.
      */
     struct ChunkMesh {
         static constexpr s32 max_vertex_count = Chunk::volume * 24; // 4 verts per face * 6 faces = 24 verts
@@ -18,19 +46,363 @@ namespace sivox {
         static constexpr s32 max_triangle_index_count = max_triangle_count * 3; // 3 indices per triangle
 
         using TriangleIndex = u32;
+        /*
+         * [ao] is the ambient occlusion of the vertex, from 0 for none to 3 for the most, the same as in PackedVertex.
+         */
         struct Vertex {
             glm::vec3 position;
             glm::vec3 normal;
+            f32 ao = 0.0f;
         };
 
+        /*
+         * Vertex positions are whole numbers within the chunk, so they fit in a few bits each:
+         *   [position_face]  x: bits 0-5, y: bits 6-11, z + 1: bits 12-17, face: bits 18-20, ao: bits 21-22
+         *   [material]       block id
+         *
+         * z is stored with an offset because block faces span -1..0 on z. (See the face templates in the mesh
+         * generator.) ao is how many of the blocks around the corner occlude it, baked in by the mesh generator.
+         */
+        struct PackedVertex {
+            u32 position_face;
+            u32 material;
+
+            static constexpr u32 position_bits = 6;
+            static constexpr u32 position_mask = (1u << position_bits) - 1;
+            static constexpr u32 face_shift = 3 * position_bits;
+            static constexpr u32 face_mask = 0x7;
+            static constexpr u32 ao_shift = face_shift + 3;
+            static constexpr u32 ao_mask = 0x3;
+
+            static PackedVertex pack(Position position, BlockFace face, Block block, u32 ao = 0) {
+                u32 packed = static_cast<u32>(position.x) & position_mask;
+                packed |= (static_cast<u32>(position.y) & position_mask) << position_bits;
+                packed |= (static_cast<u32>(position.z + 1) & position_mask) << (2 * position_bits);
+                packed |= (static_cast<u32>(face) & face_mask) << face_shift;
+                packed |= (ao & ao_mask) << ao_shift;
+                return { packed, static_cast<u32>(block.id) };
+            }
+
+            Position position() const {
+                return {
+                    static_cast<s32>(position_face & position_mask),
+                    static_cast<s32>((position_face >> position_bits) & position_mask),
+                    static_cast<s32>((position_face >> (2 * position_bits)) & position_mask) - 1
+                };
+            }
+            BlockFace face() const { return static_cast<BlockFace>((position_face >> face_shift) & face_mask); }
+            u32 ao() const { return (position_face >> ao_shift) & ao_mask; }
+            Block block() const { return static_cast<s32>(material); }
+        };
+
+        static_assert(Chunk::width < (1 << PackedVertex::position_bits), "Chunk too wide for packed vertices");
+        static_assert(Chunk::height < (1 << PackedVertex::position_bits), "Chunk too tall for packed vertices");
+        static_assert(Chunk::length < (1 << PackedVertex::position_bits), "Chunk too long for packed vertices");
+
+        VertexFormat format = VertexFormat::Float;
         std::vector<Vertex> vertices;
+        std::vector<PackedVertex> packed_vertices;
         std::vector<TriangleIndex> triangles;
+
+        s32 vertex_count() const {
+            return static_cast<s32>(format == VertexFormat::Packed ? packed_vertices.size() : vertices.size());
+        }
+
+        static s32 vertex_size(VertexFormat format) {
+            return format == VertexFormat::Packed ? sizeof(PackedVertex) : sizeof(Vertex);
+        }
+    };
+
+    /*
+     * Caller owned memory to generate a mesh into: room for [vertex_capacity] vertices in [format], which are
+     * ChunkMesh::Vertex or ChunkMesh::PackedVertex to match, and [triangle_index_capacity] triangle indices. Can point
+     * into a MeshArena or straight into mapped GPU staging memory.
+     */
+    struct MeshTarget {
+        VertexFormat format = VertexFormat::Float;
+        void *vertices = nullptr;
+        s32 vertex_capacity = 0;
+        ChunkMesh::TriangleIndex *triangles = nullptr;
+        s32 triangle_index_capacity = 0;
+    };
+
+    /*
+     * The size of a generated mesh.
+     */
+    struct MeshCounts {
+        s32 vertex_count = 0;
+        s32 triangle_index_count = 0;
+    };
+
+    /*
+     * Reusable scratch memory for meshes. It grows to fit the largest mesh generated into it and never shrinks, so
+     * once it has warmed up, generating a mesh allocates nothing. Meant to be kept per thread (see for_this_thread)
+     * and read back or uploaded right after each mesh is generated, since the next one overwrites it.
+     */
+    class MeshArena {
+    public:
+        /*
+         * An arena owned by the calling thread, for as long as the thread lives.
+         */
+        static MeshArena &for_this_thread();
+
+        /*
+         * Makes room for at least [vertex_count] vertices in [format] and [triangle_index_count] indices, keeping
+         * whatever is already there.
+         */
+        void reserve(VertexFormat format, s32 vertex_count, s32 triangle_index_count);
+
+        MeshTarget target(VertexFormat format);
+
+        ChunkMesh::Vertex const* vertices() const { return m_vertices.data(); }
+        ChunkMesh::PackedVertex const* packed_vertices() const { return m_packed_vertices.data(); }
+        ChunkMesh::TriangleIndex const* triangles() const { return m_triangles.data(); }
+
+        void const* vertex_data(VertexFormat format) const {
+            return format == VertexFormat::Packed ? static_cast<void const*>(packed_vertices()) : static_cast<void const*>(vertices());
+        }
+
+        /*
+         * Copies the first [counts] of the arena into a ChunkMesh of its own.
+         */
+        ChunkMesh to_mesh(VertexFormat format, MeshCounts counts) const;
+
+        s64 memory_usage() const {
+            return static_cast<s64>(m_vertices.capacity() * sizeof(ChunkMesh::Vertex)
+                + m_packed_vertices.capacity() * sizeof(ChunkMesh::PackedVertex)
+                + m_triangles.capacity() * sizeof(ChunkMesh::TriangleIndex));
+        }
+
+    private:
+        std::vector<ChunkMesh::Vertex> m_vertices;
+        std::vector<ChunkMesh::PackedVertex> m_packed_vertices;
+        std::vector<ChunkMesh::TriangleIndex> m_triangles;
+    };
+
+    /*
+     * Returns the unit normal of [face].
+     */
+    inline glm::vec3 face_normal(BlockFace face) {
+        switch (face) {
+            case BlockFace::Top:    return glm::vec3(0.0f, 1.0f, 0.0f);
+            case BlockFace::Bottom: return glm::vec3(0.0f, -1.0f, 0.0f);
+            case BlockFace::Left:   return glm::vec3(-1.0f, 0.0f, 0.0f);
+            case BlockFace::Right:  return glm::vec3(1.0f, 0.0f, 0.0f);
+            case BlockFace::Front:  return glm::vec3(0.0f, 0.0f, -1.0f);
+            case BlockFace::Back:
+            default:                return glm::vec3(0.0f, 0.0f, 1.0f);
+        }
+    }
+
+    /*
+     * How generate_mesh turns exposed block faces into geometry.
+     *   - PerFace
+     *     Every exposed face becomes its own quad. Simple and fast to generate.
+     *
+     *   - Greedy
+     *     Coplanar exposed faces of the same block id are merged into as few rectangles as possible. Takes longer to
+     *     generate but looks identical and usually has several times fewer vertices.
+     *
+     *   - GreedyNoOcclusion
+     *     Same as Greedy without ambient occlusion, so every coplanar face of the same block id can merge. For when
+     *     vertex count matters more than shading.
+     *
+     * Otherwise, each vertex gets ambient occlusion from the blocks around its corner, and quads are split into
+     * triangles along whichever diagonal shades them more evenly. Greedy only merges faces with the same occlusion at
+     * every corner, which keeps the shading exactly that of PerFace.
+     */
+    enum class MeshingMode {
+        PerFace,
+        Greedy,
+        GreedyNoOcclusion,
+    };
+
+    /*
+     * A copy of a chunk's blocks along with a one block border taken from the surrounding chunks.
+     *
+     * Meshing a chunk on its own treats everything outside of it as air, which means every face on the chunk border is
+     * emitted, even when the neighbouring chunk is solid there. Meshing a neighbourhood culls those faces correctly.
+     * Since it's a copy, it's also safe to hand to another thread while the terrain keeps changing.
+     */
+    class ChunkNeighbourhood {
+    public:
+        static constexpr s32 width = Chunk::width + 2;
+        static constexpr s32 height = Chunk::height + 2;
+        static constexpr s32 length = Chunk::length + 2;
+        static constexpr s32 volume = width * height * length;
+
+        /*
+         * Just the [chunk], surrounded by air.
+         */
+        explicit ChunkNeighbourhood(Chunk const& chunk);
+
+        /*
+         * The chunk at [chunk_position] along with a border from all 26 of its neighbours. Missing chunks are air.
+         */
+        ChunkNeighbourhood(Terrain const& terrain, Position chunk_position);
+
+        /*
+         * Same, only copying what meshing the chunk's [sections] needs: the blocks of those sections and a layer
+         * above and below each of them. Everything else is air. (See generate_section_mesh)
+         */
+        ChunkNeighbourhood(Terrain const& terrain, Position chunk_position, u32 sections);
+
+        /*
+         * Returns the block at [p], relative to the chunk. Valid from -1 up to and including the chunk size on each
+         * axis. Anything further out is air.
+         */
+        Block block(Position p) const {
+            if (p.x >= -1 && p.x <= Chunk::width && p.y >= -1 && p.y <= Chunk::height && p.z >= -1 && p.z <= Chunk::length) {
+                return m_data[padded_index(p)];
+            }
+            else { return 0; }
+        }
+
+        /*
+         * The column of blocks at [x], [z], from y = -1 up to and including Chunk::height. [x] and [z] must be
+         * within the border. Columns are contiguous since y is the lowest part of the index.
+         */
+        Block const* column(s32 x, s32 z) const { return &m_data[padded_index({x, -1, z})]; }
+
+    private:
+        std::array<Block, volume> m_data;
+
+        static s32 padded_index(Position p) {
+            return (p.y + 1) + (p.x + 1) * height + (p.z + 1) * height * width;
+        }
+    };
+
+    /*
+     * How ChunkLod decides whether a cell of blocks is solid.
+     *   - Majority
+     *     Solid if at least half of its blocks are. Keeps the overall shape of the terrain, but thin walls, pillars
+     *     and overhangs disappear and surfaces may move down by up to half a cell.
+     *
+     *   - AnySolid
+     *     Solid if any of its blocks are. Nothing disappears, but everything grows by up to a cell and caves close up.
+     */
+    enum class LodRule {
+        Majority,
+        AnySolid,
+    };
+
+    /*
+     * A chunk downsampled for drawing far away: every cube of 2, 4 or 8 blocks on a side (level 1, 2 or 3) becomes
+     * a single cell, which is either air or the most common solid block in it. Meshing it gives a mesh in the same
+     * block coordinates as the full chunk, with each cell drawn as a block [scale()] blocks wide.
+     *
+     * Chunks at different levels don't line up at their shared faces, so LOD meshes come with skirts: the chunk is
+     * meshed on its own, which keeps the faces on its border, and cells on the border are always downsampled with
+     * LodRule::AnySolid. A coarse surface then never sits below the full detail surface next to it, and wherever it
+     * sits above, its border faces close the gap. Between two coarse chunks, each one's border faces cover the
+     * other's side.
+     */
+    class ChunkLod {
+    public:
+        static constexpr s32 max_level = 3;
+        static_assert(Chunk::width >> max_level > 0 && Chunk::height >> max_level > 0 && Chunk::length >> max_level > 0,
+            "Chunk too small for the coarsest LOD");
+
+        /*
+         * [level] is clamped to 1..max_level.
+         */
+        ChunkLod(Chunk const& chunk, s32 level, LodRule rule = LodRule::Majority);
+
+        s32 level() const { return m_level; }
+        s32 scale() const { return 1 << m_level; }
+        s32 width() const { return Chunk::width >> m_level; }
+        s32 height() const { return Chunk::height >> m_level; }
+        s32 length() const { return Chunk::length >> m_level; }
+
+        /*
+         * Returns the cell at [p], in cells. Anything outside of the chunk is air.
+         */
+        Block block(Position p) const {
+            if (p.x >= 0 && p.x < width() && p.y >= 0 && p.y < height() && p.z >= 0 && p.z < length()) {
+                return m_data[p.y + p.x * height() + p.z * height() * width()];
+            }
+            else { return 0; }
+        }
+
+    private:
+        s32 m_level;
+        std::array<Block, (Chunk::volume >> 3)> m_data;
+    };
+
+    /*
+     * Picks the ChunkLod level to draw a chunk with by its distance from the camera. Each level covers twice the
+     * distance of the one before it, so a cell stays roughly the same size on screen from one level to the next.
+     */
+    struct LodDistances {
+        f32 full_detail = 128.0f; // Chunks closer than this, in blocks, are drawn at full detail
+        s32 max_level = ChunkLod::max_level;
+
+        s32 level(f32 distance) const {
+            s32 level = 0;
+            for (f32 limit = full_detail; level < max_level && distance >= limit; limit *= 2.0f) { ++level; }
+            return level;
+        }
     };
 
     /*
      * Generates a mesh for a single [chunk].
+     * Everything outside of the chunk is treated as air.
+     *
+     * The mesh is generated in the calling thread's MeshArena and then copied into vectors of exactly its size.
+     */
+    ChunkMesh generate_mesh(Chunk const& chunk, MeshingMode mode = MeshingMode::PerFace, VertexFormat format = VertexFormat::Float);
+
+    /*
+     * Generates a mesh for the chunk in the middle of [neighbourhood], culling faces hidden by neighbouring chunks.
+     */
+    ChunkMesh generate_mesh(ChunkNeighbourhood const& neighbourhood, MeshingMode mode = MeshingMode::PerFace, VertexFormat format = VertexFormat::Float);
+
+    /*
+     * Same as generate_mesh, writing into the start of [arena], which grows if the mesh doesn't fit. Returns the size
+     * of the mesh.
+     */
+    MeshCounts generate_mesh(Chunk const& chunk, MeshingMode mode, VertexFormat format, MeshArena &arena);
+    MeshCounts generate_mesh(ChunkNeighbourhood const& neighbourhood, MeshingMode mode, VertexFormat format, MeshArena &arena);
+
+    /*
+     * Same as generate_mesh, writing into [target]. Returns the size of the whole mesh, even if it doesn't fit: in
+     * that case nothing past the target's capacity is written and the caller can try again with a bigger target.
+     */
+    MeshCounts generate_mesh(Chunk const& chunk, MeshingMode mode, MeshTarget const& target);
+    MeshCounts generate_mesh(ChunkNeighbourhood const& neighbourhood, MeshingMode mode, MeshTarget const& target);
+
+    /*
+     * Generates the mesh of a single [section] of the chunk in the middle of [neighbourhood]: only the faces of blocks
+     * in the section, looking at the blocks around them as usual. Meshing each section on its own covers the same
+     * faces as meshing the whole chunk, except that greedy meshing doesn't merge faces across sections, so a chunk can
+     * be drawn as its sections and have just the changed ones remeshed. (See Chunk::dirty_sections)
+     */
+    ChunkMesh generate_section_mesh(ChunkNeighbourhood const& neighbourhood, s32 section, MeshingMode mode = MeshingMode::PerFace,
+        VertexFormat format = VertexFormat::Float);
+    MeshCounts generate_section_mesh(ChunkNeighbourhood const& neighbourhood, s32 section, MeshingMode mode, VertexFormat format,
+        MeshArena &arena);
+
+    /*
+     * Same as generate_mesh with MeshingMode::PerFace, looking up the six neighbours of each block one at a time
+     * rather than finding the exposed faces of whole columns at once. Gives the same mesh, vertex for vertex.
+     */
+    ChunkMesh generate_mesh_per_block(Chunk const& chunk, VertexFormat format = VertexFormat::Float);
+    ChunkMesh generate_mesh_per_block(ChunkNeighbourhood const& neighbourhood, VertexFormat format = VertexFormat::Float);
+
+    /*
+     * Generates a greedy mesh for [lod], in the block coordinates of the full chunk. Everything outside of the chunk is
+     * treated as air, which is what gives the mesh its skirts. (See ChunkLod)
+     */
+    ChunkMesh generate_mesh(ChunkLod const& lod, VertexFormat format = VertexFormat::Float);
+    MeshCounts generate_mesh(ChunkLod const& lod, VertexFormat format, MeshArena &arena);
+
+    /*
+     * Returns the positions of the chunks whose ChunkNeighbourhood border holds the block at [block_position] in the
+     * chunk at [chunk_position]: the ones sharing a face with it, and on an edge or corner of the chunk, the ones
+     * sharing that edge or corner, whose ambient occlusion it darkens. Their meshes need regenerating when that block
+     * changes.
      */
-    ChunkMesh generate_mesh(Chunk const& chunk);
+    std::vector<Position> chunks_touching_block(Position chunk_position, Position block_position);
 };
 
 #endif // SIVOX_GAME_MESHGENERATOR_HPP
@@ -0,0 +1,559 @@
+#include "occlusion.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define SIVOX_OCCLUSION_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace {
+    using sivox::f32;
+    using sivox::s32;
+    using sivox::u32;
+
+    constexpr f32 far_depth = std::numeric_limits<f32>::infinity();
+
+    /*
+     * Finds the longest run of set bits in [layers], one bit per layer of the chunk.
+     */
+    sivox::OccluderSlab longest_run(u32 layers) {
+        sivox::OccluderSlab slab;
+        s32 begin = 0;
+        for (s32 y = 0; y <= sivox::Chunk::height; ++y) {
+            if (y < sivox::Chunk::height && ((layers >> y) & 1u)) { continue; }
+            if (y - begin > slab.y_end - slab.y_begin) {
+                slab.y_begin = begin;
+                slab.y_end = y;
+            }
+            begin = y + 1;
+        }
+        return slab;
+    }
+
+    /*
+     * Builds the slabs from [solid_column], which gives a column of solid bits per x, z, bit y set for a solid block
+     * at height y.
+     */
+    template<typename SolidColumn>
+    sivox::ChunkOccluder occluder_from_columns(SolidColumn solid_column) {
+        using sivox::ChunkOccluder;
+        ChunkOccluder occluder;
+        for (s32 cell_z = 0; cell_z < ChunkOccluder::cells; ++cell_z) {
+            for (s32 cell_x = 0; cell_x < ChunkOccluder::cells; ++cell_x) {
+                u32 layers = ~0u;
+                for (s32 z = cell_z * ChunkOccluder::cell_size; z < (cell_z + 1) * ChunkOccluder::cell_size && layers != 0; ++z) {
+                    for (s32 x = cell_x * ChunkOccluder::cell_size; x < (cell_x + 1) * ChunkOccluder::cell_size; ++x) {
+                        layers &= solid_column(x, z);
+                    }
+                }
+                occluder.slabs[cell_x + cell_z * ChunkOccluder::cells] = longest_run(layers);
+            }
+        }
+        return occluder;
+    }
+
+    struct ClipPoint {
+        f32 x, y, w;
+    };
+
+    struct ScreenPoint {
+        f32 x, y;
+    };
+
+    ClipPoint transform(glm::mat4 const& m, glm::vec3 p) {
+        return {
+            m[0][0] * p.x + m[1][0] * p.y + m[2][0] * p.z + m[3][0],
+            m[0][1] * p.x + m[1][1] * p.y + m[2][1] * p.z + m[3][1],
+            m[0][3] * p.x + m[1][3] * p.y + m[2][3] * p.z + m[3][3]
+        };
+    }
+
+    std::array<ClipPoint, 8> box_corners(glm::mat4 const& m, glm::vec3 min, glm::vec3 max) {
+        std::array<ClipPoint, 8> corners;
+        for (s32 i = 0; i < 8; ++i) {
+            corners[i] = transform(m, glm::vec3((i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z));
+        }
+        return corners;
+    }
+
+    f32 cross(ScreenPoint o, ScreenPoint a, ScreenPoint b) {
+        return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+    }
+
+    /*
+     * Replaces [points] with their convex hull, counter-clockwise. Andrew's monotone chain.
+     */
+    void convex_hull(std::vector<ScreenPoint> &points, std::vector<ScreenPoint> &hull) {
+        std::sort(points.begin(), points.end(), [](ScreenPoint a, ScreenPoint b) {
+            return a.x < b.x || (a.x == b.x && a.y < b.y);
+        });
+        const s32 n = static_cast<s32>(points.size());
+        hull.resize(2 * n);
+        s32 k = 0;
+        for (s32 i = 0; i < n; ++i) {
+            while (k >= 2 && cross(hull[k - 2], hull[k - 1], points[i]) <= 0.0f) { --k; }
+            hull[k++] = points[i];
+        }
+        for (s32 i = n - 2, lower = k + 1; i >= 0; --i) {
+            while (k >= lower && cross(hull[k - 2], hull[k - 1], points[i]) <= 0.0f) { --k; }
+            hull[k++] = points[i];
+        }
+        hull.resize(std::max(k - 1, 0));
+        points.swap(hull);
+    }
+
+    /*
+     * Clips the convex polygon [points] to the side of the line where [inside] is non-negative. Sutherland-Hodgman.
+     */
+    template<typename Inside>
+    void clip_polygon(std::vector<ScreenPoint> &points, std::vector<ScreenPoint> &clipped, Inside inside) {
+        clipped.clear();
+        for (std::size_t i = 0; i < points.size(); ++i) {
+            ScreenPoint a = points[i];
+            ScreenPoint b = points[(i + 1) % points.size()];
+            f32 da = inside(a), db = inside(b);
+            if (da >= 0.0f) { clipped.push_back(a); }
+            if ((da >= 0.0f) != (db >= 0.0f)) {
+                f32 t = da / (da - db);
+                clipped.push_back({ a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t });
+            }
+        }
+        points.swap(clipped);
+    }
+
+    /*
+     * A linear function of the screen position, a * x + b * y + c. Used for the edges of a polygon being drawn, where
+     * a pixel's center is on the inside of the edge when it's non-negative, and for the 1 / w of its faces.
+     */
+    struct Edge {
+        f32 a, b, c;
+    };
+}
+
+namespace sivox {
+    bool ChunkOccluder::empty() const {
+        return std::all_of(slabs.begin(), slabs.end(), [](OccluderSlab slab) { return slab.empty(); });
+    }
+
+    ChunkOccluder ChunkOccluder::compute(Chunk const& chunk) {
+        if (chunk.bits_per_block() == 0) {
+            ChunkOccluder occluder;
+            occluder.slabs.fill(chunk.block_at(0) != 0 ? OccluderSlab{ 0, Chunk::height } : OccluderSlab{});
+            return occluder;
+        }
+        return occluder_from_columns([&chunk](s32 x, s32 z) {
+            const s32 base = Chunk::block_index({x, 0, z});
+            u32 solid = 0;
+            for (s32 y = 0; y < Chunk::height; ++y) {
+                solid |= static_cast<u32>(chunk.block_at(base + y) != 0) << y;
+            }
+            return solid;
+        });
+    }
+
+    ChunkOccluder ChunkOccluder::compute(ChunkNeighbourhood const& neighbourhood) {
+        return occluder_from_columns([&neighbourhood](s32 x, s32 z) {
+            Block const* column = neighbourhood.column(x, z) + 1;
+            u32 solid = 0;
+            for (s32 y = 0; y < Chunk::height; ++y) {
+                solid |= static_cast<u32>(column[y] != 0) << y;
+            }
+            return solid;
+        });
+    }
+
+    void ChunkOccluder::boxes(Position chunk_position, std::vector<std::pair<glm::vec3, glm::vec3>> &boxes) const {
+        const glm::vec3 origin(
+            chunk_position.x * Chunk::width,
+            chunk_position.y * Chunk::height,
+            chunk_position.z * Chunk::length - 1
+        );
+
+        /*
+         * Merged along x into runs of equal slabs, then runs along z with the same x extent.
+         */
+        std::array<bool, cells * cells> done = {};
+        for (s32 z = 0; z < cells; ++z) {
+            for (s32 x = 0; x < cells; ++x) {
+                const OccluderSlab slab = slabs[x + z * cells];
+                if (done[x + z * cells] || slab.empty()) { continue; }
+
+                s32 x_end = x + 1;
+                while (x_end < cells && !done[x_end + z * cells] && slabs[x_end + z * cells] == slab) { ++x_end; }
+                s32 z_end = z + 1;
+                while (z_end < cells) {
+                    bool same = true;
+                    for (s32 i = x; i < x_end && same; ++i) {
+                        same = !done[i + z_end * cells] && slabs[i + z_end * cells] == slab;
+                    }
+                    if (!same) { break; }
+                    ++z_end;
+                }
+                for (s32 j = z; j < z_end; ++j) {
+                    for (s32 i = x; i < x_end; ++i) {
+                        done[i + j * cells] = true;
+                    }
+                }
+
+                boxes.push_back({
+                    origin + glm::vec3(x * cell_size, slab.y_begin, z * cell_size),
+                    origin + glm::vec3(x_end * cell_size, slab.y_end, z_end * cell_size)
+                });
+            }
+        }
+    }
+
+    HiZBuffer::HiZBuffer(s32 width, s32 height) : m_view_projection(1.0f), m_pixels_per_unit(0.0f) {
+        /*
+         * Padding is never drawn into, so it stays far away. An odd row count gets a padding row too, so every level
+         * can be downsampled two whole rows at a time.
+         */
+        s32 level_width = std::max(width, 1), level_height = std::max(height, 1);
+        while (true) {
+            Level level;
+            level.width = level_width;
+            level.height = level_height;
+            level.stride = (level_width + 7) & ~7;
+            level.depth.assign(static_cast<std::size_t>(level.stride) * (level_height + (level_height & 1)), far_depth);
+            m_levels.push_back(std::move(level));
+
+            if (level_width == 1 && level_height == 1) { break; }
+            level_width = (level_width + 1) / 2;
+            level_height = (level_height + 1) / 2;
+        }
+    }
+
+    void HiZBuffer::clear(glm::mat4 const& view_projection) {
+        m_view_projection = view_projection;
+
+        /*
+         * The rows giving clip space x and y are scaled by the projection alone, as the view doesn't change lengths.
+         */
+        const glm::vec3 row_x(view_projection[0][0], view_projection[1][0], view_projection[2][0]);
+        const glm::vec3 row_y(view_projection[0][1], view_projection[1][1], view_projection[2][1]);
+        m_pixels_per_unit = std::max(glm::length(row_x) * width(), glm::length(row_y) * height()) * 0.5f;
+
+        std::fill(m_levels[0].depth.begin(), m_levels[0].depth.end(), far_depth);
+    }
+
+    void HiZBuffer::draw_box(glm::vec3 min, glm::vec3 max) {
+        draw<true>(min, max);
+    }
+
+    void HiZBuffer::draw_box_scalar(glm::vec3 min, glm::vec3 max) {
+        draw<false>(min, max);
+    }
+
+    template<bool Simd>
+    void HiZBuffer::draw(glm::vec3 min, glm::vec3 max) {
+        Level &level = m_levels[0];
+        const f32 width = static_cast<f32>(level.width);
+        const f32 height = static_cast<f32>(level.height);
+        const std::array<ClipPoint, 8> corners = box_corners(m_view_projection, min, max);
+
+        /*
+         * A ray enters the box through the last of the front facing planes it crosses, so its depth there is the
+         * furthest of the planes' depths. Each plane's 1 / w is a linear function of the screen position, and is
+         * taken at the furthest corner of the pixel. The camera maps to x = y = w = 0, which tells the front faces
+         * apart without having to know where it is.
+         */
+        std::array<Edge, 3> planes;
+        s32 plane_count = 0;
+        for (s32 axis = 0; axis < 3; ++axis) {
+            const s32 others[2] = { (axis + 1) % 3, (axis + 2) % 3 };
+            for (s32 side = 0; side < 2; ++side) {
+                ClipPoint p0 = corners[side << axis];
+                ClipPoint p1 = corners[(side << axis) | (1 << others[0])];
+                ClipPoint p2 = corners[(side << axis) | (1 << others[1])];
+                ClipPoint opposite = corners[(side ^ 1) << axis];
+
+                const f64 ux = p1.x - p0.x, uy = p1.y - p0.y, uw = p1.w - p0.w;
+                const f64 vx = p2.x - p0.x, vy = p2.y - p0.y, vw = p2.w - p0.w;
+                const f64 nx = uy * vw - uw * vy, ny = uw * vx - ux * vw, nw = ux * vy - uy * vx;
+                const f64 distance = nx * p0.x + ny * p0.y + nw * p0.w;
+                const f64 inside = nx * opposite.x + ny * opposite.y + nw * opposite.w - distance;
+                if (distance * inside <= 0.0) { continue; }
+
+                const f64 a = 2.0 * nx / (width * distance);
+                const f64 b = 2.0 * ny / (height * distance);
+                const f64 c = (nw - nx - ny) / distance - 0.5 * (std::abs(a) + std::abs(b));
+                planes[plane_count++] = { static_cast<f32>(a), static_cast<f32>(b), static_cast<f32>(c) };
+            }
+        }
+        if (plane_count == 0) { return; }
+
+        /*
+         * The part of the box in front of the near plane: its corners in front and the points where its edges cross.
+         * Since w is linear, the furthest of them is the furthest point of the box that can be seen, which bounds the
+         * depth where the planes get too steep to help.
+         */
+        thread_local std::vector<ScreenPoint> points, scratch;
+        points.clear();
+        f32 furthest = 0.0f;
+        auto add_point = [&](ClipPoint p) {
+            points.push_back({ (p.x / p.w * 0.5f + 0.5f) * width, (p.y / p.w * 0.5f + 0.5f) * height });
+            furthest = std::max(furthest, p.w);
+        };
+        for (s32 i = 0; i < 8; ++i) {
+            if (corners[i].w >= near_depth) { add_point(corners[i]); }
+            for (s32 axis = 1; axis < 8; axis <<= 1) {
+                if (i & axis) { continue; }
+                ClipPoint a = corners[i], b = corners[i | axis];
+                if ((a.w >= near_depth) != (b.w >= near_depth)) {
+                    f32 t = (near_depth - a.w) / (b.w - a.w);
+                    add_point({ a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, near_depth });
+                }
+            }
+        }
+        if (points.size() < 3) { return; }
+
+        /*
+         * Clipping to the screen keeps the edge equations small enough for floats to be exact where it matters.
+         */
+        convex_hull(points, scratch);
+        clip_polygon(points, scratch, [](ScreenPoint p) { return p.x; });
+        clip_polygon(points, scratch, [width](ScreenPoint p) { return width - p.x; });
+        clip_polygon(points, scratch, [](ScreenPoint p) { return p.y; });
+        clip_polygon(points, scratch, [height](ScreenPoint p) { return height - p.y; });
+        if (points.size() < 3) { return; }
+
+        /*
+         * The box cut by the near plane has at most 14 corners, and each side of the screen adds at most one more.
+         */
+        std::array<Edge, 18> edges;
+        if (points.size() > edges.size()) { return; }
+        s32 edge_count = 0;
+        f32 min_x = width, max_x = 0.0f, min_y = height, max_y = 0.0f;
+        for (std::size_t i = 0; i < points.size(); ++i) {
+            ScreenPoint p = points[i], q = points[(i + 1) % points.size()];
+            min_x = std::min(min_x, p.x);
+            max_x = std::max(max_x, p.x);
+            min_y = std::min(min_y, p.y);
+            max_y = std::max(max_y, p.y);
+
+            f32 dx = q.x - p.x, dy = q.y - p.y;
+            if (dx == 0.0f && dy == 0.0f) { continue; }
+            edges[edge_count++] = { -dy, dx, dy * p.x - dx * p.y };
+        }
+
+        const s32 x_begin = std::max(0, static_cast<s32>(std::floor(min_x)));
+        const s32 x_end = std::min(level.width, static_cast<s32>(std::ceil(max_x)));
+        const s32 y_begin = std::max(0, static_cast<s32>(std::floor(min_y)));
+        const s32 y_end = std::min(level.height, static_cast<s32>(std::ceil(max_y)));
+
+        /*
+         * Each row of a convex polygon is a single span. Its ends come from the edges, so the pixels in between only
+         * need their depth worked out.
+         */
+        std::array<f32, 3> plane_offsets;
+        for (s32 y = y_begin; y < y_end; ++y) {
+            const f32 center_y = static_cast<f32>(y) + 0.5f;
+            f32 span_min = static_cast<f32>(x_begin), span_max = static_cast<f32>(x_end - 1);
+            for (s32 e = 0; e < edge_count; ++e) {
+                const f32 offset = edges[e].b * center_y + edges[e].c;
+                if (edges[e].a > 0.0f) {
+                    span_min = std::max(span_min, std::ceil(-offset / edges[e].a - 0.5f));
+                } else if (edges[e].a < 0.0f) {
+                    span_max = std::min(span_max, std::floor(-offset / edges[e].a - 0.5f));
+                } else if (offset < 0.0f) {
+                    span_max = -1.0f;
+                }
+            }
+            if (span_max < span_min) { continue; }
+            const s32 span_begin = static_cast<s32>(span_min);
+            const s32 span_end = static_cast<s32>(span_max) + 1;
+
+            for (s32 p = 0; p < plane_count; ++p) {
+                plane_offsets[p] = planes[p].b * center_y + planes[p].c;
+            }
+            f32 *row = &level.depth[static_cast<std::size_t>(y) * level.stride];
+
+            s32 x = span_begin;
+#ifdef SIVOX_OCCLUSION_SSE
+            if constexpr (Simd) {
+                /*
+                 * Four pixels at a time from the group of four holding the first, leaving the ones outside the span
+                 * on either end alone.
+                 */
+                const __m128 first = _mm_set1_ps(static_cast<f32>(span_begin));
+                const __m128 last = _mm_set1_ps(static_cast<f32>(span_end));
+                const __m128 lane_offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+                const __m128 zero = _mm_setzero_ps();
+                const __m128 one = _mm_set1_ps(1.0f);
+                const __m128 box_furthest = _mm_set1_ps(furthest);
+                for (x = span_begin & ~3; x < span_end; x += 4) {
+                    const __m128 center_x = _mm_add_ps(_mm_set1_ps(static_cast<f32>(x)), lane_offsets);
+                    const __m128 inside = _mm_and_ps(_mm_cmpgt_ps(center_x, first), _mm_cmplt_ps(center_x, last));
+
+                    __m128 inverse = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[0].a), center_x), _mm_set1_ps(plane_offsets[0]));
+                    for (s32 p = 1; p < plane_count; ++p) {
+                        inverse = _mm_min_ps(inverse, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[p].a), center_x), _mm_set1_ps(plane_offsets[p])));
+                    }
+                    const __m128 in_front = _mm_cmpgt_ps(inverse, zero);
+                    const __m128 plane_depth = _mm_min_ps(_mm_div_ps(one, inverse), box_furthest);
+                    const __m128 depth = _mm_or_ps(_mm_and_ps(in_front, plane_depth), _mm_andnot_ps(in_front, box_furthest));
+
+                    const __m128 old_depth = _mm_loadu_ps(row + x);
+                    const __m128 new_depth = _mm_min_ps(old_depth, depth);
+                    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, new_depth), _mm_andnot_ps(inside, old_depth)));
+                }
+            }
+#endif
+            for (; x < span_end; ++x) {
+                const f32 center_x = static_cast<f32>(x) + 0.5f;
+                f32 inverse = planes[0].a * center_x + plane_offsets[0];
+                for (s32 p = 1; p < plane_count; ++p) {
+                    inverse = std::min(inverse, planes[p].a * center_x + plane_offsets[p]);
+                }
+                const f32 depth = inverse > 0.0f ? std::min(1.0f / inverse, furthest) : furthest;
+                row[x] = std::min(row[x], depth);
+            }
+        }
+    }
+
+    void HiZBuffer::build_pyramid() {
+        for (std::size_t l = 1; l < m_levels.size(); ++l) {
+            Level const& source = m_levels[l - 1];
+            Level &level = m_levels[l];
+            const s32 count = std::min(level.stride, source.stride / 2);
+            for (s32 y = 0; y < level.height; ++y) {
+                f32 const* top = &source.depth[static_cast<std::size_t>(2 * y) * source.stride];
+                f32 const* bottom = top + source.stride;
+                f32 *row = &level.depth[static_cast<std::size_t>(y) * level.stride];
+
+                s32 x = 0;
+#ifdef SIVOX_OCCLUSION_SSE
+                /*
+                 * Eight source texels from each row make four, the pairs split into even and odd lanes.
+                 */
+                for (; x + 4 <= count; x += 4) {
+                    __m128 left = _mm_max_ps(_mm_loadu_ps(top + 2 * x), _mm_loadu_ps(bottom + 2 * x));
+                    __m128 right = _mm_max_ps(_mm_loadu_ps(top + 2 * x + 4), _mm_loadu_ps(bottom + 2 * x + 4));
+                    __m128 even = _mm_shuffle_ps(left, right, _MM_SHUFFLE(2, 0, 2, 0));
+                    __m128 odd = _mm_shuffle_ps(left, right, _MM_SHUFFLE(3, 1, 3, 1));
+                    _mm_storeu_ps(row + x, _mm_max_ps(even, odd));
+                }
+#endif
+                for (; x < count; ++x) {
+                    row[x] = std::max(std::max(top[2 * x], top[2 * x + 1]), std::max(bottom[2 * x], bottom[2 * x + 1]));
+                }
+            }
+        }
+    }
+
+    bool HiZBuffer::occluded(glm::vec3 min, glm::vec3 max) const {
+        Level const& full = m_levels[0];
+        const f32 width = static_cast<f32>(full.width);
+        const f32 height = static_cast<f32>(full.height);
+
+        f32 nearest = far_depth;
+        f32 min_x = far_depth, max_x = -far_depth, min_y = far_depth, max_y = -far_depth;
+        for (ClipPoint p : box_corners(m_view_projection, min, max)) {
+            if (p.w < near_depth) { return false; }
+            nearest = std::min(nearest, p.w);
+            f32 x = (p.x / p.w * 0.5f + 0.5f) * width;
+            f32 y = (p.y / p.w * 0.5f + 0.5f) * height;
+            min_x = std::min(min_x, x);
+            max_x = std::max(max_x, x);
+            min_y = std::min(min_y, y);
+            max_y = std::max(max_y, y);
+        }
+
+        /*
+         * Only the part of the box on screen matters. Boxes entirely off screen are left to frustum culling. The
+         * rectangle is grown by a pixel to cover pixels whose center an occluder covers but the rest not quite.
+         */
+        if (max_x <= 0.0f || min_x >= width || max_y <= 0.0f || min_y >= height) { return false; }
+        const s32 x_begin = static_cast<s32>(std::max(0.0f, std::floor(min_x) - 1.0f));
+        const s32 x_end = static_cast<s32>(std::min(width, std::ceil(max_x) + 1.0f));
+        const s32 y_begin = static_cast<s32>(std::max(0.0f, std::floor(min_y) - 1.0f));
+        const s32 y_end = static_cast<s32>(std::min(height, std::ceil(max_y) + 1.0f));
+
+        s32 l = 0;
+        while (l + 1 < level_count()
+                && (((x_end - 1) >> l) - (x_begin >> l) > 3 || ((y_end - 1) >> l) - (y_begin >> l) > 3)) {
+            ++l;
+        }
+        Level const& level = m_levels[l];
+        for (s32 y = y_begin >> l; y <= (y_end - 1) >> l; ++y) {
+            f32 const* row = &level.depth[static_cast<std::size_t>(y) * level.stride];
+            for (s32 x = x_begin >> l; x <= (x_end - 1) >> l; ++x) {
+                if (row[x] >= nearest) { return false; }
+            }
+        }
+        return true;
+    }
+
+    f32 HiZBuffer::projected_size(glm::vec3 min, glm::vec3 max) const {
+        const glm::vec3 center = (min + max) * 0.5f;
+        const f32 radius = glm::length(max - min) * 0.5f;
+        const f32 depth = m_view_projection[0][3] * center.x + m_view_projection[1][3] * center.y
+            + m_view_projection[2][3] * center.z + m_view_projection[3][3];
+        if (depth - radius < near_depth) { return far_depth; }
+        return 2.0f * radius * m_pixels_per_unit / depth;
+    }
+
+    OcclusionCuller::OcclusionCuller(s32 width, s32 height) : m_buffer(width, height), m_worker(1) {}
+
+    OcclusionCuller::~OcclusionCuller() {
+        m_worker.wait_idle();
+    }
+
+    void OcclusionCuller::set(Position chunk_position, ChunkOccluder const& occluder) {
+        if (occluder.empty()) {
+            m_occluders.erase(chunk_position);
+        }
+        else {
+            m_occluders[chunk_position] = occluder;
+        }
+    }
+
+    void OcclusionCuller::begin(glm::mat4 const& view_projection, Frustum const& frustum) {
+        m_worker.wait_idle();
+
+        /*
+         * Copied so the occluders can keep changing while the worker draws.
+         */
+        m_drawn.clear();
+        for (auto const& pair : m_occluders) {
+            if (frustum.intersects(chunk_center(pair.first), chunk_extent())) {
+                m_drawn.push_back(pair);
+            }
+        }
+
+        m_started = true;
+        m_worker.submit([this, view_projection]() {
+            m_buffer.clear(view_projection);
+            for (auto const& pair : m_drawn) {
+                m_boxes.clear();
+                pair.second.boxes(pair.first, m_boxes);
+                for (auto const& box : m_boxes) {
+                    if (m_buffer.projected_size(box.first, box.second) >= min_occluder_size) {
+                        m_buffer.draw_box(box.first, box.second);
+                    }
+                }
+            }
+            m_buffer.build_pyramid();
+        });
+    }
+
+    HiZBuffer const& OcclusionCuller::buffer() {
+        m_worker.wait_idle();
+        return m_buffer;
+    }
+
+    void OcclusionCuller::cull(std::vector<Position> const& chunks, std::vector<Position> &visible) {
+        visible.clear();
+        HiZBuffer const& hiz = buffer();
+        const glm::vec3 extent = chunk_extent();
+        for (Position chunk_position : chunks) {
+            const glm::vec3 center = chunk_center(chunk_position);
+            if (!m_started || !hiz.occluded(center - extent, center + extent)) {
+                visible.push_back(chunk_position);
+            }
+        }
+    }
+}
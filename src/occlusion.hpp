@@ -0,0 +1,208 @@
+#pragma once
+#ifndef SIVOX_GAME_OCCLUSION_HPP
+#define SIVOX_GAME_OCCLUSION_HPP
+
+#include "common.hpp"
+#include <array>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+#include "frustum.hpp"
+#include "jobpool.hpp"
+#include "meshgenerator.hpp"
+#include "voxelterrain.hpp"
+
+namespace sivox {
+    /*
+     * A horizontal slab of blocks that is solid all the way through: layers [y_begin, y_end).
+     */
+    struct OccluderSlab {
+        s32 y_begin = 0;
+        s32 y_end = 0;
+
+        bool empty() const { return y_end <= y_begin; }
+
+        friend bool operator==(OccluderSlab a, OccluderSlab b) { return a.y_begin == b.y_begin && a.y_end == b.y_end; }
+        friend bool operator!=(OccluderSlab a, OccluderSlab b) { return !(a == b); }
+    };
+
+    /*
+     * The occluders of a chunk: a grid of cells across the chunk, each with the thickest slab of its columns that has
+     * no air in it at all. So they never cover any air. Solid chunks are one slab from top to bottom, and the ground
+     * under hills keeps a slab up to the lowest dip of each cell, which follows slopes much closer than one slab for
+     * the whole chunk would.
+     */
+    struct ChunkOccluder {
+        static constexpr s32 cells = 4;
+        static constexpr s32 cell_size = Chunk::width / cells;
+        static_assert(Chunk::width == Chunk::length, "Cells are square");
+
+        std::array<OccluderSlab, cells * cells> slabs; // Indexed by x + z * cells
+
+        bool empty() const;
+
+        /*
+         * A ChunkNeighbourhood gives the same as the chunk in the middle of it; the border is ignored.
+         */
+        static ChunkOccluder compute(Chunk const& chunk);
+        static ChunkOccluder compute(ChunkNeighbourhood const& neighbourhood);
+
+        /*
+         * Appends the boxes of the slabs, in blocks, for the chunk at [chunk_position]. Neighbouring cells with the
+         * same slab are merged into one box. Shifted along z like chunk_center() so they line up with the chunk's mesh.
+         */
+        void boxes(Position chunk_position, std::vector<std::pair<glm::vec3, glm::vec3>> &boxes) const;
+
+        friend bool operator==(ChunkOccluder const& a, ChunkOccluder const& b) { return a.slabs == b.slabs; }
+        friend bool operator!=(ChunkOccluder const& a, ChunkOccluder const& b) { return !(a == b); }
+    };
+
+    /*
+     * A low resolution depth buffer with a hierarchical-Z pyramid on top, for occlusion culling on the CPU.
+     *
+     * Occluder boxes are drawn as their silhouette, clipped to the near plane, covering the pixels whose centers it
+     * covers. Each pixel gets the depth where the ray through it enters the box, from the box's front faces, taken at
+     * the pixel's furthest corner and never beyond the furthest point of the box. Depth is the clip space w, which is
+     * the distance along the view direction for a perspective projection, and empty pixels are infinitely far away.
+     *
+     * Each level of the pyramid holds the furthest depth of the 2x2 texels under it. A box is occluded if its nearest
+     * point is behind the furthest depth of every texel its screen rectangle touches, grown by a pixel to make up for
+     * sampling pixel centers, tested at the level where the rectangle spans at most four texels each way. That isn't
+     * strictly conservative along the silhouettes of occluders, but close enough not to be seen.
+     *
+     * Rows are padded to a multiple of eight texels so drawing and downsampling can use SSE four texels at a time
+     * without running off the end of a row. Rows are only as aligned as std::vector makes them, which isn't 16 bytes
+     * everywhere, so loads and stores are unaligned.
+     */
+    class HiZBuffer {
+    public:
+        /*
+         * Occluders are clipped to this depth, and boxes reaching closer than this are never occluded.
+         */
+        static constexpr f32 near_depth = 1.0f;
+
+        HiZBuffer(s32 width, s32 height);
+
+        s32 width() const { return m_levels[0].width; }
+        s32 height() const { return m_levels[0].height; }
+
+        s32 level_count() const { return static_cast<s32>(m_levels.size()); }
+        s32 level_width(s32 level) const { return m_levels[level].width; }
+        s32 level_height(s32 level) const { return m_levels[level].height; }
+        f32 depth(s32 level, s32 x, s32 y) const { return m_levels[level].depth[x + y * m_levels[level].stride]; }
+
+        /*
+         * Empties the buffer and sets the [view_projection] matrix (projection * view) boxes are drawn and tested
+         * with. Must be called before drawing.
+         */
+        void clear(glm::mat4 const& view_projection);
+
+        /*
+         * Draws the occluder box from [min] to [max], in blocks, into the full resolution level.
+         */
+        void draw_box(glm::vec3 min, glm::vec3 max);
+
+        /*
+         * Same as draw_box(), one pixel at a time. Gives the same results.
+         */
+        void draw_box_scalar(glm::vec3 min, glm::vec3 max);
+
+        /*
+         * Fills in the coarser levels from the full resolution one. Call after drawing, before testing boxes.
+         */
+        void build_pyramid();
+
+        /*
+         * Whether the box from [min] to [max], in blocks, is certainly hidden behind the occluders drawn.
+         */
+        bool occluded(glm::vec3 min, glm::vec3 max) const;
+
+        /*
+         * Roughly how many pixels across the box from [min] to [max] is on screen, going by its bounding sphere.
+         * Boxes reaching closer than near_depth are infinitely big.
+         */
+        f32 projected_size(glm::vec3 min, glm::vec3 max) const;
+
+    private:
+        struct Level {
+            s32 width;
+            s32 height;
+            s32 stride;
+            std::vector<f32> depth;
+        };
+
+        std::vector<Level> m_levels;
+        glm::mat4 m_view_projection;
+        f32 m_pixels_per_unit; // Pixels per unit of size at depth 1
+
+        template<bool Simd>
+        void draw(glm::vec3 min, glm::vec3 max);
+    };
+
+    /*
+     * Culls chunks hidden behind the solid slabs of other chunks (see ChunkOccluder), as seen from the camera.
+     *
+     * begin() snapshots the occluders in the frustum and draws them into a HiZBuffer on a worker thread, so the
+     * caller can get on with the rest of the frame (e.g. VisibilityGraph::traverse) until cull() needs the buffer.
+     * It's meant for open terrain, where mountains and hills hide the valleys behind them but every chunk of air
+     * connects to every other, so cave culling can't do much.
+     */
+    class OcclusionCuller {
+    public:
+        static constexpr s32 default_width = 256;
+        static constexpr s32 default_height = 128;
+
+        /*
+         * Occluder boxes smaller than this many pixels across are skipped. They hide next to nothing, and there are a
+         * lot of them in the distance.
+         */
+        static constexpr f32 min_occluder_size = 16.0f;
+
+        explicit OcclusionCuller(s32 width = default_width, s32 height = default_height);
+        ~OcclusionCuller();
+
+        OcclusionCuller(OcclusionCuller const& other) = delete;
+        OcclusionCuller &operator=(OcclusionCuller const& other) = delete;
+
+        /*
+         * Adds the occluder of the chunk at [chunk_position], or replaces it. Empty occluders are removed. Changes
+         * are picked up by the next begin().
+         */
+        void set(Position chunk_position, ChunkOccluder const& occluder);
+        void remove(Position chunk_position) { m_occluders.erase(chunk_position); }
+        void clear() { m_occluders.clear(); }
+
+        s32 occluder_count() const { return static_cast<s32>(m_occluders.size()); }
+
+        /*
+         * Starts drawing the occluders intersecting the [frustum] into the buffer, as seen through [view_projection].
+         */
+        void begin(glm::mat4 const& view_projection, Frustum const& frustum);
+
+        /*
+         * Replaces the contents of [visible] with the [chunks] not occluded, in the same order. Waits for the buffer
+         * started by the last begin(); without one, nothing is culled.
+         */
+        void cull(std::vector<Position> const& chunks, std::vector<Position> &visible);
+
+        /*
+         * Waits for the buffer started by the last begin(). The buffer must not be looked at before this.
+         */
+        HiZBuffer const& buffer();
+
+    private:
+        std::unordered_map<Position, ChunkOccluder, PositionHash> m_occluders;
+        std::vector<std::pair<Position, ChunkOccluder>> m_drawn;  // Occluders being drawn, owned by the worker until it's done
+        std::vector<std::pair<glm::vec3, glm::vec3>> m_boxes;     // Scratch space for the worker
+        HiZBuffer m_buffer;
+        bool m_started = false;
+
+        /*
+         * Declared last so it's destroyed first: the worker must be joined before the buffer it draws into goes away.
+         */
+        JobPool m_worker;
+    };
+}
+
+#endif // SIVOX_GAME_OCCLUSION_HPP
@@ -0,0 +1,136 @@
+#include "rangeallocator.hpp"
+#include <algorithm>
+#include <cassert>
+
+namespace sivox {
+    RangeAllocator::RangeAllocator(s64 capacity) : m_capacity(0) {
+        grow(capacity);
+    }
+
+    RangeAllocator::Handle RangeAllocator::new_handle(Range range) {
+        if (!m_free_handles.empty()) {
+            Handle handle = m_free_handles.back();
+            m_free_handles.pop_back();
+            m_allocations[handle] = range;
+            return handle;
+        }
+        m_allocations.push_back(range);
+        return static_cast<Handle>(m_allocations.size() - 1);
+    }
+
+    RangeAllocator::Handle RangeAllocator::allocate(s64 size) {
+        assert(size >= 0);
+        if (size == 0) { return new_handle({ 0, 0 }); }
+
+        auto best = m_free_by_size.lower_bound(size);
+        if (best == m_free_by_size.end()) { return invalid_handle; }
+
+        s64 offset = best->second;
+        s64 free_size = best->first;
+        remove_free_range(m_free_by_offset.find(offset));
+
+        if (free_size > size) {
+            add_free_range(offset + size, free_size - size);
+        }
+
+        m_used += size;
+        return new_handle({ offset, size });
+    }
+
+    void RangeAllocator::free(Handle handle) {
+        if (!valid(handle)) { return; }
+
+        Range range = m_allocations[handle];
+        m_allocations[handle] = { 0, -1 };
+        m_free_handles.push_back(handle);
+
+        if (range.size > 0) {
+            m_used -= range.size;
+            add_free_range(range.offset, range.size);
+        }
+    }
+
+    void RangeAllocator::grow(s64 new_capacity) {
+        if (new_capacity <= m_capacity) { return; }
+        s64 old_capacity = m_capacity;
+        m_capacity = new_capacity;
+        add_free_range(old_capacity, new_capacity - old_capacity);
+    }
+
+    void RangeAllocator::add_free_range(s64 offset, s64 size) {
+        /*
+         * Merge with the free ranges directly before and after, if there are any.
+         */
+        auto next = m_free_by_offset.lower_bound(offset);
+        if (next != m_free_by_offset.begin()) {
+            auto previous = std::prev(next);
+            if (previous->first + previous->second == offset) {
+                offset = previous->first;
+                size += previous->second;
+                remove_free_range(previous);
+            }
+        }
+
+        next = m_free_by_offset.lower_bound(offset + size);
+        if (next != m_free_by_offset.end() && next->first == offset + size) {
+            size += next->second;
+            remove_free_range(next);
+        }
+
+        m_free_by_offset[offset] = size;
+        m_free_by_size.insert({ size, offset });
+    }
+
+    void RangeAllocator::remove_free_range(std::map<s64, s64>::iterator it) {
+        auto sizes = m_free_by_size.equal_range(it->second);
+        for (auto size_it = sizes.first; size_it != sizes.second; ++size_it) {
+            if (size_it->second == it->first) {
+                m_free_by_size.erase(size_it);
+                break;
+            }
+        }
+        m_free_by_offset.erase(it);
+    }
+
+    std::vector<RangeAllocator::Move> RangeAllocator::defragment() {
+        std::vector<Handle> live;
+        for (Handle handle = 0; handle < static_cast<Handle>(m_allocations.size()); ++handle) {
+            if (m_allocations[handle].size > 0) { live.push_back(handle); }
+        }
+        std::sort(live.begin(), live.end(), [this](Handle a, Handle b) {
+            return m_allocations[a].offset < m_allocations[b].offset;
+        });
+
+        /*
+         * Moving in offset order means every allocation only ever moves down into space that has already been vacated.
+         */
+        std::vector<Move> moves;
+        s64 offset = 0;
+        for (Handle handle : live) {
+            Range &range = m_allocations[handle];
+            if (range.offset != offset) {
+                moves.push_back({ handle, range.offset, offset, range.size });
+                range.offset = offset;
+            }
+            offset += range.size;
+        }
+
+        m_free_by_offset.clear();
+        m_free_by_size.clear();
+        if (offset < m_capacity) {
+            add_free_range(offset, m_capacity - offset);
+        }
+
+        return moves;
+    }
+
+    RangeAllocator::Stats RangeAllocator::stats() const {
+        Stats stats = {};
+        stats.capacity = m_capacity;
+        stats.used = m_used;
+        stats.largest_free = m_free_by_size.empty() ? 0 : m_free_by_size.rbegin()->first;
+        stats.allocation_count = static_cast<s32>(m_allocations.size() - m_free_handles.size());
+        stats.free_range_count = static_cast<s32>(m_free_by_offset.size());
+        return stats;
+    }
+}
@@ -0,0 +1,110 @@
+#pragma once
+#ifndef SIVOX_GAME_RANGEALLOCATOR_HPP
+#define SIVOX_GAME_RANGEALLOCATOR_HPP
+
+#include "common.hpp"
+#include <map>
+#include <vector>
+
+namespace sivox {
+    /*
+     * Hands out ranges of some linear resource (elements in a big GPU buffer, for example) using a free list.
+     *
+     * The allocator only does the bookkeeping and never touches the memory itself, so it can be used and tested
+     * without an OpenGL context. Allocations are referred to by handle rather than by offset because defragment()
+     * moves them around.
+     *
+     * Free ranges are kept sorted by offset, so neighbouring free ranges are merged as soon as they appear, and sorted
+     * by size, so allocation can pick the smallest free range that fits. (Best fit.)
+     */
+    class RangeAllocator {
+    public:
+        using Handle = s32;
+        static constexpr Handle invalid_handle = -1;
+
+        struct Range {
+            s64 offset;
+            s64 size;
+        };
+
+        /*
+         * Describes an allocation that defragment() moved from [from] to [to]. The contents must be copied over by
+         * the owner of the memory. The source and destination ranges of a single move may overlap.
+         */
+        struct Move {
+            Handle handle;
+            s64 from;
+            s64 to;
+            s64 size;
+        };
+
+        struct Stats {
+            s64 capacity;
+            s64 used;
+            s64 largest_free;
+            s32 allocation_count;
+            s32 free_range_count;
+
+            s64 free() const { return capacity - used; }
+            f32 occupancy() const { return capacity > 0 ? static_cast<f32>(used) / static_cast<f32>(capacity) : 0.0f; }
+
+            /*
+             * 0 when all the free space is in one piece, approaching 1 as it gets split up into small ranges.
+             */
+            f32 fragmentation() const {
+                return free() > 0 ? 1.0f - static_cast<f32>(largest_free) / static_cast<f32>(free()) : 0.0f;
+            }
+        };
+
+        explicit RangeAllocator(s64 capacity = 0);
+
+        /*
+         * Returns a handle to a new range of [size] units, or invalid_handle if there's no free range big enough.
+         * Zero sized allocations always succeed and take up no space.
+         */
+        Handle allocate(s64 size);
+
+        /*
+         * Returns the range of [handle] to the free list. Freeing invalid_handle does nothing.
+         */
+        void free(Handle handle);
+
+        Range range(Handle handle) const { return m_allocations[handle]; }
+        bool valid(Handle handle) const {
+            return handle >= 0 && handle < static_cast<Handle>(m_allocations.size()) && m_allocations[handle].size >= 0;
+        }
+
+        /*
+         * Extends the managed range to [new_capacity]. Shrinking is not supported.
+         */
+        void grow(s64 new_capacity);
+
+        /*
+         * Packs every allocation towards offset 0, in offset order, leaving a single free range at the end.
+         * Returns the moves that happened, in the order they must be applied in.
+         */
+        std::vector<Move> defragment();
+
+        s64 capacity() const { return m_capacity; }
+        Stats stats() const;
+
+    private:
+        s64 m_capacity;
+        s64 m_used = 0;
+
+        /*
+         * Indexed by handle. Unused handles have a negative size and are kept in m_free_handles for reuse.
+         */
+        std::vector<Range> m_allocations;
+        std::vector<Handle> m_free_handles;
+
+        std::map<s64, s64> m_free_by_offset;     // offset -> size
+        std::multimap<s64, s64> m_free_by_size;  // size -> offset
+
+        void add_free_range(s64 offset, s64 size);
+        void remove_free_range(std::map<s64, s64>::iterator it);
+        Handle new_handle(Range range);
+    };
+}
+
+#endif // SIVOX_GAME_RANGEALLOCATOR_HPP
@@ -0,0 +1,480 @@
+#include "regionfile.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <unordered_set>
+
+namespace fs = std::filesystem;
+
+namespace {
+    using namespace sivox;
+
+    constexpr char region_magic[4] = { 'S', 'V', 'R', 'G' };
+
+    /*
+     * New slots are rounded up so a chunk that grows a little can still be rewritten in place.
+     */
+    constexpr u32 slot_granularity = 256;
+
+    /*
+     * Slots closer than this in a batched read are prefetched as one range. Reading the gap is cheaper than another
+     * round trip to the disk.
+     */
+    constexpr u64 coalesce_gap = 16 * 1024;
+
+    void put_u32(std::vector<u8> &out, u32 value) {
+        for (s32 i = 0; i < 4; ++i) { out.push_back(static_cast<u8>(value >> (8 * i))); }
+    }
+
+    void put_u64(u8 *out, u64 value) {
+        for (s32 i = 0; i < 8; ++i) { out[i] = static_cast<u8>(value >> (8 * i)); }
+    }
+
+    void put_u32(u8 *out, u32 value) {
+        for (s32 i = 0; i < 4; ++i) { out[i] = static_cast<u8>(value >> (8 * i)); }
+    }
+
+    u32 get_u32(u8 const* in) {
+        u32 value = 0;
+        for (s32 i = 0; i < 4; ++i) { value |= static_cast<u32>(in[i]) << (8 * i); }
+        return value;
+    }
+
+    u64 get_u64(u8 const* in) {
+        u64 value = 0;
+        for (s32 i = 0; i < 8; ++i) { value |= static_cast<u64>(in[i]) << (8 * i); }
+        return value;
+    }
+
+    void put_varint(std::vector<u8> &out, u32 value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<u8>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<u8>(value));
+    }
+
+    bool get_varint(u8 const*& in, u8 const* end, u32 &value) {
+        value = 0;
+        for (s32 shift = 0; shift < 35; shift += 7) {
+            if (in == end) { return false; }
+            u8 byte = *in++;
+            value |= static_cast<u32>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) { return true; }
+        }
+        return false;
+    }
+}
+
+namespace sivox {
+    std::vector<u8> encode_chunk(Chunk const& chunk) {
+        std::vector<Block> palette;
+        std::vector<std::pair<u32, u32>> runs;
+
+        Block run_block = chunk.block_at(0);
+        u32 run_palette_index = 0;
+        u32 run_length = 0;
+        for (s32 i = 0; i <= Chunk::volume; ++i) {
+            if (i < Chunk::volume && run_length > 0 && chunk.block_at(i) == run_block) {
+                ++run_length;
+                continue;
+            }
+            if (run_length > 0) {
+                runs.push_back({ run_length, run_palette_index });
+            }
+            if (i == Chunk::volume) { break; }
+
+            run_block = chunk.block_at(i);
+            run_length = 1;
+            run_palette_index = static_cast<u32>(std::find(palette.begin(), palette.end(), run_block) - palette.begin());
+            if (run_palette_index == palette.size()) {
+                palette.push_back(run_block);
+            }
+        }
+
+        std::vector<u8> data;
+        data.reserve(4 + palette.size() * 4 + runs.size() * 3);
+        put_u32(data, static_cast<u32>(palette.size()));
+        for (Block block : palette) {
+            put_u32(data, static_cast<u32>(block.id));
+        }
+        for (auto const& run : runs) {
+            put_varint(data, run.first);
+            put_varint(data, run.second);
+        }
+        return data;
+    }
+
+    bool decode_chunk(u8 const* data, s64 size, Chunk &chunk) {
+        ChunkState state = chunk.state();
+        chunk = Chunk();
+        chunk.set_state(state);
+
+        u8 const* in = data;
+        u8 const* end = data + size;
+        if (size < 4) { return false; }
+
+        u32 palette_size = get_u32(in);
+        in += 4;
+        if (palette_size == 0 || palette_size > static_cast<u32>(Chunk::volume) || static_cast<s64>(palette_size) * 4 > end - in) {
+            return false;
+        }
+
+        std::vector<Block> palette(palette_size);
+        for (Block &block : palette) {
+            block = static_cast<s32>(get_u32(in));
+            in += 4;
+        }
+
+        s32 index = 0;
+        while (index < Chunk::volume) {
+            u32 run_length, palette_index;
+            if (!get_varint(in, end, run_length) || !get_varint(in, end, palette_index)) { break; }
+            if (run_length == 0 || run_length > static_cast<u32>(Chunk::volume - index) || palette_index >= palette_size) { break; }
+
+            chunk.fill_at(index, index + static_cast<s32>(run_length), palette[palette_index]);
+            index += static_cast<s32>(run_length);
+        }
+
+        if (index != Chunk::volume || in != end) {
+            chunk = Chunk();
+            chunk.set_state(state);
+            return false;
+        }
+
+        chunk.compact();
+        return true;
+    }
+
+    RegionFile::RegionFile(fs::path path) : m_path(std::move(path)), m_entries(region_volume) {
+        read_header();
+    }
+
+    void RegionFile::read_header() {
+        std::fill(m_entries.begin(), m_entries.end(), Entry());
+        m_file_size = 0;
+
+        if (!m_mapping.open(m_path)) { return; }
+        u8 const* data = m_mapping.data();
+        if (m_mapping.size() < header_size || std::memcmp(data, region_magic, 4) != 0 || get_u32(data + 4) != version) {
+            m_mapping.close();
+            return;
+        }
+
+        for (s32 i = 0; i < region_volume; ++i) {
+            u8 const* entry = data + 8 + i * 16;
+            Entry &e = m_entries[i];
+            e.offset = get_u64(entry);
+            e.size = get_u32(entry + 8);
+            e.capacity = get_u32(entry + 12);
+
+            /*
+             * Drop entries pointing outside the file rather than trusting them later.
+             */
+            if (e.size > e.capacity || e.offset < static_cast<u64>(header_size) || e.offset + e.capacity > static_cast<u64>(m_mapping.size())) {
+                e = Entry();
+            }
+        }
+        m_file_size = static_cast<u64>(m_mapping.size());
+    }
+
+    bool RegionFile::contains(Position chunk_position) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_entries[chunk_index(chunk_position)].size > 0;
+    }
+
+    bool RegionFile::read(Position chunk_position, Chunk &chunk) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        Entry const& entry = m_entries[chunk_index(chunk_position)];
+        if (entry.size == 0) { return false; }
+
+        if (!m_mapping.is_open() && !m_mapping.open(m_path)) { return false; }
+        if (entry.offset + entry.size > static_cast<u64>(m_mapping.size())) { return false; }
+
+        return decode_chunk(m_mapping.data() + entry.offset, entry.size, chunk);
+    }
+
+    void RegionFile::read(std::vector<Position> const& chunk_positions, std::vector<std::unique_ptr<Chunk>> &chunks) {
+        chunks.clear();
+        chunks.resize(chunk_positions.size());
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        std::vector<std::pair<Entry, std::size_t>> reads;
+        for (std::size_t i = 0; i < chunk_positions.size(); ++i) {
+            Entry const& entry = m_entries[chunk_index(chunk_positions[i])];
+            if (entry.size > 0) {
+                reads.push_back({ entry, i });
+            }
+        }
+        if (reads.empty()) { return; }
+        if (!m_mapping.is_open() && !m_mapping.open(m_path)) { return; }
+
+        std::sort(reads.begin(), reads.end(), [](auto const& a, auto const& b) { return a.first.offset < b.first.offset; });
+
+        /*
+         * Prefetch runs of nearby slots as single ranges before decoding anything.
+         */
+        u64 range_begin = reads.front().first.offset;
+        u64 range_end = range_begin;
+        for (auto const& read : reads) {
+            Entry const& entry = read.first;
+            if (entry.offset > range_end + coalesce_gap) {
+                m_mapping.prefetch(static_cast<s64>(range_begin), static_cast<s64>(range_end - range_begin));
+                range_begin = entry.offset;
+            }
+            range_end = std::max(range_end, entry.offset + entry.size);
+        }
+        m_mapping.prefetch(static_cast<s64>(range_begin), static_cast<s64>(range_end - range_begin));
+
+        for (auto const& read : reads) {
+            Entry const& entry = read.first;
+            if (entry.offset + entry.size > static_cast<u64>(m_mapping.size())) { continue; }
+
+            auto chunk = std::make_unique<Chunk>();
+            if (decode_chunk(m_mapping.data() + entry.offset, entry.size, *chunk)) {
+                chunks[read.second] = std::move(chunk);
+            }
+        }
+    }
+
+    bool RegionFile::write(Position chunk_position, Chunk const& chunk) {
+        return write({ { chunk_position, &chunk } });
+    }
+
+    bool RegionFile::write(std::vector<std::pair<Position, Chunk const*>> const& chunks) {
+        std::vector<std::vector<u8>> encoded;
+        encoded.reserve(chunks.size());
+        for (auto const& pair : chunks) {
+            encoded.push_back(encode_chunk(*pair.second));
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_mapping.close();
+
+        /*
+         * Start a new file, header and all, if there isn't a valid one yet.
+         */
+        if (m_file_size == 0) {
+            std::ofstream file(m_path, std::ios::binary | std::ios::trunc);
+            std::vector<u8> header(static_cast<std::size_t>(header_size), 0);
+            std::memcpy(header.data(), region_magic, 4);
+            put_u32(header.data() + 4, version);
+            file.write(reinterpret_cast<char const*>(header.data()), header.size());
+            if (!file) { return false; }
+            m_file_size = static_cast<u64>(header_size);
+        }
+
+        std::fstream file(m_path, std::ios::binary | std::ios::in | std::ios::out);
+        if (!file) { return false; }
+
+        for (std::size_t i = 0; i < chunks.size(); ++i) {
+            std::vector<u8> &data = encoded[i];
+            s32 index = chunk_index(chunks[i].first);
+            Entry entry = m_entries[index];
+            u32 size = static_cast<u32>(data.size());
+            if (entry.offset == 0 || size > entry.capacity) {
+                entry.offset = m_file_size;
+                entry.capacity = (size + slot_granularity - 1) / slot_granularity * slot_granularity;
+                data.resize(entry.capacity, 0);
+            }
+            entry.size = size;
+
+            file.seekp(static_cast<std::streamoff>(entry.offset));
+            file.write(reinterpret_cast<char const*>(data.data()), data.size());
+
+            u8 table_entry[16];
+            put_u64(table_entry, entry.offset);
+            put_u32(table_entry + 8, entry.size);
+            put_u32(table_entry + 12, entry.capacity);
+            file.seekp(8 + static_cast<std::streamoff>(index) * 16);
+            file.write(reinterpret_cast<char const*>(table_entry), sizeof(table_entry));
+            if (!file) { return false; }
+
+            m_entries[index] = entry;
+            m_file_size = std::max<u64>(m_file_size, entry.offset + entry.capacity);
+        }
+
+        file.flush();
+        return static_cast<bool>(file);
+    }
+
+    RegionStorage::RegionStorage(fs::path directory) : m_directory(std::move(directory)) {
+        std::error_code error;
+        fs::create_directories(m_directory, error);
+    }
+
+    fs::path RegionStorage::region_path(Position region_position) const {
+        return m_directory / (
+            "r." + std::to_string(region_position.x) +
+            "." + std::to_string(region_position.y) +
+            "." + std::to_string(region_position.z) + ".region"
+        );
+    }
+
+    RegionStorage::Region &RegionStorage::region(Position chunk_position) {
+        Position region_position = RegionFile::region_position(chunk_position);
+        std::unique_ptr<Region> &region = m_regions[region_position];
+        if (!region) {
+            region = std::make_unique<Region>(region_path(region_position));
+        }
+        return *region;
+    }
+
+    std::vector<std::pair<RegionStorage::Region*, std::vector<s32>>> RegionStorage::group_by_region(std::vector<Position> const& chunk_positions) {
+        std::vector<std::pair<Region*, std::vector<s32>>> groups;
+        std::unordered_map<Position, std::size_t, PositionHash> group_indices;
+        for (std::size_t i = 0; i < chunk_positions.size(); ++i) {
+            auto inserted = group_indices.insert({ RegionFile::region_position(chunk_positions[i]), groups.size() });
+            if (inserted.second) {
+                groups.push_back({ &region(chunk_positions[i]), {} });
+            }
+            groups[inserted.first->second].second.push_back(static_cast<s32>(i));
+        }
+        return groups;
+    }
+
+    bool RegionStorage::load(Position chunk_position, Chunk &chunk) {
+        RegionFile *file;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto staged = m_staged.find(chunk_position);
+            if (staged != m_staged.end()) {
+                ChunkState state = chunk.state();
+                chunk = *staged->second;
+                chunk.set_state(state);
+                return true;
+            }
+            file = &region(chunk_position).file;
+        }
+        return file->read(chunk_position, chunk);
+    }
+
+    std::vector<std::unique_ptr<Chunk>> RegionStorage::load(std::vector<Position> const& chunk_positions) {
+        std::vector<std::unique_ptr<Chunk>> chunks(chunk_positions.size());
+        std::vector<Position> unstaged_positions;
+        std::vector<s32> unstaged_indices;
+        std::vector<std::pair<Region*, std::vector<s32>>> groups;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (std::size_t i = 0; i < chunk_positions.size(); ++i) {
+                auto staged = m_staged.find(chunk_positions[i]);
+                if (staged != m_staged.end()) {
+                    chunks[i] = std::make_unique<Chunk>(*staged->second);
+                    chunks[i]->set_state(ChunkState::Unused);
+                } else {
+                    unstaged_positions.push_back(chunk_positions[i]);
+                    unstaged_indices.push_back(static_cast<s32>(i));
+                }
+            }
+            groups = group_by_region(unstaged_positions);
+        }
+
+        std::vector<Position> positions;
+        std::vector<std::unique_ptr<Chunk>> read;
+        for (auto const& group : groups) {
+            positions.clear();
+            for (s32 i : group.second) {
+                positions.push_back(unstaged_positions[i]);
+            }
+            group.first->file.read(positions, read);
+            for (std::size_t i = 0; i < read.size(); ++i) {
+                chunks[unstaged_indices[group.second[i]]] = std::move(read[i]);
+            }
+        }
+        return chunks;
+    }
+
+    bool RegionStorage::save(Position chunk_position, Chunk const& chunk) {
+        RegionFile *file;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            file = &region(chunk_position).file;
+        }
+        return file->write(chunk_position, chunk);
+    }
+
+    void RegionStorage::stage(Position chunk_position, std::shared_ptr<Chunk const> chunk) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_staged[chunk_position] = std::move(chunk);
+    }
+
+    bool RegionStorage::flush(Position chunk_position) {
+        return flush(std::vector<Position>{ chunk_position });
+    }
+
+    bool RegionStorage::flush(std::vector<Position> const& chunk_positions) {
+        std::vector<Position> positions;
+        std::vector<std::pair<Region*, std::vector<s32>>> groups;
+        std::unordered_set<Position, PositionHash> seen;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (Position position : chunk_positions) {
+                if (m_staged.count(position) && seen.insert(position).second) {
+                    positions.push_back(position);
+                }
+            }
+            groups = group_by_region(positions);
+        }
+
+        bool written = true;
+        std::vector<std::pair<Position, std::shared_ptr<Chunk const>>> snapshots;
+        std::vector<std::pair<Position, Chunk const*>> chunks;
+        for (auto const& group : groups) {
+            /*
+             * The snapshots are taken with the region's flush lock held, so any flush that took older ones has
+             * finished writing them by now, and any flush taking newer ones writes after this one.
+             */
+            std::lock_guard<std::mutex> flush_lock(group.first->flush_mutex);
+            snapshots.clear();
+            chunks.clear();
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                for (s32 i : group.second) {
+                    auto staged = m_staged.find(positions[i]);
+                    if (staged != m_staged.end()) {
+                        snapshots.push_back({ positions[i], staged->second });
+                    }
+                }
+            }
+            if (snapshots.empty()) { continue; }
+            for (auto const& snapshot : snapshots) {
+                chunks.push_back({ snapshot.first, snapshot.second.get() });
+            }
+            if (!group.first->file.write(chunks)) {
+                written = false;
+                continue;
+            }
+
+            /*
+             * Only unstage the snapshots that were written. A newer one staged in the meantime still needs writing.
+             */
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (auto const& snapshot : snapshots) {
+                auto staged = m_staged.find(snapshot.first);
+                if (staged != m_staged.end() && staged->second == snapshot.second) {
+                    m_staged.erase(staged);
+                }
+            }
+        }
+        return written;
+    }
+
+    bool RegionStorage::flush() {
+        std::vector<Position> positions;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (auto const& pair : m_staged) {
+                positions.push_back(pair.first);
+            }
+        }
+        return flush(positions);
+    }
+
+    s32 RegionStorage::staged_count() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return static_cast<s32>(m_staged.size());
+    }
+}
@@ -0,0 +1,204 @@
+#pragma once
+#ifndef SIVOX_GAME_REGIONFILE_HPP
+#define SIVOX_GAME_REGIONFILE_HPP
+
+#include "common.hpp"
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "ioutils.hpp"
+#include "voxelterrain.hpp"
+
+namespace sivox {
+    /*
+     * Compresses [chunk] for storage. Blocks are run length encoded in block_index order, which walks up each y
+     * column, with each run pointing into a palette of the chunk's blocks:
+     *
+     *     u32 palette size, u32 block id * palette size, (varint run length, varint palette index) * run count
+     *
+     * A uniform chunk takes a dozen bytes. Chunks of flat layers take a couple of bytes per layer per column.
+     */
+    std::vector<u8> encode_chunk(Chunk const& chunk);
+
+    /*
+     * Replaces the blocks of [chunk] with [size] bytes of [data] from encode_chunk. The chunk's state is kept.
+     * Returns false and leaves the chunk all air if the data is malformed.
+     */
+    bool decode_chunk(u8 const* data, s64 size, Chunk &chunk);
+
+    /*
+     * A file holding up to region_volume chunks, a region_size^3 cube of them.
+     *
+     * The file starts with a header and an offset table with an entry per chunk, followed by the encoded chunks:
+     *
+     *     "SVRG", u32 version, (u64 offset, u32 size, u32 capacity) * region_volume, chunk data...
+     *
+     * Everything is little endian. A chunk with size 0 isn't stored. A rewritten chunk goes back where it was if it
+     * fits in the capacity of its old slot and is appended to the end of the file otherwise.
+     *
+     * Chunks are read through a MappedFile, so loading a chunk costs a page fault or two rather than a read call and
+     * a copy. Writes go through a regular file stream and drop the mapping, which is opened again by the next read.
+     *
+     * Reads and writes are thread safe.
+     */
+    class RegionFile {
+    public:
+        static constexpr s32 region_bits = 4;
+        static constexpr s32 region_size = 1 << region_bits;
+        static constexpr s32 region_mask = region_size - 1;
+        static constexpr s32 region_volume = region_size * region_size * region_size;
+
+        static constexpr u32 version = 1;
+        static constexpr s64 header_size = 8 + region_volume * 16;
+
+        explicit RegionFile(std::filesystem::path path);
+
+        RegionFile(RegionFile const& other) = delete;
+        RegionFile &operator=(RegionFile const& other) = delete;
+
+        std::filesystem::path const& path() const { return m_path; }
+
+        /*
+         * Reads the chunk at [chunk_position] into [chunk]. Positions are chunk positions in the world; only their
+         * low region_bits are used. Returns false if the chunk isn't stored or can't be decoded.
+         */
+        bool read(Position chunk_position, Chunk &chunk);
+        bool contains(Position chunk_position) const;
+
+        /*
+         * Reads a batch of chunks, setting chunks[i] to the chunk at chunk_positions[i], or null if it isn't stored or
+         * can't be decoded. Chunks are read in file order and neighbouring slots are prefetched together, so a batch
+         * of adjacent chunks costs about one trip to the disk rather than one per chunk.
+         */
+        void read(std::vector<Position> const& chunk_positions, std::vector<std::unique_ptr<Chunk>> &chunks);
+
+        /*
+         * Stores [chunk] at [chunk_position], creating the file if needed. Returns false if the file can't be
+         * written.
+         */
+        bool write(Position chunk_position, Chunk const& chunk);
+
+        /*
+         * Stores a batch of chunks, opening the file once for all of them.
+         */
+        bool write(std::vector<std::pair<Position, Chunk const*>> const& chunks);
+
+        /*
+         * The region a chunk belongs to. Shifts are arithmetic, so negative positions round down.
+         */
+        static Position region_position(Position chunk_position) {
+            return { chunk_position.x >> region_bits, chunk_position.y >> region_bits, chunk_position.z >> region_bits };
+        }
+
+        /*
+         * Same order as Chunk::block_index, y first, then x, then z.
+         */
+        static s32 chunk_index(Position chunk_position) {
+            return (chunk_position.y & region_mask)
+                | ((chunk_position.x & region_mask) << region_bits)
+                | ((chunk_position.z & region_mask) << (2 * region_bits));
+        }
+
+    private:
+        struct Entry {
+            u64 offset = 0;
+            u32 size = 0;
+            u32 capacity = 0;
+        };
+
+        std::filesystem::path m_path;
+        mutable std::mutex m_mutex;
+        std::vector<Entry> m_entries;
+        u64 m_file_size = 0;
+        MappedFile m_mapping;
+
+        /*
+         * Reads the offset table. A missing or malformed file is treated as empty and replaced by the next write.
+         */
+        void read_header();
+    };
+
+    /*
+     * Saves and loads chunks in a directory of region files, named r.<x>.<y>.<z>.region after their region position.
+     *
+     * Chunks can be staged for saving: stage() only keeps a reference to a snapshot of the chunk, so it's cheap to
+     * call from the render thread, and flush() writes it out later, typically from a worker. Loads see staged chunks,
+     * so a chunk loaded again before its save is flushed still comes back as it was saved.
+     *
+     * Thread safe.
+     */
+    class RegionStorage {
+    public:
+        explicit RegionStorage(std::filesystem::path directory);
+
+        RegionStorage(RegionStorage const& other) = delete;
+        RegionStorage &operator=(RegionStorage const& other) = delete;
+
+        std::filesystem::path const& directory() const { return m_directory; }
+
+        /*
+         * Reads the chunk at [chunk_position] into [chunk], keeping its state. Returns false if it was never saved.
+         */
+        bool load(Position chunk_position, Chunk &chunk);
+
+        /*
+         * Loads a batch of chunks, reading each region file involved once. The result has a chunk per position, null
+         * for chunks that were never saved.
+         */
+        std::vector<std::unique_ptr<Chunk>> load(std::vector<Position> const& chunk_positions);
+
+        /*
+         * Writes [chunk] straight away.
+         */
+        bool save(Position chunk_position, Chunk const& chunk);
+
+        /*
+         * Queues up [chunk] to be written by flush(). Replaces anything already staged for [chunk_position].
+         */
+        void stage(Position chunk_position, std::shared_ptr<Chunk const> chunk);
+
+        /*
+         * Writes the chunk staged for [chunk_position], if any, or every staged chunk. Returns false if any of them
+         * couldn't be written. Those stay staged, so they still load and the next flush tries again.
+         */
+        bool flush(Position chunk_position);
+        bool flush(std::vector<Position> const& chunk_positions);
+        bool flush();
+
+        s32 staged_count() const;
+
+        std::filesystem::path region_path(Position region_position) const;
+
+    private:
+        struct Region {
+            explicit Region(std::filesystem::path path) : file(std::move(path)) {}
+
+            RegionFile file;
+
+            /*
+             * Held by flush() from taking the snapshots of the region's chunks until they're written, so an older
+             * snapshot can never be written over a newer one by a flush running alongside.
+             */
+            std::mutex flush_mutex;
+        };
+
+        std::filesystem::path m_directory;
+        mutable std::mutex m_mutex;
+        std::unordered_map<Position, std::unique_ptr<Region>, PositionHash> m_regions;
+        std::unordered_map<Position, std::shared_ptr<Chunk const>, PositionHash> m_staged;
+
+        /*
+         * The region for [chunk_position], opening its file if needed. m_mutex must be held.
+         */
+        Region &region(Position chunk_position);
+
+        /*
+         * Indices into [chunk_positions], grouped by region. m_mutex must be held.
+         */
+        std::vector<std::pair<Region*, std::vector<s32>>> group_by_region(std::vector<Position> const& chunk_positions);
+    };
+}
+
+#endif // SIVOX_GAME_REGIONFILE_HPP
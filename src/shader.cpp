@@ -69,6 +69,26 @@ namespace {
         }
         return program;
     }
+
+    /*
+     * GLSL requires #version to be the first thing in the file, so the defines go on the line after it.
+     */
+    std::string add_defines(std::string source_code, std::vector<std::string> const& defines) {
+        if (defines.empty()) { return source_code; }
+
+        std::string define_lines;
+        for (std::string const& define : defines) {
+            define_lines += "#define " + define + "\n";
+        }
+
+        auto insert_at = std::string::npos;
+        if (source_code.compare(0, 8, "#version") == 0) {
+            insert_at = source_code.find('\n');
+        }
+
+        if (insert_at == std::string::npos) { return define_lines + source_code; }
+        else { return source_code.insert(insert_at + 1, define_lines); }
+    }
 }
 
 namespace sivox {
@@ -92,7 +112,7 @@ namespace sivox {
         }
     }
 
-    Shader Shader::load(std::string const& name) {
+    Shader Shader::load(std::string const& name, std::vector<std::string> const& defines) {
         const fs::path shader_dir = "shaders";
 
         fs::path vertex_path = shader_dir / name;
@@ -101,6 +121,9 @@ namespace sivox {
         fs::path fragment_path = shader_dir / name;
         fragment_path += ".frag";
 
-        return Shader(read_text_file(vertex_path), read_text_file(fragment_path));
+        return Shader(
+            add_defines(read_text_file(vertex_path), defines),
+            add_defines(read_text_file(fragment_path), defines)
+        );
     }
 }
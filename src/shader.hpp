@@ -4,6 +4,7 @@
 
 #include "common.hpp"
 #include <string>
+#include <vector>
 #include <glad/glad.h>
 
 namespace sivox {
@@ -29,7 +30,11 @@ namespace sivox {
         GLuint program() const { return m_program; }
         operator GLuint() const { return program(); }
 
-        static Shader load(std::string const& name);
+        /*
+         * Loads shaders/[name].vert and shaders/[name].frag. Each of the [defines] is #defined in both right after the
+         * #version line, so one shader file can be built in several variants.
+         */
+        static Shader load(std::string const& name, std::vector<std::string> const& defines = {});
 
     private:
         GLuint m_program;
@@ -0,0 +1,356 @@
+#include "terraingenerator.hpp"
+#include <algorithm>
+#include <cmath>
+
+/*
+ * With GCC and Clang on x86 the AVX2 kernels are always compiled, targeting AVX2 function by function, and only run
+ * if the CPU has it. Other compilers, MSVC included, only get them in builds with AVX2 enabled (SIVOX_AVX2), where
+ * they always run.
+ */
+#if defined(__AVX2__)
+#define SIVOX_TERRAIN_AVX2
+#define SIVOX_TERRAIN_AVX2_TARGET
+#include <immintrin.h>
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define SIVOX_TERRAIN_AVX2
+#define SIVOX_TERRAIN_AVX2_DISPATCH
+#define SIVOX_TERRAIN_AVX2_TARGET __attribute__((target("avx2")))
+#include <immintrin.h>
+#endif
+
+namespace {
+    using namespace sivox;
+
+    constexpr u32 hash_x = 0x8DA6B343u;
+    constexpr u32 hash_y = 0xD8163841u;
+    constexpr u32 hash_z = 0xCB1AB31Fu;
+
+    u64 splitmix64(u64 x) {
+        x += 0x9E3779B97F4A7C15ull;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+
+    /*
+     * Lattice points are hashed as seed ^ x * hash_x ^ y * hash_y ^ z * hash_z, then mixed by this. Only 32 bit
+     * multiplies, shifts and xors, which AVX2 has too.
+     */
+    u32 finalize(u32 h) {
+        h ^= h >> 16;
+        h *= 0x7FEB352Du;
+        h ^= h >> 15;
+        h *= 0x846CA68Bu;
+        h ^= h >> 16;
+        return h;
+    }
+
+    /*
+     * The value at a lattice point, in [-1, 1).
+     */
+    f32 lattice_value(u32 h) {
+        return static_cast<f32>(static_cast<s32>(h >> 8)) * (1.0f / 8388608.0f) - 1.0f;
+    }
+
+    f32 smooth(f32 t) { return t * t * (3.0f - 2.0f * t); }
+    f32 lerp(f32 a, f32 b, f32 t) { return a + (b - a) * t; }
+
+    struct Octave {
+        s32 cell_bits;
+        f32 amplitude;
+    };
+
+    constexpr Octave height_octaves[] = { { 7, 1.0f }, { 6, 0.5f }, { 5, 0.25f }, { 4, 0.125f } };
+    constexpr f32 height_normalize = 1.0f / 1.875f;
+
+    constexpr s32 density_octave_count = TerrainGenerator::density_octave_count;
+    constexpr Octave density_octaves[density_octave_count] = { { 5, 1.0f }, { 4, 0.5f } };
+    constexpr f32 density_normalize = 1.0f / 1.5f;
+
+    f32 cell_fraction(s32 coordinate, s32 cell_bits) {
+        return static_cast<f32>(coordinate & ((1 << cell_bits) - 1)) * (1.0f / static_cast<f32>(1 << cell_bits));
+    }
+
+    /*
+     * The lattice cell of a column along x and z for one octave of the density noise. The same for every block in
+     * the column, so it's worked out once per column and only y varies from block to block.
+     */
+    struct ColumnCell {
+        s32 cell_bits;
+        u32 seeds[2][2]; // seed ^ x * hash_x ^ z * hash_z for each corner, indexed [dx][dz]
+        f32 tx, tz;
+    };
+
+    ColumnCell column_cell(u32 seed, s32 x, s32 z, s32 cell_bits) {
+        ColumnCell cell;
+        cell.cell_bits = cell_bits;
+        s32 ix = x >> cell_bits;
+        s32 iz = z >> cell_bits;
+        for (s32 dx = 0; dx < 2; ++dx) {
+            for (s32 dz = 0; dz < 2; ++dz) {
+                cell.seeds[dx][dz] = seed ^ (static_cast<u32>(ix + dx) * hash_x) ^ (static_cast<u32>(iz + dz) * hash_z);
+            }
+        }
+        cell.tx = smooth(cell_fraction(x, cell_bits));
+        cell.tz = smooth(cell_fraction(z, cell_bits));
+        return cell;
+    }
+
+    /*
+     * Written out step by step so the AVX2 version can do exactly the same operations in the same order.
+     */
+    f32 density_noise(ColumnCell const (&cells)[density_octave_count], s32 y) {
+        f32 sum = 0.0f;
+        for (s32 o = 0; o < density_octave_count; ++o) {
+            ColumnCell const& c = cells[o];
+            s32 iy = y >> c.cell_bits;
+            f32 ty = smooth(cell_fraction(y, c.cell_bits));
+            u32 hy0 = static_cast<u32>(iy) * hash_y;
+            u32 hy1 = static_cast<u32>(iy + 1) * hash_y;
+
+            f32 x00 = lerp(lattice_value(finalize(c.seeds[0][0] ^ hy0)), lattice_value(finalize(c.seeds[1][0] ^ hy0)), c.tx);
+            f32 x10 = lerp(lattice_value(finalize(c.seeds[0][0] ^ hy1)), lattice_value(finalize(c.seeds[1][0] ^ hy1)), c.tx);
+            f32 x01 = lerp(lattice_value(finalize(c.seeds[0][1] ^ hy0)), lattice_value(finalize(c.seeds[1][1] ^ hy0)), c.tx);
+            f32 x11 = lerp(lattice_value(finalize(c.seeds[0][1] ^ hy1)), lattice_value(finalize(c.seeds[1][1] ^ hy1)), c.tx);
+            f32 y0 = lerp(x00, x10, ty);
+            f32 y1 = lerp(x01, x11, ty);
+            sum = sum + density_octaves[o].amplitude * lerp(y0, y1, c.tz);
+        }
+        return sum * density_normalize;
+    }
+
+#ifdef SIVOX_TERRAIN_AVX2
+    SIVOX_TERRAIN_AVX2_TARGET __m256i finalize8(__m256i h) {
+        h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 16));
+        h = _mm256_mullo_epi32(h, _mm256_set1_epi32(static_cast<s32>(0x7FEB352Du)));
+        h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 15));
+        h = _mm256_mullo_epi32(h, _mm256_set1_epi32(static_cast<s32>(0x846CA68Bu)));
+        h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 16));
+        return h;
+    }
+
+    SIVOX_TERRAIN_AVX2_TARGET __m256 lattice_value8(u32 seed, __m256i hy) {
+        __m256i h = finalize8(_mm256_xor_si256(_mm256_set1_epi32(static_cast<s32>(seed)), hy));
+        __m256 value = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(h, 8)), _mm256_set1_ps(1.0f / 8388608.0f));
+        return _mm256_sub_ps(value, _mm256_set1_ps(1.0f));
+    }
+
+    SIVOX_TERRAIN_AVX2_TARGET __m256 smooth8(__m256 t) {
+        __m256 t2 = _mm256_mul_ps(t, t);
+        return _mm256_mul_ps(t2, _mm256_sub_ps(_mm256_set1_ps(3.0f), _mm256_mul_ps(_mm256_set1_ps(2.0f), t)));
+    }
+
+    SIVOX_TERRAIN_AVX2_TARGET __m256 lerp8(__m256 a, __m256 b, __m256 t) {
+        return _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), t));
+    }
+
+    /*
+     * density_noise for the eight heights in [y].
+     */
+    SIVOX_TERRAIN_AVX2_TARGET __m256 density_noise8(ColumnCell const (&cells)[density_octave_count], __m256i y) {
+        __m256 sum = _mm256_setzero_ps();
+        for (s32 o = 0; o < density_octave_count; ++o) {
+            ColumnCell const& c = cells[o];
+            const s32 cell_bits = c.cell_bits;
+            __m256i iy = _mm256_sra_epi32(y, _mm_cvtsi32_si128(cell_bits));
+            __m256 fy = _mm256_cvtepi32_ps(_mm256_and_si256(y, _mm256_set1_epi32((1 << cell_bits) - 1)));
+            __m256 ty = smooth8(_mm256_mul_ps(fy, _mm256_set1_ps(1.0f / static_cast<f32>(1 << cell_bits))));
+            __m256i hy0 = _mm256_mullo_epi32(iy, _mm256_set1_epi32(static_cast<s32>(hash_y)));
+            __m256i hy1 = _mm256_mullo_epi32(_mm256_add_epi32(iy, _mm256_set1_epi32(1)), _mm256_set1_epi32(static_cast<s32>(hash_y)));
+
+            __m256 tx = _mm256_set1_ps(c.tx);
+            __m256 x00 = lerp8(lattice_value8(c.seeds[0][0], hy0), lattice_value8(c.seeds[1][0], hy0), tx);
+            __m256 x10 = lerp8(lattice_value8(c.seeds[0][0], hy1), lattice_value8(c.seeds[1][0], hy1), tx);
+            __m256 x01 = lerp8(lattice_value8(c.seeds[0][1], hy0), lattice_value8(c.seeds[1][1], hy0), tx);
+            __m256 x11 = lerp8(lattice_value8(c.seeds[0][1], hy1), lattice_value8(c.seeds[1][1], hy1), tx);
+            __m256 y0 = lerp8(x00, x10, ty);
+            __m256 y1 = lerp8(x01, x11, ty);
+            __m256 octave = lerp8(y0, y1, _mm256_set1_ps(c.tz));
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(density_octaves[o].amplitude), octave));
+        }
+        return _mm256_mul_ps(sum, _mm256_set1_ps(density_normalize));
+    }
+
+    /*
+     * Writes the block ids of a column with surface [height] from [y] up to [band_end], eight at a time, to [ids].
+     * [origin_y] is the world height of ids[0]. The last group of eight may write past [band_end]. Returns where it
+     * stopped, which is at or past [band_end].
+     */
+    SIVOX_TERRAIN_AVX2_TARGET s32 classify_band8(TerrainGenerator::Settings const& settings,
+            ColumnCell const (&cells)[density_octave_count], f32 height, s32 origin_y, s32 y, s32 band_end, s32 *ids) {
+        const __m256 height8 = _mm256_set1_ps(height);
+        const __m256 amplitude8 = _mm256_set1_ps(settings.density_amplitude);
+        const __m256 depth8 = _mm256_set1_ps(static_cast<f32>(settings.surface_depth));
+        const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        for (; y < band_end; y += 8) {
+            __m256i world_y = _mm256_add_epi32(_mm256_set1_epi32(origin_y + y), lanes);
+            __m256 density = _mm256_sub_ps(height8, _mm256_cvtepi32_ps(world_y));
+            density = _mm256_add_ps(density, _mm256_mul_ps(amplitude8, density_noise8(cells, world_y)));
+
+            __m256 air = _mm256_cmp_ps(density, _mm256_setzero_ps(), _CMP_LE_OQ);
+            __m256 shallow = _mm256_cmp_ps(density, depth8, _CMP_LT_OQ);
+            __m256 block = _mm256_castsi256_ps(_mm256_set1_epi32(settings.stone.id));
+            block = _mm256_blendv_ps(block, _mm256_castsi256_ps(_mm256_set1_epi32(settings.surface.id)), shallow);
+            block = _mm256_blendv_ps(block, _mm256_setzero_ps(), air);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(ids + y), _mm256_castps_si256(block));
+        }
+        return y;
+    }
+
+    bool cpu_has_avx2() {
+#ifdef SIVOX_TERRAIN_AVX2_DISPATCH
+        static const bool has_avx2 = [] {
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") != 0;
+        }();
+        return has_avx2;
+#else
+        return true;
+#endif
+    }
+#endif
+
+    /*
+     * Writes a column of block ids, bottom to top, as runs. Columns are contiguous in block_index order.
+     */
+    void write_column(Chunk &chunk, s32 base_index, s32 const* ids) {
+        s32 begin = 0;
+        for (s32 y = 1; y <= Chunk::height; ++y) {
+            if (y == Chunk::height || ids[y] != ids[begin]) {
+                chunk.fill_at(base_index + begin, base_index + y, ids[begin]);
+                begin = y;
+            }
+        }
+    }
+}
+
+namespace sivox {
+    TerrainGenerator::TerrainGenerator(u64 seed) : TerrainGenerator(seed, Settings()) {}
+
+    TerrainGenerator::TerrainGenerator(u64 seed, Settings const& settings) : m_seed(seed), m_settings(settings) {
+        m_height_seed = static_cast<u32>(splitmix64(seed) >> 32);
+        for (s32 o = 0; o < density_octave_count; ++o) {
+            m_density_seeds[o] = static_cast<u32>(splitmix64(seed + 1 + static_cast<u64>(o)) >> 32);
+        }
+    }
+
+    f32 TerrainGenerator::height(s32 x, s32 z) const {
+        f32 sum = 0.0f;
+        for (Octave const& octave : height_octaves) {
+            s32 ix = x >> octave.cell_bits;
+            s32 iz = z >> octave.cell_bits;
+            f32 tx = smooth(cell_fraction(x, octave.cell_bits));
+            f32 tz = smooth(cell_fraction(z, octave.cell_bits));
+
+            u32 hx0 = static_cast<u32>(ix) * hash_x;
+            u32 hx1 = static_cast<u32>(ix + 1) * hash_x;
+            u32 hz0 = static_cast<u32>(iz) * hash_z;
+            u32 hz1 = static_cast<u32>(iz + 1) * hash_z;
+            f32 z0 = lerp(lattice_value(finalize(m_height_seed ^ hx0 ^ hz0)), lattice_value(finalize(m_height_seed ^ hx1 ^ hz0)), tx);
+            f32 z1 = lerp(lattice_value(finalize(m_height_seed ^ hx0 ^ hz1)), lattice_value(finalize(m_height_seed ^ hx1 ^ hz1)), tx);
+            sum = sum + octave.amplitude * lerp(z0, z1, tz);
+        }
+        return m_settings.base_height + m_settings.height_amplitude * (sum * height_normalize);
+    }
+
+    void TerrainGenerator::noise_band(f32 height, s32 &lowest, s32 &highest) const {
+        /*
+         * Below height - density_amplitude - surface_depth the density is at least surface_depth whatever the noise
+         * does, and above height + density_amplitude it's at most 0.
+         */
+        lowest = static_cast<s32>(std::floor(height - m_settings.density_amplitude - static_cast<f32>(m_settings.surface_depth)));
+        highest = static_cast<s32>(std::ceil(height + m_settings.density_amplitude));
+    }
+
+    Block TerrainGenerator::classify(f32 density) const {
+        if (density <= 0.0f) { return 0; }
+        if (density < static_cast<f32>(m_settings.surface_depth)) { return m_settings.surface; }
+        return m_settings.stone;
+    }
+
+    Block TerrainGenerator::block(Position p) const {
+        f32 h = height(p.x, p.z);
+        s32 lowest, highest;
+        noise_band(h, lowest, highest);
+        if (p.y < lowest) { return m_settings.stone; }
+        if (p.y >= highest) { return 0; }
+
+        ColumnCell cells[density_octave_count];
+        for (s32 o = 0; o < density_octave_count; ++o) {
+            cells[o] = column_cell(m_density_seeds[o], p.x, p.z, density_octaves[o].cell_bits);
+        }
+        return classify((h - static_cast<f32>(p.y)) + m_settings.density_amplitude * density_noise(cells, p.y));
+    }
+
+    void TerrainGenerator::generate_scalar(Chunk &chunk, Position chunk_position) const {
+        ChunkState state = chunk.state();
+        chunk = Chunk();
+        chunk.set_state(state);
+
+        const Position origin(chunk_position.x * Chunk::width, chunk_position.y * Chunk::height, chunk_position.z * Chunk::length);
+        s32 ids[Chunk::height];
+        for (s32 z = 0; z < Chunk::length; ++z) {
+            for (s32 x = 0; x < Chunk::width; ++x) {
+                for (s32 y = 0; y < Chunk::height; ++y) {
+                    ids[y] = block({origin.x + x, origin.y + y, origin.z + z}).id;
+                }
+                write_column(chunk, Chunk::block_index({x, 0, z}), ids);
+            }
+        }
+    }
+
+    void TerrainGenerator::generate(Chunk &chunk, Position chunk_position) const {
+        ChunkState state = chunk.state();
+        chunk = Chunk();
+        chunk.set_state(state);
+
+        const Position origin(chunk_position.x * Chunk::width, chunk_position.y * Chunk::height, chunk_position.z * Chunk::length);
+        const s32 stone = m_settings.stone.id;
+#ifdef SIVOX_TERRAIN_AVX2
+        const bool use_avx2 = cpu_has_avx2();
+#endif
+
+        /*
+         * Padded so a group of eight starting near the top of the chunk can be stored whole.
+         */
+        s32 ids[Chunk::height + 8];
+        for (s32 z = 0; z < Chunk::length; ++z) {
+            for (s32 x = 0; x < Chunk::width; ++x) {
+                const s32 world_x = origin.x + x;
+                const s32 world_z = origin.z + z;
+                const f32 h = height(world_x, world_z);
+
+                s32 lowest, highest;
+                noise_band(h, lowest, highest);
+                const s32 band_begin = std::clamp(lowest - origin.y, 0, Chunk::height);
+                const s32 band_end = std::clamp(highest - origin.y, band_begin, Chunk::height);
+
+                std::fill(ids, ids + band_begin, stone);
+
+                s32 y = band_begin;
+                if (y < band_end) {
+                    ColumnCell cells[density_octave_count];
+                    for (s32 o = 0; o < density_octave_count; ++o) {
+                        cells[o] = column_cell(m_density_seeds[o], world_x, world_z, density_octaves[o].cell_bits);
+                    }
+
+#ifdef SIVOX_TERRAIN_AVX2
+                    if (use_avx2) {
+                        y = classify_band8(m_settings, cells, h, origin.y, y, band_end, ids);
+                    }
+#endif
+                    for (; y < band_end; ++y) {
+                        const s32 world_y = origin.y + y;
+                        ids[y] = classify((h - static_cast<f32>(world_y)) + m_settings.density_amplitude * density_noise(cells, world_y)).id;
+                    }
+                }
+
+                /*
+                 * The last group of eight may have run past the band.
+                 */
+                std::fill(ids + band_end, ids + Chunk::height, 0);
+                write_column(chunk, Chunk::block_index({x, 0, z}), ids);
+            }
+        }
+    }
+}
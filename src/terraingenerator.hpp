@@ -0,0 +1,83 @@
+#pragma once
+#ifndef SIVOX_GAME_TERRAINGENERATOR_HPP
+#define SIVOX_GAME_TERRAINGENERATOR_HPP
+
+#include "common.hpp"
+#include "voxelterrain.hpp"
+
+namespace sivox {
+    /*
+     * Generates terrain from a world seed: rolling hills from a 2D heightmap, roughened by 3D density noise into
+     * overhangs and the odd floating rock near the surface.
+     *
+     * A block at height y in a column with surface height h has density
+     *
+     *     d = (h - y) + density_amplitude * noise(x, y, z)
+     *
+     * and is air if d <= 0, the surface block if d < surface_depth and stone otherwise. Both h and the noise are fBm
+     * value noise, hashed from integer lattice coordinates and the seed, so every block depends only on the seed and
+     * its own position. Chunks can be generated in any order, on any thread, and always come out the same.
+     *
+     * Since the noise is bounded, blocks more than density_amplitude away from the heightmap are stone or air no
+     * matter what, and only the band around the surface is evaluated. Within it, a column is evaluated eight blocks
+     * at a time with AVX2 when the CPU has it (see SIVOX_AVX2 in src/CMakeLists.txt for MSVC).
+     */
+    class TerrainGenerator {
+    public:
+        struct Settings {
+            f32 base_height = 16.0f;
+            f32 height_amplitude = 24.0f;  // Surface heights range over base_height +- this
+            f32 density_amplitude = 6.0f;  // How far from the heightmap the density noise reaches, in blocks
+            s32 surface_depth = 3;
+            Block stone = 1;
+            Block surface = 2;
+        };
+
+        /*
+         * Octaves of the 3D density noise, each with a seed of its own.
+         */
+        static constexpr s32 density_octave_count = 2;
+
+        explicit TerrainGenerator(u64 seed);
+        TerrainGenerator(u64 seed, Settings const& settings);
+
+        u64 seed() const { return m_seed; }
+        Settings const& settings() const { return m_settings; }
+
+        /*
+         * Fills [chunk] with the terrain at [chunk_position]. Thread safe.
+         */
+        void generate(Chunk &chunk, Position chunk_position) const;
+
+        /*
+         * Same as generate(), one block at a time without SIMD. Gives the same results.
+         */
+        void generate_scalar(Chunk &chunk, Position chunk_position) const;
+
+        /*
+         * The surface height of the heightmap at world block column [x], [z], before the density noise.
+         */
+        f32 height(s32 x, s32 z) const;
+
+        /*
+         * The block at world block position [p].
+         */
+        Block block(Position p) const;
+
+    private:
+        u64 m_seed;
+        Settings m_settings;
+        u32 m_height_seed;
+        u32 m_density_seeds[density_octave_count];
+
+        /*
+         * The range of heights, [lowest, highest), where blocks in a column with surface [height] need the density
+         * noise. Everything below is stone and everything above is air.
+         */
+        void noise_band(f32 height, s32 &lowest, s32 &highest) const;
+
+        Block classify(f32 density) const;
+    };
+}
+
+#endif // SIVOX_GAME_TERRAINGENERATOR_HPP
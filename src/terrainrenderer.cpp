@@ -0,0 +1,141 @@
+#include "terrainrenderer.hpp"
+#include <cstring>
+
+namespace {
+    /*
+     * Not in the GL 3.3 headers glad generated for us.
+     */
+    const GLenum gl_draw_indirect_buffer = 0x8F3F;
+
+    bool has_extension(char const* name) {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; ++i) {
+            char const* extension = reinterpret_cast<char const*>(glGetStringi(GL_EXTENSIONS, i));
+            if (extension && std::strcmp(extension, name) == 0) { return true; }
+        }
+        return false;
+    }
+}
+
+namespace sivox {
+    TerrainRenderer::MultiDrawElementsIndirectProc TerrainRenderer::load_multi_draw_indirect(GLADloadproc load) {
+        if (!load) { return nullptr; }
+
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+
+        /*
+         * Base instance is needed too, it's what picks each command's chunk slot. (See ChunkSlotSource)
+         */
+        bool supported = major > 4 || (major == 4 && minor >= 3) ||
+            (has_extension("GL_ARB_multi_draw_indirect") && has_extension("GL_ARB_base_instance"));
+        if (!supported) { return nullptr; }
+
+        return reinterpret_cast<MultiDrawElementsIndirectProc>(load("glMultiDrawElementsIndirect"));
+    }
+
+    TerrainRenderer::TerrainRenderer(VertexFormat format, GLADloadproc load) :
+        m_multi_draw_elements_indirect(load_multi_draw_indirect(load)),
+        m_geometry(format, m_multi_draw_elements_indirect ? ChunkSlotSource::BaseInstance : ChunkSlotSource::PerVertex),
+        m_command_buffer(0), m_command_buffer_capacity(0) {
+        if (uses_multi_draw_indirect()) {
+            glGenBuffers(1, &m_command_buffer);
+        }
+    }
+
+    TerrainRenderer::~TerrainRenderer() {
+        glDeleteBuffers(1, &m_command_buffer);
+    }
+
+    void TerrainRenderer::add_commands(ChunkGeometryPool::Entry const& entry) {
+        for (ChunkGeometryPool::Section const& section : entry.sections) {
+            if (section.empty()) { continue; }
+
+            DrawCommand command;
+            command.count = static_cast<GLuint>(section.triangle_index_count);
+            command.instance_count = 1;
+            command.first_index = static_cast<GLuint>(m_geometry.first_triangle_index(section));
+            command.base_vertex = static_cast<GLint>(m_geometry.base_vertex(section));
+            command.base_instance = static_cast<GLuint>(entry.slot);
+            m_commands.push_back(command);
+            m_triangle_index_count += section.triangle_index_count;
+
+            if (!uses_multi_draw_indirect()) {
+                m_counts.push_back(static_cast<GLsizei>(command.count));
+                m_first_indices.push_back(reinterpret_cast<void const*>(command.first_index * sizeof(ChunkMesh::TriangleIndex)));
+                m_base_vertices.push_back(command.base_vertex);
+            }
+        }
+    }
+
+    void TerrainRenderer::draw(std::vector<Position> const& chunk_positions, GLint chunk_offsets_location) {
+        m_commands.clear();
+        m_counts.clear();
+        m_first_indices.clear();
+        m_base_vertices.clear();
+        m_triangle_index_count = 0;
+
+        auto const& entries = m_geometry.entries();
+        for (Position chunk_position : chunk_positions) {
+            auto it = entries.find(chunk_position);
+            if (it != entries.end()) {
+                add_commands(it->second);
+            }
+        }
+        submit(chunk_offsets_location);
+    }
+
+    void TerrainRenderer::draw_all(GLint chunk_offsets_location) {
+        m_commands.clear();
+        m_counts.clear();
+        m_first_indices.clear();
+        m_base_vertices.clear();
+        m_triangle_index_count = 0;
+
+        for (auto const& pair : m_geometry.entries()) {
+            add_commands(pair.second);
+        }
+        submit(chunk_offsets_location);
+    }
+
+    void TerrainRenderer::submit(GLint chunk_offsets_location) {
+        if (m_commands.empty()) { return; }
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_BUFFER, m_geometry.chunk_offset_texture());
+        glUniform1i(chunk_offsets_location, 0);
+        glBindVertexArray(m_geometry.vertex_array());
+
+        if (uses_multi_draw_indirect()) {
+            s64 size = static_cast<s64>(m_commands.size() * sizeof(DrawCommand));
+            while (m_command_buffer_capacity < size) {
+                m_command_buffer_capacity = m_command_buffer_capacity > 0 ? m_command_buffer_capacity * 2 : 4096;
+            }
+
+            /*
+             * Orphan last frame's commands rather than overwriting them, so we don't wait on the GPU to finish with
+             * them.
+             */
+            glBindBuffer(gl_draw_indirect_buffer, m_command_buffer);
+            glBufferData(gl_draw_indirect_buffer, m_command_buffer_capacity, nullptr, GL_STREAM_DRAW);
+            glBufferSubData(gl_draw_indirect_buffer, 0, size, m_commands.data());
+            m_multi_draw_elements_indirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, static_cast<GLsizei>(m_commands.size()), 0);
+            glBindBuffer(gl_draw_indirect_buffer, 0);
+        }
+        else {
+            glMultiDrawElementsBaseVertex(
+                GL_TRIANGLES,
+                m_counts.data(),
+                GL_UNSIGNED_INT,
+                m_first_indices.data(),
+                static_cast<GLsizei>(m_counts.size()),
+                m_base_vertices.data()
+            );
+        }
+
+        glBindVertexArray(0);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+}
@@ -0,0 +1,102 @@
+#pragma once
+#ifndef SIVOX_GAME_TERRAINRENDERER_HPP
+#define SIVOX_GAME_TERRAINRENDERER_HPP
+
+#include "common.hpp"
+#include <vector>
+#include <glad/glad.h>
+#include "chunkgeometrypool.hpp"
+
+namespace sivox {
+    /*
+     * Draws the chunks in a ChunkGeometryPool with one draw call per frame, however many chunks there are.
+     *
+     * Every frame a command list is built for the chunks to draw and submitted with glMultiDrawElementsIndirect if
+     * the context supports it (GL 4.3, or ARB_multi_draw_indirect and ARB_base_instance), and with
+     * glMultiDrawElementsBaseVertex otherwise. The shader finds each chunk's offset with
+     *
+     *     texelFetch(u_chunk_offsets, int(vert_chunk_slot)).xyz
+     *
+     * where vert_chunk_slot is the uint attribute at location 2 and u_chunk_offsets is a samplerBuffer. How the slot
+     * gets there depends on the path, but the shader doesn't need to know. (See ChunkSlotSource)
+     */
+    class TerrainRenderer {
+    public:
+        /*
+         * Layout of the command glMultiDrawElementsIndirect reads from the GL_DRAW_INDIRECT_BUFFER.
+         */
+        struct DrawCommand {
+            GLuint count;
+            GLuint instance_count;
+            GLuint first_index;
+            GLint base_vertex;
+            GLuint base_instance;
+        };
+        static_assert(sizeof(DrawCommand) == 5 * sizeof(GLuint), "DrawCommand must be tightly packed.");
+
+        /*
+         * [load] is used to look up the entry points glad doesn't load, like glMultiDrawElementsIndirect. Without it
+         * the renderer always falls back to glMultiDrawElementsBaseVertex.
+         */
+        explicit TerrainRenderer(VertexFormat format, GLADloadproc load = nullptr);
+        ~TerrainRenderer();
+
+        TerrainRenderer(TerrainRenderer const& other) = delete;
+        TerrainRenderer &operator=(TerrainRenderer const& other) = delete;
+
+        ChunkGeometryPool &geometry() { return m_geometry; }
+        ChunkGeometryPool const& geometry() const { return m_geometry; }
+
+        /*
+         * Draws the chunks at [chunk_positions] which have geometry in the pool, or every chunk in the pool. The
+         * shader should already be in use, with its u_chunk_offsets sampler at [chunk_offsets_location]. Texture
+         * unit 0 is used for the chunk offsets.
+         */
+        void draw(std::vector<Position> const& chunk_positions, GLint chunk_offsets_location);
+        void draw_all(GLint chunk_offsets_location);
+
+        bool uses_multi_draw_indirect() const { return m_multi_draw_elements_indirect != nullptr; }
+
+        /*
+         * Number of draw commands in the last draw: one per non-empty section of each chunk drawn.
+         */
+        s32 draw_count() const { return static_cast<s32>(m_commands.size()); }
+
+        /*
+         * Number of triangles drawn by the last draw.
+         */
+        s64 triangle_count() const { return m_triangle_index_count / 3; }
+
+    private:
+        using MultiDrawElementsIndirectProc = void (APIENTRYP)(GLenum mode, GLenum type, void const* indirect, GLsizei draw_count, GLsizei stride);
+
+        /*
+         * Declared before m_geometry because it decides the pool's ChunkSlotSource.
+         */
+        MultiDrawElementsIndirectProc m_multi_draw_elements_indirect;
+        ChunkGeometryPool m_geometry;
+
+        GLuint m_command_buffer;
+        s64 m_command_buffer_capacity;
+
+        /*
+         * Reused every frame so building the command list doesn't allocate once it has grown to size. The fallback
+         * path needs the commands split into separate arrays.
+         */
+        std::vector<DrawCommand> m_commands;
+        std::vector<GLsizei> m_counts;
+        std::vector<void const*> m_first_indices;
+        std::vector<GLint> m_base_vertices;
+        s64 m_triangle_index_count = 0;
+
+        static MultiDrawElementsIndirectProc load_multi_draw_indirect(GLADloadproc load);
+
+        /*
+         * Adds a command for each non-empty section of [entry].
+         */
+        void add_commands(ChunkGeometryPool::Entry const& entry);
+        void submit(GLint chunk_offsets_location);
+    };
+}
+
+#endif // SIVOX_GAME_TERRAINRENDERER_HPP
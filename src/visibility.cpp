@@ -0,0 +1,218 @@
+#include "visibility.hpp"
+#include <array>
+#include <cmath>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace {
+    static_assert(sivox::Chunk::height == 32, "Air is flood filled one u32 column at a time");
+
+    constexpr sivox::s32 column_count = sivox::Chunk::width * sivox::Chunk::length;
+
+    sivox::s32 count_trailing_zeros(sivox::u32 bits) {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, bits);
+        return static_cast<sivox::s32>(index);
+#else
+        return __builtin_ctz(bits);
+#endif
+    }
+
+    sivox::s32 highest_bit(sivox::u32 bits) {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanReverse(&index, bits);
+        return static_cast<sivox::s32>(index);
+#else
+        return 31 - __builtin_clz(bits);
+#endif
+    }
+
+    /*
+     * The run of set bits in [bits] which bit [y] is part of. Bit [y] must be set.
+     */
+    sivox::u32 run_through(sivox::u32 bits, sivox::s32 y) {
+        using sivox::u32;
+        const u32 bit = 1u << y;
+
+        /*
+         * Adding the bit carries through the run from y up and clears it, leaving everything else as it was.
+         */
+        const u32 above = bits & ~(bits + bit);
+        const u32 gaps_below = ~bits & (bit - 1);
+        const u32 below = gaps_below ? (bit - 1) & ~((2u << highest_bit(gaps_below)) - 1) : bit - 1;
+        return above | below;
+    }
+
+    /*
+     * [air] holds a column of air bits per x, z, indexed by x + z * width, bit y set for air at height y.
+     */
+    sivox::FaceConnectivity flood_fill(std::array<sivox::u32, column_count> const& air) {
+        using namespace sivox;
+
+        bool any_air = false, all_air = true;
+        for (u32 column : air) {
+            any_air |= column != 0;
+            all_air &= column == ~0u;
+        }
+        if (!any_air) { return FaceConnectivity::none(); }
+        if (all_air) { return FaceConnectivity::all(); }
+
+        /*
+         * Each seed is a column index and a height. A whole run of air is filled at once, seeding the runs it touches
+         * in the four neighbouring columns.
+         */
+        std::array<u32, column_count> filled = {};
+        std::vector<std::pair<s32, s32>> seeds;
+        FaceConnectivity connectivity;
+
+        for (s32 start = 0; start < column_count; ++start) {
+            while (u32 unfilled = air[start] & ~filled[start]) {
+                u32 faces = 0;
+                seeds.push_back({ start, count_trailing_zeros(unfilled) });
+                while (!seeds.empty()) {
+                    auto [column, y] = seeds.back();
+                    seeds.pop_back();
+                    if ((filled[column] >> y) & 1u) { continue; }
+
+                    const u32 run = run_through(air[column], y);
+                    filled[column] |= run;
+
+                    const s32 x = column % Chunk::width;
+                    const s32 z = column / Chunk::width;
+                    faces |= (run & 1u) << static_cast<s32>(BlockFace::Bottom);
+                    faces |= (run >> (Chunk::height - 1)) << static_cast<s32>(BlockFace::Top);
+                    faces |= static_cast<u32>(x == 0) << static_cast<s32>(BlockFace::Left);
+                    faces |= static_cast<u32>(x == Chunk::width - 1) << static_cast<s32>(BlockFace::Right);
+                    faces |= static_cast<u32>(z == 0) << static_cast<s32>(BlockFace::Front);
+                    faces |= static_cast<u32>(z == Chunk::length - 1) << static_cast<s32>(BlockFace::Back);
+
+                    auto seed_runs = [&](s32 neighbour) {
+                        u32 touching = air[neighbour] & ~filled[neighbour] & run;
+                        for (u32 starts = touching & ~(touching << 1); starts != 0; starts &= starts - 1) {
+                            seeds.push_back({ neighbour, count_trailing_zeros(starts) });
+                        }
+                    };
+                    if (x > 0) { seed_runs(column - 1); }
+                    if (x < Chunk::width - 1) { seed_runs(column + 1); }
+                    if (z > 0) { seed_runs(column - Chunk::width); }
+                    if (z < Chunk::length - 1) { seed_runs(column + Chunk::width); }
+                }
+
+                for (s32 a = 0; a < 6; ++a) {
+                    if (!((faces >> a) & 1u)) { continue; }
+                    for (s32 b = a; b < 6; ++b) {
+                        if ((faces >> b) & 1u) { connectivity.connect(static_cast<BlockFace>(a), static_cast<BlockFace>(b)); }
+                    }
+                }
+            }
+        }
+        return connectivity;
+    }
+
+    /*
+     * Offset to the chunk on the other side of each face, indexed by BlockFace. The face on the other side is always
+     * face ^ 1.
+     */
+    const std::array<sivox::Position, 6> s_face_offsets = {{
+        { 0, 1, 0 },
+        { 0, -1, 0 },
+        { -1, 0, 0 },
+        { 1, 0, 0 },
+        { 0, 0, -1 },
+        { 0, 0, 1 },
+    }};
+}
+
+namespace sivox {
+    FaceConnectivity FaceConnectivity::compute(Chunk const& chunk) {
+        if (chunk.bits_per_block() == 0) {
+            return chunk.block_at(0) == 0 ? all() : none();
+        }
+
+        std::array<u32, column_count> air;
+        for (s32 z = 0; z < Chunk::length; ++z) {
+            for (s32 x = 0; x < Chunk::width; ++x) {
+                const s32 base = Chunk::block_index({x, 0, z});
+                u32 bits = 0;
+                for (s32 y = 0; y < Chunk::height; ++y) {
+                    bits |= static_cast<u32>(chunk.block_at(base + y) == 0) << y;
+                }
+                air[x + z * Chunk::width] = bits;
+            }
+        }
+        return flood_fill(air);
+    }
+
+    FaceConnectivity FaceConnectivity::compute(ChunkNeighbourhood const& neighbourhood) {
+        std::array<u32, column_count> air;
+        for (s32 z = 0; z < Chunk::length; ++z) {
+            for (s32 x = 0; x < Chunk::width; ++x) {
+                Block const* column = neighbourhood.column(x, z) + 1;
+                u32 bits = 0;
+                for (s32 y = 0; y < Chunk::height; ++y) {
+                    bits |= static_cast<u32>(column[y] == 0) << y;
+                }
+                air[x + z * Chunk::width] = bits;
+            }
+        }
+        return flood_fill(air);
+    }
+
+    void VisibilityGraph::traverse(glm::vec3 camera, Frustum const& frustum, s32 max_distance, std::vector<Position> &visible) {
+        visible.clear();
+        m_queue.clear();
+        m_visited.clear();
+
+        const Position camera_chunk = {
+            static_cast<s32>(std::floor(camera.x / Chunk::width)),
+            static_cast<s32>(std::floor(camera.y / Chunk::height)),
+            static_cast<s32>(std::floor(camera.z / Chunk::length))
+        };
+        m_queue.push_back({ camera_chunk, -1, 0 });
+        m_visited.insert(camera_chunk);
+
+        /*
+         * The queue is only ever appended to, so it doubles as the list of chunks visited in order.
+         */
+        for (std::size_t next = 0; next < m_queue.size(); ++next) {
+            const Step step = m_queue[next];
+
+            auto it = m_chunks.find(step.chunk_position);
+            if (it != m_chunks.end()) {
+                visible.push_back(step.chunk_position);
+            }
+            const FaceConnectivity connectivity = it != m_chunks.end() ? it->second : FaceConnectivity::all();
+
+            for (s32 face = 0; face < 6; ++face) {
+                /*
+                 * Never back towards the camera, and only out through faces the way in can see.
+                 */
+                if ((step.directions >> (face ^ 1)) & 1u) { continue; }
+                if (step.entered_through >= 0
+                        && !connectivity.connected(static_cast<BlockFace>(step.entered_through), static_cast<BlockFace>(face))) {
+                    continue;
+                }
+
+                Position offset = s_face_offsets[face];
+                Position neighbour = {
+                    step.chunk_position.x + offset.x,
+                    step.chunk_position.y + offset.y,
+                    step.chunk_position.z + offset.z
+                };
+                if (std::abs(neighbour.x - camera_chunk.x) > max_distance
+                        || std::abs(neighbour.y - camera_chunk.y) > max_distance
+                        || std::abs(neighbour.z - camera_chunk.z) > max_distance) {
+                    continue;
+                }
+                if (!frustum.intersects(chunk_center(neighbour), chunk_extent())) { continue; }
+                if (!m_visited.insert(neighbour).second) { continue; }
+
+                m_queue.push_back({ neighbour, face ^ 1, step.directions | (1u << face) });
+            }
+        }
+    }
+}
@@ -0,0 +1,99 @@
+#pragma once
+#ifndef SIVOX_GAME_VISIBILITY_HPP
+#define SIVOX_GAME_VISIBILITY_HPP
+
+#include "common.hpp"
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <glm/glm.hpp>
+#include "frustum.hpp"
+#include "meshgenerator.hpp"
+#include "voxelterrain.hpp"
+
+namespace sivox {
+    /*
+     * Which faces of a chunk can see each other through the chunk: faces a and b are connected if some pocket of air
+     * in the chunk touches both of them. One bit per pair of faces, indexed by BlockFace, and symmetric.
+     *
+     * A chunk of solid stone connects nothing, so nothing behind it can be seen through it. An empty chunk connects
+     * everything.
+     */
+    class FaceConnectivity {
+    public:
+        static FaceConnectivity none() { return FaceConnectivity(); }
+        static FaceConnectivity all() {
+            FaceConnectivity connectivity;
+            connectivity.m_bits = (u64(1) << 36) - 1;
+            return connectivity;
+        }
+
+        /*
+         * Flood fills the air in [chunk], a run of air in a column at a time. A ChunkNeighbourhood gives the same as
+         * the chunk in the middle of it; the border is ignored.
+         */
+        static FaceConnectivity compute(Chunk const& chunk);
+        static FaceConnectivity compute(ChunkNeighbourhood const& neighbourhood);
+
+        bool connected(BlockFace a, BlockFace b) const { return (m_bits >> bit(a, b)) & 1u; }
+        void connect(BlockFace a, BlockFace b) { m_bits |= (u64(1) << bit(a, b)) | (u64(1) << bit(b, a)); }
+
+        u64 bits() const { return m_bits; }
+
+        friend bool operator==(FaceConnectivity a, FaceConnectivity b) { return a.m_bits == b.m_bits; }
+        friend bool operator!=(FaceConnectivity a, FaceConnectivity b) { return a.m_bits != b.m_bits; }
+
+    private:
+        u64 m_bits = 0;
+
+        static s32 bit(BlockFace a, BlockFace b) { return static_cast<s32>(a) * 6 + static_cast<s32>(b); }
+    };
+
+    /*
+     * The face connectivity of every chunk, for finding which chunks can be seen from the camera at all.
+     *
+     * traverse() walks the chunks breadth first from the one the camera is in. A chunk entered through one face is
+     * only left through faces connected to it, and only in directions that don't lead back towards the camera, so
+     * chunks hidden behind solid rock are never reached. Since each chunk is only entered once, through whichever face
+     * gets there first, this can miss chunks seen through a winding path; it errs towards drawing less in caves rather
+     * than more, which is the usual trade-off for this kind of cave culling.
+     *
+     * Chunks missing from the graph count as air, so the camera can see across unloaded space, but they're never
+     * reported visible.
+     */
+    class VisibilityGraph {
+    public:
+        /*
+         * Adds the chunk at [chunk_position], or replaces its connectivity.
+         */
+        void set(Position chunk_position, FaceConnectivity connectivity) { m_chunks[chunk_position] = connectivity; }
+        void remove(Position chunk_position) { m_chunks.erase(chunk_position); }
+        void clear() { m_chunks.clear(); }
+
+        s32 chunk_count() const { return static_cast<s32>(m_chunks.size()); }
+
+        /*
+         * Replaces the contents of [visible] with the chunks in the graph that may be seen from [camera], in blocks:
+         * those reached from the camera's chunk which intersect the [frustum]. Nothing further than [max_distance]
+         * chunks from the camera's chunk on any axis is visited. The chunks come out roughly front to back.
+         */
+        void traverse(glm::vec3 camera, Frustum const& frustum, s32 max_distance, std::vector<Position> &visible);
+
+    private:
+        struct Step {
+            Position chunk_position;
+            s32 entered_through;  // BlockFace of the chunk, or -1 for the camera's own chunk
+            u32 directions;       // Faces stepped through on the way here, one bit per BlockFace
+        };
+
+        std::unordered_map<Position, FaceConnectivity, PositionHash> m_chunks;
+
+        /*
+         * Kept between traversals so they don't allocate once they've grown.
+         */
+        std::vector<Step> m_queue;
+        std::unordered_set<Position, PositionHash> m_visited;
+    };
+}
+
+#endif // SIVOX_GAME_VISIBILITY_HPP
@@ -1,81 +1,494 @@
 #include "voxelterrain.hpp"
+#include <algorithm>
+#include <cmath>
 
 namespace sivox {
+    void Chunk::set_block_at(s32 index, Block block) {
+        s32 y = index & height_mask;
+        m_dirty_sections |= sections_around(y, y + 1);
+        s32 palette_index = add_to_palette(block);
+        if (m_bits_log2 >= 0) {
+            set_palette_index(index, palette_index);
+        }
+    }
+
+    void Chunk::fill_at(s32 begin, s32 end, Block block) {
+        /*
+         * A range within a single column only dirties the sections around it.
+         */
+        if (begin < end && begin >> height_bits == (end - 1) >> height_bits) {
+            m_dirty_sections |= sections_around(begin & height_mask, ((end - 1) & height_mask) + 1);
+        }
+        else if (begin < end) {
+            m_dirty_sections = all_sections;
+        }
+
+        s32 palette_index = add_to_palette(block);
+        if (m_bits_log2 < 0) { return; }
+
+        /*
+         * Whole words in the middle of the range are written in one go, with the index repeated across the word.
+         */
+        const s32 per_word_log2 = 6 - m_bits_log2;
+        const s32 per_word_mask = (1 << per_word_log2) - 1;
+        const u64 pattern = static_cast<u64>(palette_index) * (~u64(0) / ((u64(1) << (1 << m_bits_log2)) - 1));
+
+        s32 index = begin;
+        for (; index < end && (index & per_word_mask) != 0; ++index) {
+            set_palette_index(index, palette_index);
+        }
+        for (; index + per_word_mask < end; index += per_word_mask + 1) {
+            m_indices[index >> per_word_log2] = pattern;
+        }
+        for (; index < end; ++index) {
+            set_palette_index(index, palette_index);
+        }
+    }
+
+    void Chunk::fill(Block block) {
+        m_dirty_sections = all_sections;
+        m_palette.assign(1, block);
+        m_palette.shrink_to_fit();
+        m_indices.clear();
+        m_indices.shrink_to_fit();
+        m_bits_log2 = -1;
+    }
+
+    s32 Chunk::add_to_palette(Block block) {
+        s32 palette_index = static_cast<s32>(std::find(m_palette.begin(), m_palette.end(), block) - m_palette.begin());
+        if (palette_index == palette_size()) {
+            m_palette.push_back(block);
+
+            s32 capacity = m_bits_log2 < 0 ? 1 : 1 << (1 << m_bits_log2);
+            if (palette_size() > capacity) {
+                std::vector<s32> identity(palette_size());
+                for (s32 i = 0; i < palette_size(); ++i) { identity[i] = i; }
+                repack(m_bits_log2 + 1, identity);
+            }
+        }
+        return palette_index;
+    }
+
+    void Chunk::set_palette_index(s32 index, s32 palette_index) {
+        s32 shift = (index << m_bits_log2) & 63;
+        u64 mask = ((u64(1) << (1 << m_bits_log2)) - 1) << shift;
+        u64 &word = m_indices[(index << m_bits_log2) >> 6];
+        word = (word & ~mask) | ((static_cast<u64>(palette_index) << shift) & mask);
+    }
+
+    void Chunk::repack(s32 bits_log2, std::vector<s32> const& remap) {
+        std::vector<u64> old_indices;
+        old_indices.swap(m_indices);
+        s32 old_bits_log2 = m_bits_log2;
+
+        m_bits_log2 = bits_log2;
+        if (bits_log2 < 0) { return; }
+        m_indices.assign((static_cast<s64>(volume) << bits_log2) / 64, 0);
+
+        if (old_bits_log2 < 0) {
+            if (remap[0] != 0) {
+                for (s32 i = 0; i < volume; ++i) { set_palette_index(i, remap[0]); }
+            }
+            return;
+        }
+
+        /*
+         * The old indices are decoded at the old width, m_bits_log2 already holds the new one.
+         */
+        for (s32 i = 0; i < volume; ++i) {
+            s32 shift = (i << old_bits_log2) & 63;
+            u64 mask = (u64(1) << (1 << old_bits_log2)) - 1;
+            s32 old_index = static_cast<s32>((old_indices[(i << old_bits_log2) >> 6] >> shift) & mask);
+            set_palette_index(i, remap[old_index]);
+        }
+    }
+
+    void Chunk::assign(std::vector<Block> palette, u16 const* indices) {
+        s32 bits_log2 = -1;
+        while ((bits_log2 < 0 ? 1 : 1 << (1 << bits_log2)) < static_cast<s32>(palette.size())) { ++bits_log2; }
+
+        m_palette = std::move(palette);
+        m_bits_log2 = bits_log2;
+        m_dirty_sections = all_sections;
+        if (bits_log2 < 0) {
+            m_indices.clear();
+            return;
+        }
+
+        /*
+         * Each word is put together in a register and written once.
+         */
+        const s32 bits = 1 << bits_log2;
+        const s32 per_word = 64 >> bits_log2;
+        m_indices.resize((static_cast<s64>(volume) << bits_log2) / 64);
+        for (std::size_t word = 0; word < m_indices.size(); ++word) {
+            u16 const* in = indices + word * per_word;
+            u64 packed = 0;
+            for (s32 i = 0; i < per_word; ++i) {
+                packed |= static_cast<u64>(in[i]) << (i * bits);
+            }
+            m_indices[word] = packed;
+        }
+    }
+
+    void Chunk::compact() {
+        if (m_bits_log2 < 0) { return; }
+
+        std::vector<bool> used(palette_size(), false);
+        for (s32 i = 0; i < volume; ++i) { used[palette_index(i)] = true; }
+
+        std::vector<Block> palette;
+        std::vector<s32> remap(palette_size(), 0);
+        for (s32 i = 0; i < palette_size(); ++i) {
+            if (used[i]) {
+                remap[i] = static_cast<s32>(palette.size());
+                palette.push_back(m_palette[i]);
+            }
+        }
+
+        s32 bits_log2 = -1;
+        while ((bits_log2 < 0 ? 1 : 1 << (1 << bits_log2)) < static_cast<s32>(palette.size())) { ++bits_log2; }
+
+        if (bits_log2 != m_bits_log2 || palette.size() != m_palette.size()) {
+            repack(bits_log2, remap);
+        }
+        m_palette = std::move(palette);
+        m_palette.shrink_to_fit();
+        m_indices.shrink_to_fit();
+    }
+
+    Terrain::Terrain() :
+        m_bounded(false),
+        m_width_chunks(0), m_height_chunks(0), m_length_chunks(0),
+        m_width_pages(0), m_height_pages(0), m_length_pages(0) {
+        m_page_table.resize(64);
+        m_page_table_shift = 64 - 6;
+    }
+
     Terrain::Terrain(s32 width_chunks, s32 height_chunks, s32 length_chunks) :
-        m_width_chunks(width_chunks), m_height_chunks(height_chunks), m_length_chunks(length_chunks) {}
+        m_bounded(true),
+        m_width_chunks(width_chunks), m_height_chunks(height_chunks), m_length_chunks(length_chunks),
+        m_width_pages((width_chunks + page_mask) >> page_bits),
+        m_height_pages((height_chunks + page_mask) >> page_bits),
+        m_length_pages((length_chunks + page_mask) >> page_bits) {
+        m_pages.resize(static_cast<std::size_t>(m_width_pages) * m_height_pages * m_length_pages);
+    }
 
-    Chunk *Terrain::chunk(Position chunk_position) { 
-        if (chunk_position.x < 0 || chunk_position.x >= width_chunks()) { return nullptr; }
-        if (chunk_position.y < 0 || chunk_position.y >= height_chunks()) { return nullptr; }
-        if (chunk_position.z < 0 || chunk_position.z >= length_chunks()) { return nullptr; }
+    Terrain::ChunkPage &Terrain::add_page(Position cp) {
+        if (m_bounded) {
+            std::unique_ptr<ChunkPage> &page = m_pages[page_index(cp)];
+            page = std::make_unique<ChunkPage>();
+            return *page;
+        }
+
+        if ((m_page_table_count + 1) * 2 > static_cast<s32>(m_page_table.size())) {
+            grow_page_table();
+        }
+
+        const s32 mask = static_cast<s32>(m_page_table.size()) - 1;
+        s32 i = page_table_home(page_position(cp));
+        while (m_page_table[i].page) { i = (i + 1) & mask; }
+
+        m_page_table[i].page_position = page_position(cp);
+        m_page_table[i].page = std::make_unique<ChunkPage>();
+        ++m_page_table_count;
+        return *m_page_table[i].page;
+    }
+
+    void Terrain::remove_page(Position cp) {
+        if (m_bounded) {
+            m_pages[page_index(cp)].reset();
+            return;
+        }
+
+        const s32 mask = static_cast<s32>(m_page_table.size()) - 1;
+        const Position target = page_position(cp);
+        s32 i = page_table_home(target);
+        while (m_page_table[i].page && m_page_table[i].page_position != target) { i = (i + 1) & mask; }
+        if (!m_page_table[i].page) { return; }
+
+        m_page_table[i].page.reset();
+        --m_page_table_count;
+
+        /*
+         * Backward shift deletion: later slots in the same run move up into the hole unless their home is
+         * cyclically after it, so lookups never stop early at a hole and no tombstones are needed.
+         */
+        s32 hole = i;
+        for (s32 j = (i + 1) & mask; m_page_table[j].page; j = (j + 1) & mask) {
+            s32 home = page_table_home(m_page_table[j].page_position);
+            bool stays = hole <= j ? (home > hole && home <= j) : (home > hole || home <= j);
+            if (!stays) {
+                m_page_table[hole] = std::move(m_page_table[j]);
+                hole = j;
+            }
+        }
+    }
+
+    Terrain::ChunkPage const* Terrain::find_unbounded_page(Position page_position) const {
+        const s32 mask = static_cast<s32>(m_page_table.size()) - 1;
+        for (s32 i = page_table_home(page_position); m_page_table[i].page; i = (i + 1) & mask) {
+            if (m_page_table[i].page_position == page_position) { return m_page_table[i].page.get(); }
+        }
+        return nullptr;
+    }
 
-        auto it = m_chunks.find(chunk_index(chunk_position));
-        if (it == m_chunks.end()) { return nullptr; }
-        else { return it->second.get(); }
+    /*
+     * Fibonacci hashing, taking the top bits of the product so that neighbouring pages spread out over the table.
+     */
+    s32 Terrain::page_table_home(Position page_position) const {
+        u64 hash = static_cast<u64>(PositionHash{}(page_position)) * 0x9E3779B97F4A7C15ull;
+        return static_cast<s32>(hash >> m_page_table_shift);
     }
-    Chunk const* Terrain::chunk(Position chunk_position) const {
-        if (chunk_position.x < 0 || chunk_position.x >= width_chunks()) { return nullptr; }
-        if (chunk_position.y < 0 || chunk_position.y >= height_chunks()) { return nullptr; }
-        if (chunk_position.z < 0 || chunk_position.z >= length_chunks()) { return nullptr; }
 
-        auto it = m_chunks.find(chunk_index(chunk_position));
-        if (it == m_chunks.end()) { return nullptr; }
-        else { return it->second.get(); }
+    void Terrain::grow_page_table() {
+        std::vector<PageTableSlot> old_table;
+        old_table.swap(m_page_table);
+
+        m_page_table.resize(old_table.size() * 2);
+        --m_page_table_shift;
+
+        const s32 mask = static_cast<s32>(m_page_table.size()) - 1;
+        for (PageTableSlot &slot : old_table) {
+            if (!slot.page) { continue; }
+            s32 i = page_table_home(slot.page_position);
+            while (m_page_table[i].page) { i = (i + 1) & mask; }
+            m_page_table[i] = std::move(slot);
+        }
     }
 
     Chunk *Terrain::create_chunk(Position chunk_position) {
-        if (chunk_position.x < 0 || chunk_position.x >= width_chunks()) { return nullptr; }
-        if (chunk_position.y < 0 || chunk_position.y >= height_chunks()) { return nullptr; }
-        if (chunk_position.z < 0 || chunk_position.z >= length_chunks()) { return nullptr; }
+        if (!in_bounds(chunk_position)) { return nullptr; }
+
+        ChunkPage *page = find_page(chunk_position);
+        if (!page) { page = &add_page(chunk_position); }
 
-        if (Chunk *c = chunk(chunk_position)) { return c; }
-        else {
-            auto index = chunk_index(chunk_position);
-            m_chunks[index] = std::make_unique<Chunk>();
-            return m_chunks[index].get();
+        Chunk *&slot = page->chunks[index_in_page(chunk_position)];
+        if (slot) { return slot; }
+
+        if (m_free_chunks.empty()) {
+            m_slabs.push_back(std::make_unique<Chunk[]>(chunks_per_slab));
+            Chunk *slab = m_slabs.back().get();
+            for (s32 i = chunks_per_slab - 1; i >= 0; --i) {
+                m_free_chunks.push_back(&slab[i]);
+            }
         }
+
+        slot = m_free_chunks.back();
+        m_free_chunks.pop_back();
+        ++page->count;
+        ++m_chunk_count;
+        return slot;
     }
 
     void Terrain::delete_chunk(Position chunk_position) {
-        auto it = m_chunks.find(chunk_index(chunk_position));
-        if (it != m_chunks.end()) {
-            m_chunks.erase(it);
+        ChunkPage *page = find_page(chunk_position);
+        if (!page) { return; }
+
+        Chunk *&slot = page->chunks[index_in_page(chunk_position)];
+        if (!slot) { return; }
+
+        /*
+         * Reset now rather than in create_chunk so the blocks' memory is released while the chunk sits unused.
+         */
+        *slot = Chunk();
+        m_free_chunks.push_back(slot);
+        slot = nullptr;
+        --m_chunk_count;
+
+        s32 index = index_in_page(chunk_position);
+        if (page->references[index] == 0 && page->release_serials[index] != 0) { --m_released_count; }
+        page->references[index] = 0;
+        page->release_serials[index] = 0;
+
+        if (--page->count == 0) {
+            remove_page(chunk_position);
         }
     }
 
+    namespace {
+        /*
+         * Largest s such that s * s <= n, for n >= 0.
+         */
+        s32 isqrt(s32 n) {
+            s32 s = static_cast<s32>(std::sqrt(static_cast<f64>(n)));
+            while (s * s > n) { --s; }
+            while ((s + 1) * (s + 1) <= n) { ++s; }
+            return s;
+        }
+
+        /*
+         * The y interval [min, max] of the sphere around [center] with [radius] in the column at (x, z). Empty when
+         * min > max.
+         */
+        struct Column {
+            s32 min = 0;
+            s32 max = -1;
+        };
+
+        Column sphere_column(Position center, s32 radius, s32 x, s32 z) {
+            s32 dx = x - center.x;
+            s32 dz = z - center.z;
+            s32 remaining = radius * radius - dx * dx - dz * dz;
+            if (radius < 0 || remaining < 0) { return {}; }
+            s32 half_height = isqrt(remaining);
+            return { center.y - half_height, center.y + half_height };
+        }
+
+        /*
+         * Calls [f] with every position in the sphere around [center] with [radius] which isn't in the one around
+         * [other_center] with [other_radius].
+         */
+        template <typename F>
+        void sphere_difference(Position center, s32 radius, Position other_center, s32 other_radius, F f) {
+            if (radius < 0) { return; }
+            for (s32 z = center.z - radius; z <= center.z + radius; ++z) {
+                for (s32 x = center.x - radius; x <= center.x + radius; ++x) {
+                    Column column = sphere_column(center, radius, x, z);
+                    Column other = sphere_column(other_center, other_radius, x, z);
+                    for (s32 y = column.min; y <= column.max; ++y) {
+                        if (y >= other.min && y <= other.max) {
+                            y = other.max;
+                            continue;
+                        }
+                        f(Position(x, y, z));
+                    }
+                }
+            }
+        }
+
+        s32 distance_squared(Position a, Position b) {
+            s32 dx = a.x - b.x;
+            s32 dy = a.y - b.y;
+            s32 dz = a.z - b.z;
+            return dx * dx + dy * dy + dz * dz;
+        }
+    }
+
+    Chunk *Terrain::acquire_chunk(Position chunk_position) {
+        Chunk *chunk = create_chunk(chunk_position);
+        if (!chunk) { return nullptr; }
+
+        ChunkPage &page = *find_page(chunk_position);
+        s32 index = index_in_page(chunk_position);
+        if (page.references[index]++ == 0 && page.release_serials[index] != 0) {
+            page.release_serials[index] = 0;
+            --m_released_count;
+        }
+        return chunk;
+    }
+
+    void Terrain::release_chunk(Position chunk_position) {
+        ChunkPage *page = find_page(chunk_position);
+        if (!page) { return; }
+
+        s32 index = index_in_page(chunk_position);
+        if (!page->chunks[index] || page->references[index] == 0) { return; }
+
+        if (--page->references[index] == 0) {
+            u64 serial = m_next_release_serial++;
+            page->release_serials[index] = serial;
+            m_released.push_back({ chunk_position, serial, m_tick });
+            ++m_released_count;
+        }
+    }
+
+    bool Terrain::is_released(Released const& released) const {
+        ChunkPage const* page = find_page(released.chunk_position);
+        if (!page) { return false; }
+        s32 index = index_in_page(released.chunk_position);
+        return page->references[index] == 0 && page->release_serials[index] == released.serial;
+    }
+
+    void Terrain::tick() {
+        ++m_tick;
+        m_evicted.clear();
+
+        while (!m_released.empty()) {
+            Released const& front = m_released.front();
+            if (is_released(front)) {
+                bool expired = m_tick - front.tick >= m_grace_period;
+                if (!expired && m_released_count <= m_released_capacity) { break; }
+
+                m_evicted.push_back(front.chunk_position);
+                delete_chunk(front.chunk_position);
+            }
+            m_released.pop_front();
+        }
+    }
+
+    s32 Terrain::references(Position chunk_position) const {
+        ChunkPage const* page = find_page(chunk_position);
+        if (!page) { return 0; }
+        return page->references[index_in_page(chunk_position)];
+    }
+
     LoadedArea::LoadedArea(Terrain &terrain, Position center_chunk, s32 radius_chunks) : m_terrain(terrain) {
         update_loaded_volume(center_chunk, radius_chunks);
     }
 
+    LoadedArea::~LoadedArea() {
+        sphere_difference(m_center_chunk, m_radius_chunks, Position(), -1, [this](Position position) {
+            if (m_chunks[chunk_index(position)]) {
+                terrain().release_chunk(position);
+            }
+        });
+    }
+
     void LoadedArea::update_loaded_volume(Position new_center_chunk, s32 new_radius_chunks) {
-        m_center_chunk = new_center_chunk;
-        m_radius_chunks = new_radius_chunks;
-        
-        s32 radius = radius_chunks();
-        s32 diameter = diameter_chunks();
-
-        m_chunks.resize(diameter * diameter * diameter, nullptr);
-
-        for (s32 z = 0; z < diameter; ++z) {
-            for (s32 x = 0; x < diameter; ++x) {
-                for (s32 y = 0; y < diameter; ++y) {
-                    Position position = {x, y, z};
-                    f32 distance = Position::distance(position, center_chunk());
-                    if (distance <= radius) {
-                        Chunk *chunk = terrain().chunk(position);
-                        if (!chunk) {
-                            chunk = terrain().create_chunk(position);
-                        }
-                        // TODO: Increase chunk ref count
-                        m_chunks[chunk_index(position)] = chunk;
-                    }
-                    else {
-                        // TODO: If already loaded, decrease chunk ref count
-                        terrain().delete_chunk(position);
-                        m_chunks[chunk_index(position)] = nullptr;
+        const Position old_center = m_center_chunk;
+        const s32 old_radius = m_radius_chunks;
+
+        m_loaded.clear();
+        m_unloaded.clear();
+
+        sphere_difference(old_center, old_radius, new_center_chunk, new_radius_chunks, [this](Position position) {
+            Chunk *&slot = m_chunks[chunk_index(position)];
+            if (slot) {
+                terrain().release_chunk(position);
+                slot = nullptr;
+                m_unloaded.push_back(position);
+            }
+        });
+
+        /*
+         * The slot grid depends on the radius. Chunks staying in the area have to be moved to their new slots.
+         */
+        if (new_radius_chunks != old_radius) {
+            std::vector<Chunk*> old_chunks;
+            old_chunks.swap(m_chunks);
+
+            m_radius_chunks = new_radius_chunks;
+            s32 side = diameter_chunks();
+            m_chunks.assign(static_cast<std::size_t>(side) * side * side, nullptr);
+
+            if (old_radius >= 0) {
+                const s32 old_side = 2 * old_radius + 1;
+                auto wrap = [old_side](s32 v) { s32 m = v % old_side; return m < 0 ? m + old_side : m; };
+                sphere_difference(old_center, old_radius, Position(), -1, [&](Position position) {
+                    if (contains(new_center_chunk, new_radius_chunks, position)) {
+                        s32 old_index = wrap(position.y) + wrap(position.x) * old_side + wrap(position.z) * old_side * old_side;
+                        m_chunks[chunk_index(position)] = old_chunks[old_index];
                     }
-                }
+                });
             }
         }
+
+        m_center_chunk = new_center_chunk;
+        m_radius_chunks = new_radius_chunks;
+
+        sphere_difference(new_center_chunk, new_radius_chunks, old_center, old_radius, [this](Position position) {
+            if (Chunk *chunk = terrain().acquire_chunk(position)) {
+                m_chunks[chunk_index(position)] = chunk;
+                m_loaded.push_back(position);
+            }
+        });
+
+        std::sort(m_loaded.begin(), m_loaded.end(), [this](Position a, Position b) {
+            return distance_squared(a, m_center_chunk) < distance_squared(b, m_center_chunk);
+        });
+        std::sort(m_unloaded.begin(), m_unloaded.end(), [this](Position a, Position b) {
+            return distance_squared(a, m_center_chunk) > distance_squared(b, m_center_chunk);
+        });
     }
 }
@@ -3,7 +3,9 @@
 #define SIVOX_GAME_VOXELTERRAIN_HPP
 
 #include "common.hpp"
+#include <algorithm>
 #include <array>
+#include <deque>
 #include <vector>
 #include <unordered_map>
 #include <memory>
@@ -41,6 +43,18 @@ namespace sivox {
     inline bool operator==(Position a, Position b) { return a.x == b.x && a.y == b.y && a.z == b.z; }
     inline bool operator!=(Position a, Position b) { return !(a == b); }
 
+    /*
+     * Lets Position be used as a key in unordered containers.
+     */
+    struct PositionHash {
+        std::size_t operator()(Position p) const {
+            u64 hash = static_cast<u32>(p.x);
+            hash = hash * 0x9E3779B1u + static_cast<u32>(p.y);
+            hash = hash * 0x9E3779B1u + static_cast<u32>(p.z);
+            return static_cast<std::size_t>(hash ^ (hash >> 29));
+        }
+    };
+
     /*
      * Represents a single block in the world.
      */
@@ -56,8 +70,46 @@ namespace sivox {
     inline bool operator==(Block a, Block b) { return a.id == b.id; }
     inline bool operator!=(Block a, Block b) { return !(a == b); }
 
+    /*
+     * The state a chunk is in. See ChunkProcessor for how chunks move between them.
+     *   - Created
+     *     The chunk has just been created and contains no meaningful block data. The data
+     *     must now be loaded or generated.
+     *
+     *   - Updated
+     *     The chunk has just been modified and its mesh must be recomputed. (Possibly
+     *     along with other data...)
+     *
+     *   - Loaded
+     *     The chunk has been loaded or generated and contains actual terrain data. This
+     *     is the resting state most chunks are going to be in.
+     *
+     *   - Unloaded
+     *     The chunk contains actual data but is no longer loaded. Its data can be saved
+     *     to disk at this point.
+     *
+     *   - Unused
+     *     The chunk is not in use and may be freed or reused. While it may contain
+     *     meaningful data, it's best to assume it contains garbage.
+     */
+    enum class ChunkState {
+        Created,
+        Updated,
+        Loaded,
+        Unloaded,
+        Unused,
+    };
+
     /*
      * Represents a small volume of the world.
+     *
+     * Blocks are palette compressed. The chunk keeps a palette of the distinct blocks in it and each block is stored
+     * as an index into the palette, packed bits_per_block() bits at a time into 64 bit words. A chunk holding a single
+     * kind of block (all air, all stone) has a one entry palette and stores no indices at all.
+     *
+     * Indices are 0, 1, 2, 4, 8 or 16 bits wide so that they never straddle two words. The width grows as new blocks
+     * are added to the palette, but never shrinks by itself since blocks that get overwritten stay in the palette.
+     * compact() drops them again.
      */
     class Chunk {
     public:
@@ -80,13 +132,122 @@ namespace sivox {
         static constexpr s32 height_mask = height - 1;
         static constexpr s32 length_mask = length - 1;
 
+        /*
+         * Chunks are split into sections of section_height layers each, which can be meshed and drawn on their own.
+         * (See ChunkProcessor::set_partial_remeshing)
+         */
+        static constexpr s32 section_height_bits = 3;
+        static constexpr s32 section_height = 1 << section_height_bits;
+        static constexpr s32 section_count = height / section_height;
+        static_assert(section_height_bits <= height_bits);
+        static_assert(section_count <= 32, "Dirty sections are tracked one bit per section in a u32");
+        static constexpr u32 all_sections = section_count == 32 ? ~0u : (1u << section_count) - 1;
+
+        static constexpr s32 max_bits_per_block = 16;
+        static_assert(Block::max_id < (1 << max_bits_per_block), "Every block id must fit in the widest palette.");
+
         Block block(Position p) const { 
-            if (p.x >= 0 && p.x < width && p.y >= 0 && p.y < height && p.z >= 0 && p.z < length) { return m_data[block_index(p)]; }
+            if (p.x >= 0 && p.x < width && p.y >= 0 && p.y < height && p.z >= 0 && p.z < length) { return block_at(block_index(p)); }
             else { return 0; }
         }
 
         void set_block(Position p, Block block) {
-            if (p.x >= 0 && p.x < width && p.y >= 0 && p.y < height && p.z >= 0 && p.z < length) { m_data[block_index(p)] = block; }
+            if (p.x >= 0 && p.x < width && p.y >= 0 && p.y < height && p.z >= 0 && p.z < length) { set_block_at(block_index(p), block); }
+        }
+
+        /*
+         * Sections whose mesh may be out of date, one bit per section. Every way of changing blocks marks the sections
+         * holding them, along with the sections of the blocks right above and below, since their faces and ambient
+         * occlusion depend on the changed blocks too. A new chunk starts out with every section dirty.
+         *
+         * Nothing clears the bits but clear_dirty_sections(), which whoever remeshes the chunk calls.
+         */
+        u32 dirty_sections() const { return m_dirty_sections; }
+        void mark_sections_dirty(u32 sections) { m_dirty_sections |= sections & all_sections; }
+        void clear_dirty_sections() { m_dirty_sections = 0; }
+
+        /*
+         * The sections to mark dirty when the blocks at heights [y_begin, y_end) change. The heights may be outside
+         * of the chunk, for blocks of a neighbouring chunk.
+         */
+        static u32 sections_around(s32 y_begin, s32 y_end) {
+            s32 lowest = std::max(y_begin - 1, 0);
+            s32 highest = std::min(y_end, height - 1);
+            if (lowest > highest) { return 0; }
+            return ((2u << (highest >> section_height_bits)) - 1) & ~((1u << (lowest >> section_height_bits)) - 1);
+        }
+
+        /*
+         * Same as block and set_block, taking an index from block_index instead of a position.
+         */
+        Block block_at(s32 index) const {
+            if (m_bits_log2 < 0) { return m_palette[0]; }
+            return m_palette[palette_index(index)];
+        }
+        void set_block_at(s32 index, Block block);
+
+        /*
+         * Sets every block with an index in [begin, end) to [block], looking it up in the palette only once.
+         */
+        void fill_at(s32 begin, s32 end, Block block);
+
+        /*
+         * Sets every block in the chunk to [block], leaving a uniform chunk with a one entry palette.
+         */
+        void fill(Block block);
+
+        /*
+         * Sets the blocks at heights [y_begin, y_end) of the column at [x], [z] to [block]. The column must be inside
+         * the chunk and 0 <= y_begin <= y_end <= height; nothing is bounds checked.
+         */
+        void fill_column(s32 x, s32 z, s32 y_begin, s32 y_end, Block block) {
+            s32 base = block_index({x, 0, z});
+            fill_at(base + y_begin, base + y_end, block);
+        }
+
+        /*
+         * Replaces every block with f(position, block), walking the chunk in block_index order. [f] is called
+         * directly rather than through a std::function so it can be inlined. The new palette indices are collected
+         * in a flat array and packed once at the end, at the width the new palette needs, so nothing is repacked
+         * along the way and blocks that were only in the old chunk don't linger in the palette.
+         */
+        template <typename F>
+        void transform(F &&f) {
+            std::vector<Block> palette;
+            std::unique_ptr<u16[]> indices(new u16[volume]);
+
+            Block previous;
+            u16 previous_index = 0;
+            for (s32 i = 0; i < volume; ++i) {
+                Block block = f(block_position(i), block_at(i));
+                if (palette.empty() || block != previous) {
+                    previous = block;
+                    auto it = std::find(palette.begin(), palette.end(), block);
+                    previous_index = static_cast<u16>(it - palette.begin());
+                    if (it == palette.end()) { palette.push_back(block); }
+                }
+                indices[i] = previous_index;
+            }
+            assign(std::move(palette), indices.get());
+        }
+
+        /*
+         * Removes blocks which are no longer in the chunk from the palette, narrowing the indices if possible.
+         * A chunk that has been filled with a single kind of block goes back to storing no indices.
+         */
+        void compact();
+
+        /*
+         * Number of distinct blocks in the palette. (Some may no longer be in the chunk, see compact)
+         */
+        s32 palette_size() const { return static_cast<s32>(m_palette.size()); }
+        s32 bits_per_block() const { return m_bits_log2 < 0 ? 0 : 1 << m_bits_log2; }
+
+        /*
+         * Bytes used by the chunk, including the palette and packed indices on the heap.
+         */
+        s64 memory_usage() const {
+            return static_cast<s64>(sizeof(Chunk) + m_palette.capacity() * sizeof(Block) + m_indices.capacity() * sizeof(u64));
         }
 
         /*
@@ -102,19 +263,19 @@ namespace sivox {
                 Block block;
             };
 
-            Iterator(std::array<Block, volume> const* data, s32 pos) : m_data(data), m_position(pos) {}
+            Iterator(Chunk const* chunk, s32 pos) : m_chunk(chunk), m_position(pos) {}
 
             Value operator->() const { 
                 return {
                     block_position(m_position),
-                    (*m_data)[m_position]
+                    m_chunk->block_at(m_position)
                 };
             }
 
             Value operator*() const { 
                 return {
                     block_position(m_position),
-                    (*m_data)[m_position]
+                    m_chunk->block_at(m_position)
                 };
             }
 
@@ -129,7 +290,7 @@ namespace sivox {
             }
 
             friend bool operator==(Iterator a, Iterator b) {
-                return a.m_data && b.m_data && a.m_position == b.m_position && a.m_data == b.m_data;
+                return a.m_chunk && b.m_chunk && a.m_position == b.m_position && a.m_chunk == b.m_chunk;
             }
 
             friend bool operator!=(Iterator a, Iterator b) {
@@ -137,16 +298,19 @@ namespace sivox {
             }
 
         private:
-            std::array<Block, volume> const* m_data;
+            Chunk const* m_chunk;
             s32 m_position;
         };
 
-        Iterator begin() const { return Iterator(&m_data, 0); }
-        Iterator end() const { return Iterator(&m_data, volume); }
+        Iterator begin() const { return Iterator(this, 0); }
+        Iterator end() const { return Iterator(this, volume); }
 
-    private:
-        std::array<Block, volume> m_data;
+        ChunkState state() const { return m_state; }
+        void set_state(ChunkState state) { m_state = state; }
 
+        /*
+         * Blocks are stored y first, then x, then z. Walking indices in order walks each y column bottom to top.
+         */
         static s32 block_index(Position p) {
             auto index = p.y & height_mask;
             index |= (p.x & width_mask) << height_bits;
@@ -160,6 +324,45 @@ namespace sivox {
             s32 z = (index >> (height_bits + width_bits)) & length_mask;
             return {x, y, z};
         }
+
+    private:
+        /*
+         * Distinct blocks in the chunk. Never empty; a new chunk is all air.
+         */
+        std::vector<Block> m_palette = { Block(0) };
+
+        /*
+         * Palette indices, (64 >> m_bits_log2) per word. Empty when m_bits_log2 is -1, meaning every block is
+         * m_palette[0].
+         */
+        std::vector<u64> m_indices;
+        s32 m_bits_log2 = -1;
+
+        ChunkState m_state = ChunkState::Created;
+        u32 m_dirty_sections = all_sections;
+
+        s32 palette_index(s32 index) const {
+            s32 shift = (index << m_bits_log2) & 63;
+            u64 mask = (u64(1) << (1 << m_bits_log2)) - 1;
+            return static_cast<s32>((m_indices[(index << m_bits_log2) >> 6] >> shift) & mask);
+        }
+
+        void set_palette_index(s32 index, s32 palette_index);
+
+        /*
+         * Index of [block] in the palette, adding it and widening the indices if it isn't there yet.
+         */
+        s32 add_to_palette(Block block);
+
+        /*
+         * Repacks the indices [bits_log2] wide, mapping each old palette index through [remap].
+         */
+        void repack(s32 bits_log2, std::vector<s32> const& remap);
+
+        /*
+         * Replaces the contents of the chunk with [palette] and one index into it per block, in block_index order.
+         */
+        void assign(std::vector<Block> palette, u16 const* indices);
     };
 
     inline Position Position::block_to_chunk(Position position) {
@@ -170,10 +373,43 @@ namespace sivox {
         };
     }
 
+    /*
+     * A world of chunks, either bounded to width_chunks x height_chunks x length_chunks or unbounded in every
+     * direction, including negative positions.
+     *
+     * Chunks are found through a paged directory. The world is split into pages of page_size^3 chunk pointers and a
+     * page is only allocated once a chunk in it exists. In a bounded world the pages are in a flat array, so a lookup
+     * is a bounds check and two array reads no matter how big the world is, while empty parts of the world cost one
+     * null pointer per page. In an unbounded world the pages are in an open addressing hash table keyed on the page
+     * position, which is only looked up once per page rather than once per chunk and grows by doubling.
+     *
+     * The chunks themselves come from slabs of chunks_per_slab. Deleted chunks are reset and kept on a free list for
+     * the next create_chunk, so loading and unloading chunks as the player moves doesn't touch the heap. Chunk
+     * pointers stay valid until the chunk is deleted.
+     *
+     * Chunks can be shared with acquire_chunk and release_chunk, which count references, so that several
+     * LoadedAreas can overlap. A chunk whose last reference goes isn't deleted straight away but kept around, still
+     * findable with chunk(), in case it's acquired again: areas moving back and forth over a boundary shouldn't
+     * throw chunks away and load them again. tick() deletes released chunks once they've gone unused for
+     * grace_period ticks, or sooner, least recently released first, when more than released_capacity are waiting.
+     */
     class Terrain {
     public:
+        static constexpr s32 page_bits = 3;
+        static constexpr s32 page_size = 1 << page_bits;
+        static constexpr s32 page_mask = page_size - 1;
+        static constexpr s32 page_volume = page_size * page_size * page_size;
+        static constexpr s32 chunks_per_slab = 64;
+
+        /*
+         * An unbounded world. Its width, height and length are 0.
+         */
+        Terrain();
         Terrain(s32 width_chunks, s32 height_chunks, s32 length_chunks);
 
+        Terrain(Terrain const& other) = delete;
+        Terrain &operator=(Terrain const& other) = delete;
+
         s32 width_chunks() const { return m_width_chunks; }
         s32 height_chunks() const { return m_height_chunks; }
         s32 length_chunks() const { return m_length_chunks; }
@@ -184,26 +420,185 @@ namespace sivox {
         s32 length_blocks() const { return length_chunks() * Chunk::length; }
         s32 volume_blocks() const { return width_blocks() * height_blocks() * length_blocks(); }
 
-        Chunk *chunk(Position chunk_position);
-        Chunk const* chunk(Position chunk_position) const;
+        bool bounded() const { return m_bounded; }
+
+        Chunk *chunk(Position chunk_position) {
+            return const_cast<Chunk*>(static_cast<Terrain const*>(this)->chunk(chunk_position));
+        }
+
+        Chunk const* chunk(Position chunk_position) const {
+            ChunkPage const* page = find_page(chunk_position);
+            if (!page) { return nullptr; }
+            return page->chunks[index_in_page(chunk_position)];
+        }
 
         // TODO: Rename create_chunk to load_chunk and implement generation / loading logic.
         Chunk *create_chunk(Position chunk_position);
         // TODO: Rename delete_chunk to unload_chunk and implement unloading logic.
         void delete_chunk(Position chunk_position);
 
+        /*
+         * Adds a reference to the chunk at [chunk_position], creating it if it doesn't exist. Returns nullptr for
+         * positions outside the terrain.
+         */
+        Chunk *acquire_chunk(Position chunk_position);
+
+        /*
+         * Removes a reference added by acquire_chunk. The chunk is deleted by a later tick() once nothing references
+         * it. (Chunks made with create_chunk and never acquired are left alone.)
+         */
+        void release_chunk(Position chunk_position);
+
+        /*
+         * Advances the clock used for the grace period by one and deletes released chunks which have expired or
+         * don't fit in released_capacity.
+         */
+        void tick();
+
+        /*
+         * Chunks deleted by the last tick(), least recently released first.
+         */
+        std::vector<Position> const& evicted_chunks() const { return m_evicted; }
+
+        s32 references(Position chunk_position) const;
+        s32 released_chunk_count() const { return m_released_count; }
+
+        s64 grace_period() const { return m_grace_period; }
+        void set_grace_period(s64 ticks) { m_grace_period = ticks; }
+        s32 released_capacity() const { return m_released_capacity; }
+        void set_released_capacity(s32 capacity) { m_released_capacity = capacity; }
+
+        /*
+         * Number of chunks that currently exist, and number allocated in slabs including free ones.
+         */
+        s32 chunk_count() const { return m_chunk_count; }
+        s32 pooled_chunk_count() const { return static_cast<s32>(m_slabs.size()) * chunks_per_slab; }
+
     private:
-        std::unordered_map<s32, std::unique_ptr<Chunk>> m_chunks;
+        struct ChunkPage {
+            std::array<Chunk*, page_volume> chunks {};
+            s32 count = 0;
+
+            /*
+             * References from acquire_chunk, and which release made the reference count 0. (See Released)
+             */
+            std::array<s32, page_volume> references {};
+            std::array<u64, page_volume> release_serials {};
+        };
+
+        /*
+         * A chunk waiting to be deleted, in release order. Entries aren't removed when the chunk is acquired again
+         * or deleted; they're skipped once the serial in the page no longer matches or the chunk is referenced.
+         */
+        struct Released {
+            Position chunk_position;
+            u64 serial;
+            s64 tick;
+        };
+
+        /*
+         * An empty slot has no page.
+         */
+        struct PageTableSlot {
+            Position page_position;
+            std::unique_ptr<ChunkPage> page;
+        };
+
+        bool m_bounded;
         s32 m_width_chunks, m_height_chunks, m_length_chunks;
+        s32 m_width_pages, m_height_pages, m_length_pages;
+        std::vector<std::unique_ptr<ChunkPage>> m_pages;
 
-        s32 chunk_index(Position cp) const {
-            return cp.y + cp.x * height_chunks() + cp.z * width_chunks() * height_chunks();
+        /*
+         * Pages of an unbounded world. The capacity is a power of two, 1 << (64 - m_page_table_shift).
+         */
+        std::vector<PageTableSlot> m_page_table;
+        s32 m_page_table_count = 0;
+        s32 m_page_table_shift = 64;
+
+        std::vector<std::unique_ptr<Chunk[]>> m_slabs;
+        std::vector<Chunk*> m_free_chunks;
+        s32 m_chunk_count = 0;
+
+        std::deque<Released> m_released;
+        std::vector<Position> m_evicted;
+        s32 m_released_count = 0;
+        u64 m_next_release_serial = 1;
+        s64 m_tick = 0;
+        s64 m_grace_period = 120;
+        s32 m_released_capacity = 4096;
+
+        bool is_released(Released const& released) const;
+
+        bool in_bounds(Position cp) const {
+            return !m_bounded || (
+                cp.x >= 0 && cp.x < width_chunks()
+                && cp.y >= 0 && cp.y < height_chunks()
+                && cp.z >= 0 && cp.z < length_chunks()
+            );
+        }
+
+        ChunkPage const* find_page(Position cp) const {
+            if (m_bounded) {
+                if (!in_bounds(cp)) { return nullptr; }
+                return m_pages[page_index(cp)].get();
+            }
+            return find_unbounded_page(page_position(cp));
+        }
+
+        ChunkPage *find_page(Position cp) {
+            return const_cast<ChunkPage*>(static_cast<Terrain const*>(this)->find_page(cp));
+        }
+
+        /*
+         * Adds an empty page for [cp], which must be in bounds and not have one already.
+         */
+        ChunkPage &add_page(Position cp);
+        void remove_page(Position cp);
+
+        ChunkPage const* find_unbounded_page(Position page_position) const;
+        s32 page_table_home(Position page_position) const;
+        void grow_page_table();
+
+        /*
+         * Shifts are arithmetic, so negative positions round down into the right page.
+         */
+        static Position page_position(Position cp) {
+            return { cp.x >> page_bits, cp.y >> page_bits, cp.z >> page_bits };
+        }
+
+        s32 page_index(Position cp) const {
+            return (cp.y >> page_bits) + (cp.x >> page_bits) * m_height_pages + (cp.z >> page_bits) * m_width_pages * m_height_pages;
+        }
+
+        /*
+         * Same order as Chunk::block_index, y first, then x, then z.
+         */
+        static s32 index_in_page(Position cp) {
+            return (cp.y & page_mask) | ((cp.x & page_mask) << page_bits) | ((cp.z & page_mask) << (2 * page_bits));
         }
     };
 
+    /*
+     * Keeps every chunk within radius_chunks of center_chunk loaded, holding a reference to each through
+     * Terrain::acquire_chunk so areas can overlap. The radius is measured between chunk positions, so a radius of 0
+     * is the center chunk alone.
+     *
+     * Moving the area or changing its radius only visits the chunks that enter or leave it. The sphere is handled as
+     * a set of y columns, one per (x, z), and each column of the old and new spheres is a single y interval, so
+     * finding what changed takes O(radius^2) work plus the number of chunks that changed.
+     *
+     * Chunk pointers are kept in a (2r + 1)^3 grid indexed by chunk position modulo its side. The sphere never spans
+     * more than 2r + 1 chunks on an axis, so positions in it never share a slot and nothing has to be shuffled around
+     * when the center moves.
+     */
     class LoadedArea {
     public:
         LoadedArea(Terrain &terrain, Position center_chunk, s32 radius_chunks);
+        ~LoadedArea();
+
+        LoadedArea(LoadedArea const& other) = delete;
+        LoadedArea &operator=(LoadedArea const& other) = delete;
 
         void update_loaded_volume(Position center_chunk) {
             update_loaded_volume(center_chunk, radius_chunks());
@@ -214,84 +609,49 @@ namespace sivox {
         Terrain &terrain() { return m_terrain; }
         Terrain const& terrain() const { return m_terrain; }
         s32 radius_chunks() const { return m_radius_chunks; }
-        s32 diameter_chunks() const { return 2 * m_radius_chunks; }
+        s32 diameter_chunks() const { return 2 * m_radius_chunks + 1; }
         Position center_chunk() const { return m_center_chunk; }
 
+        bool contains(Position chunk_position) const {
+            return contains(m_center_chunk, m_radius_chunks, chunk_position);
+        }
+
+        /*
+         * The chunk at [chunk_position] if it's in the area, or nullptr.
+         */
+        Chunk *chunk(Position chunk_position) {
+            return contains(chunk_position) ? m_chunks[chunk_index(chunk_position)] : nullptr;
+        }
+
+        /*
+         * Chunks which entered and left the area in the last update. Entering chunks are ordered nearest to the
+         * center first, leaving chunks furthest first. Positions outside the terrain aren't listed. Chunks leaving
+         * the area are released, so they may still be loaded for other areas or during the grace period.
+         */
+        std::vector<Position> const& loaded_chunks() const { return m_loaded; }
+        std::vector<Position> const& unloaded_chunks() const { return m_unloaded; }
+
     private:
         Terrain &m_terrain;
         Position m_center_chunk;
-        s32 m_radius_chunks;
+        s32 m_radius_chunks = -1;
         std::vector<Chunk*> m_chunks;
 
-        s32 chunk_index(Position rcp) {
-            Position center = center_chunk();
-            Position cp = {
-                rcp.x + center.x,
-                rcp.y + center.y,
-                rcp.z + center.z
-            };
-            return cp.y + cp.x * diameter_chunks() + cp.z * diameter_chunks() * diameter_chunks();
-        }
-    };
+        std::vector<Position> m_loaded;
+        std::vector<Position> m_unloaded;
 
-    /*
-     * Processes chunks as they are created, loaded, generated, updated, unloaded and
-     * destroyed. Any chunk can be in one of a number of states at any given time:
-     *   - Created
-     *     The chunk has just been created and contaisn no meaningful block data. The data
-     *     must now be loaded or generated.
-     *
-     *   - Updated
-     *     The chunk has just been modified and its mesh must be recomputed. (Possibly
-     *     along with other data...)
-     *
-     *   - Loaded
-     *     The chunk has been loaded or generated and contains actual terrain data. This
-     *     is the resting state most chunks are going to be in.
-     *
-     *   - Unloaded
-     *     The chunk contains actual data but is no longer loaded. Its data can be saved
-     *     to disk at this point.
-     *
-     *   - Unused
-     *     The chunk is not in use and may be freed or reused. While it may contain
-     *     meaningful data, it's best to assume it contains garbage.
-     *
-     *  The ChunkProcessor contains a queue of chunk pointers. Chunks may be added to the
-     *  queue as needed and will be processed one by one, moving them from one state to
-     *  the next using whatever method is necessary.
-     *
-     *  The state transitions are as follows:
-     *   - Created --> Updated
-     *     The chunk is loaded from disk or generated. Its mesh must be generated for
-     *     display and other data may be computed too.
-     *
-     *   - Loaded --> Loaded
-     *     Currently chunks in the loaded state should not be submitted at all. So a
-     *     Loaded chunk is simply skipped. (In practice, we check if a chunk is Loaded
-     *     before even adding it to the queue to save effort.)
-     *
-     *     IDEA: In the future, we may implement this transition to simulate fluids or do
-     *     other dynamic things. (Though a 'Loaded --> Updated' transition probably makes
-     *     more sense...)
-     *
-     *   - Unloaded --> Unused
-     *     The data of an unloaded chunk may be saved to disk before its state is updated.
-     *     As this is currently not needed, we will simply change the state immediately
-     *     instead of adding the chunk to the queue.
-     *
-     *  Any other state transitions are up to the user and must happen elsewhere. Reusing
-     *  an Unused chunk will require the state to be manually set to Created. Same for
-     *  freeing it. Changing the state from Loaded to Updated when a block is changed is
-     *  also up to the user, meant to be done wherever the block placement logic is
-     *  handled.
-     *
-     *  Internally the ChunkProcessor is intended to use a lockfree thread pool to
-     *  accomplish the transitions since they can lock up the thread for a while.
-     *  (Recomputing a mesh can be costly, disk IO operations can block for a while, ...)
-     */
-    class ChunkProcessor {
+        static bool contains(Position center, s32 radius, Position chunk_position) {
+            s32 dx = chunk_position.x - center.x;
+            s32 dy = chunk_position.y - center.y;
+            s32 dz = chunk_position.z - center.z;
+            return radius >= 0 && dx * dx + dy * dy + dz * dz <= radius * radius;
+        }
 
+        s32 chunk_index(Position cp) const {
+            s32 side = diameter_chunks();
+            auto wrap = [side](s32 v) { s32 m = v % side; return m < 0 ? m + side : m; };
+            return wrap(cp.y) + wrap(cp.x) * side + wrap(cp.z) * side * side;
+        }
     };
 }
 
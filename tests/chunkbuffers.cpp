@@ -0,0 +1,40 @@
+#include <chunkbuffers.hpp>
+#include <catch2/catch.hpp>
+
+using namespace sivox;
+
+TEST_CASE("ChunkBuffers : Capacity fits the mesh", "[rendering][buffers]") {
+    const s64 min = ChunkBuffers::min_capacity;
+
+    REQUIRE(ChunkBuffers::fitted_capacity(0, 0) == 0);
+    REQUIRE(ChunkBuffers::fitted_capacity(0, 1) == min);
+    REQUIRE(ChunkBuffers::fitted_capacity(0, min + 1) == 2 * min);
+    REQUIRE(ChunkBuffers::fitted_capacity(0, 5 * min) == 8 * min);
+
+    /*
+     * Fits already, leave it alone.
+     */
+    REQUIRE(ChunkBuffers::fitted_capacity(8 * min, 8 * min) == 8 * min);
+    REQUIRE(ChunkBuffers::fitted_capacity(8 * min, 2 * min) == 8 * min);
+
+    /*
+     * Grows geometrically.
+     */
+    REQUIRE(ChunkBuffers::fitted_capacity(8 * min, 8 * min + 1) == 16 * min);
+
+    /*
+     * Shrinks once the mesh uses less than a quarter.
+     */
+    REQUIRE(ChunkBuffers::fitted_capacity(8 * min, 2 * min - 1) == 4 * min);
+    REQUIRE(ChunkBuffers::fitted_capacity(8 * min, 0) == min);
+    REQUIRE(ChunkBuffers::fitted_capacity(min, 0) == min);
+}
+
+TEST_CASE("ChunkBuffers : A full chunk mesh still fits", "[rendering][buffers]") {
+    for (VertexFormat format : { VertexFormat::Float, VertexFormat::Packed }) {
+        s64 required = static_cast<s64>(ChunkMesh::max_vertex_count) * ChunkMesh::vertex_size(format);
+        s64 capacity = ChunkBuffers::fitted_capacity(0, required);
+        REQUIRE(capacity >= required);
+        REQUIRE(capacity < 2 * required);
+    }
+}
@@ -0,0 +1,163 @@
+#include <chunkio.hpp>
+#include <catch2/catch.hpp>
+#include "testutils.hpp"
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+using namespace sivox;
+
+namespace {
+    /*
+     * Loads of every chunk in a cube of [size] chunks starting at the origin, tagged with their index.
+     */
+    std::vector<ChunkIO::LoadRequest> cube_requests(s32 size) {
+        std::vector<ChunkIO::LoadRequest> requests;
+        for (s32 z = 0; z < size; ++z) {
+            for (s32 x = 0; x < size; ++x) {
+                for (s32 y = 0; y < size; ++y) {
+                    requests.push_back({ {x, y, z}, requests.size() });
+                }
+            }
+        }
+        return requests;
+    }
+
+    std::vector<ChunkIO::LoadResult> load_all(ChunkIO &io, std::vector<ChunkIO::LoadRequest> const& requests) {
+        io.load(requests);
+        io.wait_idle();
+        std::vector<ChunkIO::LoadResult> results = io.poll();
+        std::sort(results.begin(), results.end(), [](auto const& a, auto const& b) { return a.tag < b.tag; });
+        return results;
+    }
+}
+
+TEST_CASE("ChunkIO : Batched loads come back tagged", "[io][files][chunks]") {
+    ScratchDirectory directory("chunkio_batch");
+    std::vector<ChunkIO::LoadRequest> requests = cube_requests(4);
+
+    /*
+     * Every other chunk, across the region boundary at 16.
+     */
+    {
+        RegionStorage storage(directory.path);
+        for (auto const& request : requests) {
+            if (request.tag % 2 == 0) {
+                REQUIRE(storage.save(request.chunk_position, layered_chunk(static_cast<s32>(request.tag % Chunk::height))));
+            }
+        }
+        REQUIRE(storage.save({16, 0, 0}, layered_chunk(3)));
+    }
+    requests.push_back({ {16, 0, 0}, requests.size() });
+    requests.push_back({ {-1, 0, 0}, requests.size() });
+
+    RegionStorage storage(directory.path);
+    ChunkIO io(storage, 2);
+    std::vector<ChunkIO::LoadResult> results = load_all(io, requests);
+    REQUIRE(results.size() == requests.size());
+    REQUIRE(io.pending_count() == 0);
+    REQUIRE(io.poll().empty());
+
+    for (std::size_t i = 0; i < 64; ++i) {
+        ChunkIO::LoadResult const& result = results[i];
+        REQUIRE(result.tag == i);
+        REQUIRE(result.chunk_position == requests[i].chunk_position);
+        if (i % 2 == 0) {
+            REQUIRE(result.chunk);
+            s32 top = static_cast<s32>(i % Chunk::height);
+            REQUIRE(result.chunk->block({0, top, 0}) == 2);
+            REQUIRE(result.chunk->block({0, top + 1, 0}) == 0);
+        }
+        else {
+            REQUIRE_FALSE(result.chunk);
+        }
+    }
+    REQUIRE(results[64].chunk);
+    REQUIRE(results[64].chunk->block({5, 3, 5}) == 2);
+    REQUIRE_FALSE(results[65].chunk);
+}
+
+TEST_CASE("ChunkIO : Saves are loaded back before and after they're written", "[io][files][chunks]") {
+    ScratchDirectory directory("chunkio_save");
+    {
+        RegionStorage storage(directory.path);
+        ChunkIO io(storage);
+
+        io.save({2, 0, 0}, std::make_shared<Chunk const>(layered_chunk(4)));
+        io.save({2, 0, 0}, std::make_shared<Chunk const>(layered_chunk(5)));
+        std::vector<ChunkIO::LoadResult> results = load_all(io, { { {2, 0, 0}, 7 } });
+        REQUIRE(results.size() == 1);
+        REQUIRE(results[0].tag == 7);
+        REQUIRE(results[0].chunk);
+        REQUIRE(results[0].chunk->block({0, 5, 0}) == 2);
+        REQUIRE(storage.staged_count() == 0);
+
+        /*
+         * Still queued when the ChunkIO goes away.
+         */
+        io.save({3, 0, 0}, std::make_shared<Chunk const>(layered_chunk(6)));
+    }
+
+    RegionStorage storage(directory.path);
+    Chunk chunk;
+    REQUIRE(storage.load({2, 0, 0}, chunk));
+    REQUIRE(chunk.block({0, 5, 0}) == 2);
+    REQUIRE(storage.load({3, 0, 0}, chunk));
+    REQUIRE(chunk.block({0, 6, 0}) == 2);
+}
+
+TEST_CASE("ChunkIO : Back to back saves leave the newest on disk", "[io][files][chunks][jobs]") {
+    ScratchDirectory directory("chunkio_resave");
+
+    /*
+     * Saved over and over without waiting, so the saves get spread over both workers.
+     */
+    const s32 save_count = Chunk::height;
+    {
+        RegionStorage storage(directory.path);
+        ChunkIO io(storage, 2);
+        for (s32 top = 0; top < save_count; ++top) {
+            for (s32 x = 0; x < 4; ++x) {
+                io.save({x, 0, 0}, std::make_shared<Chunk const>(layered_chunk(top)));
+            }
+        }
+        io.wait_idle();
+        REQUIRE(storage.staged_count() == 0);
+    }
+
+    RegionStorage storage(directory.path);
+    Chunk chunk;
+    for (s32 x = 0; x < 4; ++x) {
+        REQUIRE(storage.load({x, 0, 0}, chunk));
+        REQUIRE(chunk.block({0, save_count - 1, 0}) == 2);
+        REQUIRE(chunk.block({0, save_count - 2, 0}) == 1);
+    }
+}
+
+TEST_CASE("ChunkIO : load throughput", "[io][files][chunks][!benchmark]") {
+    /*
+     * 512 chunks per batch, so chunks/sec is 512 over the time reported. The cold case opens the region files from
+     * scratch every time, though the OS will still have them cached.
+     */
+    ScratchDirectory directory("chunkio_benchmark");
+    std::vector<ChunkIO::LoadRequest> requests = cube_requests(8);
+    {
+        RegionStorage storage(directory.path);
+        for (auto const& request : requests) {
+            storage.save(request.chunk_position, layered_chunk(static_cast<s32>(request.tag % Chunk::height)));
+        }
+    }
+
+    BENCHMARK("cold load, 512 chunks") {
+        RegionStorage storage(directory.path);
+        ChunkIO io(storage);
+        return load_all(io, requests).size();
+    };
+
+    RegionStorage storage(directory.path);
+    ChunkIO io(storage);
+    load_all(io, requests);
+    BENCHMARK("warm load, 512 chunks") {
+        return load_all(io, requests).size();
+    };
+}
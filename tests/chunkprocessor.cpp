@@ -0,0 +1,432 @@
+#include <chunkprocessor.hpp>
+#include <jobpool.hpp>
+#include <catch2/catch.hpp>
+#include "testutils.hpp"
+#include <atomic>
+#include <map>
+#include <tuple>
+#include <vector>
+
+using namespace sivox;
+
+TEST_CASE("JobPool : Runs every job", "[jobs]") {
+    JobPool pool(4);
+    std::atomic<s32> counter(0);
+
+    for (s32 i = 0; i < 1000; ++i) {
+        pool.submit([&counter]() { counter++; });
+    }
+    pool.wait_idle();
+
+    REQUIRE(counter.load() == 1000);
+    REQUIRE(pool.pending_count() == 0);
+}
+
+TEST_CASE("JobPool : Jobs submitted from jobs", "[jobs]") {
+    JobPool pool(4);
+    std::atomic<s32> counter(0);
+
+    for (s32 i = 0; i < 100; ++i) {
+        pool.submit([&pool, &counter]() {
+            for (s32 j = 0; j < 10; ++j) {
+                pool.submit([&counter]() { counter++; });
+            }
+        });
+    }
+    pool.wait_idle();
+
+    REQUIRE(counter.load() == 1000);
+}
+
+TEST_CASE("JobPool : Lower priority values run first", "[jobs]") {
+    JobPool pool(1);
+    std::atomic<bool> release(false);
+    std::vector<s32> order;
+
+    /*
+     * Keep the only worker busy while we queue up the rest.
+     */
+    pool.submit([&release]() { while (!release.load()) { std::this_thread::yield(); } }, -1);
+    for (s32 priority : { 3, 1, 4, 0, 2 }) {
+        pool.submit([&order, priority]() { order.push_back(priority); }, priority);
+    }
+    release = true;
+    pool.wait_idle();
+
+    REQUIRE(order == std::vector<s32>{ 0, 1, 2, 3, 4 });
+}
+
+namespace {
+    void fill_bottom_half(Chunk &chunk, Position) {
+        for (s32 z = 0; z < Chunk::length; ++z) {
+            for (s32 x = 0; x < Chunk::width; ++x) {
+                for (s32 y = 0; y < Chunk::height / 2; ++y) {
+                    chunk.set_block({x, y, z}, 1);
+                }
+            }
+        }
+    }
+
+    std::vector<ChunkProcessor::Result> collect_all(ChunkProcessor &processor) {
+        std::vector<ChunkProcessor::Result> results;
+        while (processor.pending_count() > 0) {
+            processor.wait_idle();
+            for (auto &result : processor.collect()) {
+                results.push_back(std::move(result));
+            }
+        }
+        return results;
+    }
+}
+
+TEST_CASE("ChunkProcessor : Created chunks are generated and meshed", "[terrain][chunks][jobs]") {
+    Terrain terrain(4, 1, 4);
+    ChunkProcessor processor(terrain, fill_bottom_half, 2);
+
+    for (s32 z = 0; z < terrain.length_chunks(); ++z) {
+        for (s32 x = 0; x < terrain.width_chunks(); ++x) {
+            terrain.create_chunk({x, 0, z});
+            processor.submit({x, 0, z}, x + z);
+        }
+    }
+
+    /*
+     * Chunks get remeshed as their neighbours finish generating, so only the latest mesh of each chunk counts.
+     */
+    std::map<std::tuple<s32, s32, s32>, ChunkMesh> meshes;
+    for (auto &result : collect_all(processor)) {
+        Position p = result.chunk_position;
+        meshes[{p.x, p.y, p.z}] = std::move(result.mesh);
+    }
+    REQUIRE(meshes.size() == 16);
+
+    for (auto const& pair : meshes) {
+        Position position = {std::get<0>(pair.first), std::get<1>(pair.first), std::get<2>(pair.first)};
+        Chunk const* chunk = terrain.chunk(position);
+        REQUIRE(chunk != nullptr);
+        REQUIRE(chunk->state() == ChunkState::Loaded);
+        REQUIRE(chunk->block({0, 0, 0}) == 1);
+        REQUIRE(chunk->block({0, Chunk::height - 1, 0}) == 0);
+
+        ChunkMesh expected = generate_mesh(ChunkNeighbourhood(terrain, position));
+        REQUIRE(pair.second.vertices.size() == expected.vertices.size());
+        REQUIRE(pair.second.triangles.size() == expected.triangles.size());
+    }
+}
+
+TEST_CASE("ChunkProcessor : Updated chunks are remeshed from a snapshot", "[terrain][chunks][jobs]") {
+    Terrain terrain(1, 1, 1);
+    ChunkProcessor processor(terrain, fill_bottom_half, 1);
+
+    Chunk *chunk = terrain.create_chunk({0, 0, 0});
+    chunk->set_block({0, 0, 0}, 1);
+    chunk->set_state(ChunkState::Updated);
+    processor.submit({0, 0, 0});
+
+    auto results = collect_all(processor);
+    REQUIRE(results.size() == 1);
+    REQUIRE(results[0].mesh.triangles.size() == 6 * 6);
+    REQUIRE(chunk->state() == ChunkState::Loaded);
+
+    /*
+     * Loaded chunks are skipped.
+     */
+    processor.submit({0, 0, 0});
+    REQUIRE(processor.pending_count() == 0);
+}
+
+TEST_CASE("ChunkProcessor : Chunks are meshed at the level of detail picked for them", "[terrain][chunks][jobs][lod]") {
+    Terrain terrain(2, 1, 1);
+    ChunkProcessor processor(terrain, fill_bottom_half, 2);
+    processor.set_meshing_mode(MeshingMode::Greedy);
+    processor.set_lod_selector([](Position chunk_position) { return chunk_position.x == 0 ? 0 : 2; });
+
+    terrain.create_chunk({0, 0, 0});
+    terrain.create_chunk({1, 0, 0});
+    processor.submit({0, 0, 0});
+    processor.submit({1, 0, 0});
+
+    std::map<s32, ChunkProcessor::Result> latest;
+    for (auto &result : collect_all(processor)) {
+        latest[result.chunk_position.x] = std::move(result);
+    }
+    REQUIRE(latest.size() == 2);
+    REQUIRE(latest[0].lod_level == 0);
+    REQUIRE(latest[1].lod_level == 2);
+
+    ChunkMesh full_detail = generate_mesh(ChunkNeighbourhood(terrain, {0, 0, 0}), MeshingMode::Greedy);
+    ChunkMesh coarse = generate_mesh(ChunkLod(*terrain.chunk({1, 0, 0}), 2));
+    REQUIRE(latest[0].mesh.triangles.size() == full_detail.triangles.size());
+    REQUIRE(latest[1].mesh.triangles.size() == coarse.triangles.size());
+}
+
+TEST_CASE("ChunkProcessor : Partial remeshing only remeshes dirty sections", "[terrain][chunks][jobs][sections]") {
+    Terrain terrain(2, 1, 1);
+    ChunkProcessor processor(terrain, fill_bottom_half, 2);
+    processor.set_partial_remeshing(true);
+
+    terrain.create_chunk({0, 0, 0});
+    terrain.create_chunk({1, 0, 0});
+    processor.submit({0, 0, 0});
+    processor.submit({1, 0, 0});
+    collect_all(processor);
+
+    /*
+     * Sections meshed for each chunk, by x, along with the section meshes themselves.
+     */
+    auto remeshed = [&processor]() {
+        std::map<std::tuple<s32, s32>, ChunkMesh> sections;
+        for (auto &result : collect_all(processor)) {
+            REQUIRE(result.section != ChunkProcessor::whole_chunk);
+            sections[{result.chunk_position.x, result.section}] = std::move(result.mesh);
+        }
+        return sections;
+    };
+
+    Chunk *chunk = terrain.chunk({0, 0, 0});
+    chunk->set_block({10, 20, 10}, 1);
+    processor.block_changed({0, 0, 0}, {10, 20, 10});
+    auto sections = remeshed();
+    REQUIRE(sections.size() == 1);
+    REQUIRE(sections.count({0, 2}) == 1);
+    REQUIRE(sections[{0, 2}].triangles.size() == 6 * 6);
+
+    /*
+     * On a section boundary and on the chunk border, where the neighbour shares the block's faces.
+     */
+    chunk->set_block({Chunk::width - 1, 16, 10}, 1);
+    processor.block_changed({0, 0, 0}, {Chunk::width - 1, 16, 10});
+    sections = remeshed();
+    REQUIRE(sections.size() == 4);
+    for (auto const& key : { std::make_tuple(0, 1), std::make_tuple(0, 2), std::make_tuple(1, 1), std::make_tuple(1, 2) }) {
+        REQUIRE(sections.count(key) == 1);
+        ChunkNeighbourhood neighbourhood(terrain, {std::get<0>(key), 0, 0});
+        REQUIRE(sections[key].triangles.size() == generate_section_mesh(neighbourhood, std::get<1>(key)).triangles.size());
+    }
+    REQUIRE(chunk->dirty_sections() == 0);
+
+    /*
+     * Nothing dirty, so the whole chunk.
+     */
+    chunk->set_state(ChunkState::Updated);
+    processor.submit({0, 0, 0});
+    REQUIRE(remeshed().size() == Chunk::section_count);
+}
+
+TEST_CASE("ChunkProcessor : Partial remeshing of the chunks around a corner", "[terrain][chunks][jobs][sections]") {
+    Terrain terrain(2, 2, 2);
+    ChunkProcessor processor(terrain, fill_bottom_half, 2);
+    processor.set_partial_remeshing(true);
+    for (s32 z = 0; z < 2; ++z) {
+        for (s32 y = 0; y < 2; ++y) {
+            for (s32 x = 0; x < 2; ++x) {
+                terrain.create_chunk({x, y, z});
+                processor.submit({x, y, z});
+            }
+        }
+    }
+    collect_all(processor);
+
+    /*
+     * A block in the top corner of chunk (0, 0, 0) is in the border of all eight chunks. The ones below only remesh
+     * the top section and the ones above only the bottom one, diagonal neighbours included.
+     */
+    const Position block_position = {Chunk::width - 1, Chunk::height - 1, Chunk::length - 1};
+    terrain.chunk({0, 0, 0})->set_block(block_position, 1);
+    processor.block_changed({0, 0, 0}, block_position);
+
+    std::map<std::tuple<s32, s32, s32>, u32> sections;
+    for (auto const& result : collect_all(processor)) {
+        REQUIRE(result.section != ChunkProcessor::whole_chunk);
+        sections[{result.chunk_position.x, result.chunk_position.y, result.chunk_position.z}] |= 1u << result.section;
+    }
+    REQUIRE(sections.size() == 8);
+    for (auto const& pair : sections) {
+        u32 expected = std::get<1>(pair.first) == 0
+            ? Chunk::sections_around(Chunk::height - 1, Chunk::height)
+            : Chunk::sections_around(-1, 0);
+        REQUIRE(pair.second == expected);
+        REQUIRE(terrain.chunk({std::get<0>(pair.first), std::get<1>(pair.first), std::get<2>(pair.first)})->dirty_sections() == 0);
+    }
+}
+
+TEST_CASE("ChunkProcessor : Meshes come with the chunk's face connectivity and occluder", "[terrain][chunks][jobs][visibility][occlusion]") {
+    Terrain terrain(1, 1, 1);
+    ChunkProcessor processor(terrain, fill_bottom_half, 1);
+
+    Chunk *chunk = terrain.create_chunk({0, 0, 0});
+    processor.submit({0, 0, 0});
+    collect_all(processor);
+
+    /*
+     * The same whether the chunk is meshed whole, a section at a time or at a coarser level of detail.
+     */
+    chunk->set_block({10, 20, 10}, 1);
+    FaceConnectivity expected = FaceConnectivity::compute(*chunk);
+    REQUIRE(expected.connected(BlockFace::Top, BlockFace::Left));
+    REQUIRE(!expected.connected(BlockFace::Bottom, BlockFace::Top));
+    ChunkOccluder expected_occluder = ChunkOccluder::compute(*chunk);
+    REQUIRE(!expected_occluder.empty());
+
+    for (s32 mode = 0; mode < 3; ++mode) {
+        processor.set_partial_remeshing(mode == 1);
+        processor.set_lod_selector(mode == 2 ? [](Position) { return 1; } : ChunkProcessor::LodSelector());
+        chunk->set_state(ChunkState::Updated);
+        processor.submit({0, 0, 0});
+
+        auto results = collect_all(processor);
+        REQUIRE(!results.empty());
+        for (auto const& result : results) {
+            REQUIRE(result.connectivity == expected);
+            REQUIRE(result.occluder == expected_occluder);
+        }
+    }
+}
+
+TEST_CASE("ChunkProcessor : Resubmitting supersedes older work", "[terrain][chunks][jobs]") {
+    Terrain terrain(1, 1, 1);
+    ChunkProcessor processor(terrain, fill_bottom_half, 1);
+
+    Chunk *chunk = terrain.create_chunk({0, 0, 0});
+    chunk->set_state(ChunkState::Updated);
+    processor.submit({0, 0, 0});
+
+    chunk->set_block({0, 0, 0}, 1);
+    chunk->set_block({5, 5, 5}, 1);
+    processor.submit({0, 0, 0});
+
+    auto results = collect_all(processor);
+    REQUIRE(results.size() == 1);
+    REQUIRE(results[0].mesh.triangles.size() == 2 * 6 * 6);
+}
+
+TEST_CASE("ChunkProcessor : Cancelled work is dropped", "[terrain][chunks][jobs]") {
+    Terrain terrain(1, 1, 1);
+    ChunkProcessor processor(terrain, fill_bottom_half, 1);
+
+    Chunk *chunk = terrain.create_chunk({0, 0, 0});
+    processor.submit({0, 0, 0});
+    processor.cancel({0, 0, 0});
+    REQUIRE(processor.pending_count() == 0);
+
+    processor.wait_idle();
+    REQUIRE(processor.collect().empty());
+    REQUIRE(chunk->state() == ChunkState::Created);
+}
+
+TEST_CASE("ChunkProcessor : Unloaded chunks become unused", "[terrain][chunks][jobs]") {
+    Terrain terrain(1, 1, 1);
+    ChunkProcessor processor(terrain, fill_bottom_half, 1);
+
+    Chunk *chunk = terrain.create_chunk({0, 0, 0});
+    chunk->set_state(ChunkState::Unloaded);
+    processor.submit({0, 0, 0});
+    REQUIRE(chunk->state() == ChunkState::Unused);
+}
+
+TEST_CASE("ChunkProcessor : Edits on a chunk border remesh the neighbour", "[terrain][chunks][jobs]") {
+    Terrain terrain(2, 1, 1);
+    ChunkProcessor processor(terrain, fill_bottom_half, 1);
+
+    terrain.create_chunk({0, 0, 0});
+    terrain.create_chunk({1, 0, 0});
+    processor.submit({0, 0, 0});
+    processor.submit({1, 0, 0});
+    collect_all(processor);
+
+    /*
+     * Not on a border, only the chunk itself is remeshed.
+     */
+    terrain.chunk({0, 0, 0})->set_block({5, Chunk::height / 2, 5}, 1);
+    processor.block_changed({0, 0, 0}, {5, Chunk::height / 2, 5});
+    auto results = collect_all(processor);
+    REQUIRE(results.size() == 1);
+    REQUIRE(results[0].chunk_position == Position(0, 0, 0));
+
+    /*
+     * On the border between the two chunks, both get remeshed.
+     */
+    terrain.chunk({0, 0, 0})->set_block({Chunk::width - 1, Chunk::height / 2, 5}, 1);
+    processor.block_changed({0, 0, 0}, {Chunk::width - 1, Chunk::height / 2, 5});
+    results = collect_all(processor);
+    REQUIRE(results.size() == 2);
+    for (auto const& result : results) {
+        ChunkMesh expected = generate_mesh(ChunkNeighbourhood(terrain, result.chunk_position));
+        REQUIRE(result.mesh.vertices.size() == expected.vertices.size());
+    }
+}
+
+TEST_CASE("ChunkProcessor : Edits on a chunk edge remesh the diagonal neighbour", "[terrain][chunks][jobs][ao]") {
+    Terrain terrain(2, 1, 2);
+    ChunkProcessor processor(terrain, fill_bottom_half, 1);
+    for (s32 z = 0; z < 2; ++z) {
+        for (s32 x = 0; x < 2; ++x) {
+            terrain.create_chunk({x, 0, z});
+            processor.submit({x, 0, z});
+        }
+    }
+    collect_all(processor);
+
+    auto total_ao = [](ChunkMesh const& mesh) {
+        f32 total = 0.0f;
+        for (auto const& vertex : mesh.vertices) { total += vertex.ao; }
+        return total;
+    };
+
+    /*
+     * A block on the ground in the corner of chunk (0, 0, 0) darkens a corner of the ground in chunk (1, 0, 1).
+     */
+    const Position block_position = {Chunk::width - 1, Chunk::height / 2, Chunk::length - 1};
+    const f32 ao_before = total_ao(generate_mesh(ChunkNeighbourhood(terrain, {1, 0, 1})));
+    terrain.chunk({0, 0, 0})->set_block(block_position, 1);
+    processor.block_changed({0, 0, 0}, block_position);
+    REQUIRE(total_ao(generate_mesh(ChunkNeighbourhood(terrain, {1, 0, 1}))) != ao_before);
+
+    std::map<std::tuple<s32, s32, s32>, ChunkMesh> meshes;
+    for (auto &result : collect_all(processor)) {
+        Position p = result.chunk_position;
+        meshes[{p.x, p.y, p.z}] = std::move(result.mesh);
+    }
+    REQUIRE(meshes.size() == 4);
+    for (auto const& pair : meshes) {
+        Position position = {std::get<0>(pair.first), std::get<1>(pair.first), std::get<2>(pair.first)};
+        REQUIRE(total_ao(pair.second) == total_ao(generate_mesh(ChunkNeighbourhood(terrain, position))));
+    }
+}
+
+TEST_CASE("ChunkProcessor : Unloaded chunks are saved and loaded back", "[terrain][chunks][jobs][io]") {
+    ScratchDirectory directory("chunkprocessor_storage");
+    {
+        RegionStorage storage(directory.path);
+        ChunkIO io(storage);
+        Terrain terrain(1, 1, 1);
+        ChunkProcessor processor(terrain, fill_bottom_half, 1);
+        processor.set_chunk_io(&io);
+
+        Chunk *chunk = terrain.create_chunk({0, 0, 0});
+        processor.submit({0, 0, 0});
+        collect_all(processor);
+        chunk->set_block({0, Chunk::height - 1, 0}, 2);
+
+        chunk->set_state(ChunkState::Unloaded);
+        processor.submit({0, 0, 0});
+        REQUIRE(chunk->state() == ChunkState::Unused);
+    }
+
+    /*
+     * A processor that can't generate anything, so the chunk must come from disk.
+     */
+    RegionStorage storage(directory.path);
+    ChunkIO io(storage);
+    Terrain terrain(1, 1, 1);
+    ChunkProcessor processor(terrain, [](Chunk &, Position) {}, 1);
+    processor.set_chunk_io(&io);
+
+    Chunk *chunk = terrain.create_chunk({0, 0, 0});
+    processor.submit({0, 0, 0});
+    collect_all(processor);
+    REQUIRE(chunk->state() == ChunkState::Loaded);
+    REQUIRE(chunk->block({0, 0, 0}) == 1);
+    REQUIRE(chunk->block({0, Chunk::height - 1, 0}) == 2);
+    REQUIRE(chunk->block({1, Chunk::height - 1, 0}) == 0);
+}
@@ -0,0 +1,107 @@
+#include <frustum.hpp>
+#include <catch2/catch.hpp>
+#include "testutils.hpp"
+#include <random>
+
+using namespace sivox;
+
+namespace {
+    /*
+     * Every chunk within [radius] chunks of the origin, like a LoadedArea.
+     */
+    void add_sphere(ChunkCuller &culler, s32 radius) {
+        for (s32 z = -radius; z <= radius; ++z) {
+            for (s32 x = -radius; x <= radius; ++x) {
+                for (s32 y = -radius; y <= radius; ++y) {
+                    if (x * x + y * y + z * z <= radius * radius) {
+                        culler.add({x, y, z});
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Frustum : Boxes inside and outside", "[frustum]") {
+    Frustum frustum = Frustum::from_matrix(camera({0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, -1.0f}, 40.0f));
+    glm::vec3 extent(0.5f);
+
+    REQUIRE(frustum.intersects({0.0f, 0.0f, -10.0f}, extent));
+    REQUIRE(!frustum.intersects({0.0f, 0.0f, 10.0f}, extent));
+    REQUIRE(!frustum.intersects({100.0f, 0.0f, -10.0f}, extent));
+    REQUIRE(!frustum.intersects({0.0f, -100.0f, -10.0f}, extent));
+    REQUIRE(!frustum.intersects({0.0f, 0.0f, -2000.0f}, extent));
+
+    /*
+     * Straddling the edge of the view is still visible.
+     */
+    f32 edge_x = 10.0f * glm::tan(glm::radians(20.0f)) * 16.0f / 9.0f;
+    REQUIRE(frustum.intersects({edge_x + 0.4f, 0.0f, -10.0f}, extent));
+    REQUIRE(!frustum.intersects({edge_x + 1.0f, 0.0f, -10.0f}, extent));
+}
+
+TEST_CASE("Frustum : Chunk boxes cover their meshes", "[frustum]") {
+    glm::vec3 min = chunk_center({1, 2, 3}) - chunk_extent();
+    glm::vec3 max = chunk_center({1, 2, 3}) + chunk_extent();
+    REQUIRE(min == glm::vec3(Chunk::width, 2 * Chunk::height, 3 * Chunk::length - 1));
+    REQUIRE(max == glm::vec3(2 * Chunk::width, 3 * Chunk::height, 4 * Chunk::length - 1));
+}
+
+TEST_CASE("Frustum : Culling chunks matches the scalar test", "[frustum]") {
+    ChunkCuller culler;
+    add_sphere(culler, 12);
+
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<f32> coordinate(-400.0f, 400.0f);
+    std::vector<Position> visible, expected;
+    for (s32 i = 0; i < 20; ++i) {
+        glm::vec3 eye(coordinate(rng), coordinate(rng), coordinate(rng));
+        glm::vec3 target(coordinate(rng), coordinate(rng), coordinate(rng));
+        Frustum frustum = Frustum::from_matrix(camera(eye, target, 30.0f + i * 4.0f));
+
+        culler.cull(frustum, visible);
+        culler.cull_scalar(frustum, expected);
+        REQUIRE(visible == expected);
+
+        for (Position p : visible) {
+            REQUIRE(frustum.intersects(chunk_center(p), chunk_extent()));
+        }
+    }
+}
+
+TEST_CASE("Frustum : Culling a sphere of chunks from its centre", "[frustum]") {
+    ChunkCuller culler;
+    add_sphere(culler, 16);
+
+    std::vector<Position> visible;
+    culler.cull(Frustum::from_matrix(camera({16.0f, 16.0f, 16.0f}, {16.0f, 16.0f, -100.0f}, 40.0f)), visible);
+    REQUIRE(visible.size() > 0);
+    REQUIRE(visible.size() * 5 < culler.chunks().size());
+}
+
+TEST_CASE("Frustum : Culling benchmark", "[frustum][!benchmark]") {
+    ChunkCuller culler;
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<s32> coordinate(-64, 64);
+    culler.reserve(100000);
+    for (s32 i = 0; i < 100000; ++i) {
+        culler.add({coordinate(rng), coordinate(rng), coordinate(rng)});
+    }
+
+    Frustum frustum = Frustum::from_matrix(camera({0.0f, 0.0f, 0.0f}, {1.0f, 0.2f, -1.0f}, 40.0f));
+    std::vector<Position> visible;
+    visible.reserve(100000);
+
+    culler.cull(frustum, visible);
+    WARN("Frustum culling: " << visible.size() << " of " << culler.chunk_count() << " chunks visible");
+
+    BENCHMARK("cull 100k chunks, one at a time") {
+        culler.cull_scalar(frustum, visible);
+        return visible.size();
+    };
+
+    BENCHMARK("cull 100k chunks, four at a time") {
+        culler.cull(frustum, visible);
+        return visible.size();
+    };
+}
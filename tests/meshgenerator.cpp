@@ -0,0 +1,796 @@
+#include <meshgenerator.hpp>
+#include <terraingenerator.hpp>
+#include <catch2/catch.hpp>
+#include <cmath>
+#include <map>
+#include <random>
+#include <string>
+#include <tuple>
+
+using namespace sivox;
+
+namespace {
+    void fill_random(Chunk &chunk, u32 seed, s32 percent_solid, s32 max_id = 1) {
+        std::mt19937 rng(seed);
+        std::uniform_int_distribution<s32> percent(0, 99);
+        std::uniform_int_distribution<s32> id(1, max_id);
+        for (s32 z = 0; z < Chunk::length; ++z) {
+            for (s32 x = 0; x < Chunk::width; ++x) {
+                for (s32 y = 0; y < Chunk::height; ++y) {
+                    chunk.set_block({x, y, z}, percent(rng) < percent_solid ? id(rng) : 0);
+                }
+            }
+        }
+    }
+
+    void fill_sine(Chunk &chunk) {
+        for (s32 z = 0; z < Chunk::length; ++z) {
+            for (s32 x = 0; x < Chunk::width; ++x) {
+                f32 sin_z = glm::sin(glm::radians(60.0f + 150.0f * (z / 31.0f)));
+                f32 sin_x = glm::sin(glm::radians(20.0f + 120.0f * (x / 31.0f)));
+                f32 max_y = 10 + glm::clamp(20 * sin_z * sin_x, 0.0f, 20.0f);
+                for (s32 y = 0; y < Chunk::height; ++y) {
+                    chunk.set_block({x, y, z}, y <= max_y ? 1 : 0);
+                }
+            }
+        }
+    }
+
+    /*
+     * A unit face of a block: the direction it's facing and the block-space cell it covers on its plane.
+     */
+    using FaceCell = std::tuple<s32, s32, s32, s32, s32, s32>;
+
+    /*
+     * Splits every quad in [mesh] into the unit faces it covers and counts how many times each one is covered.
+     * Also checks each triangle winds counter-clockwise when looking at it from the direction of its normal.
+     */
+    std::map<FaceCell, s32> covered_faces(ChunkMesh const& mesh) {
+        std::map<FaceCell, s32> cells;
+
+        REQUIRE(mesh.vertices.size() % 4 == 0);
+        REQUIRE(mesh.triangles.size() == mesh.vertices.size() / 4 * 6);
+
+        for (std::size_t t = 0; t < mesh.triangles.size(); t += 3) {
+            auto const& a = mesh.vertices[mesh.triangles[t]];
+            auto const& b = mesh.vertices[mesh.triangles[t + 1]];
+            auto const& c = mesh.vertices[mesh.triangles[t + 2]];
+            glm::vec3 facing = glm::cross(b.position - a.position, c.position - a.position);
+            REQUIRE(glm::dot(facing, a.normal) > 0.0f);
+        }
+
+        for (std::size_t q = 0; q < mesh.vertices.size(); q += 4) {
+            glm::vec3 normal = mesh.vertices[q].normal;
+            glm::vec3 min = mesh.vertices[q].position;
+            glm::vec3 max = mesh.vertices[q].position;
+            for (std::size_t i = q; i < q + 4; ++i) {
+                REQUIRE(mesh.vertices[i].normal == normal);
+                min = glm::min(min, mesh.vertices[i].position);
+                max = glm::max(max, mesh.vertices[i].position);
+            }
+
+            s32 nx = static_cast<s32>(normal.x), ny = static_cast<s32>(normal.y), nz = static_cast<s32>(normal.z);
+            s32 x0 = static_cast<s32>(min.x), y0 = static_cast<s32>(min.y), z0 = static_cast<s32>(min.z);
+            s32 x1 = static_cast<s32>(max.x), y1 = static_cast<s32>(max.y), z1 = static_cast<s32>(max.z);
+            if (nx != 0) { x1 = x0 + 1; }
+            if (ny != 0) { y1 = y0 + 1; }
+            if (nz != 0) { z1 = z0 + 1; }
+
+            for (s32 z = z0; z < z1; ++z) {
+                for (s32 x = x0; x < x1; ++x) {
+                    for (s32 y = y0; y < y1; ++y) {
+                        cells[{nx, ny, nz, x, y, z}]++;
+                    }
+                }
+            }
+        }
+        return cells;
+    }
+
+    /*
+     * The occlusion at the middle of every unit face covered by [mesh], interpolated bilinearly over the quad that
+     * covers it. Bilinear and triangle interpolation agree when the occlusion only changes along one axis of a quad,
+     * and on a unit face the middle is the mean of the corners either way.
+     */
+    std::map<FaceCell, f32> face_shading(ChunkMesh const& mesh) {
+        std::map<FaceCell, f32> shading;
+        for (std::size_t q = 0; q < mesh.vertices.size(); q += 4) {
+            glm::vec3 normal = mesh.vertices[q].normal;
+            glm::vec3 min = mesh.vertices[q].position;
+            glm::vec3 max = mesh.vertices[q].position;
+            for (std::size_t i = q; i < q + 4; ++i) {
+                min = glm::min(min, mesh.vertices[i].position);
+                max = glm::max(max, mesh.vertices[i].position);
+            }
+            s32 a = normal.x != 0.0f ? 1 : 0;
+            s32 b = normal.z != 0.0f ? 1 : 2;
+
+            for (s32 i = 0; i < static_cast<s32>(max[a] - min[a]); ++i) {
+                for (s32 j = 0; j < static_cast<s32>(max[b] - min[b]); ++j) {
+                    f32 s = (i + 0.5f) / (max[a] - min[a]);
+                    f32 t = (j + 0.5f) / (max[b] - min[b]);
+                    f32 ao = 0.0f;
+                    for (std::size_t k = q; k < q + 4; ++k) {
+                        glm::vec3 const& corner = mesh.vertices[k].position;
+                        ao += mesh.vertices[k].ao * (corner[a] == max[a] ? s : 1.0f - s) * (corner[b] == max[b] ? t : 1.0f - t);
+                    }
+
+                    glm::vec3 cell = min;
+                    cell[a] += static_cast<f32>(i);
+                    cell[b] += static_cast<f32>(j);
+                    shading[{static_cast<s32>(normal.x), static_cast<s32>(normal.y), static_cast<s32>(normal.z),
+                        static_cast<s32>(cell.x), static_cast<s32>(cell.y), static_cast<s32>(cell.z)}] = ao;
+                }
+            }
+        }
+        return shading;
+    }
+
+    void require_same_surface(Chunk const& chunk) {
+        ChunkMesh per_face = generate_mesh(chunk, MeshingMode::PerFace);
+        auto expected = covered_faces(per_face);
+
+        for (MeshingMode mode : { MeshingMode::Greedy, MeshingMode::GreedyNoOcclusion }) {
+            ChunkMesh greedy = generate_mesh(chunk, mode);
+            auto result = covered_faces(greedy);
+
+            for (auto const& cell : result) {
+                REQUIRE(cell.second == 1);
+            }
+            REQUIRE(result == expected);
+            REQUIRE(greedy.vertices.size() <= per_face.vertices.size());
+        }
+    }
+}
+
+TEST_CASE("Mesh generator : Empty chunk", "[meshing]") {
+    Chunk chunk;
+    for (MeshingMode mode : { MeshingMode::PerFace, MeshingMode::Greedy, MeshingMode::GreedyNoOcclusion }) {
+        ChunkMesh mesh = generate_mesh(chunk, mode);
+        REQUIRE(mesh.vertices.empty());
+        REQUIRE(mesh.triangles.empty());
+    }
+}
+
+TEST_CASE("Mesh generator : Single block", "[meshing]") {
+    Chunk chunk;
+    chunk.set_block({3, 4, 5}, 1);
+    for (MeshingMode mode : { MeshingMode::PerFace, MeshingMode::Greedy, MeshingMode::GreedyNoOcclusion }) {
+        ChunkMesh mesh = generate_mesh(chunk, mode);
+        REQUIRE(mesh.vertices.size() == 6 * 4);
+        REQUIRE(mesh.triangles.size() == 6 * 6);
+    }
+}
+
+TEST_CASE("Mesh generator : Greedy mesh of a full chunk is six quads", "[meshing][greedy]") {
+    Chunk chunk;
+    fill_random(chunk, 0, 100);
+
+    ChunkMesh mesh = generate_mesh(chunk, MeshingMode::Greedy);
+    REQUIRE(mesh.vertices.size() == 6 * 4);
+    REQUIRE(mesh.triangles.size() == 6 * 6);
+    require_same_surface(chunk);
+}
+
+TEST_CASE("Mesh generator : Greedy mesh covers the surface exactly once", "[meshing][greedy]") {
+    SECTION("sine") {
+        Chunk chunk;
+        fill_sine(chunk);
+        require_same_surface(chunk);
+
+        ChunkMesh per_face = generate_mesh(chunk, MeshingMode::PerFace);
+        ChunkMesh greedy = generate_mesh(chunk, MeshingMode::GreedyNoOcclusion);
+        REQUIRE(greedy.vertices.size() * 5 <= per_face.vertices.size());
+        for (auto const& vertex : greedy.vertices) {
+            REQUIRE(vertex.ao == 0.0f);
+        }
+
+        /*
+         * With occlusion, the faces around the corners of each step can't merge at all.
+         */
+        ChunkMesh shaded = generate_mesh(chunk, MeshingMode::Greedy);
+        REQUIRE(shaded.vertices.size() * 4 <= per_face.vertices.size());
+    }
+
+    SECTION("random") {
+        for (u32 seed = 0; seed < 4; ++seed) {
+            Chunk chunk;
+            fill_random(chunk, seed, 20 + 20 * seed);
+            require_same_surface(chunk);
+        }
+    }
+
+    SECTION("random with several block ids") {
+        for (u32 seed = 0; seed < 4; ++seed) {
+            Chunk chunk;
+            fill_random(chunk, seed, 70, 3);
+            require_same_surface(chunk);
+        }
+    }
+}
+
+TEST_CASE("Mesh generator : Greedy mesh is shaded like the per face mesh", "[meshing][greedy]") {
+    auto require_same_shading = [](Chunk const& chunk) {
+        auto expected = face_shading(generate_mesh(chunk, MeshingMode::PerFace));
+        auto result = face_shading(generate_mesh(chunk, MeshingMode::Greedy));
+        REQUIRE(result.size() == expected.size());
+        for (auto const& cell : expected) {
+            REQUIRE(result.count(cell.first) == 1);
+            REQUIRE(std::abs(result[cell.first] - cell.second) < 1e-4f);
+        }
+    };
+
+    Chunk sine;
+    fill_sine(sine);
+    require_same_shading(sine);
+
+    for (u32 seed = 0; seed < 4; ++seed) {
+        Chunk chunk;
+        fill_random(chunk, seed, 20 + 20 * seed);
+        require_same_shading(chunk);
+    }
+}
+
+TEST_CASE("Mesh generator : Neighbourhood of a lone chunk matches the chunk", "[meshing][neighbours]") {
+    Chunk chunk;
+    fill_random(chunk, 7, 50);
+
+    for (MeshingMode mode : { MeshingMode::PerFace, MeshingMode::Greedy }) {
+        ChunkMesh expected = generate_mesh(chunk, mode);
+        ChunkMesh result = generate_mesh(ChunkNeighbourhood(chunk), mode);
+        REQUIRE(result.vertices.size() == expected.vertices.size());
+        REQUIRE(covered_faces(result) == covered_faces(expected));
+    }
+}
+
+TEST_CASE("Mesh generator : Faces between solid chunks are culled", "[meshing][neighbours]") {
+    Terrain terrain(3, 3, 3);
+    for (s32 z = 0; z < 3; ++z) {
+        for (s32 x = 0; x < 3; ++x) {
+            for (s32 y = 0; y < 3; ++y) {
+                fill_random(*terrain.create_chunk({x, y, z}), 0, 100);
+            }
+        }
+    }
+
+    /*
+     * Completely surrounded by solid chunks, nothing is visible.
+     */
+    for (MeshingMode mode : { MeshingMode::PerFace, MeshingMode::Greedy }) {
+        ChunkMesh mesh = generate_mesh(ChunkNeighbourhood(terrain, {1, 1, 1}), mode);
+        REQUIRE(mesh.vertices.empty());
+    }
+
+    /*
+     * Only the top face is exposed when the chunks above are missing. (All of them, so none of the top faces are
+     * occluded by the chunks diagonally above and there's nothing to stop them being merged.)
+     */
+    for (s32 z = 0; z < 3; ++z) {
+        for (s32 x = 0; x < 3; ++x) {
+            terrain.delete_chunk({x, 2, z});
+        }
+    }
+    ChunkMesh per_face = generate_mesh(ChunkNeighbourhood(terrain, {1, 1, 1}), MeshingMode::PerFace);
+    REQUIRE(per_face.vertices.size() == Chunk::width * Chunk::length * 4);
+    for (auto const& vertex : per_face.vertices) {
+        REQUIRE(vertex.normal == glm::vec3(0.0f, 1.0f, 0.0f));
+    }
+    ChunkMesh greedy = generate_mesh(ChunkNeighbourhood(terrain, {1, 1, 1}), MeshingMode::Greedy);
+    REQUIRE(greedy.vertices.size() == 4);
+
+    /*
+     * Chunks on the edge of the terrain still have their outside faces.
+     */
+    ChunkMesh corner = generate_mesh(ChunkNeighbourhood(terrain, {0, 0, 0}), MeshingMode::Greedy);
+    REQUIRE(corner.vertices.size() == 3 * 4);
+}
+
+TEST_CASE("Mesh generator : Ambient occlusion", "[meshing][ao]") {
+    /*
+     * The top face of the block at [p], as its corners' positions and occlusion.
+     */
+    auto top_face = [](ChunkMesh const& mesh, Position p) {
+        std::map<std::pair<s32, s32>, u32> corners;
+        for (auto const& vertex : mesh.packed_vertices) {
+            Position corner = vertex.position();
+            bool on_face = vertex.face() == BlockFace::Top && corner.y == p.y + 1
+                && corner.x >= p.x && corner.x <= p.x + 1 && corner.z >= p.z - 1 && corner.z <= p.z;
+            if (on_face) { corners[{corner.x, corner.z}] = vertex.ao(); }
+        }
+        return corners;
+    };
+
+    const Position p = {4, 4, 4};
+    for (MeshingMode mode : { MeshingMode::PerFace, MeshingMode::Greedy }) {
+        SECTION("nothing around") {
+            Chunk chunk;
+            chunk.set_block(p, 1);
+            auto corners = top_face(generate_mesh(chunk, mode, VertexFormat::Packed), p);
+            REQUIRE(corners.size() == 4);
+            for (auto const& corner : corners) {
+                REQUIRE(corner.second == 0);
+            }
+        }
+
+        SECTION("a wall along one side") {
+            Chunk chunk;
+            chunk.set_block(p, 1);
+            for (s32 z = p.z - 1; z <= p.z + 1; ++z) {
+                chunk.set_block({p.x - 1, p.y + 1, z}, 1);
+            }
+            auto corners = top_face(generate_mesh(chunk, mode, VertexFormat::Packed), p);
+            REQUIRE(corners[{p.x, p.z - 1}] == 2);
+            REQUIRE(corners[{p.x, p.z}] == 2);
+            REQUIRE(corners[{p.x + 1, p.z - 1}] == 0);
+            REQUIRE(corners[{p.x + 1, p.z}] == 0);
+        }
+
+        SECTION("boxed in by both sides") {
+            Chunk chunk;
+            chunk.set_block(p, 1);
+            chunk.set_block({p.x - 1, p.y + 1, p.z}, 1);
+            chunk.set_block({p.x, p.y + 1, p.z - 1}, 1);
+            auto corners = top_face(generate_mesh(chunk, mode, VertexFormat::Packed), p);
+            REQUIRE(corners[{p.x, p.z - 1}] == 3);
+            REQUIRE(corners[{p.x, p.z}] == 1);
+            REQUIRE(corners[{p.x + 1, p.z - 1}] == 1);
+            REQUIRE(corners[{p.x + 1, p.z}] == 0);
+        }
+    }
+
+    /*
+     * A lone dark corner is on the diagonal the quad is split along.
+     */
+    Chunk chunk;
+    chunk.set_block(p, 1);
+    chunk.set_block({p.x - 1, p.y + 1, p.z - 1}, 1);
+    ChunkMesh mesh = generate_mesh(chunk, MeshingMode::PerFace, VertexFormat::Packed);
+    for (std::size_t quad = 0; quad < mesh.triangles.size(); quad += 6) {
+        ChunkMesh::PackedVertex const& vertex = mesh.packed_vertices[mesh.triangles[quad]];
+        if (vertex.face() != BlockFace::Top || vertex.position().y != p.y + 1) { continue; }
+
+        std::map<u32, s32> shared; // How many triangles of the quad each corner is in
+        for (std::size_t i = quad; i < quad + 6; ++i) {
+            ++shared[mesh.triangles[i]];
+        }
+        for (auto const& corner : shared) {
+            ChunkMesh::PackedVertex const& v = mesh.packed_vertices[corner.first];
+            bool dark = v.ao() != 0;
+            bool opposite = v.position().x == p.x + 1 && v.position().z == p.z;
+            REQUIRE(corner.second == (dark || opposite ? 2 : 1));
+        }
+    }
+
+    /*
+     * A border chunk occludes the faces next to it.
+     */
+    Terrain terrain(2, 1, 1);
+    terrain.create_chunk({0, 0, 0})->set_block({Chunk::width - 1, 0, 0}, 1);
+    terrain.create_chunk({1, 0, 0})->set_block({0, 1, 0}, 1);
+    ChunkMesh bordered = generate_mesh(ChunkNeighbourhood(terrain, {0, 0, 0}), MeshingMode::PerFace, VertexFormat::Packed);
+    auto corners = top_face(bordered, {Chunk::width - 1, 0, 0});
+    REQUIRE(corners[{Chunk::width, -1}] == 1);
+    REQUIRE(corners[{Chunk::width, 0}] == 1);
+    REQUIRE(corners[{Chunk::width - 1, 0}] == 0);
+}
+
+TEST_CASE("Mesh generator : Chunks touching a block", "[meshing][neighbours]") {
+    Position chunk = {4, 5, 6};
+    REQUIRE(chunks_touching_block(chunk, {5, 5, 5}).empty());
+    REQUIRE(chunks_touching_block(chunk, {0, 5, 5}) == std::vector<Position>{ {3, 5, 6} });
+    REQUIRE(chunks_touching_block(chunk, {5, Chunk::height - 1, 5}) == std::vector<Position>{ {4, 6, 6} });
+
+    /*
+     * Edges and corners also touch the chunks diagonally across them.
+     */
+    REQUIRE(chunks_touching_block(chunk, {0, 5, 0}) == std::vector<Position>{ {3, 5, 6}, {4, 5, 5}, {3, 5, 5} });
+    REQUIRE(chunks_touching_block(chunk, {0, 0, Chunk::length - 1}) == std::vector<Position>{
+        {4, 4, 6}, {3, 5, 6}, {3, 4, 6}, {4, 5, 7}, {4, 4, 7}, {3, 5, 7}, {3, 4, 7}
+    });
+}
+
+TEST_CASE("Mesh generator : Packed vertex round trip", "[meshing][packed]") {
+    REQUIRE(sizeof(ChunkMesh::PackedVertex) == 8);
+
+    for (s32 face = 0; face < 6; ++face) {
+        for (u32 ao = 0; ao < 4; ++ao) {
+            for (Position p : { Position(0, 0, -1), Position(Chunk::width, Chunk::height, Chunk::length - 1), Position(7, 19, 23) }) {
+                auto packed = ChunkMesh::PackedVertex::pack(p, static_cast<BlockFace>(face), Block::max_id, ao);
+                REQUIRE(packed.position() == p);
+                REQUIRE(packed.face() == static_cast<BlockFace>(face));
+                REQUIRE(packed.ao() == ao);
+                REQUIRE(packed.block() == Block::max_id);
+            }
+        }
+    }
+}
+
+TEST_CASE("Mesh generator : Packed meshes match float meshes", "[meshing][packed]") {
+    Chunk chunk;
+    fill_random(chunk, 3, 40, 5);
+
+    for (MeshingMode mode : { MeshingMode::PerFace, MeshingMode::Greedy, MeshingMode::GreedyNoOcclusion }) {
+        ChunkMesh floats = generate_mesh(chunk, mode, VertexFormat::Float);
+        ChunkMesh packed = generate_mesh(chunk, mode, VertexFormat::Packed);
+
+        REQUIRE(packed.format == VertexFormat::Packed);
+        REQUIRE(packed.vertices.empty());
+        REQUIRE(packed.vertex_count() == floats.vertex_count());
+        REQUIRE(packed.triangles == floats.triangles);
+
+        for (std::size_t i = 0; i < floats.vertices.size(); ++i) {
+            Position p = packed.packed_vertices[i].position();
+            REQUIRE(glm::vec3(p.x, p.y, p.z) == floats.vertices[i].position);
+            REQUIRE(face_normal(packed.packed_vertices[i].face()) == floats.vertices[i].normal);
+            REQUIRE(static_cast<f32>(packed.packed_vertices[i].ao()) == floats.vertices[i].ao);
+            REQUIRE(packed.packed_vertices[i].block() != 0);
+        }
+    }
+}
+
+namespace {
+    void require_same_mesh(ChunkMesh const& a, ChunkMesh const& b) {
+        REQUIRE(a.format == b.format);
+        REQUIRE(a.triangles == b.triangles);
+        REQUIRE(a.vertices.size() == b.vertices.size());
+        for (std::size_t i = 0; i < a.vertices.size(); ++i) {
+            REQUIRE(a.vertices[i].position == b.vertices[i].position);
+            REQUIRE(a.vertices[i].normal == b.vertices[i].normal);
+            REQUIRE(a.vertices[i].ao == b.vertices[i].ao);
+        }
+        REQUIRE(a.packed_vertices.size() == b.packed_vertices.size());
+        for (std::size_t i = 0; i < a.packed_vertices.size(); ++i) {
+            REQUIRE(a.packed_vertices[i].position_face == b.packed_vertices[i].position_face);
+            REQUIRE(a.packed_vertices[i].material == b.packed_vertices[i].material);
+        }
+    }
+
+    std::vector<std::pair<std::string, Chunk>> benchmark_chunks() {
+        std::vector<std::pair<std::string, Chunk>> chunks(4);
+        chunks[0].first = "empty";
+        chunks[1].first = "full";
+        fill_random(chunks[1].second, 0, 100);
+        chunks[2].first = "random";
+        fill_random(chunks[2].second, 1, 50, 3);
+        chunks[3].first = "sine";
+        fill_sine(chunks[3].second);
+        return chunks;
+    }
+}
+
+TEST_CASE("Mesh generator : Column masks give the same mesh as checking each block", "[meshing]") {
+    for (auto const& pair : benchmark_chunks()) {
+        INFO(pair.first);
+        for (VertexFormat format : { VertexFormat::Float, VertexFormat::Packed }) {
+            require_same_mesh(generate_mesh(pair.second, MeshingMode::PerFace, format), generate_mesh_per_block(pair.second, format));
+        }
+    }
+
+    /*
+     * Neighbouring chunks, partly solid, so faces on every side of the border are culled or not.
+     */
+    Terrain terrain(3, 3, 3);
+    s32 seed = 0;
+    for (s32 z = 0; z < 3; ++z) {
+        for (s32 x = 0; x < 3; ++x) {
+            for (s32 y = 0; y < 3; ++y) {
+                fill_random(*terrain.create_chunk({x, y, z}), seed++, 60, 2);
+            }
+        }
+    }
+    for (Position chunk_position : { Position(1, 1, 1), Position(0, 0, 0), Position(2, 1, 0) }) {
+        ChunkNeighbourhood neighbourhood(terrain, chunk_position);
+        for (VertexFormat format : { VertexFormat::Float, VertexFormat::Packed }) {
+            require_same_mesh(generate_mesh(neighbourhood, MeshingMode::PerFace, format), generate_mesh_per_block(neighbourhood, format));
+        }
+    }
+}
+
+TEST_CASE("Mesh generator : Meshing into an arena", "[meshing][arena]") {
+    MeshArena arena;
+    for (auto const& pair : benchmark_chunks()) {
+        ChunkNeighbourhood neighbourhood(pair.second);
+        for (MeshingMode mode : { MeshingMode::PerFace, MeshingMode::Greedy }) {
+            for (VertexFormat format : { VertexFormat::Float, VertexFormat::Packed }) {
+                MeshCounts counts = generate_mesh(neighbourhood, mode, format, arena);
+                require_same_mesh(arena.to_mesh(format, counts), generate_mesh(neighbourhood, mode, format));
+            }
+        }
+    }
+
+    /*
+     * Once it has seen the biggest mesh, meshing again doesn't grow it.
+     */
+    s64 memory_usage = arena.memory_usage();
+    for (auto const& pair : benchmark_chunks()) {
+        generate_mesh(pair.second, MeshingMode::PerFace, VertexFormat::Packed, arena);
+        generate_mesh(pair.second, MeshingMode::PerFace, VertexFormat::Float, arena);
+    }
+    REQUIRE(arena.memory_usage() == memory_usage);
+}
+
+TEST_CASE("Mesh generator : Meshing into a target that's too small", "[meshing][arena]") {
+    Chunk chunk;
+    fill_random(chunk, 2, 50, 3);
+    ChunkMesh expected = generate_mesh(chunk, MeshingMode::PerFace, VertexFormat::Packed);
+
+    /*
+     * Room for 10 quads, with guard values everywhere nothing is written.
+     */
+    const ChunkMesh::PackedVertex guard_vertex = { 0xDEADBEEF, 0xDEADBEEF };
+    const ChunkMesh::TriangleIndex guard_index = 0xDEADBEEF;
+    std::vector<ChunkMesh::PackedVertex> vertices(40 + 4, guard_vertex);
+    std::vector<ChunkMesh::TriangleIndex> triangles(60 + 6, guard_index);
+
+    MeshTarget target = { VertexFormat::Packed, vertices.data(), 40, triangles.data(), 60 };
+    MeshCounts counts = generate_mesh(chunk, MeshingMode::PerFace, target);
+    REQUIRE(counts.vertex_count == expected.vertex_count());
+    REQUIRE(counts.triangle_index_count == static_cast<s32>(expected.triangles.size()));
+
+    /*
+     * Whole blocks are written up to the first one that doesn't fit, so some of the room may be left over.
+     */
+    s32 written = 0;
+    while (written < 40 && vertices[written].position_face != guard_vertex.position_face) { ++written; }
+    REQUIRE(written > 0);
+    REQUIRE(written % 4 == 0);
+    for (s32 i = 0; i < written; ++i) {
+        REQUIRE(vertices[i].position_face == expected.packed_vertices[i].position_face);
+        REQUIRE(vertices[i].material == expected.packed_vertices[i].material);
+    }
+    for (s32 i = 0; i < written / 4 * 6; ++i) {
+        REQUIRE(triangles[i] == expected.triangles[i]);
+    }
+    for (s32 i = written; i < 44; ++i) {
+        REQUIRE(vertices[i].position_face == guard_vertex.position_face);
+        REQUIRE(vertices[i].material == guard_vertex.material);
+    }
+    for (s32 i = written / 4 * 6; i < 66; ++i) {
+        REQUIRE(triangles[i] == guard_index);
+    }
+}
+
+namespace {
+    /*
+     * Fills [terrain] with a region of generated terrain [size] chunks across and two chunks high.
+     */
+    void generate_terrain(Terrain &terrain, s32 size) {
+        TerrainGenerator generator(1);
+        for (s32 z = 0; z < size; ++z) {
+            for (s32 x = 0; x < size; ++x) {
+                for (s32 y = 0; y < 2; ++y) {
+                    generator.generate(*terrain.create_chunk({x, y, z}), {x, y, z});
+                }
+            }
+        }
+    }
+
+    /*
+     * Meshes every chunk in [terrain], at full detail or at the LOD level picked by [distances] as seen from the
+     * middle of the region, and returns the total triangle count.
+     */
+    s64 mesh_terrain(Terrain const& terrain, s32 size, LodDistances const* distances, MeshArena &arena) {
+        const glm::vec3 camera(size * Chunk::width / 2.0f, 2.0f * Chunk::height, size * Chunk::length / 2.0f);
+        s64 triangle_index_count = 0;
+        for (s32 z = 0; z < size; ++z) {
+            for (s32 x = 0; x < size; ++x) {
+                for (s32 y = 0; y < 2; ++y) {
+                    Position p = {x, y, z};
+                    glm::vec3 centre = glm::vec3(p.x + 0.5f, p.y + 0.5f, p.z + 0.5f) * glm::vec3(Chunk::width, Chunk::height, Chunk::length);
+                    s32 level = distances ? distances->level(glm::length(centre - camera)) : 0;
+                    if (level > 0) {
+                        triangle_index_count += generate_mesh(ChunkLod(*terrain.chunk(p), level), VertexFormat::Packed, arena).triangle_index_count;
+                    }
+                    else {
+                        triangle_index_count += generate_mesh(ChunkNeighbourhood(terrain, p), MeshingMode::Greedy, VertexFormat::Packed, arena).triangle_index_count;
+                    }
+                }
+            }
+        }
+        return triangle_index_count / 3;
+    }
+}
+
+TEST_CASE("Mesh generator : LOD downsampling", "[meshing][lod]") {
+    Chunk chunk;
+    chunk.transform([](Position p, Block) { return p.y < 9 ? 1 : 0; });
+
+    /*
+     * Cells of 4 blocks: y = 8..11 has a single solid layer, which only counts with AnySolid. Cells on the chunk
+     * border always use AnySolid.
+     */
+    ChunkLod majority(chunk, 2, LodRule::Majority);
+    ChunkLod any_solid(chunk, 2, LodRule::AnySolid);
+    REQUIRE(majority.scale() == 4);
+    REQUIRE(majority.width() == Chunk::width / 4);
+    REQUIRE(majority.block({1, 1, 1}) == 1);
+    REQUIRE(majority.block({1, 2, 1}) == 0);
+    REQUIRE(majority.block({0, 2, 1}) == 1);
+    REQUIRE(any_solid.block({1, 2, 1}) == 1);
+    REQUIRE(any_solid.block({1, 3, 1}) == 0);
+    REQUIRE(majority.block({-1, 0, 0}) == 0);
+
+    /*
+     * The most common solid block wins.
+     */
+    Chunk mixed;
+    mixed.transform([](Position p, Block) { return p.y == 0 ? 0 : p.x == 0 && p.z == 0 ? 3 : 2; });
+    REQUIRE(ChunkLod(mixed, 1).block({0, 0, 0}) == 2);
+
+    /*
+     * Coarse cells are meshed as blocks of the same size, in block coordinates of the full chunk.
+     */
+    Chunk full;
+    full.fill(1);
+    for (s32 level = 1; level <= ChunkLod::max_level; ++level) {
+        ChunkMesh mesh = generate_mesh(ChunkLod(full, level));
+        REQUIRE(mesh.vertices.size() == 6 * 4);
+        glm::vec3 max(0.0f);
+        for (ChunkMesh::Vertex const& vertex : mesh.vertices) {
+            max = glm::max(max, vertex.position);
+        }
+        REQUIRE(max == glm::vec3(Chunk::width, Chunk::height, Chunk::length - 1));
+    }
+}
+
+TEST_CASE("Mesh generator : LOD surfaces never sit below full detail on the chunk border", "[meshing][lod]") {
+    Terrain terrain(2, 2, 2);
+    generate_terrain(terrain, 2);
+    for (s32 level = 1; level <= ChunkLod::max_level; ++level) {
+        for (Position chunk_position : { Position(0, 0, 0), Position(1, 0, 1), Position(0, 1, 1) }) {
+            Chunk const& chunk = *terrain.chunk(chunk_position);
+            ChunkLod lod(chunk, level, LodRule::Majority);
+            for (s32 i = 0; i < Chunk::volume; ++i) {
+                Position p = Chunk::block_position(i);
+                bool border = p.x == 0 || p.y == 0 || p.z == 0 || p.x == Chunk::width - 1 || p.y == Chunk::height - 1 || p.z == Chunk::length - 1;
+                if (border && chunk.block_at(i) != 0) {
+                    REQUIRE(lod.block({p.x >> level, p.y >> level, p.z >> level}) != 0);
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Mesh generator : LOD levels by distance", "[meshing][lod]") {
+    LodDistances distances;
+    distances.full_detail = 100.0f;
+    REQUIRE(distances.level(0.0f) == 0);
+    REQUIRE(distances.level(99.0f) == 0);
+    REQUIRE(distances.level(100.0f) == 1);
+    REQUIRE(distances.level(250.0f) == 2);
+    REQUIRE(distances.level(450.0f) == 3);
+    REQUIRE(distances.level(10000.0f) == ChunkLod::max_level);
+
+    distances.max_level = 1;
+    REQUIRE(distances.level(10000.0f) == 1);
+}
+
+TEST_CASE("Mesh generator : LOD cuts the triangle count of distant terrain", "[meshing][lod]") {
+    Terrain terrain(8, 2, 8);
+    generate_terrain(terrain, 8);
+    LodDistances distances;
+    distances.full_detail = 64.0f;
+
+    MeshArena arena;
+    s64 full_detail = mesh_terrain(terrain, 8, nullptr, arena);
+    s64 lod = mesh_terrain(terrain, 8, &distances, arena);
+    REQUIRE(lod > 0);
+    REQUIRE(lod * 2 < full_detail);
+}
+
+TEST_CASE("Mesh generator : Sections cover the same faces as the whole chunk", "[meshing][sections]") {
+    Terrain terrain(2, 2, 2);
+    generate_terrain(terrain, 2);
+    for (Position chunk_position : { Position(0, 0, 0), Position(1, 0, 1), Position(0, 1, 1) }) {
+        ChunkNeighbourhood neighbourhood(terrain, chunk_position);
+        for (MeshingMode mode : { MeshingMode::PerFace, MeshingMode::Greedy }) {
+            ChunkMesh whole = generate_mesh(neighbourhood, mode);
+            std::map<FaceCell, s32> sections;
+            std::size_t triangle_count = 0;
+            for (s32 section = 0; section < Chunk::section_count; ++section) {
+                ChunkMesh mesh = generate_section_mesh(neighbourhood, section, mode);
+                for (auto const& cell : covered_faces(mesh)) {
+                    s32 y = std::get<4>(cell.first) - (std::get<1>(cell.first) > 0 ? 1 : 0);
+                    REQUIRE(y >> Chunk::section_height_bits == section);
+                    sections[cell.first] += cell.second;
+                }
+                triangle_count += mesh.triangles.size();
+
+                /*
+                 * Only the section and the layers around it are needed.
+                 */
+                ChunkNeighbourhood partial(terrain, chunk_position, 1u << section);
+                require_same_mesh(generate_section_mesh(partial, section, mode), mesh);
+            }
+            REQUIRE(sections == covered_faces(whole));
+            if (mode == MeshingMode::PerFace) {
+                REQUIRE(triangle_count == whole.triangles.size());
+            }
+        }
+    }
+}
+
+TEST_CASE("Mesh generator : per face meshing benchmark", "[meshing][!benchmark]") {
+    for (auto const& pair : benchmark_chunks()) {
+        ChunkNeighbourhood neighbourhood(pair.second);
+
+        BENCHMARK(pair.first + ", column masks") {
+            return generate_mesh(neighbourhood, MeshingMode::PerFace, VertexFormat::Packed).vertex_count();
+        };
+
+        BENCHMARK(pair.first + ", per block") {
+            return generate_mesh_per_block(neighbourhood, VertexFormat::Packed).vertex_count();
+        };
+    }
+}
+
+TEST_CASE("Mesh generator : arena meshing benchmark", "[meshing][arena][!benchmark]") {
+    MeshArena arena;
+    for (auto const& pair : benchmark_chunks()) {
+        ChunkNeighbourhood neighbourhood(pair.second);
+        generate_mesh(neighbourhood, MeshingMode::PerFace, VertexFormat::Packed, arena);
+
+        BENCHMARK(pair.first + ", into an arena") {
+            return generate_mesh(neighbourhood, MeshingMode::PerFace, VertexFormat::Packed, arena).vertex_count;
+        };
+
+        BENCHMARK(pair.first + ", into a ChunkMesh") {
+            return generate_mesh(neighbourhood, MeshingMode::PerFace, VertexFormat::Packed).vertex_count();
+        };
+    }
+}
+
+TEST_CASE("Mesh generator : LOD meshing benchmark", "[meshing][lod][!benchmark]") {
+    /*
+     * The same region meshed at full detail and with LOD, as seen from its middle. The triangle counts are what the
+     * renderer would draw with LOD off and on.
+     */
+    constexpr s32 size = 8;
+    Terrain terrain(size, 2, size);
+    generate_terrain(terrain, size);
+    LodDistances distances;
+    distances.full_detail = 64.0f;
+
+    MeshArena arena;
+    WARN("LOD off: " << mesh_terrain(terrain, size, nullptr, arena) << " triangles, LOD on: "
+        << mesh_terrain(terrain, size, &distances, arena) << " triangles");
+
+    BENCHMARK("128 chunks, LOD off") {
+        return mesh_terrain(terrain, size, nullptr, arena);
+    };
+
+    BENCHMARK("128 chunks, LOD on") {
+        return mesh_terrain(terrain, size, &distances, arena);
+    };
+
+    for (s32 level = 0; level <= ChunkLod::max_level; ++level) {
+        Chunk const& chunk = *terrain.chunk({0, 0, 0});
+        BENCHMARK("downsample and mesh one chunk, level " + std::to_string(level)) {
+            if (level == 0) {
+                return generate_mesh(ChunkNeighbourhood(terrain, {0, 0, 0}), MeshingMode::Greedy, VertexFormat::Packed, arena).triangle_index_count;
+            }
+            return generate_mesh(ChunkLod(chunk, level), VertexFormat::Packed, arena).triangle_index_count;
+        };
+    }
+}
+
+TEST_CASE("Mesh generator : section remeshing benchmark", "[meshing][sections][!benchmark]") {
+    /*
+     * What a single block edit in the middle of a section costs, copying the neighbourhood included, against
+     * remeshing the whole chunk.
+     */
+    Terrain terrain(2, 2, 2);
+    generate_terrain(terrain, 2);
+    const Position chunk_position = {1, 0, 1};
+    MeshArena arena;
+
+    BENCHMARK("whole chunk") {
+        ChunkNeighbourhood neighbourhood(terrain, chunk_position);
+        return generate_mesh(neighbourhood, MeshingMode::Greedy, VertexFormat::Packed, arena).triangle_index_count;
+    };
+
+    BENCHMARK("one section") {
+        ChunkNeighbourhood neighbourhood(terrain, chunk_position, 0b100);
+        return generate_section_mesh(neighbourhood, 2, MeshingMode::Greedy, VertexFormat::Packed, arena).triangle_index_count;
+    };
+}
@@ -0,0 +1,422 @@
+#include <occlusion.hpp>
+#include <terraingenerator.hpp>
+#include <visibility.hpp>
+#include <catch2/catch.hpp>
+#include "testutils.hpp"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+using namespace sivox;
+
+namespace {
+    const f32 fov_degrees = 60.0f;
+    const f32 aspect = 2.0f;
+
+    bool same_depths(HiZBuffer const& a, HiZBuffer const& b) {
+        for (s32 y = 0; y < a.height(); ++y) {
+            for (s32 x = 0; x < a.width(); ++x) {
+                if (a.depth(0, x, y) != b.depth(0, x, y)) { return false; }
+            }
+        }
+        return true;
+    }
+
+    /*
+     * Casts a ray through the blocks of [terrain] and returns the chunk of the first solid block hit, or false if it
+     * leaves the terrain first. Blocks are shifted along z like the meshes (see chunk_center()), so the block at z
+     * covers [z - 1, z).
+     */
+    bool cast_ray(Terrain const& terrain, glm::vec3 origin, glm::vec3 direction, Position &hit_chunk) {
+        origin.z += 1.0f;
+        Position block = {
+            static_cast<s32>(std::floor(origin.x)),
+            static_cast<s32>(std::floor(origin.y)),
+            static_cast<s32>(std::floor(origin.z))
+        };
+        const f32 direction_of[3] = { direction.x, direction.y, direction.z };
+        const f32 origin_of[3] = { origin.x, origin.y, origin.z };
+        s32 *block_of[3] = { &block.x, &block.y, &block.z };
+        s32 step[3];
+        f32 next[3], delta[3];
+        for (s32 axis = 0; axis < 3; ++axis) {
+            const f32 d = direction_of[axis];
+            step[axis] = d > 0.0f ? 1 : -1;
+            delta[axis] = d != 0.0f ? std::abs(1.0f / d) : INFINITY;
+            const f32 boundary = static_cast<f32>(*block_of[axis] + (d > 0.0f ? 1 : 0));
+            next[axis] = d != 0.0f ? (boundary - origin_of[axis]) / d : INFINITY;
+        }
+
+        const s32 limits[3] = {
+            terrain.width_chunks() * Chunk::width,
+            terrain.height_chunks() * Chunk::height,
+            terrain.length_chunks() * Chunk::length
+        };
+        while (true) {
+            bool inside = true;
+            for (s32 axis = 0; axis < 3; ++axis) {
+                inside &= *block_of[axis] >= 0 && *block_of[axis] < limits[axis];
+            }
+            if (inside) {
+                Position chunk_position = { block.x / Chunk::width, block.y / Chunk::height, block.z / Chunk::length };
+                Chunk const* chunk = terrain.chunk(chunk_position);
+                if (chunk && chunk->block({block.x % Chunk::width, block.y % Chunk::height, block.z % Chunk::length}) != 0) {
+                    hit_chunk = chunk_position;
+                    return true;
+                }
+            }
+            else {
+                /*
+                 * Outside the terrain and heading further out on some axis, so nothing more can be hit.
+                 */
+                for (s32 axis = 0; axis < 3; ++axis) {
+                    if ((*block_of[axis] < 0 && step[axis] < 0) || (*block_of[axis] >= limits[axis] && step[axis] > 0)) {
+                        return false;
+                    }
+                }
+            }
+
+            s32 axis = next[0] < next[1] ? (next[0] < next[2] ? 0 : 2) : (next[1] < next[2] ? 1 : 2);
+            *block_of[axis] += step[axis];
+            next[axis] += delta[axis];
+        }
+    }
+
+    /*
+     * The chunks which some ray from [eye], through a [width] by [height] grid of the view, hits a block of first.
+     * A chunk that's hit must be drawn, so culling any of them is an error.
+     */
+    std::vector<Position> reference_visible(Terrain const& terrain, glm::vec3 eye, glm::vec3 target, s32 width, s32 height) {
+        glm::vec3 forward = glm::normalize(target - eye);
+        glm::vec3 right = glm::normalize(glm::cross(forward, glm::vec3(0.0f, 1.0f, 0.0f)));
+        glm::vec3 up = glm::cross(right, forward);
+        const f32 tan_half = std::tan(glm::radians(fov_degrees) * 0.5f);
+
+        std::vector<Position> visible;
+        for (s32 y = 0; y < height; ++y) {
+            for (s32 x = 0; x < width; ++x) {
+                f32 ndc_x = ((x + 0.5f) / width) * 2.0f - 1.0f;
+                f32 ndc_y = ((y + 0.5f) / height) * 2.0f - 1.0f;
+                glm::vec3 direction = forward + right * (ndc_x * tan_half * aspect) + up * (ndc_y * tan_half);
+                Position hit;
+                if (cast_ray(terrain, eye, direction, hit) && std::find(visible.begin(), visible.end(), hit) == visible.end()) {
+                    visible.push_back(hit);
+                }
+            }
+        }
+        return visible;
+    }
+
+    /*
+     * Mountains reaching well over a chunk above and below the base height, which is at chunk y = 3.
+     */
+    const s32 mountains_height = 8;
+
+    TerrainGenerator::Settings mountain_settings() {
+        TerrainGenerator::Settings settings;
+        settings.height_amplitude = 90.0f;
+        return settings;
+    }
+
+    void generate_mountains(Terrain &terrain, TerrainGenerator const& generator, OcclusionCuller &occlusion, VisibilityGraph &graph) {
+        for (s32 z = 0; z < terrain.length_chunks(); ++z) {
+            for (s32 y = 0; y < terrain.height_chunks(); ++y) {
+                for (s32 x = 0; x < terrain.width_chunks(); ++x) {
+                    Chunk &chunk = *terrain.create_chunk({x, y, z});
+                    generator.generate(chunk, {x, y - 3, z});
+                    chunk.compact();
+                    occlusion.set({x, y, z}, ChunkOccluder::compute(chunk));
+                    graph.set({x, y, z}, FaceConnectivity::compute(chunk));
+                }
+            }
+        }
+    }
+
+    struct Scene {
+        const char *name;
+        glm::vec3 eye;
+        glm::vec3 target;
+    };
+
+    /*
+     * A camera standing just above the ground at ([x], [z]), looking out across the terrain towards the target.
+     */
+    Scene standing(TerrainGenerator const& generator, const char *name, f32 x, f32 z, f32 target_x, f32 target_z) {
+        f32 y = generator.height(static_cast<s32>(x), static_cast<s32>(z)) + generator.settings().density_amplitude
+            + 3.0f * Chunk::height + 2.0f;
+        return Scene{ name, { x, y, z }, { target_x, y - 10.0f, target_z } };
+    }
+
+    /*
+     * The number of chunks in [reference] missing from [drawn].
+     */
+    s32 count_missing(std::vector<Position> const& reference, std::vector<Position> const& drawn) {
+        s32 missing = 0;
+        for (Position p : reference) {
+            missing += std::find(drawn.begin(), drawn.end(), p) == drawn.end();
+        }
+        return missing;
+    }
+}
+
+TEST_CASE("ChunkOccluder : Thickest solid slab of each cell", "[occlusion]") {
+    Chunk chunk;
+    REQUIRE(ChunkOccluder::compute(chunk).empty());
+
+    chunk.fill(1);
+    ChunkOccluder occluder = ChunkOccluder::compute(chunk);
+    for (OccluderSlab slab : occluder.slabs) {
+        REQUIRE(slab == OccluderSlab{ 0, Chunk::height });
+    }
+
+    /*
+     * One block of air splits its layer out of its cell's slab, and the longer of the two runs left is kept.
+     */
+    const s32 cell = 3 / ChunkOccluder::cell_size + (30 / ChunkOccluder::cell_size) * ChunkOccluder::cells;
+    chunk.set_block({3, 10, 30}, 0);
+    REQUIRE(ChunkOccluder::compute(chunk).slabs[cell] == OccluderSlab{ 11, Chunk::height });
+    chunk.set_block({2, 28, 29}, 0);
+    occluder = ChunkOccluder::compute(chunk);
+    REQUIRE(occluder.slabs[cell] == OccluderSlab{ 11, 28 });
+    REQUIRE(occluder.slabs[0] == OccluderSlab{ 0, Chunk::height });
+
+    Terrain terrain(1, 1, 1);
+    *terrain.create_chunk({0, 0, 0}) = chunk;
+    REQUIRE(ChunkOccluder::compute(ChunkNeighbourhood(terrain, {0, 0, 0})) == occluder);
+
+    /*
+     * The full cells merge into one box over the first rows, and the last row is split by the odd cell out.
+     */
+    std::vector<std::pair<glm::vec3, glm::vec3>> boxes;
+    occluder.boxes({1, 2, 3}, boxes);
+    REQUIRE(boxes.size() == 3);
+    const glm::vec3 origin(Chunk::width, 2 * Chunk::height, 3 * Chunk::length - 1);
+    const f32 row = static_cast<f32>((ChunkOccluder::cells - 1) * ChunkOccluder::cell_size);
+    REQUIRE(boxes[0].first == origin);
+    REQUIRE(boxes[0].second == origin + glm::vec3(Chunk::width, Chunk::height, row));
+    REQUIRE(boxes[1].first == origin + glm::vec3(0.0f, 11.0f, row));
+    REQUIRE(boxes[1].second == origin + glm::vec3(ChunkOccluder::cell_size, 28.0f, Chunk::length));
+    REQUIRE(boxes[2].first == origin + glm::vec3(ChunkOccluder::cell_size, 0.0f, row));
+    REQUIRE(boxes[2].second == origin + glm::vec3(Chunk::width, Chunk::height, Chunk::length));
+}
+
+TEST_CASE("HiZBuffer : Boxes behind an occluder", "[occlusion]") {
+    /*
+     * Looking down -z at a wall 20 blocks away.
+     */
+    HiZBuffer buffer(64, 32);
+    buffer.clear(camera({0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, -1.0f}, fov_degrees, aspect));
+    buffer.draw_box({-20.0f, -10.0f, -22.0f}, {20.0f, 10.0f, -20.0f});
+    buffer.build_pyramid();
+
+    REQUIRE(std::abs(buffer.depth(0, 32, 16) - 20.0f) < 0.001f);
+    REQUIRE(buffer.depth(buffer.level_count() - 1, 0, 0) == INFINITY);
+
+    REQUIRE(buffer.occluded({-2.0f, -2.0f, -40.0f}, {2.0f, 2.0f, -30.0f}));
+    REQUIRE(!buffer.occluded({-2.0f, -2.0f, -15.0f}, {2.0f, 2.0f, -10.0f}));
+
+    /*
+     * Straddling the wall, sticking out past its edge, and closer than the near depth.
+     */
+    REQUIRE(!buffer.occluded({-2.0f, -2.0f, -30.0f}, {2.0f, 2.0f, -19.0f}));
+    REQUIRE(!buffer.occluded({15.0f, -2.0f, -40.0f}, {40.0f, 2.0f, -30.0f}));
+    REQUIRE(!buffer.occluded({-2.0f, -2.0f, -40.0f}, {2.0f, 2.0f, 1.0f}));
+
+    /*
+     * A floor reaching behind the camera still hides what's under its far end. Boxes are only hidden behind the
+     * furthest point of an occluder, so nothing inside the floor is.
+     */
+    buffer.clear(camera({0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, -1.0f}, fov_degrees, aspect));
+    buffer.draw_box({-100.0f, -100.0f, -20.0f}, {100.0f, -5.0f, 10.0f});
+    buffer.build_pyramid();
+    REQUIRE(buffer.occluded({-2.0f, -25.0f, -60.0f}, {2.0f, -20.0f, -50.0f}));
+    REQUIRE(!buffer.occluded({-2.0f, -15.0f, -15.0f}, {2.0f, -10.0f, -10.0f}));
+    REQUIRE(!buffer.occluded({-2.0f, -4.0f, -40.0f}, {2.0f, 2.0f, -30.0f}));
+}
+
+TEST_CASE("HiZBuffer : Drawing matches the scalar version", "[occlusion]") {
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<f32> coordinate(-100.0f, 100.0f);
+    std::uniform_real_distribution<f32> size(1.0f, 40.0f);
+
+    HiZBuffer simd(100, 50), scalar(100, 50);
+    for (s32 frame = 0; frame < 10; ++frame) {
+        glm::mat4 view_projection = camera(
+            glm::vec3(coordinate(rng), coordinate(rng), coordinate(rng)),
+            glm::vec3(coordinate(rng), coordinate(rng), coordinate(rng)),
+            fov_degrees,
+            aspect
+        );
+        simd.clear(view_projection);
+        scalar.clear(view_projection);
+        for (s32 i = 0; i < 50; ++i) {
+            glm::vec3 min(coordinate(rng), coordinate(rng), coordinate(rng));
+            glm::vec3 max = min + glm::vec3(size(rng), size(rng), size(rng));
+            simd.draw_box(min, max);
+            scalar.draw_box_scalar(min, max);
+        }
+        REQUIRE(same_depths(simd, scalar));
+
+        /*
+         * Every texel is the furthest of the four under it.
+         */
+        simd.build_pyramid();
+        for (s32 l = 1; l < simd.level_count(); ++l) {
+            for (s32 y = 0; y < simd.level_height(l); ++y) {
+                for (s32 x = 0; x < simd.level_width(l); ++x) {
+                    f32 furthest = 0.0f;
+                    for (s32 i = 0; i < 4; ++i) {
+                        s32 sx = 2 * x + (i & 1), sy = 2 * y + (i >> 1);
+                        bool outside = sx >= simd.level_width(l - 1) || sy >= simd.level_height(l - 1);
+                        furthest = std::max(furthest, outside ? INFINITY : simd.depth(l - 1, sx, sy));
+                    }
+                    REQUIRE(simd.depth(l, x, y) == furthest);
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("OcclusionCuller : Culls chunks behind solid ones", "[occlusion]") {
+    OcclusionCuller culler(64, 32);
+    std::vector<Position> chunks = { {0, 0, 0}, {0, 0, -1}, {0, 0, -3}, {5, 0, -3} };
+    std::vector<Position> visible;
+
+    /*
+     * Nothing is culled before the first buffer.
+     */
+    culler.cull(chunks, visible);
+    REQUIRE(visible == chunks);
+
+    Chunk solid;
+    solid.fill(1);
+    culler.set({0, 0, -1}, ChunkOccluder::compute(solid));
+    culler.set({0, 0, 0}, ChunkOccluder::compute(Chunk()));
+    REQUIRE(culler.occluder_count() == 1);
+
+    glm::vec3 eye(16.0f, 16.0f, 10.0f);
+    glm::mat4 view_projection = camera(eye, eye - glm::vec3(0.0f, 0.0f, 1.0f), fov_degrees, aspect);
+    culler.begin(view_projection, Frustum::from_matrix(view_projection));
+    culler.cull(chunks, visible);
+    REQUIRE(visible == std::vector<Position>{ {0, 0, 0}, {0, 0, -1}, {5, 0, -3} });
+
+    culler.remove({0, 0, -1});
+    culler.begin(view_projection, Frustum::from_matrix(view_projection));
+    culler.cull(chunks, visible);
+    REQUIRE(visible == chunks);
+}
+
+TEST_CASE("OcclusionCuller : Chunks a ray can see are never culled", "[occlusion]") {
+    const s32 size = 8;
+    TerrainGenerator generator(5, mountain_settings());
+    Terrain terrain(size, mountains_height, size);
+    OcclusionCuller occlusion;
+    VisibilityGraph graph;
+    generate_mountains(terrain, generator, occlusion, graph);
+
+    const f32 extent = size * Chunk::width;
+    const Scene scenes[] = {
+        standing(generator, "corner, across", 20.0f, 20.0f, extent, extent),
+        standing(generator, "edge, across", extent - 20.0f, 30.0f, 0.0f, extent),
+    };
+    std::vector<Position> reachable, drawn;
+    for (Scene const& scene : scenes) {
+        glm::mat4 view_projection = camera(scene.eye, scene.target, fov_degrees, aspect);
+        Frustum frustum = Frustum::from_matrix(view_projection);
+        graph.traverse(scene.eye, frustum, size, reachable);
+        occlusion.begin(view_projection, frustum);
+        occlusion.cull(reachable, drawn);
+
+        /*
+         * Center sampling makes the buffer not strictly conservative, so this is what keeps it honest: every chunk
+         * a ray hits first must still be drawn.
+         */
+        INFO(scene.name);
+        REQUIRE(count_missing(reference_visible(terrain, scene.eye, scene.target, 192, 96), drawn) == 0);
+        REQUIRE(drawn.size() < reachable.size());
+    }
+}
+
+TEST_CASE("OcclusionCuller : Culled chunks on mountains", "[occlusion][!benchmark]") {
+    const s32 size = 24;
+    TerrainGenerator generator(5, mountain_settings());
+    Terrain terrain(size, mountains_height, size);
+    OcclusionCuller occlusion;
+    VisibilityGraph graph;
+    generate_mountains(terrain, generator, occlusion, graph);
+    ChunkCuller frustum_culler;
+    for (s32 z = 0; z < size; ++z) {
+        for (s32 y = 0; y < mountains_height; ++y) {
+            for (s32 x = 0; x < size; ++x) {
+                frustum_culler.add({x, y, z});
+            }
+        }
+    }
+
+    const f32 extent = size * Chunk::width;
+    const Scene scenes[] = {
+        standing(generator, "corner, across", 40.0f, 40.0f, extent, extent),
+        standing(generator, "middle, sideways", extent * 0.5f, extent * 0.5f, extent, extent * 0.3f),
+        standing(generator, "edge, across", extent - 40.0f, 60.0f, 0.0f, extent),
+    };
+
+    /*
+     * How much each step culls, against what a ray caster sees. Chunks of nothing but air have no mesh to draw, so
+     * they don't count.
+     */
+    auto with_blocks = [&terrain](std::vector<Position> const& chunks) {
+        return std::count_if(chunks.begin(), chunks.end(), [&terrain](Position p) {
+            Chunk const& chunk = *terrain.chunk(p);
+            return chunk.bits_per_block() != 0 || chunk.block_at(0) != 0;
+        });
+    };
+    std::vector<Position> in_frustum, reachable, drawn;
+    for (Scene const& scene : scenes) {
+        glm::mat4 view_projection = camera(scene.eye, scene.target, fov_degrees, aspect);
+        Frustum frustum = Frustum::from_matrix(view_projection);
+
+        frustum_culler.cull(frustum, in_frustum);
+        graph.traverse(scene.eye, frustum, size, reachable);
+        occlusion.begin(view_projection, frustum);
+        occlusion.cull(reachable, drawn);
+
+        std::vector<Position> reference = reference_visible(terrain, scene.eye, scene.target, 384, 192);
+        WARN(scene.name << ": " << with_blocks(in_frustum) << " chunks in the frustum, " << with_blocks(reachable)
+            << " after cave culling, " << with_blocks(drawn) << " after occlusion culling, " << reference.size()
+            << " seen by the reference ray caster, " << count_missing(reference, drawn) << " wrongly culled");
+    }
+    glm::mat4 view_projection = camera(scenes[0].eye, scenes[0].target, fov_degrees, aspect);
+    Frustum frustum = Frustum::from_matrix(view_projection);
+    graph.traverse(scenes[0].eye, frustum, size, reachable);
+    BENCHMARK("Draw occluders and build the pyramid") {
+        occlusion.begin(view_projection, frustum);
+        return occlusion.buffer().depth(0, 0, 0);
+    };
+    BENCHMARK("Test the chunks left after cave culling") {
+        occlusion.cull(reachable, drawn);
+        return drawn.size();
+    };
+
+    HiZBuffer simd(OcclusionCuller::default_width, OcclusionCuller::default_height);
+    HiZBuffer scalar(OcclusionCuller::default_width, OcclusionCuller::default_height);
+    std::vector<std::pair<glm::vec3, glm::vec3>> boxes;
+    for (s32 z = 0; z < size; ++z) {
+        for (s32 y = 0; y < mountains_height; ++y) {
+            for (s32 x = 0; x < size; ++x) {
+                if (frustum.intersects(chunk_center({x, y, z}), chunk_extent())) {
+                    ChunkOccluder::compute(*terrain.chunk({x, y, z})).boxes({x, y, z}, boxes);
+                }
+            }
+        }
+    }
+    BENCHMARK("Draw occluders with SSE") {
+        simd.clear(view_projection);
+        for (auto const& box : boxes) { simd.draw_box(box.first, box.second); }
+        return simd.depth(0, 0, 0);
+    };
+    BENCHMARK("Draw occluders one pixel at a time") {
+        scalar.clear(view_projection);
+        for (auto const& box : boxes) { scalar.draw_box_scalar(box.first, box.second); }
+        return scalar.depth(0, 0, 0);
+    };
+}
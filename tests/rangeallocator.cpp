@@ -0,0 +1,168 @@
+#include <rangeallocator.hpp>
+#include <catch2/catch.hpp>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace sivox;
+
+namespace {
+    /*
+     * Checks that no two live allocations overlap and all of them are inside the allocator.
+     */
+    void require_disjoint(RangeAllocator const& allocator, std::vector<RangeAllocator::Handle> const& handles) {
+        std::vector<RangeAllocator::Range> ranges;
+        for (auto handle : handles) {
+            auto range = allocator.range(handle);
+            if (range.size > 0) { ranges.push_back(range); }
+        }
+        std::sort(ranges.begin(), ranges.end(), [](auto a, auto b) { return a.offset < b.offset; });
+        for (std::size_t i = 0; i < ranges.size(); ++i) {
+            REQUIRE(ranges[i].offset >= 0);
+            REQUIRE(ranges[i].offset + ranges[i].size <= allocator.capacity());
+            if (i > 0) { REQUIRE(ranges[i - 1].offset + ranges[i - 1].size <= ranges[i].offset); }
+        }
+    }
+}
+
+TEST_CASE("RangeAllocator : Allocate and free", "[allocator]") {
+    RangeAllocator allocator(100);
+
+    auto a = allocator.allocate(40);
+    auto b = allocator.allocate(40);
+    REQUIRE(a != RangeAllocator::invalid_handle);
+    REQUIRE(b != RangeAllocator::invalid_handle);
+    REQUIRE(allocator.range(a).offset == 0);
+    REQUIRE(allocator.range(b).offset == 40);
+
+    REQUIRE(allocator.allocate(21) == RangeAllocator::invalid_handle);
+    auto c = allocator.allocate(20);
+    REQUIRE(c != RangeAllocator::invalid_handle);
+    REQUIRE(allocator.stats().used == 100);
+    REQUIRE(allocator.stats().largest_free == 0);
+
+    allocator.free(b);
+    REQUIRE(allocator.stats().used == 60);
+    REQUIRE(allocator.stats().largest_free == 40);
+
+    /*
+     * Freeing the neighbours merges the free ranges back into one.
+     */
+    allocator.free(a);
+    allocator.free(c);
+    auto stats = allocator.stats();
+    REQUIRE(stats.used == 0);
+    REQUIRE(stats.free_range_count == 1);
+    REQUIRE(stats.largest_free == 100);
+    REQUIRE(stats.allocation_count == 0);
+}
+
+TEST_CASE("RangeAllocator : Best fit", "[allocator]") {
+    RangeAllocator allocator(100);
+    auto a = allocator.allocate(10);
+    auto gap_large = allocator.allocate(30);
+    auto b = allocator.allocate(10);
+    auto gap_small = allocator.allocate(15);
+    auto c = allocator.allocate(10);
+    allocator.free(gap_large);
+    allocator.free(gap_small);
+
+    auto d = allocator.allocate(12);
+    REQUIRE(allocator.range(d).offset == 50);
+
+    REQUIRE(allocator.valid(a));
+    REQUIRE(allocator.valid(b));
+    REQUIRE(allocator.valid(c));
+}
+
+TEST_CASE("RangeAllocator : Zero sized allocations", "[allocator]") {
+    RangeAllocator allocator(0);
+    auto a = allocator.allocate(0);
+    REQUIRE(allocator.valid(a));
+    REQUIRE(allocator.range(a).size == 0);
+    REQUIRE(allocator.allocate(1) == RangeAllocator::invalid_handle);
+    allocator.free(a);
+    REQUIRE(!allocator.valid(a));
+    allocator.free(RangeAllocator::invalid_handle);
+}
+
+TEST_CASE("RangeAllocator : Grow", "[allocator]") {
+    RangeAllocator allocator(10);
+    auto a = allocator.allocate(10);
+    REQUIRE(allocator.allocate(5) == RangeAllocator::invalid_handle);
+
+    allocator.grow(20);
+    auto b = allocator.allocate(10);
+    REQUIRE(b != RangeAllocator::invalid_handle);
+    REQUIRE(allocator.range(b).offset == 10);
+    REQUIRE(allocator.range(a).offset == 0);
+}
+
+TEST_CASE("RangeAllocator : Defragment", "[allocator]") {
+    RangeAllocator allocator(1000);
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<s64> size(1, 20);
+
+    std::vector<RangeAllocator::Handle> live;
+    for (s32 i = 0; i < 60; ++i) {
+        live.push_back(allocator.allocate(size(rng)));
+    }
+    for (s32 i = 0; i < 30; ++i) {
+        std::uniform_int_distribution<std::size_t> pick(0, live.size() - 1);
+        auto it = live.begin() + pick(rng);
+        allocator.free(*it);
+        live.erase(it);
+    }
+
+    s64 used = allocator.stats().used;
+    REQUIRE(allocator.stats().fragmentation() > 0.0f);
+
+    std::vector<s64> sizes;
+    for (auto handle : live) { sizes.push_back(allocator.range(handle).size); }
+
+    auto moves = allocator.defragment();
+    REQUIRE(!moves.empty());
+    for (auto const& move : moves) {
+        REQUIRE(move.to < move.from);
+        REQUIRE(allocator.range(move.handle).offset == move.to);
+    }
+
+    auto stats = allocator.stats();
+    REQUIRE(stats.used == used);
+    REQUIRE(stats.free_range_count == 1);
+    REQUIRE(stats.largest_free == stats.free());
+    REQUIRE(stats.fragmentation() == 0.0f);
+    require_disjoint(allocator, live);
+    for (std::size_t i = 0; i < live.size(); ++i) {
+        REQUIRE(allocator.range(live[i]).size == sizes[i]);
+    }
+}
+
+TEST_CASE("RangeAllocator : Random allocations never overlap", "[allocator]") {
+    RangeAllocator allocator(4096);
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<s64> size(0, 100);
+    std::uniform_int_distribution<s32> action(0, 2);
+
+    std::vector<RangeAllocator::Handle> live;
+    s64 used = 0;
+    for (s32 i = 0; i < 2000; ++i) {
+        if (action(rng) > 0 || live.empty()) {
+            s64 requested = size(rng);
+            auto handle = allocator.allocate(requested);
+            if (handle != RangeAllocator::invalid_handle) {
+                live.push_back(handle);
+                used += requested;
+            }
+        }
+        else {
+            std::uniform_int_distribution<std::size_t> pick(0, live.size() - 1);
+            auto it = live.begin() + pick(rng);
+            used -= allocator.range(*it).size;
+            allocator.free(*it);
+            live.erase(it);
+        }
+        REQUIRE(allocator.stats().used == used);
+    }
+    require_disjoint(allocator, live);
+}
@@ -0,0 +1,217 @@
+#include <regionfile.hpp>
+#include <catch2/catch.hpp>
+#include "testutils.hpp"
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace sivox;
+namespace fs = std::filesystem;
+
+namespace {
+    Chunk random_chunk(u32 seed) {
+        std::mt19937 rng(seed);
+        Chunk chunk;
+        for (s32 i = 0; i < Chunk::volume; ++i) {
+            chunk.set_block_at(i, static_cast<s32>(rng() % Block::max_id));
+        }
+        return chunk;
+    }
+}
+
+TEST_CASE("RegionFile : Encode and decode chunks", "[io][chunks]") {
+    std::vector<Chunk> chunks = { Chunk(), layered_chunk(14), random_chunk(1) };
+    Chunk stone;
+    stone.fill_at(0, Chunk::volume, 1);
+    chunks.push_back(stone);
+
+    for (Chunk const& chunk : chunks) {
+        std::vector<u8> data = encode_chunk(chunk);
+
+        Chunk decoded;
+        decoded.set_state(ChunkState::Loaded);
+        REQUIRE(decode_chunk(data.data(), static_cast<s64>(data.size()), decoded));
+        REQUIRE(same_blocks(chunk, decoded));
+        REQUIRE(decoded.state() == ChunkState::Loaded);
+    }
+
+    REQUIRE(encode_chunk(Chunk()).size() < 16);
+    REQUIRE(encode_chunk(stone).size() < 16);
+}
+
+TEST_CASE("RegionFile : Malformed chunk data is rejected", "[io][chunks]") {
+    std::vector<u8> data = encode_chunk(random_chunk(2));
+
+    /*
+     * Truncated every 101 bytes, which lands at a different spot in each part of the data, and one byte short. Then
+     * some garbage.
+     */
+    std::vector<std::size_t> sizes;
+    for (std::size_t size = 0; size < data.size(); size += 101) { sizes.push_back(size); }
+    sizes.push_back(data.size() - 1);
+    for (std::size_t size : sizes) {
+        Chunk chunk;
+        REQUIRE_FALSE(decode_chunk(data.data(), static_cast<s64>(size), chunk));
+        REQUIRE(chunk.palette_size() == 1);
+        REQUIRE(chunk.block({0, 0, 0}) == 0);
+    }
+
+    std::mt19937 rng(3);
+    std::vector<u8> garbage(1000);
+    for (u8 &byte : garbage) { byte = static_cast<u8>(rng()); }
+    Chunk chunk;
+    REQUIRE_FALSE(decode_chunk(garbage.data(), static_cast<s64>(garbage.size()), chunk));
+}
+
+TEST_CASE("RegionFile : Chunk positions map to regions", "[io][chunks]") {
+    REQUIRE(RegionFile::region_position({0, 0, 0}) == Position(0, 0, 0));
+    REQUIRE(RegionFile::region_position({15, 16, 31}) == Position(0, 1, 1));
+    REQUIRE(RegionFile::region_position({-1, -16, -17}) == Position(-1, -1, -2));
+
+    REQUIRE(RegionFile::chunk_index({0, 0, 0}) == 0);
+    REQUIRE(RegionFile::chunk_index({-1, -1, -1}) == RegionFile::region_volume - 1);
+    REQUIRE(RegionFile::chunk_index({16, 17, 18}) == RegionFile::chunk_index({0, 1, 2}));
+}
+
+TEST_CASE("RegionStorage : Chunks survive a restart", "[io][files][chunks]") {
+    ScratchDirectory directory("regionstorage_restart");
+    const Chunk layered = layered_chunk(14);
+    const Chunk random = random_chunk(4);
+
+    {
+        RegionStorage storage(directory.path);
+        Chunk chunk;
+        REQUIRE_FALSE(storage.load({0, 0, 0}, chunk));
+
+        REQUIRE(storage.save({0, 0, 0}, layered));
+        REQUIRE(storage.save({-1, 5, -17}, random));
+        REQUIRE(storage.save({3, 3, 3}, Chunk()));
+
+        /*
+         * Grows out of its slot, then shrinks back into the new one.
+         */
+        REQUIRE(storage.save({1, 0, 0}, layered));
+        REQUIRE(storage.save({1, 0, 0}, random));
+        REQUIRE(storage.load({1, 0, 0}, chunk));
+        REQUIRE(same_blocks(chunk, random));
+        REQUIRE(storage.save({1, 0, 0}, layered));
+    }
+
+    REQUIRE(fs::exists(directory.path / "r.0.0.0.region"));
+    REQUIRE(fs::exists(directory.path / "r.-1.0.-2.region"));
+
+    RegionStorage storage(directory.path);
+    Chunk chunk;
+    REQUIRE(storage.load({0, 0, 0}, chunk));
+    REQUIRE(same_blocks(chunk, layered));
+    REQUIRE(storage.load({1, 0, 0}, chunk));
+    REQUIRE(same_blocks(chunk, layered));
+    REQUIRE(storage.load({-1, 5, -17}, chunk));
+    REQUIRE(same_blocks(chunk, random));
+    REQUIRE(storage.load({3, 3, 3}, chunk));
+    REQUIRE(same_blocks(chunk, Chunk()));
+    REQUIRE_FALSE(storage.load({2, 0, 0}, chunk));
+}
+
+TEST_CASE("RegionStorage : Staged chunks are loaded before they're flushed", "[io][files][chunks]") {
+    ScratchDirectory directory("regionstorage_staged");
+    RegionStorage storage(directory.path);
+
+    storage.stage({7, 0, 0}, std::make_shared<Chunk const>(layered_chunk(14)));
+    REQUIRE(storage.staged_count() == 1);
+
+    Chunk chunk;
+    REQUIRE(storage.load({7, 0, 0}, chunk));
+    REQUIRE(same_blocks(chunk, layered_chunk(14)));
+    REQUIRE_FALSE(fs::exists(storage.region_path({0, 0, 0})));
+
+    storage.flush();
+    REQUIRE(storage.staged_count() == 0);
+    REQUIRE(RegionStorage(directory.path).load({7, 0, 0}, chunk));
+    REQUIRE(same_blocks(chunk, layered_chunk(14)));
+}
+
+TEST_CASE("RegionStorage : Flushes running alongside keep the newest chunk", "[io][files][chunks][jobs]") {
+    ScratchDirectory directory("regionstorage_concurrent");
+    RegionStorage storage(directory.path);
+
+    /*
+     * Two threads staging and flushing the same chunk a few times each, for a different chunk every round. Every
+     * snapshot has a different block set, and whichever was staged last has to be what ends up on disk.
+     */
+    const s32 chunk_count = 64;
+    const s32 versions_per_thread = 4;
+    std::vector<std::shared_ptr<Chunk const>> newest(chunk_count);
+    for (s32 c = 0; c < chunk_count; ++c) {
+        const Position chunk_position(c % 4, 0, c / 4);
+        std::mutex staging_mutex;
+        s32 next_version = 0;
+        auto stage_and_flush = [&]() {
+            for (s32 i = 0; i < versions_per_thread; ++i) {
+                {
+                    std::lock_guard<std::mutex> lock(staging_mutex);
+                    auto chunk = std::make_shared<Chunk>();
+                    chunk->set_block({next_version, 0, 0}, 1);
+                    ++next_version;
+                    newest[c] = chunk;
+                    storage.stage(chunk_position, chunk);
+                }
+                storage.flush(chunk_position);
+            }
+        };
+        std::thread first(stage_and_flush), second(stage_and_flush);
+        first.join();
+        second.join();
+    }
+
+    REQUIRE(storage.staged_count() == 0);
+    RegionStorage reopened(directory.path);
+    for (s32 c = 0; c < chunk_count; ++c) {
+        Chunk chunk;
+        REQUIRE(reopened.load({c % 4, 0, c / 4}, chunk));
+        REQUIRE(same_blocks(chunk, *newest[c]));
+    }
+}
+
+TEST_CASE("RegionStorage : Chunks that fail to flush stay staged", "[io][files][chunks]") {
+    ScratchDirectory directory("regionstorage_unwritable");
+    RegionStorage storage(directory.path);
+
+    /*
+     * A directory where the region file should be can't be opened as a file.
+     */
+    fs::create_directories(storage.region_path({0, 0, 0}));
+    storage.stage({1, 0, 0}, std::make_shared<Chunk const>(layered_chunk(5)));
+    REQUIRE_FALSE(storage.flush({1, 0, 0}));
+    REQUIRE(storage.staged_count() == 1);
+    Chunk chunk;
+    REQUIRE(storage.load({1, 0, 0}, chunk));
+    REQUIRE(same_blocks(chunk, layered_chunk(5)));
+
+    fs::remove(storage.region_path({0, 0, 0}));
+    REQUIRE(storage.flush());
+    REQUIRE(storage.staged_count() == 0);
+    REQUIRE(RegionStorage(directory.path).load({1, 0, 0}, chunk));
+    REQUIRE(same_blocks(chunk, layered_chunk(5)));
+}
+
+TEST_CASE("RegionStorage : Malformed region files are treated as empty", "[io][files][chunks]") {
+    ScratchDirectory directory("regionstorage_malformed");
+    {
+        RegionStorage storage(directory.path);
+        std::ofstream file(storage.region_path({0, 0, 0}), std::ios::binary);
+        file << "not a region file";
+    }
+
+    RegionStorage storage(directory.path);
+    Chunk chunk;
+    REQUIRE_FALSE(storage.load({0, 0, 0}, chunk));
+
+    REQUIRE(storage.save({0, 0, 0}, layered_chunk(14)));
+    REQUIRE(RegionStorage(directory.path).load({0, 0, 0}, chunk));
+    REQUIRE(same_blocks(chunk, layered_chunk(14)));
+}
@@ -0,0 +1,137 @@
+#include <terraingenerator.hpp>
+#include <jobpool.hpp>
+#include <catch2/catch.hpp>
+#include "testutils.hpp"
+#include <memory>
+#include <vector>
+
+using namespace sivox;
+
+namespace {
+    s32 count_blocks(Chunk const& chunk, Block block) {
+        s32 count = 0;
+        for (s32 i = 0; i < Chunk::volume; ++i) {
+            if (chunk.block_at(i) == block) { ++count; }
+        }
+        return count;
+    }
+
+    const std::vector<Position> sample_chunks = {
+        {0, 0, 0}, {1, 0, 0}, {0, 0, 1}, {-1, 0, -1}, {5, 1, -3}, {-7, -1, 2}, {100, 0, -100}, {3, -2, 3}, {2, 3, 2},
+    };
+}
+
+TEST_CASE("TerrainGenerator : Same seed, same terrain", "[terrain][generation]") {
+    TerrainGenerator a(1234);
+    TerrainGenerator b(1234);
+    TerrainGenerator c(4321);
+
+    s32 differing = 0;
+    for (Position chunk_position : sample_chunks) {
+        Chunk chunk_a, chunk_b, chunk_c;
+        a.generate(chunk_a, chunk_position);
+        b.generate(chunk_b, chunk_position);
+        c.generate(chunk_c, chunk_position);
+        REQUIRE(same_blocks(chunk_a, chunk_b));
+        differing += same_blocks(chunk_a, chunk_c) ? 0 : 1;
+    }
+    REQUIRE(differing > 0);
+}
+
+TEST_CASE("TerrainGenerator : SIMD and scalar generation agree", "[terrain][generation]") {
+    TerrainGenerator generator(99);
+    for (Position chunk_position : sample_chunks) {
+        Chunk fast, scalar;
+        fast.set_state(ChunkState::Loaded);
+        generator.generate(fast, chunk_position);
+        generator.generate_scalar(scalar, chunk_position);
+        REQUIRE(fast.state() == ChunkState::Loaded);
+        REQUIRE(same_blocks(fast, scalar));
+
+        for (s32 i = 0; i < Chunk::volume; i += 97) {
+            Position p = Chunk::block_position(i);
+            Position world(chunk_position.x * Chunk::width + p.x, chunk_position.y * Chunk::height + p.y, chunk_position.z * Chunk::length + p.z);
+            REQUIRE(generator.block(world) == fast.block_at(i));
+        }
+    }
+}
+
+TEST_CASE("TerrainGenerator : Chunks generate the same on any thread in any order", "[terrain][generation][jobs]") {
+    TerrainGenerator generator(7);
+    std::vector<Chunk> sequential(sample_chunks.size());
+    for (std::size_t i = 0; i < sample_chunks.size(); ++i) {
+        generator.generate(sequential[i], sample_chunks[i]);
+    }
+
+    std::vector<Chunk> parallel(sample_chunks.size());
+    {
+        JobPool pool(4);
+        for (std::size_t i = sample_chunks.size(); i-- > 0;) {
+            pool.submit([&generator, &parallel, i]() { generator.generate(parallel[i], sample_chunks[i]); });
+        }
+        pool.wait_idle();
+    }
+
+    for (std::size_t i = 0; i < sample_chunks.size(); ++i) {
+        REQUIRE(same_blocks(sequential[i], parallel[i]));
+    }
+}
+
+TEST_CASE("TerrainGenerator : Terrain is stone below and air above the surface", "[terrain][generation]") {
+    TerrainGenerator::Settings settings;
+    settings.base_height = 0.0f;
+    settings.height_amplitude = 20.0f;
+    settings.density_amplitude = 6.0f;
+    TerrainGenerator generator(5, settings);
+
+    for (s32 x = -64; x < 64; x += 7) {
+        for (s32 z = -64; z < 64; z += 5) {
+            f32 h = generator.height(x, z);
+            REQUIRE(h >= -20.0f);
+            REQUIRE(h <= 20.0f);
+            REQUIRE(generator.block({x, static_cast<s32>(h) - 10, z}) == settings.stone);
+            REQUIRE(generator.block({x, static_cast<s32>(h) + 7, z}) == Block(0));
+        }
+    }
+
+    Chunk chunk;
+    generator.generate(chunk, {0, -2, 0});
+    REQUIRE(count_blocks(chunk, settings.stone) == Chunk::volume);
+    generator.generate(chunk, {0, 1, 0});
+    REQUIRE(count_blocks(chunk, 0) == Chunk::volume);
+
+    /*
+     * Somewhere across the surface there is grass on top.
+     */
+    s32 surface = 0;
+    for (s32 y = -1; y <= 0; ++y) {
+        generator.generate(chunk, {0, y, 0});
+        surface += count_blocks(chunk, settings.surface);
+    }
+    REQUIRE(surface >= Chunk::width * Chunk::length);
+}
+
+TEST_CASE("TerrainGenerator : generation benchmark", "[terrain][generation][!benchmark]") {
+    /*
+     * Single threaded, so this is chunks per second per core. Surface chunks, the expensive ones: chunks entirely
+     * above or below the noise band are filled without evaluating any noise.
+     */
+    TerrainGenerator generator(42);
+    Chunk chunk;
+    s32 x = 0;
+
+    BENCHMARK("generate a surface chunk") {
+        generator.generate(chunk, {x++ & 63, 0, 0});
+        return chunk.palette_size();
+    };
+
+    BENCHMARK("generate_scalar a surface chunk") {
+        generator.generate_scalar(chunk, {x++ & 63, 0, 0});
+        return chunk.palette_size();
+    };
+
+    BENCHMARK("generate a chunk far underground") {
+        generator.generate(chunk, {x++ & 63, -8, 0});
+        return chunk.palette_size();
+    };
+}
@@ -0,0 +1,53 @@
+#pragma once
+#ifndef SIVOX_GAME_TESTUTILS_HPP
+#define SIVOX_GAME_TESTUTILS_HPP
+
+#include <common.hpp>
+#include <voxelterrain.hpp>
+#include <filesystem>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+/*
+ * Fixtures shared by the test files.
+ */
+namespace sivox {
+    inline bool same_blocks(Chunk const& a, Chunk const& b) {
+        for (s32 i = 0; i < Chunk::volume; ++i) {
+            if (a.block_at(i) != b.block_at(i)) { return false; }
+        }
+        return true;
+    }
+
+    /*
+     * Block 1 below [top], block 2 at it and air above.
+     */
+    inline Chunk layered_chunk(s32 top) {
+        Chunk chunk;
+        for (s32 i = 0; i < Chunk::volume; ++i) {
+            s32 y = Chunk::block_position(i).y;
+            chunk.set_block_at(i, y < top ? 1 : y == top ? 2 : 0);
+        }
+        return chunk;
+    }
+
+    /*
+     * The view projection matrix of a camera at [eye] looking at [target], with y up.
+     */
+    inline glm::mat4 camera(glm::vec3 eye, glm::vec3 target, f32 fov_degrees = 60.0f, f32 aspect = 16.0f / 9.0f) {
+        glm::mat4 projection = glm::perspective(glm::radians(fov_degrees), aspect, 0.1f, 1000.0f);
+        return projection * glm::lookAt(eye, target, glm::vec3(0.0f, 1.0f, 0.0f));
+    }
+
+    /*
+     * A fresh, empty directory, removed again when the test is done.
+     */
+    struct ScratchDirectory {
+        std::filesystem::path path;
+
+        explicit ScratchDirectory(std::filesystem::path path_) : path(std::move(path_)) { std::filesystem::remove_all(path); }
+        ~ScratchDirectory() { std::filesystem::remove_all(path); }
+    };
+}
+
+#endif // SIVOX_GAME_TESTUTILS_HPP
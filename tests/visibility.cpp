@@ -0,0 +1,239 @@
+#include <visibility.hpp>
+#include <terraingenerator.hpp>
+#include <catch2/catch.hpp>
+#include "testutils.hpp"
+#include <algorithm>
+
+using namespace sivox;
+
+namespace {
+    /*
+     * A frustum every box is inside of.
+     */
+    Frustum everything() {
+        Frustum frustum;
+        frustum.planes.fill(glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+        return frustum;
+    }
+
+    bool contains(std::vector<Position> const& chunks, Position chunk_position) {
+        return std::find(chunks.begin(), chunks.end(), chunk_position) != chunks.end();
+    }
+
+    /*
+     * Adds the chunks of [terrain] to [graph] and the ones in the [frustum] to [in_frustum], the way a plain
+     * ChunkCuller would draw them.
+     */
+    void add_terrain(Terrain const& terrain, Frustum const& frustum, VisibilityGraph &graph, std::vector<Position> &in_frustum) {
+        in_frustum.clear();
+        for (s32 z = 0; z < terrain.length_chunks(); ++z) {
+            for (s32 y = 0; y < terrain.height_chunks(); ++y) {
+                for (s32 x = 0; x < terrain.width_chunks(); ++x) {
+                    Chunk const* chunk = terrain.chunk({x, y, z});
+                    if (!chunk) { continue; }
+                    graph.set({x, y, z}, FaceConnectivity::compute(*chunk));
+                    if (frustum.intersects(chunk_center({x, y, z}), chunk_extent())) {
+                        in_frustum.push_back({x, y, z});
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("FaceConnectivity : Empty and solid chunks", "[visibility]") {
+    Chunk chunk;
+    REQUIRE(FaceConnectivity::compute(chunk) == FaceConnectivity::all());
+
+    chunk.fill(1);
+    REQUIRE(FaceConnectivity::compute(chunk) == FaceConnectivity::none());
+
+    /*
+     * A single pocket of air only touching the top face connects the top to itself and nothing else.
+     */
+    chunk.set_block({5, Chunk::height - 1, 5}, 0);
+    chunk.set_block({5, Chunk::height - 2, 5}, 0);
+    FaceConnectivity connectivity = FaceConnectivity::compute(chunk);
+    REQUIRE(connectivity.connected(BlockFace::Top, BlockFace::Top));
+    REQUIRE(!connectivity.connected(BlockFace::Top, BlockFace::Bottom));
+    REQUIRE(!connectivity.connected(BlockFace::Left, BlockFace::Left));
+}
+
+TEST_CASE("FaceConnectivity : Walls split the air", "[visibility]") {
+    Chunk chunk;
+    for (s32 z = 0; z < Chunk::length; ++z) {
+        for (s32 y = 0; y < Chunk::height; ++y) {
+            chunk.set_block({16, y, z}, 1);
+        }
+    }
+
+    FaceConnectivity connectivity = FaceConnectivity::compute(chunk);
+    REQUIRE(!connectivity.connected(BlockFace::Left, BlockFace::Right));
+    for (BlockFace face : { BlockFace::Top, BlockFace::Bottom, BlockFace::Front, BlockFace::Back }) {
+        REQUIRE(connectivity.connected(BlockFace::Left, face));
+        REQUIRE(connectivity.connected(BlockFace::Right, face));
+    }
+
+    /*
+     * One hole in the wall joins the two sides again.
+     */
+    chunk.set_block({16, 7, 20}, 0);
+    REQUIRE(FaceConnectivity::compute(chunk) == FaceConnectivity::all());
+}
+
+TEST_CASE("FaceConnectivity : Tunnels through rock", "[visibility]") {
+    Terrain terrain(1, 1, 1);
+    Chunk &chunk = *terrain.create_chunk({0, 0, 0});
+    chunk.fill(1);
+
+    /*
+     * A winding tunnel from front to back, two blocks high, stepping sideways every block and up every few blocks so
+     * the runs of air in neighbouring columns only just overlap.
+     */
+    for (s32 z = 0; z < Chunk::length; ++z) {
+        s32 y = 4 + z / 3;
+        s32 x_begin = 8 + std::max(z - 1, 0) % 5;
+        s32 x_end = 8 + z % 5;
+        for (s32 x = std::min(x_begin, x_end); x <= std::max(x_begin, x_end); ++x) {
+            chunk.set_block({x, y, z}, 0);
+            chunk.set_block({x, y + 1, z}, 0);
+        }
+    }
+
+    FaceConnectivity connectivity = FaceConnectivity::compute(chunk);
+    REQUIRE(connectivity.connected(BlockFace::Front, BlockFace::Back));
+    REQUIRE(connectivity.connected(BlockFace::Back, BlockFace::Front));
+    REQUIRE(!connectivity.connected(BlockFace::Front, BlockFace::Top));
+    REQUIRE(!connectivity.connected(BlockFace::Left, BlockFace::Right));
+    REQUIRE(!connectivity.connected(BlockFace::Top, BlockFace::Bottom));
+
+    REQUIRE(FaceConnectivity::compute(ChunkNeighbourhood(terrain, {0, 0, 0})) == connectivity);
+}
+
+TEST_CASE("FaceConnectivity : The neighbourhood gives the same as the chunk", "[visibility]") {
+    Terrain terrain(3, 3, 3);
+    TerrainGenerator generator(7);
+    for (s32 z = 0; z < 3; ++z) {
+        for (s32 y = 0; y < 3; ++y) {
+            for (s32 x = 0; x < 3; ++x) {
+                generator.generate(*terrain.create_chunk({x, y, z}), {x, y - 1, z});
+            }
+        }
+    }
+    for (s32 y = 0; y < 3; ++y) {
+        Position chunk_position = {1, y, 1};
+        REQUIRE(FaceConnectivity::compute(ChunkNeighbourhood(terrain, chunk_position))
+            == FaceConnectivity::compute(*terrain.chunk(chunk_position)));
+    }
+}
+
+TEST_CASE("VisibilityGraph : Solid chunks hide what's behind them", "[visibility]") {
+    /*
+     * A row of chunks along x: the camera's, a solid one, then an empty one behind it.
+     */
+    VisibilityGraph graph;
+    Chunk empty, solid;
+    solid.fill(1);
+    for (s32 x = 0; x < 4; ++x) {
+        graph.set({x, 0, 0}, FaceConnectivity::compute(x == 2 ? solid : empty));
+    }
+
+    std::vector<Position> visible;
+    glm::vec3 camera_position(8.0f, 16.0f, 16.0f);
+    graph.traverse(camera_position, everything(), 8, visible);
+    REQUIRE(visible.size() == 3);
+    REQUIRE(visible[0] == Position(0, 0, 0));
+    REQUIRE(contains(visible, {1, 0, 0}));
+    REQUIRE(contains(visible, {2, 0, 0}));
+    REQUIRE(!contains(visible, {3, 0, 0}));
+
+    /*
+     * Unloaded chunks are seen through but never reported, and the distance limit holds.
+     */
+    graph.remove({2, 0, 0});
+    graph.traverse(camera_position, everything(), 8, visible);
+    REQUIRE(visible.size() == 3);
+    REQUIRE(contains(visible, {3, 0, 0}));
+
+    graph.traverse(camera_position, everything(), 1, visible);
+    REQUIRE(visible.size() == 2);
+
+    /*
+     * Looking the other way, along -x, only the camera's chunk is left.
+     */
+    Frustum frustum = Frustum::from_matrix(camera(camera_position, camera_position - glm::vec3(1.0f, 0.0f, 0.0f)));
+    graph.traverse(camera_position, frustum, 8, visible);
+    REQUIRE(visible.size() == 1);
+    REQUIRE(visible[0] == Position(0, 0, 0));
+}
+
+TEST_CASE("VisibilityGraph : Culled chunks on generated terrain", "[visibility][!benchmark]") {
+    /*
+     * Generated terrain with the surface between chunk y = 3 and 5 and solid stone below, the way most of a world
+     * is. Each scene compares the chunks drawn with the frustum alone against the chunks reached through the graph.
+     */
+    const s32 size = 24;
+    const s32 height = 6;
+    Terrain terrain(size, height, size);
+    TerrainGenerator generator(3);
+    for (s32 z = 0; z < size; ++z) {
+        for (s32 y = 0; y < height; ++y) {
+            for (s32 x = 0; x < size; ++x) {
+                generator.generate(*terrain.create_chunk({x, y, z}), {x, y - 4, z});
+            }
+        }
+    }
+
+    /*
+     * A cave for the underground scene: a tunnel along x, two blocks high, at the height of chunk y = 1.
+     */
+    const s32 cave_y = Chunk::height + 10;
+    const s32 cave_z = (size / 2) * Chunk::length + 5;
+    for (s32 x = 0; x < size * Chunk::width; ++x) {
+        for (s32 y = cave_y; y < cave_y + 2; ++y) {
+            Chunk &chunk = *terrain.chunk({x / Chunk::width, y / Chunk::height, cave_z / Chunk::length});
+            chunk.set_block({x % Chunk::width, y % Chunk::height, cave_z % Chunk::length}, 0);
+        }
+    }
+
+    const f32 middle = size * Chunk::width * 0.5f;
+    struct Scene {
+        const char *name;
+        glm::vec3 eye;
+        glm::vec3 target;
+    };
+    const Scene scenes[] = {
+        { "surface", { middle, height * Chunk::height - 4.0f, middle }, { middle + 100.0f, 150.0f, middle + 50.0f } },
+        { "surface, looking down", { middle, height * Chunk::height - 4.0f, middle }, { middle + 40.0f, 0.0f, middle + 10.0f } },
+        { "underground", { 4.0f, cave_y + 1.0f, cave_z + 0.5f }, { 100.0f, cave_y + 1.0f, cave_z + 0.5f } },
+    };
+
+    VisibilityGraph graph;
+    std::vector<Position> in_frustum, visible;
+    for (Scene const& scene : scenes) {
+        Frustum frustum = Frustum::from_matrix(camera(scene.eye, scene.target));
+        add_terrain(terrain, frustum, graph, in_frustum);
+        graph.traverse(scene.eye, frustum, size, visible);
+
+        /*
+         * Every chunk reached is in the frustum, so the graph only ever takes chunks away.
+         */
+        for (Position p : visible) {
+            REQUIRE(contains(in_frustum, p));
+        }
+        REQUIRE(visible.size() <= in_frustum.size());
+
+        f64 culled = 100.0 * (1.0 - static_cast<f64>(visible.size()) / static_cast<f64>(in_frustum.size()));
+        WARN(scene.name << ": " << visible.size() << " of " << in_frustum.size() << " chunks in the frustum drawn, "
+            << culled << "% culled");
+    }
+
+    BENCHMARK("Traverse from the surface") {
+        Frustum frustum = Frustum::from_matrix(camera(scenes[0].eye, scenes[0].target));
+        graph.traverse(scenes[0].eye, frustum, size, visible);
+        return visible.size();
+    };
+    BENCHMARK("Compute connectivity of a chunk") {
+        return FaceConnectivity::compute(*terrain.chunk({size / 2, 3, size / 2})).bits();
+    };
+}
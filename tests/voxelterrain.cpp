@@ -3,6 +3,11 @@
 #include <functional>
 #include <vector>
 #include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+#include <tuple>
+#include <unordered_map>
 
 using namespace sivox;
 
@@ -298,3 +303,621 @@ TEST_CASE("Terrain : chunk lifecycle (several positions)", "[terrain][chunks]")
         }
     }
 }
+
+TEST_CASE("Chunk : Uniform chunks store no indices", "[terrain][blocks][chunks]") {
+    Chunk chunk;
+    REQUIRE(chunk.palette_size() == 1);
+    REQUIRE(chunk.bits_per_block() == 0);
+
+    chunk_for_each([&chunk](Position pos) { chunk.set_block(pos, 0); });
+    REQUIRE(chunk.bits_per_block() == 0);
+
+    chunk_for_each([&chunk](Position pos) { chunk.set_block(pos, 7); });
+    REQUIRE(chunk.bits_per_block() == 1);
+
+    chunk.compact();
+    REQUIRE(chunk.palette_size() == 1);
+    REQUIRE(chunk.bits_per_block() == 0);
+    chunk_for_each([&chunk](Position pos) {
+        REQUIRE(chunk.block(pos) == 7);
+    });
+}
+
+TEST_CASE("Chunk : Palette grows and compacts", "[terrain][blocks][chunks]") {
+    Chunk chunk;
+
+    /*
+     * Air plus 17 other blocks need 8 bit indices. Every block is checked after each step so repacking can't lose
+     * any.
+     */
+    std::vector<s32> expected_bits = { 1, 2, 2, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 8, 8 };
+    for (s32 id = 1; id <= 17; ++id) {
+        chunk.set_block({id, id, id}, id);
+        REQUIRE(chunk.palette_size() == id + 1);
+        REQUIRE(chunk.bits_per_block() == expected_bits[id - 1]);
+        chunk_for_each([&chunk, id](Position pos) {
+            bool set = pos.x == pos.y && pos.y == pos.z && pos.x >= 1 && pos.x <= id;
+            REQUIRE(chunk.block(pos) == (set ? pos.x : 0));
+        });
+    }
+
+    /*
+     * Overwriting most of them leaves stale palette entries until the chunk is compacted.
+     */
+    for (s32 id = 1; id <= 15; ++id) {
+        chunk.set_block({id, id, id}, 0);
+    }
+    REQUIRE(chunk.palette_size() == 18);
+    chunk.compact();
+    REQUIRE(chunk.palette_size() == 3);
+    REQUIRE(chunk.bits_per_block() == 2);
+    chunk_for_each([&chunk](Position pos) {
+        bool set = pos.x == pos.y && pos.y == pos.z && pos.x >= 16 && pos.x <= 17;
+        REQUIRE(chunk.block(pos) == (set ? pos.x : 0));
+    });
+}
+
+TEST_CASE("Chunk : Memory usage", "[terrain][chunks]") {
+    Chunk uniform;
+    INFO("uniform chunk " << uniform.memory_usage() << " bytes");
+    REQUIRE(uniform.memory_usage() < 256);
+
+    /*
+     * Terrain-like: a few kinds of block in layers.
+     */
+    Chunk layered;
+    chunk_for_each([&layered](Position pos) {
+        layered.set_block(pos, pos.y < 10 ? 1 : pos.y < 14 ? 2 : pos.y < 15 ? 3 : 0);
+    });
+    INFO("layered chunk " << layered.memory_usage() << " bytes");
+    REQUIRE(layered.bits_per_block() == 2);
+    REQUIRE(layered.memory_usage() < Chunk::volume * 2 / 8 + 256);
+
+    /*
+     * Even the worst case, with every block id in use, is half the size of one s32 per block.
+     */
+    Chunk full;
+    s32 counter = 0;
+    chunk_for_each([&full, &counter](Position pos) {
+        full.set_block(pos, counter);
+        counter = (counter + 1) % Block::max_id;
+    });
+    INFO("chunk using every block id " << full.memory_usage() << " bytes");
+    REQUIRE(full.bits_per_block() == 16);
+    REQUIRE(full.memory_usage() < Chunk::volume * static_cast<s64>(sizeof(Block)) / 2 + 8 * Block::max_id);
+}
+
+TEST_CASE("Chunk : Bulk fill and transform", "[terrain][blocks][chunks]") {
+    Chunk chunk;
+    chunk.fill_column(3, 4, 0, 10, 1);
+    chunk.fill_column(3, 4, 10, 12, 2);
+    chunk.fill_column(31, 31, 20, 32, 3);
+    chunk_for_each([&chunk](Position pos) {
+        Block expected = 0;
+        if (pos.x == 3 && pos.z == 4) { expected = pos.y < 10 ? 1 : pos.y < 12 ? 2 : 0; }
+        if (pos.x == 31 && pos.z == 31 && pos.y >= 20) { expected = 3; }
+        REQUIRE(chunk.block(pos) == expected);
+    });
+
+    /*
+     * Positions come in block_index order, along with the block already there.
+     */
+    s32 calls = 0;
+    chunk.transform([&calls](Position pos, Block block) {
+        REQUIRE(Chunk::block_index(pos) == calls);
+        ++calls;
+        return block == 0 ? Block(pos.y < 5 ? 4 : 0) : Block(block.id + 10);
+    });
+    REQUIRE(calls == Chunk::volume);
+    chunk_for_each([&chunk](Position pos) {
+        Block expected = pos.y < 5 ? 4 : 0;
+        if (pos.x == 3 && pos.z == 4) { expected = pos.y < 10 ? 11 : pos.y < 12 ? 12 : expected; }
+        if (pos.x == 31 && pos.z == 31 && pos.y >= 20) { expected = 13; }
+        REQUIRE(chunk.block(pos) == expected);
+    });
+
+    chunk.fill(5);
+    REQUIRE(chunk.palette_size() == 1);
+    REQUIRE(chunk.bits_per_block() == 0);
+    REQUIRE(chunk.block({7, 7, 7}) == 5);
+
+    /*
+     * A uniform chunk stays uniform when transformed into another uniform chunk.
+     */
+    chunk.transform([](Position, Block block) { return block; });
+    REQUIRE(chunk.bits_per_block() == 0);
+    chunk.transform([](Position pos, Block) { return Block(pos.x); });
+    chunk_for_each([&chunk](Position pos) { REQUIRE(chunk.block(pos) == pos.x); });
+}
+
+TEST_CASE("Chunk : Dirty sections", "[terrain][blocks][chunks]") {
+    Chunk chunk;
+    REQUIRE(chunk.dirty_sections() == Chunk::all_sections);
+    chunk.clear_dirty_sections();
+    REQUIRE(chunk.dirty_sections() == 0);
+
+    /*
+     * A block in the middle of a section only dirties its own section, one on the edge the next one over too.
+     */
+    chunk.set_block({3, 12, 5}, 1);
+    REQUIRE(chunk.dirty_sections() == 0b10);
+    chunk.clear_dirty_sections();
+    chunk.set_block({3, Chunk::section_height - 1, 5}, 1);
+    REQUIRE(chunk.dirty_sections() == 0b11);
+    chunk.clear_dirty_sections();
+    chunk.set_block({3, 2 * Chunk::section_height, 5}, 1);
+    REQUIRE(chunk.dirty_sections() == 0b110);
+    chunk.clear_dirty_sections();
+
+    chunk.fill_column(0, 0, 1, 4, 2);
+    REQUIRE(chunk.dirty_sections() == 0b1);
+    chunk.clear_dirty_sections();
+    chunk.transform([](Position, Block block) { return block; });
+    REQUIRE(chunk.dirty_sections() == Chunk::all_sections);
+    chunk.clear_dirty_sections();
+    chunk.fill(0);
+    REQUIRE(chunk.dirty_sections() == Chunk::all_sections);
+
+    /*
+     * Blocks of the chunks above and below.
+     */
+    REQUIRE(Chunk::sections_around(-1, 0) == 0b1);
+    REQUIRE(Chunk::sections_around(Chunk::height, Chunk::height + 1) == 1u << (Chunk::section_count - 1));
+    REQUIRE(Chunk::sections_around(-2, -1) == 0);
+}
+
+TEST_CASE("Chunk : bulk fill benchmark", "[terrain][blocks][chunks][!benchmark]") {
+    /*
+     * The old way: a std::function call per block, each going through the bounds checked block and set_block.
+     */
+    auto foreach_block = [](Chunk &chunk, std::function<Block(Position, Block)> f) {
+        for (s32 z = 0; z < Chunk::length; ++z) {
+            for (s32 x = 0; x < Chunk::width; ++x) {
+                for (s32 y = 0; y < Chunk::height; ++y) {
+                    chunk.set_block({x, y, z}, f({x, y, z}, chunk.block({x, y, z})));
+                }
+            }
+        }
+    };
+    auto layers = [](Position pos, Block) { return Block(pos.y < 10 ? 1 : pos.y < 14 ? 2 : 0); };
+    Chunk chunk;
+
+    BENCHMARK("foreach_block with std::function, layers") {
+        foreach_block(chunk, layers);
+        return chunk.palette_size();
+    };
+
+    BENCHMARK("transform, layers") {
+        chunk.transform(layers);
+        return chunk.palette_size();
+    };
+
+    BENCHMARK("fill_column, layers") {
+        for (s32 z = 0; z < Chunk::length; ++z) {
+            for (s32 x = 0; x < Chunk::width; ++x) {
+                chunk.fill_column(x, z, 0, 10, 1);
+                chunk.fill_column(x, z, 10, 14, 2);
+                chunk.fill_column(x, z, 14, Chunk::height, 0);
+            }
+        }
+        return chunk.palette_size();
+    };
+
+    BENCHMARK("foreach_block with std::function, fill") {
+        foreach_block(chunk, [](Position, Block) { return Block(1); });
+        return chunk.palette_size();
+    };
+
+    BENCHMARK("fill") {
+        chunk.fill(1);
+        return chunk.palette_size();
+    };
+}
+
+TEST_CASE("Terrain : chunk lifecycle (sizes that aren't whole pages)", "[terrain][chunks]") {
+    Terrain terrain(10, 3, 17);
+
+    for (int z = -1; z <= terrain.length_chunks(); ++z) {
+        for (int x = -1; x <= terrain.width_chunks(); ++x) {
+            for (int y = -1; y <= terrain.height_chunks(); ++y) {
+                bool inside = x >= 0 && x < terrain.width_chunks()
+                    && y >= 0 && y < terrain.height_chunks()
+                    && z >= 0 && z < terrain.length_chunks();
+                INFO("position " << Position(x, y, z));
+                REQUIRE((terrain.create_chunk({x, y, z}) != nullptr) == inside);
+            }
+        }
+    }
+    REQUIRE(terrain.chunk_count() == terrain.volume_chunks());
+
+    /*
+     * Every chunk is a different object.
+     */
+    std::vector<Chunk*> chunks;
+    for (int z = 0; z < terrain.length_chunks(); ++z) {
+        for (int x = 0; x < terrain.width_chunks(); ++x) {
+            for (int y = 0; y < terrain.height_chunks(); ++y) {
+                chunks.push_back(terrain.chunk({x, y, z}));
+            }
+        }
+    }
+    std::sort(chunks.begin(), chunks.end());
+    REQUIRE(std::unique(chunks.begin(), chunks.end()) == chunks.end());
+
+    for (int z = 0; z < terrain.length_chunks(); ++z) {
+        for (int x = 0; x < terrain.width_chunks(); ++x) {
+            for (int y = 0; y < terrain.height_chunks(); ++y) {
+                terrain.delete_chunk({x, y, z});
+                REQUIRE(terrain.chunk({x, y, z}) == nullptr);
+            }
+        }
+    }
+    REQUIRE(terrain.chunk_count() == 0);
+}
+
+TEST_CASE("Terrain : deleted chunks are reused", "[terrain][chunks]") {
+    Terrain terrain(4, 4, 4);
+
+    Chunk *chunk = terrain.create_chunk({1, 2, 3});
+    chunk->set_block({4, 5, 6}, 7);
+    chunk->set_state(ChunkState::Loaded);
+    s32 pooled = terrain.pooled_chunk_count();
+
+    terrain.delete_chunk({1, 2, 3});
+    Chunk *reused = terrain.create_chunk({3, 0, 0});
+    REQUIRE(reused == chunk);
+    REQUIRE(terrain.pooled_chunk_count() == pooled);
+
+    /*
+     * Reused chunks are as good as new.
+     */
+    REQUIRE(reused->state() == ChunkState::Created);
+    REQUIRE(reused->palette_size() == 1);
+    REQUIRE(reused->block({4, 5, 6}) == 0);
+}
+
+TEST_CASE("Terrain : unbounded chunk lifecycle", "[terrain][chunks]") {
+    Terrain terrain;
+    REQUIRE_FALSE(terrain.bounded());
+
+    /*
+     * Far apart, negative and on both sides of page boundaries, so lots of pages collide in the page table.
+     */
+    std::vector<Position> positions;
+    for (s32 i = -40; i < 40; ++i) {
+        positions.push_back({i, -i, 3 * i});
+        positions.push_back({i * 1000003, 7, -i * 999});
+    }
+    positions.push_back({-(1 << 30), 1 << 30, -1});
+
+    std::vector<Chunk*> chunks;
+    for (Position position : positions) {
+        INFO("position " << position);
+        REQUIRE(terrain.chunk(position) == nullptr);
+        Chunk *chunk = terrain.create_chunk(position);
+        REQUIRE(chunk != nullptr);
+        chunks.push_back(chunk);
+    }
+    REQUIRE(terrain.chunk_count() == static_cast<s32>(positions.size()));
+
+    /*
+     * Delete every other chunk; the rest must still be found.
+     */
+    for (s32 i = 0; i < static_cast<s32>(positions.size()); i += 2) {
+        terrain.delete_chunk(positions[i]);
+    }
+    for (s32 i = 0; i < static_cast<s32>(positions.size()); ++i) {
+        INFO("position " << positions[i]);
+        REQUIRE(terrain.chunk(positions[i]) == (i % 2 == 0 ? nullptr : chunks[i]));
+    }
+
+    for (Position position : positions) {
+        terrain.delete_chunk(position);
+        REQUIRE(terrain.chunk(position) == nullptr);
+    }
+    REQUIRE(terrain.chunk_count() == 0);
+}
+
+TEST_CASE("LoadedArea : roams an unbounded terrain", "[terrain][chunks]") {
+    Terrain terrain;
+    terrain.set_grace_period(0);
+    LoadedArea area(terrain, {-50, -3, 20}, 6);
+
+    for (s32 i = 0; i < 40; ++i) {
+        area.update_loaded_volume({-50 - i, -3, 20 + i / 2});
+        terrain.tick();
+    }
+
+    for (s32 z = 0; z < 60; ++z) {
+        for (s32 x = -120; x < 0; ++x) {
+            for (s32 y = -12; y < 8; ++y) {
+                REQUIRE((terrain.chunk({x, y, z}) != nullptr) == area.contains({x, y, z}));
+            }
+        }
+    }
+}
+
+TEST_CASE("Terrain : lookup benchmark", "[terrain][chunks][!benchmark]") {
+    Terrain terrain(64, 16, 64);
+    Terrain unbounded;
+
+    /*
+     * What Terrain used to do, for comparison.
+     */
+    std::unordered_map<s32, std::unique_ptr<Chunk>> map;
+    auto map_index = [&terrain](Position cp) {
+        return cp.y + cp.x * terrain.height_chunks() + cp.z * terrain.width_chunks() * terrain.height_chunks();
+    };
+    auto map_chunk = [&](Position cp) -> Chunk* {
+        if (cp.x < 0 || cp.x >= terrain.width_chunks()) { return nullptr; }
+        if (cp.y < 0 || cp.y >= terrain.height_chunks()) { return nullptr; }
+        if (cp.z < 0 || cp.z >= terrain.length_chunks()) { return nullptr; }
+        auto it = map.find(map_index(cp));
+        return it == map.end() ? nullptr : it->second.get();
+    };
+
+    /*
+     * A sphere of chunks, like a LoadedArea.
+     */
+    Position center(32, 8, 32);
+    std::vector<Position> loaded;
+    for (int z = 0; z < terrain.length_chunks(); ++z) {
+        for (int x = 0; x < terrain.width_chunks(); ++x) {
+            for (int y = 0; y < terrain.height_chunks(); ++y) {
+                if (Position::distance({x, y, z}, center) <= 24.0f) {
+                    terrain.create_chunk({x, y, z});
+                    unbounded.create_chunk({x, y, z});
+                    map[map_index({x, y, z})] = std::make_unique<Chunk>();
+                    loaded.push_back({x, y, z});
+                }
+            }
+        }
+    }
+
+    std::mt19937 rng(0);
+    std::vector<Position> random(1 << 20);
+    for (Position &p : random) {
+        p = { static_cast<s32>(rng() % 64), static_cast<s32>(rng() % 16), static_cast<s32>(rng() % 64) };
+    }
+
+    const Position neighbours[] = { {1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1} };
+
+    BENCHMARK("random lookups, unordered_map") {
+        s32 found = 0;
+        for (Position p : random) { found += map_chunk(p) != nullptr; }
+        return found;
+    };
+
+    BENCHMARK("random lookups, paged directory") {
+        s32 found = 0;
+        for (Position p : random) { found += terrain.chunk(p) != nullptr; }
+        return found;
+    };
+
+    BENCHMARK("random lookups, unbounded") {
+        s32 found = 0;
+        for (Position p : random) { found += unbounded.chunk(p) != nullptr; }
+        return found;
+    };
+
+    BENCHMARK("neighbour lookups, unordered_map") {
+        s32 found = 0;
+        for (Position p : loaded) {
+            for (Position n : neighbours) { found += map_chunk({p.x + n.x, p.y + n.y, p.z + n.z}) != nullptr; }
+        }
+        return found;
+    };
+
+    BENCHMARK("neighbour lookups, paged directory") {
+        s32 found = 0;
+        for (Position p : loaded) {
+            for (Position n : neighbours) { found += terrain.chunk({p.x + n.x, p.y + n.y, p.z + n.z}) != nullptr; }
+        }
+        return found;
+    };
+
+    BENCHMARK("neighbour lookups, unbounded") {
+        s32 found = 0;
+        for (Position p : loaded) {
+            for (Position n : neighbours) { found += unbounded.chunk({p.x + n.x, p.y + n.y, p.z + n.z}) != nullptr; }
+        }
+        return found;
+    };
+}
+
+TEST_CASE("LoadedArea : loads exactly the chunks in its sphere", "[terrain][chunks]") {
+    Terrain terrain(24, 24, 24);
+    terrain.set_grace_period(0);
+    LoadedArea area(terrain, {12, 12, 12}, 5);
+
+    auto in_sphere = [](Position p, Position center, s32 radius) {
+        return Position::distance(p, center) <= static_cast<float>(radius);
+    };
+
+    /*
+     * Random walk, sometimes jumping, sometimes changing radius, sometimes leaving the terrain.
+     */
+    std::mt19937 rng(3);
+    Position old_center = area.center_chunk();
+    s32 old_radius = area.radius_chunks();
+    for (s32 step = 0; step < 200; ++step) {
+        Position center = old_center;
+        s32 radius = old_radius;
+        switch (rng() % 8) {
+            case 0: center = { static_cast<s32>(rng() % 30) - 3, static_cast<s32>(rng() % 30) - 3, static_cast<s32>(rng() % 30) - 3 }; break;
+            case 1: radius = static_cast<s32>(rng() % 8); break;
+            default: {
+                s32 axis = rng() % 3;
+                s32 delta = rng() % 2 ? 1 : -1;
+                if (axis == 0) { center.x += delta; }
+                else if (axis == 1) { center.y += delta; }
+                else { center.z += delta; }
+                break;
+            }
+        }
+
+        area.update_loaded_volume(center, radius);
+        terrain.tick();
+        INFO("step " << step << " center " << center << " radius " << radius);
+
+        std::vector<Position> expected_loaded, expected_unloaded;
+        for (s32 z = 0; z < terrain.length_chunks(); ++z) {
+            for (s32 x = 0; x < terrain.width_chunks(); ++x) {
+                for (s32 y = 0; y < terrain.height_chunks(); ++y) {
+                    Position p = {x, y, z};
+                    bool inside = in_sphere(p, center, radius);
+                    bool was_inside = in_sphere(p, old_center, old_radius);
+                    REQUIRE(area.contains(p) == inside);
+                    REQUIRE((terrain.chunk(p) != nullptr) == inside);
+                    REQUIRE(area.chunk(p) == (inside ? terrain.chunk(p) : nullptr));
+                    if (inside && !was_inside) { expected_loaded.push_back(p); }
+                    if (!inside && was_inside) { expected_unloaded.push_back(p); }
+                }
+            }
+        }
+
+        auto by_position = [](Position a, Position b) { return std::tie(a.x, a.y, a.z) < std::tie(b.x, b.y, b.z); };
+        std::vector<Position> loaded = area.loaded_chunks();
+        std::vector<Position> unloaded = area.unloaded_chunks();
+
+        /*
+         * Nearest loads first, furthest unloads first.
+         */
+        for (s32 i = 1; i < static_cast<s32>(loaded.size()); ++i) {
+            REQUIRE(Position::distance(loaded[i - 1], center) <= Position::distance(loaded[i], center));
+        }
+        for (s32 i = 1; i < static_cast<s32>(unloaded.size()); ++i) {
+            REQUIRE(Position::distance(unloaded[i - 1], center) >= Position::distance(unloaded[i], center));
+        }
+
+        std::sort(loaded.begin(), loaded.end(), by_position);
+        std::sort(unloaded.begin(), unloaded.end(), by_position);
+        std::sort(expected_loaded.begin(), expected_loaded.end(), by_position);
+        std::sort(expected_unloaded.begin(), expected_unloaded.end(), by_position);
+        REQUIRE(loaded == expected_loaded);
+        REQUIRE(unloaded == expected_unloaded);
+
+        old_center = center;
+        old_radius = radius;
+    }
+}
+
+TEST_CASE("Terrain : released chunks wait out the grace period", "[terrain][chunks]") {
+    Terrain terrain(4, 4, 4);
+    terrain.set_grace_period(3);
+
+    Chunk *chunk = terrain.acquire_chunk({1, 1, 1});
+    REQUIRE(chunk != nullptr);
+    REQUIRE(terrain.acquire_chunk({1, 1, 1}) == chunk);
+    REQUIRE(terrain.references({1, 1, 1}) == 2);
+    REQUIRE(terrain.acquire_chunk({4, 0, 0}) == nullptr);
+
+    terrain.release_chunk({1, 1, 1});
+    terrain.tick();
+    REQUIRE(terrain.released_chunk_count() == 0);
+    REQUIRE(terrain.chunk({1, 1, 1}) == chunk);
+
+    terrain.release_chunk({1, 1, 1});
+    REQUIRE(terrain.references({1, 1, 1}) == 0);
+    REQUIRE(terrain.released_chunk_count() == 1);
+    terrain.tick();
+    terrain.tick();
+    REQUIRE(terrain.chunk({1, 1, 1}) == chunk);
+    REQUIRE(terrain.evicted_chunks().empty());
+
+    /*
+     * Acquiring it again within the grace period keeps it.
+     */
+    REQUIRE(terrain.acquire_chunk({1, 1, 1}) == chunk);
+    REQUIRE(terrain.released_chunk_count() == 0);
+    for (s32 i = 0; i < 10; ++i) { terrain.tick(); }
+    REQUIRE(terrain.chunk({1, 1, 1}) == chunk);
+
+    terrain.release_chunk({1, 1, 1});
+    terrain.tick();
+    terrain.tick();
+    REQUIRE(terrain.chunk({1, 1, 1}) == chunk);
+    terrain.tick();
+    REQUIRE(terrain.chunk({1, 1, 1}) == nullptr);
+    REQUIRE(terrain.evicted_chunks() == std::vector<Position>{ {1, 1, 1} });
+    REQUIRE(terrain.released_chunk_count() == 0);
+}
+
+TEST_CASE("Terrain : least recently released chunks are evicted first", "[terrain][chunks]") {
+    Terrain terrain(8, 1, 1);
+    terrain.set_grace_period(1000);
+    terrain.set_released_capacity(3);
+
+    for (s32 x = 0; x < 8; ++x) {
+        terrain.acquire_chunk({x, 0, 0});
+    }
+    for (s32 x = 0; x < 8; ++x) {
+        terrain.release_chunk({x, 0, 0});
+    }
+
+    /*
+     * Re-acquiring and releasing chunk 0 makes it the most recently released.
+     */
+    terrain.acquire_chunk({0, 0, 0});
+    terrain.release_chunk({0, 0, 0});
+
+    terrain.tick();
+    REQUIRE(terrain.released_chunk_count() == 3);
+    REQUIRE(terrain.evicted_chunks() == std::vector<Position>{ {1, 0, 0}, {2, 0, 0}, {3, 0, 0}, {4, 0, 0}, {5, 0, 0} });
+    REQUIRE(terrain.chunk({0, 0, 0}) != nullptr);
+    REQUIRE(terrain.chunk({6, 0, 0}) != nullptr);
+    REQUIRE(terrain.chunk({7, 0, 0}) != nullptr);
+}
+
+TEST_CASE("LoadedArea : overlapping areas share chunks", "[terrain][chunks]") {
+    Terrain terrain(16, 16, 16);
+    terrain.set_grace_period(0);
+
+    LoadedArea a(terrain, {4, 8, 8}, 4);
+    {
+        LoadedArea b(terrain, {8, 8, 8}, 4);
+        REQUIRE(terrain.references({6, 8, 8}) == 2);
+        REQUIRE(a.chunk({6, 8, 8}) == b.chunk({6, 8, 8}));
+
+        /*
+         * Moving b away mustn't take a's chunks with it.
+         */
+        b.update_loaded_volume({12, 8, 8});
+        terrain.tick();
+        REQUIRE(terrain.references({6, 8, 8}) == 1);
+        REQUIRE(terrain.chunk({6, 8, 8}) == a.chunk({6, 8, 8}));
+        REQUIRE(terrain.chunk({4, 8, 8}) != nullptr);
+    }
+
+    terrain.tick();
+    REQUIRE(terrain.chunk({12, 8, 8}) == nullptr);
+    REQUIRE(terrain.chunk({4, 8, 8}) != nullptr);
+    for (s32 z = 0; z < terrain.length_chunks(); ++z) {
+        for (s32 x = 0; x < terrain.width_chunks(); ++x) {
+            for (s32 y = 0; y < terrain.height_chunks(); ++y) {
+                REQUIRE((terrain.chunk({x, y, z}) != nullptr) == a.contains({x, y, z}));
+                REQUIRE(terrain.references({x, y, z}) == (a.contains({x, y, z}) ? 1 : 0));
+            }
+        }
+    }
+}
+
+TEST_CASE("LoadedArea : update benchmark", "[terrain][chunks][!benchmark]") {
+    for (s32 radius : { 16, 32 }) {
+        Terrain terrain(128, 128, 128);
+        Position center(64, 64, 64);
+        LoadedArea area(terrain, center, radius);
+
+        BENCHMARK("radius " + std::to_string(radius) + ", step across a chunk boundary") {
+            center.x += area.center_chunk().x == 64 ? 1 : -1;
+            area.update_loaded_volume(center);
+            terrain.tick();
+            return area.loaded_chunks().size();
+        };
+
+        BENCHMARK("radius " + std::to_string(radius) + ", stand still") {
+            area.update_loaded_volume(center);
+            return area.loaded_chunks().size();
+        };
+    }
+}